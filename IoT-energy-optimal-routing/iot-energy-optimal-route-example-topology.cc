@@ -9,6 +9,12 @@
 #include "ns3/internet-module.h"
 #include "ns3/iot-energy-optimal-routing-helper.h"
 #include "ns3/iot-energy-optimal-route-processor.h"
+#include "ns3/iot-energy-optimal-routing-stats.h"
+#include "ns3/iot-pcap-ring-buffer.h"
+#include "ns3/iot-abstract-link-helper.h"
+#include "ns3/iot-link-monitor.h"
+#include <algorithm>
+#include <cmath>
 
 // Iot Energy Optimal Routing Network Topology Example
 //
@@ -23,6 +29,12 @@
 //                           |          |
 //                     n10   |    n7    |    n4      
 //                           |          |
+//
+// The topology can be scaled with --numberOfIotDevices: node i is placed in tier 1 + 3*i/numberOfIotDevices.
+// --linkModel=abstract replaces the Wi-Fi PHY/MAC by IotAbstractLinkChannel (unit disk / fixed loss) for large runs.
+// --adhoc puts all the Wi-Fi devices in one ad hoc network, so the frames of a hop go to the next hop instead of the access point;
+// with --lossyRelays the first nodes of Tier 1 and Tier 2 get a bit more energy but a bad receiver (--lossyRxGain), the case
+// --selectionMode=EnergyEtx is meant for.
 
 using namespace ns3;
 
@@ -64,6 +76,14 @@ static void GenerateTraffic (Ptr<Socket> socket, uint32_t pktSize,
     }
 }
 
+/**
+* Tier of the i-th IOT node when numberOfIotDevices nodes are split evenly in 3 tiers.
+*/
+static uint16_t TierOfIotNode (uint32_t i, uint32_t numberOfIotDevices)
+{
+  return 1 + (uint64_t) i * 3 / numberOfIotDevices;
+}
+
 /**
 *  Start Execution from main method
 */
@@ -75,8 +95,48 @@ main (int argc, char *argv[])
   uint32_t packetSize = 1000; // bytes
   uint32_t numPackets = 1;
   double interval = 1.0;
+  double statsInterval = 0.0;
+  std::string statsFile = "";
+  bool pcapRing = false;
+  uint32_t pcapRingSize = 64;
+  std::string linkModel = "wifi";
+  double linkRange = 0.0;
+  double linkLoss = 0.0;
+  double gridSpacing = 0.0;
+  bool verbose = true;
+  uint32_t numSources = 0;
+  double simTime = 10.0;
+  bool printRoutes = false;
+  bool dualRadio = false;
+  double airtimeCost = 0.0;
+  bool adhoc = false;
+  std::string selectionMode = "Energy";
+  uint32_t lossyRelays = 0;
+  double lossyRxGain = -57.0;
 
   CommandLine cmd;
+  cmd.AddValue ("statsInterval", "Interval in seconds between statistics reports (0 reports only at the end of the run)", statsInterval);
+  cmd.AddValue ("statsFile", "File the statistics reports are written to (standard output when empty)", statsFile);
+  cmd.AddValue ("tracing", "Enable packet capture", tracing);
+  cmd.AddValue ("pcapRing", "Keep the last packets of every interface in memory and write one merged capture only on a trigger, instead of one pcap file per device", pcapRing);
+  cmd.AddValue ("pcapRingSize", "Packets kept per interface when pcapRing is enabled", pcapRingSize);
+  cmd.AddValue ("numberOfIotDevices", "Number of IOT nodes, split evenly in 3 tiers", numberOfIotDevices);
+  cmd.AddValue ("linkModel", "Link layer of the IOT nodes: wifi (YansWifiPhy + AarfWifiManager) or abstract (IotAbstractLinkChannel)", linkModel);
+  cmd.AddValue ("linkRange", "Unit disk range in meters of the abstract link (0: all nodes in range)", linkRange);
+  cmd.AddValue ("linkLoss", "Frame loss probability of the abstract link", linkLoss);
+  cmd.AddValue ("gridSpacing", "Place the IOT nodes on a grid with this spacing in meters (0: all at the origin)", gridSpacing);
+  cmd.AddValue ("verbose", "Log every packet and the energy of all nodes after every hop", verbose);
+  cmd.AddValue ("numSources", "Number of source nodes spread over all tiers, starting at random times (0: the 5 fixed sources)", numSources);
+  cmd.AddValue ("numPackets", "Packets sent by every source", numPackets);
+  cmd.AddValue ("interval", "Interval in seconds between packets of a source", interval);
+  cmd.AddValue ("simTime", "Simulation time in seconds", simTime);
+  cmd.AddValue ("printRoutes", "Print the routing table of every IOT node after 1 second", printRoutes);
+  cmd.AddValue ("dualRadio", "Give the IOT nodes and the gateway a second, low power radio (250kbps, 10.2.3.0/24)", dualRadio);
+  cmd.AddValue ("airtimeCost", "Joules per second of air time used with the energy per bit to choose the radio (dualRadio)", airtimeCost);
+  cmd.AddValue ("adhoc", "Use ad hoc Wi-Fi MACs instead of an infrastructure network with the gateway as access point", adhoc);
+  cmd.AddValue ("selectionMode", "SelectionMode of the route processor: Energy, EnergyQueue or EnergyEtx", selectionMode);
+  cmd.AddValue ("lossyRelays", "Number of nodes of Tier 1 and of Tier 2 with a bad receiver and 5 more units of energy", lossyRelays);
+  cmd.AddValue ("lossyRxGain", "Receiver gain in dB of the lossy relays", lossyRxGain);
   cmd.Parse (argc,argv);
 
   Time interPacketInterval = Seconds (interval);
@@ -100,30 +160,81 @@ main (int argc, char *argv[])
 
   YansWifiChannelHelper channel = YansWifiChannelHelper::Default ();
   YansWifiPhyHelper phy = YansWifiPhyHelper::Default ();
-  phy.SetChannel (channel.Create ());
-
-  WifiHelper wifiHelper;
-  wifiHelper.SetRemoteStationManager ("ns3::AarfWifiManager");
-
-  WifiMacHelper wifiMacHelper;
-  Ssid ssid = Ssid ("ns-3-ssid");
-  wifiMacHelper.SetType ("ns3::StaWifiMac",
-               "Ssid", SsidValue (ssid),
-               "ActiveProbing", BooleanValue (false));
-
   NetDeviceContainer iotDevices;
-  iotDevices = wifiHelper.Install (phy, wifiMacHelper, iotNodes);
+  NetDeviceContainer gatewayDevices;
 
-  wifiMacHelper.SetType ("ns3::ApWifiMac",
-               "Ssid", SsidValue (ssid));
+  if (linkModel == "abstract")
+    {
+      // Same routing code path, cheap link layer: unit disk and/or fixed loss with a per frame energy cost
+      IotAbstractLinkHelper abstractLinkHelper;
+      abstractLinkHelper.SetUnitDisk (linkRange);
+      abstractLinkHelper.SetFixedLoss (linkLoss);
+      abstractLinkHelper.SetChannelAttribute ("TxEnergyPerByte", DoubleValue (1e-6));
+      abstractLinkHelper.SetChannelAttribute ("RxEnergyPerByte", DoubleValue (0.5e-6));
+      iotDevices = abstractLinkHelper.Install (iotNodes);
+      gatewayDevices = abstractLinkHelper.Install (gatewayNode, abstractLinkHelper.GetChannel ());
+    }
+  else
+    {
+      phy.SetChannel (channel.Create ());
+
+      WifiHelper wifiHelper;
+      wifiHelper.SetRemoteStationManager ("ns3::AarfWifiManager");
+
+      WifiMacHelper wifiMacHelper;
+      Ssid ssid = Ssid ("ns-3-ssid");
+      if (adhoc)
+        {
+          wifiMacHelper.SetType ("ns3::AdhocWifiMac");
+        }
+      else
+        {
+          wifiMacHelper.SetType ("ns3::StaWifiMac",
+                       "Ssid", SsidValue (ssid),
+                       "ActiveProbing", BooleanValue (false));
+        }
+
+      iotDevices = wifiHelper.Install (phy, wifiMacHelper, iotNodes);
+
+      if (!adhoc)
+        {
+          wifiMacHelper.SetType ("ns3::ApWifiMac",
+                       "Ssid", SsidValue (ssid));
+        }
+
+      gatewayDevices = wifiHelper.Install (phy, wifiMacHelper, gatewayNode);
+    }
 
-  NetDeviceContainer gatewayDevices;
-  gatewayDevices = wifiHelper.Install (phy, wifiMacHelper, gatewayNode);
+  // Low power radio: slower but cheaper per bit than the main radio
+  NetDeviceContainer iotLowPowerDevices;
+  NetDeviceContainer gatewayLowPowerDevices;
+  if (dualRadio)
+    {
+      IotAbstractLinkHelper lowPowerLinkHelper;
+      lowPowerLinkHelper.SetUnitDisk (linkRange);
+      lowPowerLinkHelper.SetChannelAttribute ("DataRate", DataRateValue (DataRate ("250kbps")));
+      iotLowPowerDevices = lowPowerLinkHelper.Install (iotNodes);
+      gatewayLowPowerDevices = lowPowerLinkHelper.Install (gatewayNode, lowPowerLinkHelper.GetChannel ());
+    }
 
   // Set mobility as IOT devices are static we will be using ConstantPositionMobilityModel
   MobilityHelper mobilityHelper;
   mobilityHelper.SetMobilityModel ("ns3::ConstantPositionMobilityModel");
+  if (gridSpacing > 0)
+    {
+      mobilityHelper.SetPositionAllocator ("ns3::GridPositionAllocator",
+                                           "DeltaX", DoubleValue (gridSpacing),
+                                           "DeltaY", DoubleValue (gridSpacing),
+                                           "GridWidth", UintegerValue ((uint32_t) std::ceil (std::sqrt ((double) numberOfIotDevices))));
+    }
   mobilityHelper.Install (iotNodes);
+  if (gridSpacing > 0)
+    {
+      Ptr<ListPositionAllocator> gatewayPositions = CreateObject<ListPositionAllocator> ();
+      gatewayPositions->Add (Vector (0.0, 0.0, 0.0));
+      gatewayPositions->Add (Vector (0.0, 0.0, 0.0));
+      mobilityHelper.SetPositionAllocator (gatewayPositions);
+    }
   mobilityHelper.SetMobilityModel ("ns3::ConstantPositionMobilityModel");
   mobilityHelper.Install (gatewayNodes);
 
@@ -135,10 +246,40 @@ main (int argc, char *argv[])
   IotEnergyOptimalRoutingHelper iotEnergyOptimalRoutingHelper;
   Ptr<IotEnergyOptimalRouteProcessor> iotEnergyOptimalRouteProcessor = CreateObject<IotEnergyOptimalRouteProcessor> ();
   iotEnergyOptimalRoutingHelper.Set ("RoutingProcessor", PointerValue (iotEnergyOptimalRouteProcessor));
+  iotEnergyOptimalRouteProcessor->SetAttribute ("Verbose", BooleanValue (verbose));
+  iotEnergyOptimalRouteProcessor->SetAttribute ("SelectionMode", StringValue (selectionMode));
+  iotEnergyOptimalRoutingHelper.Set ("Verbose", BooleanValue (verbose));
+  iotEnergyOptimalRoutingHelper.Set ("AirtimeCost", DoubleValue (airtimeCost));
+
+  // More than 253 IOT nodes do not fit in 10.1.3.0/24
+  Ipv4Address iotNetwork ("10.1.3.0");
+  Ipv4Mask iotMask ("255.255.255.0");
+  if (numberOfIotDevices > 253)
+    {
+      iotNetwork = Ipv4Address ("10.64.0.0");
+      iotMask = Ipv4Mask ("255.192.0.0");
+    }
+  iotEnergyOptimalRoutingHelper.Set ("GatewayAddress", Ipv4AddressValue (Ipv4Address (iotNetwork.Get () + 1)));
+
+  // Statistics collector: delay histograms, hop counts, delivery ratio and energy per delivered bit
+  Ptr<IotEnergyOptimalRoutingStats> iotEnergyOptimalRoutingStats = CreateObject<IotEnergyOptimalRoutingStats> ();
+  iotEnergyOptimalRoutingStats->SetAttribute ("RoutingProcessor", PointerValue (iotEnergyOptimalRouteProcessor));
+  iotEnergyOptimalRoutingStats->SetAttribute ("ExportInterval", TimeValue (Seconds (statsInterval)));
+  iotEnergyOptimalRoutingStats->SetAttribute ("OutputFileName", StringValue (statsFile));
+  iotEnergyOptimalRoutingHelper.Set ("Stats", PointerValue (iotEnergyOptimalRoutingStats));
+
+  // Forwarding table shared by all IOT nodes: the backhaul behind the gateway is reached down the tiers
+  Ptr<IotLpmForwardingTable> forwardingTable = CreateObject<IotLpmForwardingTable> ();
+  forwardingTable->AddTierRoute (Ipv4Address ("10.1.1.0"), Ipv4Mask ("255.255.255.0"));
+  iotEnergyOptimalRoutingHelper.Set ("ForwardingTable", PointerValue (forwardingTable));
 
   InternetStackHelper iotNodesInternetStackHelper;
   iotNodesInternetStackHelper.SetRoutingHelper(iotEnergyOptimalRoutingHelper);
   iotNodesInternetStackHelper.Install (iotNodes);
+  if (printRoutes)
+    {
+      iotEnergyOptimalRoutingHelper.PrintRoutingTableAllAt (Seconds (1.0), Create<OutputStreamWrapper> (&std::cout));
+    }
 
   /* Assign Ip addressess to all Nodes.
   * Gateway IP address will be 10.1.3.1
@@ -149,28 +290,66 @@ main (int argc, char *argv[])
   Ipv4InterfaceContainer gatewayInternetInterfaces;
   gatewayInternetInterfaces = address.Assign (gatewayInternetDevices);
 
-  address.SetBase ("10.1.3.0", "255.255.255.0");
+  address.SetBase (iotNetwork, iotMask);
   Ipv4InterfaceContainer iotInterfaces;
   Ipv4InterfaceContainer gatewayInterfaces;
   gatewayInterfaces = address.Assign (gatewayDevices);
   iotInterfaces = address.Assign (iotDevices);
 
+  // The low power addresses are assigned after the main ones, so the nodes stay known by their main address
+  if (dualRadio)
+    {
+      address.SetBase (numberOfIotDevices > 253 ? "10.128.0.0" : "10.2.3.0", iotMask);
+      Ipv4InterfaceContainer gatewayLowPowerInterfaces = address.Assign (gatewayLowPowerDevices);
+      address.Assign (iotLowPowerDevices);
+      iotEnergyOptimalRouteProcessor->AddNodeAddress (gatewayInterfaces.GetAddress (0), gatewayLowPowerInterfaces.GetAddress (0));
+      for (uint32_t i = 0; i < numberOfIotDevices; i++)
+        {
+          Ptr<Ipv4> ipv4 = iotNodes.Get (i)->GetObject<Ipv4> ();
+          Ptr<IotEnergyOptimalRouting> routing = iotNodes.Get (i)->GetObject<IotEnergyOptimalRouting> ();
+          routing->SetInterfaceCost (ipv4->GetInterfaceForDevice (iotDevices.Get (i)), 50e-9, 11e6);
+          routing->SetInterfaceCost (ipv4->GetInterfaceForDevice (iotLowPowerDevices.Get (i)), 5e-9, 250e3);
+        }
+    }
+
   
   /**
   *Assign Tiers and energy for all the nodes
   */
 
-  iotEnergyOptimalRouteProcessor->AddNodeTierEnergy(1,iotInterfaces.GetAddress(2),140);
-  iotEnergyOptimalRouteProcessor->AddNodeTierEnergy(1,iotInterfaces.GetAddress(1),140);
-  iotEnergyOptimalRouteProcessor->AddNodeTierEnergy(1,iotInterfaces.GetAddress(0),140);
-
-  iotEnergyOptimalRouteProcessor->AddNodeTierEnergy(2,iotInterfaces.GetAddress(5),120);
-  iotEnergyOptimalRouteProcessor->AddNodeTierEnergy(2,iotInterfaces.GetAddress(4),120);
-  iotEnergyOptimalRouteProcessor->AddNodeTierEnergy(2,iotInterfaces.GetAddress(3),120);
+  // Tier 1 nodes start with 140 units, Tier 2 with 120 and Tier 3 with 100; lossy relays with 5 more
+  std::vector<uint32_t> lastNodeOfTier (4, 0);
+  for (uint16_t tier = 1; tier <= 3; tier++)
+    {
+      for (uint32_t i = numberOfIotDevices; i-- > 0; )
+        {
+          if (TierOfIotNode (i, numberOfIotDevices) == tier)
+            {
+              uint32_t energy = 160 - 20 * tier;
+              Ptr<WifiNetDevice> wifiDevice = DynamicCast<WifiNetDevice> (iotDevices.Get (i));
+              bool lossy = i < lossyRelays || TierOfIotNode (i - lossyRelays, numberOfIotDevices) < tier;
+              if (tier < 3 && wifiDevice && lossy)
+                {
+                  wifiDevice->GetPhy ()->SetAttribute ("RxGain", DoubleValue (lossyRxGain));
+                  energy += 5;
+                }
+              lastNodeOfTier[tier] = std::max (lastNodeOfTier[tier], i);
+              iotEnergyOptimalRouteProcessor->AddNodeTierEnergy(tier,iotInterfaces.GetAddress(i),energy);
+            }
+        }
+    }
 
-  iotEnergyOptimalRouteProcessor->AddNodeTierEnergy(3,iotInterfaces.GetAddress(8),100);
-  iotEnergyOptimalRouteProcessor->AddNodeTierEnergy(3,iotInterfaces.GetAddress(7),100);
-  iotEnergyOptimalRouteProcessor->AddNodeTierEnergy(3,iotInterfaces.GetAddress(6),100);
+  // Queue lengths (EnergyQueue) and link delivery estimates (EnergyEtx) are followed on the Wi-Fi devices
+  Ptr<IotLinkMonitor> linkMonitor;
+  if (selectionMode != "Energy")
+    {
+      linkMonitor = CreateObject<IotLinkMonitor> ();
+      linkMonitor->SetAttribute ("RoutingProcessor", PointerValue (iotEnergyOptimalRouteProcessor));
+      for (uint32_t i = 0; i < numberOfIotDevices; i++)
+        {
+          linkMonitor->Install (iotInterfaces.GetAddress (i), iotDevices.Get (i));
+        }
+    }
 
 
   /*
@@ -182,25 +361,25 @@ main (int argc, char *argv[])
   /*
   * Source in Tier 3
   */
-  Ptr<Socket> source_tier3_0 = Socket::CreateSocket (iotNodes.Get (8), tid);
+  Ptr<Socket> source_tier3_0 = Socket::CreateSocket (iotNodes.Get (lastNodeOfTier[3]), tid);
   source_tier3_0->Connect (remote);
 
-  Ptr<Socket> source_tier3_1 = Socket::CreateSocket (iotNodes.Get (7), tid);
+  Ptr<Socket> source_tier3_1 = Socket::CreateSocket (iotNodes.Get (lastNodeOfTier[3] - 1), tid);
   source_tier3_1->Connect (remote);
 
   /*
   * Source in Tier 2
   */
-  Ptr<Socket> source_tier2_0 = Socket::CreateSocket (iotNodes.Get (5), tid);
+  Ptr<Socket> source_tier2_0 = Socket::CreateSocket (iotNodes.Get (lastNodeOfTier[2]), tid);
   source_tier2_0->Connect(remote);
 
-  Ptr<Socket> source_tier2_1 = Socket::CreateSocket (iotNodes.Get (5), tid);
+  Ptr<Socket> source_tier2_1 = Socket::CreateSocket (iotNodes.Get (lastNodeOfTier[2]), tid);
   source_tier2_1->Connect(remote);
 
   /*
   * Source in Tier 1
   */
-  Ptr<Socket> source_tier1_0 = Socket::CreateSocket (iotNodes.Get (2), tid);
+  Ptr<Socket> source_tier1_0 = Socket::CreateSocket (iotNodes.Get (lastNodeOfTier[1]), tid);
   source_tier1_0->Connect(remote);
 
 
@@ -211,53 +390,86 @@ main (int argc, char *argv[])
   InetSocketAddress local_1 = InetSocketAddress (Ipv4Address::GetAny (), 80);
   recvSink_1->Bind (local_1);
   recvSink_1->SetRecvCallback (MakeCallback (&ReceivePacket));
+  iotEnergyOptimalRoutingStats->InstallSink (gatewayNodes.Get (0));
 
 
-  /*
-  *Creating simulation each simulation sends a packet from one of the tier into sink in a time interval of 1 second
-  */
-  Simulator::ScheduleWithContext (source_tier3_0->GetNode ()->GetId (),
-                                  Seconds (1.0), &GenerateTraffic,
-                                  source_tier3_0, packetSize, numPackets, interPacketInterval);
-
-  Simulator::ScheduleWithContext (source_tier3_0->GetNode ()->GetId (),
-                                  Seconds (2.0), &GenerateTraffic,
-                                  source_tier3_0, packetSize, numPackets, interPacketInterval);
-
-  Simulator::ScheduleWithContext (source_tier3_1->GetNode ()->GetId (),
-                                  Seconds (3.0), &GenerateTraffic,
-                                  source_tier3_1, packetSize, numPackets, interPacketInterval);
-
-  Simulator::ScheduleWithContext (source_tier3_1->GetNode ()->GetId (),
-                                  Seconds (4.0), &GenerateTraffic,
-                                  source_tier3_1, packetSize, numPackets, interPacketInterval);
-
-  Simulator::ScheduleWithContext (source_tier2_0->GetNode ()->GetId (),
-                                  Seconds (5.0), &GenerateTraffic,
-                                  source_tier2_0, packetSize, numPackets, interPacketInterval);
-
-  Simulator::ScheduleWithContext (source_tier2_0->GetNode ()->GetId (),
-                                  Seconds (6.0), &GenerateTraffic,
-                                  source_tier2_0, packetSize, numPackets, interPacketInterval);
-
-  Simulator::ScheduleWithContext (source_tier2_1->GetNode ()->GetId (),
-                                  Seconds (7.0), &GenerateTraffic,
-                                  source_tier2_1, packetSize, numPackets, interPacketInterval);
-
-  Simulator::ScheduleWithContext (source_tier2_1->GetNode ()->GetId (),
-                                  Seconds (8.0), &GenerateTraffic,
-                                  source_tier2_1, packetSize, numPackets, interPacketInterval);
-
-  Simulator::ScheduleWithContext (source_tier1_0->GetNode ()->GetId (),
-                                  Seconds (9.0), &GenerateTraffic,
-                                  source_tier1_0, packetSize, numPackets, interPacketInterval);
+  if (numSources == 0)
+    {
+      /*
+      *Creating simulation each simulation sends a packet from one of the tier into sink in a time interval of 1 second
+      */
+      Simulator::ScheduleWithContext (source_tier3_0->GetNode ()->GetId (),
+                                      Seconds (1.0), &GenerateTraffic,
+                                      source_tier3_0, packetSize, numPackets, interPacketInterval);
+
+      Simulator::ScheduleWithContext (source_tier3_0->GetNode ()->GetId (),
+                                      Seconds (2.0), &GenerateTraffic,
+                                      source_tier3_0, packetSize, numPackets, interPacketInterval);
+
+      Simulator::ScheduleWithContext (source_tier3_1->GetNode ()->GetId (),
+                                      Seconds (3.0), &GenerateTraffic,
+                                      source_tier3_1, packetSize, numPackets, interPacketInterval);
+
+      Simulator::ScheduleWithContext (source_tier3_1->GetNode ()->GetId (),
+                                      Seconds (4.0), &GenerateTraffic,
+                                      source_tier3_1, packetSize, numPackets, interPacketInterval);
+
+      Simulator::ScheduleWithContext (source_tier2_0->GetNode ()->GetId (),
+                                      Seconds (5.0), &GenerateTraffic,
+                                      source_tier2_0, packetSize, numPackets, interPacketInterval);
+
+      Simulator::ScheduleWithContext (source_tier2_0->GetNode ()->GetId (),
+                                      Seconds (6.0), &GenerateTraffic,
+                                      source_tier2_0, packetSize, numPackets, interPacketInterval);
+
+      Simulator::ScheduleWithContext (source_tier2_1->GetNode ()->GetId (),
+                                      Seconds (7.0), &GenerateTraffic,
+                                      source_tier2_1, packetSize, numPackets, interPacketInterval);
+
+      Simulator::ScheduleWithContext (source_tier2_1->GetNode ()->GetId (),
+                                      Seconds (8.0), &GenerateTraffic,
+                                      source_tier2_1, packetSize, numPackets, interPacketInterval);
+
+      Simulator::ScheduleWithContext (source_tier1_0->GetNode ()->GetId (),
+                                      Seconds (9.0), &GenerateTraffic,
+                                      source_tier1_0, packetSize, numPackets, interPacketInterval);
+    }
+  else
+    {
+      /*
+      * Scaled traffic: numSources nodes spread over all the tiers, each starting at a random time
+      */
+      Ptr<UniformRandomVariable> startTime = CreateObject<UniformRandomVariable> ();
+      for (uint32_t k = 0; k < numSources; k++)
+        {
+          uint32_t i = (uint64_t) k * numberOfIotDevices / numSources;
+          Ptr<Socket> source = Socket::CreateSocket (iotNodes.Get (i), tid);
+          source->Connect (remote);
+          Simulator::ScheduleWithContext (source->GetNode ()->GetId (),
+                                          Seconds (startTime->GetValue (1.0, std::max (1.0, simTime - 1.0))), &GenerateTraffic,
+                                          source, packetSize, numPackets, interPacketInterval);
+        }
+    }
 
-  Simulator::Stop (Seconds (10.0));
+  Simulator::Stop (Seconds (simTime));
 
   /*
   * Tracing is by default enabled to be true and this creates the corresponding tcpdump files.
+  * With pcapRing the packets are kept in memory and written to a single file when a node runs out of energy,
+  * a routing anomaly is reported or at the end of the simulation.
   */
-  if (tracing == true)
+  Ptr<IotPcapRingBuffer> pcapRingBuffer;
+  if (tracing == true && pcapRing == true)
+    {
+      pcapRingBuffer = CreateObject<IotPcapRingBuffer> ();
+      pcapRingBuffer->SetAttribute ("Capacity", UintegerValue (pcapRingSize));
+      pcapRingBuffer->SetAttribute ("FilePrefix", StringValue ("iot_energy_optimal_topology_example_ring"));
+      pcapRingBuffer->Install (iotNodes);
+      pcapRingBuffer->Install (gatewayNodes);
+      pcapRingBuffer->TriggerOnNodeEnergyDepleted (iotEnergyOptimalRouteProcessor);
+      pcapRingBuffer->TriggerOnRoutingAnomaly (iotNodes);
+    }
+  else if (tracing == true && linkModel != "abstract")
     {
       pointToPoint.EnablePcapAll ("iot_energy_optimal_topology_example");
       phy.EnablePcap ("iot_energy_optimal_topology_example_gateway", gatewayDevices.Get (0));
@@ -265,6 +477,19 @@ main (int argc, char *argv[])
     }
 
   Simulator::Run ();
+  if (pcapRingBuffer)
+    {
+      pcapRingBuffer->Flush ("end of simulation");
+    }
+  if (lossyRelays > 0)
+    {
+      uint64_t delivered = iotEnergyOptimalRoutingStats->GetDeliveredPackets ();
+      NS_LOG_UNCOND ("[ETX] selectionMode=" << selectionMode
+                     << " lossyRelays=" << lossyRelays
+                     << " delivered=" << delivered
+                     << " delivery_ratio=" << iotEnergyOptimalRoutingStats->GetDeliveryRatio ()
+                     << " energy_per_delivered_packet=" << (delivered ? (double) iotEnergyOptimalRouteProcessor->GetTotalEnergyConsumed () / delivered : 0.0));
+    }
   Simulator::Destroy ();
   return 0;
 }
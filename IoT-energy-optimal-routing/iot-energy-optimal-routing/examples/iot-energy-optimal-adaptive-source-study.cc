@@ -0,0 +1,219 @@
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/iot-energy-optimal-routing-helper.h"
+#include "ns3/iot-energy-optimal-route-processor.h"
+#include "ns3/iot-energy-optimal-routing-stats.h"
+#include "ns3/iot-adaptive-source.h"
+#include "ns3/iot-abstract-link-helper.h"
+#include <sstream>
+
+// Iot Energy Optimal Routing Adaptive Source Study
+//
+// Tier 3 nodes take sensor readings (every --highPriorityEvery-th one high priority) and send them to the gateway through
+// Tier 2 and Tier 1 with IotAdaptiveSource. The network lives until one tier has spent all of its energy.
+// The run is repeated for every policy in --policies:
+//   none:     every reading is sent right away, whatever the energy left
+//   throttle: the reading rate follows the energy left in the relay tiers, down to --minRate
+//   batch:    up to --maxBatch readings per packet as the relay tiers run low
+//   drop:     low priority readings are dropped once the pressure is above --dropThreshold
+//   adaptive: the three together
+// and prints, for each, the lifetime, the readings generated, dropped and delivered (all and high priority), the mean age of
+// the delivered readings, the readings delivered per 1000 energy units and the gain in delivered readings over the first policy.
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("IotEnergyOptimalAdaptiveSourceStudy");
+
+static uint64_t g_readings;
+static uint64_t g_highPriority;
+static uint64_t g_packets;
+static IotLogHistogram g_age;
+static Time g_lifetime;
+
+static void
+ReceiveReadings (Ptr<Socket> socket)
+{
+  Ptr<Packet> p;
+  while ((p = socket->Recv ()))
+    {
+      IotReadingsHeader header;
+      p->RemoveHeader (header);
+      g_readings += header.GetReadings ();
+      g_highPriority += header.GetHighPriorityReadings ();
+      g_packets++;
+      g_age.Record ((Simulator::Now () - header.GetFirstReadingTime ()).GetMicroSeconds ());
+    }
+}
+
+static void
+EnergyPressureChanged (uint16_t tier, double pressure)
+{
+  if (pressure >= 1.0 && g_lifetime.IsZero ())
+    {
+      g_lifetime = Simulator::Now ();
+      Simulator::Stop ();
+    }
+}
+
+static uint64_t
+RunWithPolicy (std::string policy, uint32_t numberOfIotDevices, double interval, uint32_t highPriorityEvery, double minRate,
+               uint32_t maxBatch, double dropThreshold, uint32_t nodeEnergy, double simTime, uint64_t baseline)
+{
+  Ipv4AddressGenerator::Reset ();
+  g_readings = 0;
+  g_highPriority = 0;
+  g_packets = 0;
+  g_age.Reset ();
+  g_lifetime = Seconds (0);
+
+  NodeContainer gatewayNode;
+  gatewayNode.Create (1);
+  NodeContainer iotNodes;
+  iotNodes.Create (numberOfIotDevices);
+
+  IotAbstractLinkHelper abstractLinkHelper;
+  abstractLinkHelper.SetChannelAttribute ("DataRate", DataRateValue (DataRate ("250kbps")));
+  NetDeviceContainer iotDevices = abstractLinkHelper.Install (iotNodes);
+  NetDeviceContainer gatewayDevices = abstractLinkHelper.Install (gatewayNode, abstractLinkHelper.GetChannel ());
+
+  InternetStackHelper gatewayInternetStackHelper;
+  gatewayInternetStackHelper.Install (gatewayNode);
+
+  Ptr<IotEnergyOptimalRouteProcessor> iotEnergyOptimalRouteProcessor = CreateObject<IotEnergyOptimalRouteProcessor> ();
+  iotEnergyOptimalRouteProcessor->SetAttribute ("Verbose", BooleanValue (false));
+  iotEnergyOptimalRouteProcessor->TraceConnectWithoutContext ("EnergyPressureChanged", MakeCallback (&EnergyPressureChanged));
+
+  IotEnergyOptimalRoutingHelper iotEnergyOptimalRoutingHelper;
+  iotEnergyOptimalRoutingHelper.Set ("RoutingProcessor", PointerValue (iotEnergyOptimalRouteProcessor));
+  iotEnergyOptimalRoutingHelper.Set ("Verbose", BooleanValue (false));
+
+  InternetStackHelper iotNodesInternetStackHelper;
+  iotNodesInternetStackHelper.SetRoutingHelper (iotEnergyOptimalRoutingHelper);
+  iotNodesInternetStackHelper.Install (iotNodes);
+
+  Ipv4AddressHelper address;
+  address.SetBase ("10.1.3.0", "255.255.255.0");
+  Ipv4InterfaceContainer gatewayInterfaces = address.Assign (gatewayDevices);
+  Ipv4InterfaceContainer iotInterfaces = address.Assign (iotDevices);
+
+  NodeContainer sources;
+  for (uint32_t i = 0; i < numberOfIotDevices; i++)
+    {
+      uint16_t tier = 1 + (uint64_t) i * 3 / numberOfIotDevices;
+      iotEnergyOptimalRouteProcessor->AddNodeTierEnergy (tier, iotInterfaces.GetAddress (i), nodeEnergy);
+      if (tier == 3)
+        {
+          sources.Add (iotNodes.Get (i));
+        }
+    }
+
+  Ptr<Socket> sink = Socket::CreateSocket (gatewayNode.Get (0), TypeId::LookupByName ("ns3::UdpSocketFactory"));
+  sink->Bind (InetSocketAddress (Ipv4Address::GetAny (), 9));
+  sink->SetRecvCallback (MakeCallback (&ReceiveReadings));
+
+  bool adaptive = policy == "adaptive";
+  std::vector<Ptr<IotAdaptiveSource> > apps;
+  for (uint32_t i = 0; i < sources.GetN (); i++)
+    {
+      Ptr<IotAdaptiveSource> app = CreateObject<IotAdaptiveSource> ();
+      app->SetAttribute ("Remote", AddressValue (InetSocketAddress (gatewayInterfaces.GetAddress (0), 9)));
+      app->SetAttribute ("Interval", TimeValue (Seconds (interval)));
+      app->SetAttribute ("HighPriorityEvery", UintegerValue (highPriorityEvery));
+      app->SetAttribute ("RoutingProcessor", PointerValue (iotEnergyOptimalRouteProcessor));
+      if (adaptive || policy == "throttle")
+        {
+          app->SetAttribute ("MinRate", DoubleValue (minRate));
+        }
+      if (adaptive || policy == "batch")
+        {
+          app->SetAttribute ("MaxBatch", UintegerValue (maxBatch));
+        }
+      if (adaptive || policy == "drop")
+        {
+          app->SetAttribute ("DropThreshold", DoubleValue (dropThreshold));
+        }
+      app->AssignStreams (i);
+      app->SetStartTime (Seconds (1.0));
+      app->SetStopTime (Seconds (simTime));
+      sources.Get (i)->AddApplication (app);
+      apps.push_back (app);
+    }
+
+  Simulator::Stop (Seconds (simTime));
+  Simulator::Run ();
+
+  uint64_t generated = 0;
+  uint64_t dropped = 0;
+  for (uint32_t i = 0; i < apps.size (); i++)
+    {
+      generated += apps[i]->GetReadingsGenerated ();
+      dropped += apps[i]->GetReadingsDropped ();
+    }
+  uint64_t energy = iotEnergyOptimalRouteProcessor->GetTotalEnergyConsumed ();
+
+  std::ostringstream lifetime;
+  if (g_lifetime.IsZero ())
+    {
+      lifetime << ">" << simTime;
+    }
+  else
+    {
+      lifetime << g_lifetime.GetSeconds ();
+    }
+  NS_LOG_UNCOND ("[ADAPTIVE] policy=" << policy
+                 << " lifetime_s=" << lifetime.str ()
+                 << " readings_generated=" << generated
+                 << " readings_dropped=" << dropped
+                 << " readings_delivered=" << g_readings
+                 << " high_priority_delivered=" << g_highPriority
+                 << " packets_delivered=" << g_packets
+                 << " reading_age_mean_s=" << g_age.GetMean () / 1e6
+                 << " readings_per_kunit=" << (energy ? g_readings * 1000.0 / energy : 0.0)
+                 << " gain=" << (baseline ? (double) g_readings / baseline : 1.0));
+
+  Simulator::Destroy ();
+  return g_readings;
+}
+
+int
+main (int argc, char *argv[])
+{
+  uint32_t numberOfIotDevices = 60;
+  double interval = 1.0;
+  uint32_t highPriorityEvery = 10;
+  double minRate = 0.2;
+  uint32_t maxBatch = 8;
+  double dropThreshold = 0.5;
+  uint32_t nodeEnergy = 20000;
+  double simTime = 20000.0;
+  std::string policies = "none,throttle,batch,drop,adaptive";
+
+  CommandLine cmd;
+  cmd.AddValue ("numberOfIotDevices", "Number of IOT nodes, split evenly in 3 tiers", numberOfIotDevices);
+  cmd.AddValue ("interval", "Interval in seconds between readings of a source without energy pressure", interval);
+  cmd.AddValue ("highPriorityEvery", "Every n-th reading is high priority", highPriorityEvery);
+  cmd.AddValue ("minRate", "Lowest share of the reading rate kept by the throttle policy", minRate);
+  cmd.AddValue ("maxBatch", "Readings per packet at full pressure for the batch policy", maxBatch);
+  cmd.AddValue ("dropThreshold", "Pressure above which the drop policy drops low priority readings", dropThreshold);
+  cmd.AddValue ("nodeEnergy", "Initial energy of every node (10 units per packet sent)", nodeEnergy);
+  cmd.AddValue ("simTime", "Longest simulation time in seconds of every run", simTime);
+  cmd.AddValue ("policies", "Comma separated list of policies: none, throttle, batch, drop, adaptive", policies);
+  cmd.Parse (argc, argv);
+
+  Config::SetGlobal ("IotRoutingProfileReport", BooleanValue (false));
+
+  std::istringstream list (policies);
+  std::string item;
+  uint64_t baseline = 0;
+  while (std::getline (list, item, ','))
+    {
+      uint64_t delivered = RunWithPolicy (item, numberOfIotDevices, interval, highPriorityEvery, minRate, maxBatch, dropThreshold,
+                                          nodeEnergy, simTime, baseline);
+      if (baseline == 0)
+        {
+          baseline = delivered;
+        }
+    }
+  return 0;
+}
@@ -0,0 +1,174 @@
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/applications-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/iot-energy-optimal-routing-helper.h"
+#include "ns3/iot-energy-optimal-route-processor.h"
+#include "ns3/iot-energy-optimal-routing-stats.h"
+#include "ns3/iot-packet-aggregator.h"
+#include "ns3/iot-abstract-link-helper.h"
+#include <sstream>
+#include <cstdlib>
+
+// Iot Energy Optimal Routing Aggregation Study
+//
+// Tier 3 nodes send small sensor readings to the gateway; Tier 2 and Tier 1 nodes forward them.
+// The run is repeated for every aggregation delay in --delays (0 disables aggregation) and prints, for each:
+// delivered packets and throughput, mean and 99th percentile delay of Tier 3 packets, radio energy, frames sent by the relays,
+// and the lifetime (time until the first node runs out of energy).
+// The abstract link charges a fixed air time and energy per frame, which is what aggregation saves.
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("IotEnergyOptimalAggregationStudy");
+
+static Time g_firstDepletion;
+
+static void
+NodeEnergyDepleted (Ipv4Address addr)
+{
+  if (g_firstDepletion.IsZero ())
+    {
+      g_firstDepletion = Simulator::Now ();
+    }
+}
+
+static void
+RunWithAggregationDelay (Time maxDelay, uint32_t numberOfIotDevices, uint32_t packetSize, double interval,
+                         uint32_t nodeEnergy, double simTime)
+{
+  Ipv4AddressGenerator::Reset ();
+  g_firstDepletion = Seconds (0);
+
+  NodeContainer gatewayNode;
+  gatewayNode.Create (1);
+  NodeContainer iotNodes;
+  iotNodes.Create (numberOfIotDevices);
+
+  IotAbstractLinkHelper abstractLinkHelper;
+  abstractLinkHelper.SetChannelAttribute ("DataRate", DataRateValue (DataRate ("250kbps")));
+  abstractLinkHelper.SetChannelAttribute ("FrameOverhead", TimeValue (MilliSeconds (2)));
+  abstractLinkHelper.SetChannelAttribute ("TxEnergyPerFrame", DoubleValue (1e-4));
+  abstractLinkHelper.SetChannelAttribute ("TxEnergyPerByte", DoubleValue (1e-6));
+  abstractLinkHelper.SetChannelAttribute ("RxEnergyPerFrame", DoubleValue (5e-5));
+  abstractLinkHelper.SetChannelAttribute ("RxEnergyPerByte", DoubleValue (0.5e-6));
+  NetDeviceContainer iotDevices = abstractLinkHelper.Install (iotNodes);
+  NetDeviceContainer gatewayDevices = abstractLinkHelper.Install (gatewayNode, abstractLinkHelper.GetChannel ());
+
+  InternetStackHelper gatewayInternetStackHelper;
+  gatewayInternetStackHelper.Install (gatewayNode);
+  IotAggregateDemux::Install (gatewayNode.Get (0));
+
+  Ptr<IotEnergyOptimalRouteProcessor> iotEnergyOptimalRouteProcessor = CreateObject<IotEnergyOptimalRouteProcessor> ();
+  iotEnergyOptimalRouteProcessor->SetAttribute ("Verbose", BooleanValue (false));
+  iotEnergyOptimalRouteProcessor->TraceConnectWithoutContext ("NodeEnergyDepleted", MakeCallback (&NodeEnergyDepleted));
+
+  Ptr<IotEnergyOptimalRoutingStats> iotEnergyOptimalRoutingStats = CreateObject<IotEnergyOptimalRoutingStats> ();
+  iotEnergyOptimalRoutingStats->SetAttribute ("RoutingProcessor", PointerValue (iotEnergyOptimalRouteProcessor));
+
+  IotEnergyOptimalRoutingHelper iotEnergyOptimalRoutingHelper;
+  iotEnergyOptimalRoutingHelper.Set ("RoutingProcessor", PointerValue (iotEnergyOptimalRouteProcessor));
+  iotEnergyOptimalRoutingHelper.Set ("Stats", PointerValue (iotEnergyOptimalRoutingStats));
+  iotEnergyOptimalRoutingHelper.Set ("Verbose", BooleanValue (false));
+  iotEnergyOptimalRoutingHelper.Set ("AggregationMaxDelay", TimeValue (maxDelay));
+
+  InternetStackHelper iotNodesInternetStackHelper;
+  iotNodesInternetStackHelper.SetRoutingHelper (iotEnergyOptimalRoutingHelper);
+  iotNodesInternetStackHelper.Install (iotNodes);
+
+  Ipv4AddressHelper address;
+  address.SetBase ("10.1.3.0", "255.255.255.0");
+  Ipv4InterfaceContainer gatewayInterfaces = address.Assign (gatewayDevices);
+  Ipv4InterfaceContainer iotInterfaces = address.Assign (iotDevices);
+
+  NodeContainer sources;
+  for (uint32_t i = 0; i < numberOfIotDevices; i++)
+    {
+      uint16_t tier = 1 + (uint64_t) i * 3 / numberOfIotDevices;
+      iotEnergyOptimalRouteProcessor->AddNodeTierEnergy (tier, iotInterfaces.GetAddress (i), nodeEnergy);
+      if (tier == 3)
+        {
+          sources.Add (iotNodes.Get (i));
+        }
+    }
+
+  iotEnergyOptimalRoutingStats->InstallSink (gatewayNode.Get (0));
+  PacketSinkHelper sinkHelper ("ns3::UdpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), 9));
+  ApplicationContainer sinks = sinkHelper.Install (gatewayNode);
+
+  OnOffHelper sourceHelper ("ns3::UdpSocketFactory", InetSocketAddress (gatewayInterfaces.GetAddress (0), 9));
+  sourceHelper.SetAttribute ("OnTime", StringValue ("ns3::ConstantRandomVariable[Constant=1]"));
+  sourceHelper.SetAttribute ("OffTime", StringValue ("ns3::ConstantRandomVariable[Constant=0]"));
+  sourceHelper.SetAttribute ("DataRate", DataRateValue (DataRate ((uint64_t) (packetSize * 8 / interval))));
+  sourceHelper.SetAttribute ("PacketSize", UintegerValue (packetSize));
+  ApplicationContainer apps = sourceHelper.Install (sources);
+  apps.Start (Seconds (1.0));
+  apps.Stop (Seconds (simTime));
+
+  Simulator::Stop (Seconds (simTime));
+  Simulator::Run ();
+
+  uint64_t frames = 0;
+  uint64_t aggregated = 0;
+  for (uint32_t i = 0; i < numberOfIotDevices; i++)
+    {
+      Ptr<IotEnergyOptimalRouting> routing = iotNodes.Get (i)->GetObject<IotEnergyOptimalRouting> ();
+      frames += routing->GetAggregator () ? routing->GetAggregator ()->GetSentFrames () : routing->GetCounters ().forwardedPackets;
+      aggregated += routing->GetAggregator () ? routing->GetAggregator ()->GetAggregatedPackets () : 0;
+    }
+  const IotLogHistogram &delay = iotEnergyOptimalRoutingStats->GetTierDelayHistogram (3);
+  Ptr<IotAbstractLinkChannel> channel = abstractLinkHelper.GetChannel ();
+  uint64_t rxBytes = DynamicCast<PacketSink> (sinks.Get (0))->GetTotalRx ();
+
+  std::ostringstream lifetime;
+  if (g_firstDepletion.IsZero ())
+    {
+      lifetime << ">" << simTime;
+    }
+  else
+    {
+      lifetime << g_firstDepletion.GetSeconds ();
+    }
+  NS_LOG_UNCOND ("[STUDY]  max_delay_ms=" << maxDelay.GetMilliSeconds ()
+                 << " delivered=" << iotEnergyOptimalRoutingStats->GetDeliveredPackets ()
+                 << " delivery_ratio=" << iotEnergyOptimalRoutingStats->GetDeliveryRatio ()
+                 << " throughput_kbps=" << rxBytes * 8.0 / (simTime - 1.0) / 1e3
+                 << " delay_mean_ms=" << delay.GetMean () / 1e3
+                 << " delay_p99_ms=" << delay.GetQuantile (0.99) / 1e3
+                 << " relay_frames=" << frames
+                 << " packets_per_frame=" << (frames && aggregated ? (double) aggregated / frames : 1.0)
+                 << " radio_energy_J=" << channel->GetTotalEnergyConsumed ()
+                 << " lifetime_s=" << lifetime.str ());
+
+  Simulator::Destroy ();
+}
+
+int
+main (int argc, char *argv[])
+{
+  uint32_t numberOfIotDevices = 60;
+  uint32_t packetSize = 100;
+  double interval = 0.05;
+  uint32_t nodeEnergy = 100000;
+  double simTime = 20.0;
+  std::string delays = "0,5,20,50,100";
+
+  CommandLine cmd;
+  cmd.AddValue ("numberOfIotDevices", "Number of IOT nodes, split evenly in 3 tiers", numberOfIotDevices);
+  cmd.AddValue ("packetSize", "Size of the readings sent by the Tier 3 nodes", packetSize);
+  cmd.AddValue ("interval", "Interval in seconds between readings of a node", interval);
+  cmd.AddValue ("nodeEnergy", "Initial energy of every node (10 units per frame sent)", nodeEnergy);
+  cmd.AddValue ("simTime", "Simulation time in seconds of every run", simTime);
+  cmd.AddValue ("delays", "Comma separated aggregation delays in milliseconds (0: no aggregation)", delays);
+  cmd.Parse (argc, argv);
+
+  Config::SetGlobal ("IotRoutingProfileReport", BooleanValue (false));
+
+  std::istringstream list (delays);
+  std::string item;
+  while (std::getline (list, item, ','))
+    {
+      RunWithAggregationDelay (MilliSeconds (std::atof (item.c_str ())), numberOfIotDevices, packetSize, interval, nodeEnergy, simTime);
+    }
+  return 0;
+}
@@ -0,0 +1,238 @@
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/applications-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/iot-energy-optimal-routing-helper.h"
+#include "ns3/iot-energy-optimal-route-processor.h"
+#include "ns3/iot-energy-optimal-routing-stats.h"
+#include "ns3/iot-abstract-link-helper.h"
+#include <sstream>
+#include <algorithm>
+
+// Iot Energy Optimal Routing Downlink Benchmark
+//
+// A gateway and the IOT nodes, split in 3 tiers, on one IotAbstractLinkChannel, all running IotEnergyOptimalRouting with Downlink
+// (the gateway in an Ipv4ListRouting before its static routing). Every IOT node first sends one packet to the gateway, which
+// teaches the nodes on its path the reverse path. Then the gateway sends, for every mode in --modes:
+//   command:            --commands packets, each to a random Tier 3 node
+//   firmware-unicast:   --chunks firmware chunks to every IOT node, one unicast packet per node
+//   firmware-multicast: the same chunks once to a multicast group, relayed by the relay candidates of Tier 1 and Tier 2
+// and prints the packets delivered, their delay, the downlink transmissions, the energy per delivered packet (units of the route
+// processor) and the time until the last delivery.
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("IotEnergyOptimalDownlinkBenchmark");
+
+static IotLogHistogram g_delay;
+static uint64_t g_received;
+static Time g_lastReceived;
+static uint64_t g_energyAtStart;
+
+static void
+ReceiveDownlink (Ptr<Socket> socket)
+{
+  Ptr<Packet> p;
+  while ((p = socket->Recv ()))
+    {
+      SeqTsHeader seqTs;
+      p->RemoveHeader (seqTs);
+      g_delay.Record ((Simulator::Now () - seqTs.GetTs ()).GetMicroSeconds ());
+      g_received++;
+      g_lastReceived = Simulator::Now ();
+    }
+}
+
+static void
+SendUplink (Ptr<Socket> socket, uint32_t size)
+{
+  socket->Send (Create<Packet> (size));
+}
+
+static void
+SendDownlink (Ptr<Socket> socket, Ipv4Address dest, uint32_t size, uint32_t seq)
+{
+  Ptr<Packet> p = Create<Packet> (size);
+  SeqTsHeader seqTs;
+  seqTs.SetSeq (seq);
+  p->AddHeader (seqTs);
+  socket->SendTo (p, 0, InetSocketAddress (dest, 10));
+}
+
+static void
+StartMeasurement (Ptr<IotEnergyOptimalRouteProcessor> processor)
+{
+  g_energyAtStart = processor->GetTotalEnergyConsumed ();
+}
+
+static void
+Run (std::string mode, uint32_t numberOfIotDevices, DataRate radioRate, uint32_t commands, uint32_t chunks, uint32_t chunkSize,
+     double sendInterval, double warmup)
+{
+  Ipv4AddressGenerator::Reset ();
+  g_delay.Reset ();
+  g_received = 0;
+  g_lastReceived = Seconds (0);
+
+  NodeContainer gatewayNode;
+  gatewayNode.Create (1);
+  NodeContainer iotNodes;
+  iotNodes.Create (numberOfIotDevices);
+
+  IotAbstractLinkHelper abstractLinkHelper;
+  abstractLinkHelper.SetChannelAttribute ("DataRate", DataRateValue (radioRate));
+  NetDeviceContainer iotDevices = abstractLinkHelper.Install (iotNodes);
+  NetDeviceContainer gatewayDevices = abstractLinkHelper.Install (gatewayNode, abstractLinkHelper.GetChannel ());
+
+  Ptr<IotEnergyOptimalRouteProcessor> iotEnergyOptimalRouteProcessor = CreateObject<IotEnergyOptimalRouteProcessor> ();
+  iotEnergyOptimalRouteProcessor->SetAttribute ("Verbose", BooleanValue (false));
+
+  IotEnergyOptimalRoutingHelper iotEnergyOptimalRoutingHelper;
+  iotEnergyOptimalRoutingHelper.Set ("RoutingProcessor", PointerValue (iotEnergyOptimalRouteProcessor));
+  iotEnergyOptimalRoutingHelper.Set ("Verbose", BooleanValue (false));
+  iotEnergyOptimalRoutingHelper.Set ("GatewayAddress", Ipv4AddressValue ("10.64.0.1"));
+  iotEnergyOptimalRoutingHelper.Set ("Downlink", BooleanValue (true));
+
+  // The gateway routes the packets to IOT nodes itself and leaves the others to static routing
+  Ipv4StaticRoutingHelper staticRoutingHelper;
+  Ipv4ListRoutingHelper gatewayRoutingHelper;
+  gatewayRoutingHelper.Add (staticRoutingHelper, 0);
+  gatewayRoutingHelper.Add (iotEnergyOptimalRoutingHelper, 10);
+  InternetStackHelper gatewayInternetStackHelper;
+  gatewayInternetStackHelper.SetRoutingHelper (gatewayRoutingHelper);
+  gatewayInternetStackHelper.Install (gatewayNode);
+
+  InternetStackHelper iotNodesInternetStackHelper;
+  iotNodesInternetStackHelper.SetRoutingHelper (iotEnergyOptimalRoutingHelper);
+  iotNodesInternetStackHelper.Install (iotNodes);
+
+  Ipv4AddressHelper address;
+  address.SetBase ("10.64.0.0", "255.192.0.0");
+  Ipv4InterfaceContainer gatewayInterfaces = address.Assign (gatewayDevices);
+  Ipv4InterfaceContainer iotInterfaces = address.Assign (iotDevices);
+
+  // Energy is large enough for no node to run out during the benchmark
+  uint32_t firstOfTier3 = numberOfIotDevices;
+  for (uint32_t i = 0; i < numberOfIotDevices; i++)
+    {
+      uint16_t tier = 1 + (uint64_t) i * 3 / numberOfIotDevices;
+      iotEnergyOptimalRouteProcessor->AddNodeTierEnergy (tier, iotInterfaces.GetAddress (i), 1000000000);
+      if (tier == 3 && firstOfTier3 == numberOfIotDevices)
+        {
+          firstOfTier3 = i;
+        }
+    }
+
+  PacketSinkHelper sinkHelper ("ns3::UdpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), 9));
+  sinkHelper.Install (gatewayNode);
+
+  // Learning: one uplink packet per node, at random times; every node listens for the downlink packets
+  TypeId tid = TypeId::LookupByName ("ns3::UdpSocketFactory");
+  Ptr<UniformRandomVariable> random = CreateObject<UniformRandomVariable> ();
+  for (uint32_t i = 0; i < numberOfIotDevices; i++)
+    {
+      Ptr<Socket> source = Socket::CreateSocket (iotNodes.Get (i), tid);
+      source->Connect (InetSocketAddress (gatewayInterfaces.GetAddress (0), 9));
+      Simulator::ScheduleWithContext (iotNodes.Get (i)->GetId (), Seconds (random->GetValue (1.0, 1.0 + warmup)),
+                                      &SendUplink, source, 32);
+      Ptr<Socket> sink = Socket::CreateSocket (iotNodes.Get (i), tid);
+      sink->Bind (InetSocketAddress (Ipv4Address::GetAny (), 10));
+      sink->SetRecvCallback (MakeCallback (&ReceiveDownlink));
+    }
+
+  Time start = Seconds (warmup + 3.0);
+  Simulator::Schedule (start, &StartMeasurement, iotEnergyOptimalRouteProcessor);
+  Ptr<Socket> gatewaySocket = Socket::CreateSocket (gatewayNode.Get (0), tid);
+  gatewaySocket->SetAttribute ("IpMulticastTtl", UintegerValue (8));
+  uint32_t gatewayId = gatewayNode.Get (0)->GetId ();
+  Time at = start;
+  uint64_t expected = 0;
+  if (mode == "command")
+    {
+      for (uint32_t c = 0; c < commands; c++, at += Seconds (sendInterval))
+        {
+          uint32_t i = random->GetInteger (firstOfTier3, numberOfIotDevices - 1);
+          Simulator::ScheduleWithContext (gatewayId, at, &SendDownlink, gatewaySocket, iotInterfaces.GetAddress (i), 32, c);
+        }
+      expected = commands;
+    }
+  else if (mode == "firmware-unicast")
+    {
+      for (uint32_t c = 0; c < chunks; c++)
+        {
+          for (uint32_t i = 0; i < numberOfIotDevices; i++, at += Seconds (sendInterval))
+            {
+              Simulator::ScheduleWithContext (gatewayId, at, &SendDownlink, gatewaySocket, iotInterfaces.GetAddress (i), chunkSize, c);
+            }
+        }
+      expected = (uint64_t) chunks * numberOfIotDevices;
+    }
+  else
+    {
+      for (uint32_t c = 0; c < chunks; c++, at += Seconds (sendInterval))
+        {
+          Simulator::ScheduleWithContext (gatewayId, at, &SendDownlink, gatewaySocket, Ipv4Address ("225.1.2.3"), chunkSize, c);
+        }
+      expected = (uint64_t) chunks * numberOfIotDevices;
+    }
+
+  Simulator::Stop (at + Seconds (5.0));
+  Simulator::Run ();
+
+  IotRoutingCounters counters = IotEnergyOptimalRouting::GetGlobalCounters ();
+  uint32_t gatewayEntries = gatewayNode.Get (0)->GetObject<IotEnergyOptimalRouting> ()->GetReversePathTable ()->GetNEntries ();
+  uint32_t maxNodeEntries = 0;
+  for (uint32_t i = 0; i < numberOfIotDevices; i++)
+    {
+      maxNodeEntries = std::max (maxNodeEntries, iotNodes.Get (i)->GetObject<IotEnergyOptimalRouting> ()->GetReversePathTable ()->GetNEntries ());
+    }
+  uint64_t energy = iotEnergyOptimalRouteProcessor->GetTotalEnergyConsumed () - g_energyAtStart;
+  NS_LOG_UNCOND ("[DOWNLINK] mode=" << mode
+                 << " nodes=" << numberOfIotDevices
+                 << " delivered=" << g_received
+                 << " expected=" << expected
+                 << " delay_p50_ms=" << g_delay.GetQuantile (0.5) / 1e3
+                 << " delay_p99_ms=" << g_delay.GetQuantile (0.99) / 1e3
+                 << " transmissions=" << counters.downlinkPackets
+                 << " reverse_path_misses=" << counters.reversePathMisses
+                 << " energy_per_delivery=" << (g_received ? (double) energy / g_received : 0.0)
+                 << " completion_s=" << (g_received ? (g_lastReceived - start).GetSeconds () : 0.0)
+                 << " reverse_entries_gateway=" << gatewayEntries
+                 << " reverse_entries_node_max=" << maxNodeEntries);
+
+  Simulator::Destroy ();
+}
+
+int
+main (int argc, char *argv[])
+{
+  uint32_t numberOfIotDevices = 10000;
+  std::string radioRate = "1Mbps";
+  uint32_t commands = 1000;
+  uint32_t chunks = 10;
+  uint32_t chunkSize = 512;
+  double sendInterval = 0.002;
+  double warmup = 20.0;
+  std::string modes = "command,firmware-unicast,firmware-multicast";
+
+  CommandLine cmd;
+  cmd.AddValue ("numberOfIotDevices", "Number of IOT nodes, split evenly in 3 tiers", numberOfIotDevices);
+  cmd.AddValue ("radioRate", "Receive rate of every radio", radioRate);
+  cmd.AddValue ("commands", "Packets sent to random Tier 3 nodes in the command mode", commands);
+  cmd.AddValue ("chunks", "Firmware chunks sent to every IOT node in the firmware modes", chunks);
+  cmd.AddValue ("chunkSize", "Size of a firmware chunk", chunkSize);
+  cmd.AddValue ("sendInterval", "Interval in seconds between packets sent by the gateway", sendInterval);
+  cmd.AddValue ("warmup", "Period in seconds over which every IOT node sends its uplink packet", warmup);
+  cmd.AddValue ("modes", "Comma separated list of modes to run: command, firmware-unicast, firmware-multicast", modes);
+  cmd.Parse (argc, argv);
+
+  Config::SetGlobal ("IotRoutingProfileReport", BooleanValue (false));
+
+  std::istringstream list (modes);
+  std::string item;
+  while (std::getline (list, item, ','))
+    {
+      Run (item, numberOfIotDevices, DataRate (radioRate), commands, chunks, chunkSize, sendInterval, warmup);
+    }
+  return 0;
+}
@@ -0,0 +1,207 @@
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/applications-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/wifi-module.h"
+#include "ns3/mobility-module.h"
+#include "ns3/energy-module.h"
+#include "ns3/iot-energy-optimal-routing-helper.h"
+#include "ns3/iot-energy-optimal-route-processor.h"
+#include "ns3/iot-energy-optimal-routing-stats.h"
+#include "ns3/iot-duty-cycle-controller.h"
+#include <sstream>
+#include <cmath>
+
+// Iot Energy Optimal Routing Duty Cycle Lifetime
+//
+// IOT nodes on one ad hoc Wi-Fi channel run on small batteries (BasicEnergySource + WifiRadioEnergyModel).
+// Tier 3 nodes send a reading every interval; Tier 2 and Tier 1 relay them to the gateway.
+// The run is done for every mode in --modes:
+//   always-on:  every radio listens all the time
+//   duty-cycle: only the relay candidates of every tier listen, the other radios sleep between their own packets (IotDutyCycleController)
+// and prints the lifetime (time until the first battery is empty), the packets delivered by then and the share of time spent asleep.
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("IotEnergyOptimalDutyCycleLifetime");
+
+static Time g_firstDepletion;
+
+static void
+BatteryDepleted (void)
+{
+  if (g_firstDepletion.IsZero ())
+    {
+      g_firstDepletion = Simulator::Now ();
+      Simulator::Stop ();
+    }
+}
+
+static void
+Run (bool dutyCycle, uint32_t numberOfIotDevices, uint32_t relayCandidates, double batteryJ, uint32_t packetSize, double interval,
+     double gridSpacing, double simTime)
+{
+  Ipv4AddressGenerator::Reset ();
+  g_firstDepletion = Seconds (0);
+
+  NodeContainer gatewayNode;
+  gatewayNode.Create (1);
+  NodeContainer iotNodes;
+  iotNodes.Create (numberOfIotDevices);
+
+  YansWifiChannelHelper channel = YansWifiChannelHelper::Default ();
+  YansWifiPhyHelper phy = YansWifiPhyHelper::Default ();
+  phy.SetChannel (channel.Create ());
+  WifiHelper wifiHelper;
+  wifiHelper.SetStandard (WIFI_PHY_STANDARD_80211b);
+  wifiHelper.SetRemoteStationManager ("ns3::ConstantRateWifiManager",
+                                      "DataMode", StringValue ("DsssRate11Mbps"),
+                                      "ControlMode", StringValue ("DsssRate1Mbps"));
+  WifiMacHelper wifiMacHelper;
+  wifiMacHelper.SetType ("ns3::AdhocWifiMac");
+  NetDeviceContainer iotDevices = wifiHelper.Install (phy, wifiMacHelper, iotNodes);
+  NetDeviceContainer gatewayDevices = wifiHelper.Install (phy, wifiMacHelper, gatewayNode);
+
+  uint32_t gridWidth = (uint32_t) std::ceil (std::sqrt ((double) numberOfIotDevices));
+  MobilityHelper mobilityHelper;
+  mobilityHelper.SetMobilityModel ("ns3::ConstantPositionMobilityModel");
+  mobilityHelper.SetPositionAllocator ("ns3::GridPositionAllocator",
+                                       "DeltaX", DoubleValue (gridSpacing),
+                                       "DeltaY", DoubleValue (gridSpacing),
+                                       "GridWidth", UintegerValue (gridWidth));
+  mobilityHelper.Install (iotNodes);
+  Ptr<ListPositionAllocator> gatewayPosition = CreateObject<ListPositionAllocator> ();
+  gatewayPosition->Add (Vector (gridWidth * gridSpacing / 2, gridWidth * gridSpacing / 2, 0.0));
+  mobilityHelper.SetPositionAllocator (gatewayPosition);
+  mobilityHelper.Install (gatewayNode);
+
+  // The gateway is mains powered; the IOT nodes stop the run when the first battery is empty
+  BasicEnergySourceHelper energySourceHelper;
+  energySourceHelper.Set ("BasicEnergySourceInitialEnergyJ", DoubleValue (batteryJ));
+  EnergySourceContainer energySources = energySourceHelper.Install (iotNodes);
+  WifiRadioEnergyModelHelper radioEnergyHelper;
+  radioEnergyHelper.SetDepletionCallback (MakeCallback (&BatteryDepleted));
+  radioEnergyHelper.Install (iotDevices, energySources);
+
+  InternetStackHelper gatewayInternetStackHelper;
+  gatewayInternetStackHelper.Install (gatewayNode);
+
+  Ptr<IotEnergyOptimalRouteProcessor> iotEnergyOptimalRouteProcessor = CreateObject<IotEnergyOptimalRouteProcessor> ();
+  iotEnergyOptimalRouteProcessor->SetAttribute ("Verbose", BooleanValue (false));
+  iotEnergyOptimalRouteProcessor->SetAttribute ("RelayCandidates", UintegerValue (relayCandidates));
+
+  Ptr<IotEnergyOptimalRoutingStats> iotEnergyOptimalRoutingStats = CreateObject<IotEnergyOptimalRoutingStats> ();
+  iotEnergyOptimalRoutingStats->SetAttribute ("RoutingProcessor", PointerValue (iotEnergyOptimalRouteProcessor));
+
+  IotEnergyOptimalRoutingHelper iotEnergyOptimalRoutingHelper;
+  iotEnergyOptimalRoutingHelper.Set ("RoutingProcessor", PointerValue (iotEnergyOptimalRouteProcessor));
+  iotEnergyOptimalRoutingHelper.Set ("Stats", PointerValue (iotEnergyOptimalRoutingStats));
+  iotEnergyOptimalRoutingHelper.Set ("Verbose", BooleanValue (false));
+  iotEnergyOptimalRoutingHelper.Set ("GatewayAddress", Ipv4AddressValue ("10.1.0.1"));
+
+  Ptr<IotDutyCycleController> controller;
+  if (dutyCycle)
+    {
+      controller = CreateObject<IotDutyCycleController> ();
+      controller->SetAttribute ("RoutingProcessor", PointerValue (iotEnergyOptimalRouteProcessor));
+      iotEnergyOptimalRoutingHelper.Set ("DutyCycle", PointerValue (controller));
+    }
+
+  InternetStackHelper iotNodesInternetStackHelper;
+  iotNodesInternetStackHelper.SetRoutingHelper (iotEnergyOptimalRoutingHelper);
+  iotNodesInternetStackHelper.Install (iotNodes);
+
+  Ipv4AddressHelper address;
+  address.SetBase ("10.1.0.0", "255.255.0.0");
+  Ipv4InterfaceContainer gatewayInterfaces = address.Assign (gatewayDevices);
+  Ipv4InterfaceContainer iotInterfaces = address.Assign (iotDevices);
+
+  NodeContainer sources;
+  for (uint32_t i = 0; i < numberOfIotDevices; i++)
+    {
+      uint16_t tier = 1 + (uint64_t) i * 3 / numberOfIotDevices;
+      iotEnergyOptimalRouteProcessor->AddNodeTierEnergy (tier, iotInterfaces.GetAddress (i), 100000);
+      if (tier == 3)
+        {
+          sources.Add (iotNodes.Get (i));
+        }
+    }
+  // The radios are handed to the controller once all the tiers are known
+  for (uint32_t i = 0; controller && i < numberOfIotDevices; i++)
+    {
+      controller->AddNode (iotInterfaces.GetAddress (i), iotDevices.Get (i));
+    }
+
+  iotEnergyOptimalRoutingStats->InstallSink (gatewayNode.Get (0));
+  PacketSinkHelper sinkHelper ("ns3::UdpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), 9));
+  sinkHelper.Install (gatewayNode);
+
+  UdpClientHelper sourceHelper (gatewayInterfaces.GetAddress (0), 9);
+  sourceHelper.SetAttribute ("MaxPackets", UintegerValue (1000000));
+  sourceHelper.SetAttribute ("Interval", TimeValue (Seconds (interval)));
+  sourceHelper.SetAttribute ("PacketSize", UintegerValue (packetSize));
+  ApplicationContainer apps = sourceHelper.Install (sources);
+  Ptr<UniformRandomVariable> startTime = CreateObject<UniformRandomVariable> ();
+  for (uint32_t i = 0; i < apps.GetN (); i++)
+    {
+      apps.Get (i)->SetStartTime (Seconds (1.0 + startTime->GetValue (0.0, interval)));
+    }
+
+  Simulator::Stop (Seconds (simTime));
+  Simulator::Run ();
+
+  Time end = g_firstDepletion.IsZero () ? Seconds (simTime) : g_firstDepletion;
+  std::ostringstream lifetime;
+  if (g_firstDepletion.IsZero ())
+    {
+      lifetime << ">" << simTime;
+    }
+  else
+    {
+      lifetime << g_firstDepletion.GetSeconds ();
+    }
+  NS_LOG_UNCOND ("[LIFETIME] mode=" << (dutyCycle ? "duty-cycle" : "always-on")
+                 << " nodes=" << numberOfIotDevices
+                 << " battery_J=" << batteryJ
+                 << " lifetime_s=" << lifetime.str ()
+                 << " delivered=" << iotEnergyOptimalRoutingStats->GetDeliveredPackets ()
+                 << " delivery_ratio=" << iotEnergyOptimalRoutingStats->GetDeliveryRatio ()
+                 << " sleep_fraction=" << (controller ? controller->GetTotalSleepTime ().GetSeconds () / (end.GetSeconds () * numberOfIotDevices) : 0.0)
+                 << " wakeups=" << (controller ? controller->GetWakeups () : 0));
+
+  Simulator::Destroy ();
+}
+
+int
+main (int argc, char *argv[])
+{
+  uint32_t numberOfIotDevices = 30;
+  uint32_t relayCandidates = 2;
+  double batteryJ = 50.0;
+  uint32_t packetSize = 64;
+  double interval = 5.0;
+  double gridSpacing = 5.0;
+  double simTime = 3600.0;
+  std::string modes = "always-on,duty-cycle";
+
+  CommandLine cmd;
+  cmd.AddValue ("numberOfIotDevices", "Number of IOT nodes, split evenly in 3 tiers", numberOfIotDevices);
+  cmd.AddValue ("relayCandidates", "Nodes of every tier kept awake as current and likely next relays", relayCandidates);
+  cmd.AddValue ("batteryJ", "Initial energy in joules of the battery of every IOT node", batteryJ);
+  cmd.AddValue ("packetSize", "Size of the readings sent by the Tier 3 nodes", packetSize);
+  cmd.AddValue ("interval", "Interval in seconds between readings of a node", interval);
+  cmd.AddValue ("gridSpacing", "Spacing in meters of the grid of IOT nodes", gridSpacing);
+  cmd.AddValue ("simTime", "Longest simulation time in seconds of every run", simTime);
+  cmd.AddValue ("modes", "Comma separated list of modes to run: always-on, duty-cycle", modes);
+  cmd.Parse (argc, argv);
+
+  Config::SetGlobal ("IotRoutingProfileReport", BooleanValue (false));
+
+  std::istringstream list (modes);
+  std::string item;
+  while (std::getline (list, item, ','))
+    {
+      Run (item == "duty-cycle", numberOfIotDevices, relayCandidates, batteryJ, packetSize, interval, gridSpacing, simTime);
+    }
+  return 0;
+}
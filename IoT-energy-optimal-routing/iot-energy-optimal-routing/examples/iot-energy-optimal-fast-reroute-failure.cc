@@ -0,0 +1,254 @@
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/applications-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/wifi-module.h"
+#include "ns3/mobility-module.h"
+#include "ns3/iot-energy-optimal-routing-helper.h"
+#include "ns3/iot-energy-optimal-routing.h"
+#include "ns3/iot-energy-optimal-route-processor.h"
+#include "ns3/iot-energy-optimal-routing-stats.h"
+#include "ns3/iot-link-monitor.h"
+#include <sstream>
+#include <cmath>
+
+// Iot Energy Optimal Routing Fast Reroute Failure
+//
+// IOT nodes on one ad hoc Wi-Fi channel, Tier 3 nodes sending at a constant rate to the gateway. Every --failureInterval a relay
+// on the path of the first source loses its radio, in turn the Tier 2 node the source sends to and the Tier 1 node that one sends
+// to, as selected at that time: it is moved out of range for --downTime, then put back. The processor only learns of a failure
+// from the senders, so without FastReroute the packets keep going to the dead relay until the report; with it the first frame the
+// MAC gives up on switches the sender to its backup. The run is done with FastReroute off and on for every SelectionMode in
+// --modes and prints the packets lost while a relay was down, per failure.
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("IotEnergyOptimalFastRerouteFailure");
+
+struct FailureRun
+{
+  Ptr<IotEnergyOptimalRouteProcessor> processor;
+  Ptr<IotEnergyOptimalRoutingStats> stats;
+  Ipv4InterfaceContainer interfaces;
+  NodeContainer nodes;
+  Ipv4Address source;
+  Time downTime;
+  uint32_t failures;
+  uint32_t repairs;
+  uint64_t lost;
+};
+
+/*
+* The packets lost while the relay was down are the ones originated in that window and not delivered in it.
+*/
+static void
+Repair (FailureRun *run, Ptr<MobilityModel> mobility, Vector position, uint64_t sentAtFailure, uint64_t receivedAtFailure)
+{
+  mobility->SetPosition (position);
+  uint64_t sent = run->stats->GetOriginatedPackets () - sentAtFailure;
+  uint64_t received = run->stats->GetDeliveredPackets () - receivedAtFailure;
+  run->lost += sent > received ? sent - received : 0;
+  run->repairs++;
+}
+
+static void
+Fail (FailureRun *run, Time interval)
+{
+  Ipv4Address relay = run->processor->SelectNodeInTier (2, run->source);
+  if (run->failures % 2)
+    {
+      relay = run->processor->SelectNodeInTier (1, relay);
+    }
+  for (uint32_t i = 0; i < run->interfaces.GetN (); i++)
+    {
+      if (run->interfaces.GetAddress (i) != relay)
+        {
+          continue;
+        }
+      Ptr<MobilityModel> mobility = run->nodes.Get (i)->GetObject<MobilityModel> ();
+      Vector position = mobility->GetPosition ();
+      mobility->SetPosition (Vector (position.x + 100000.0, position.y, position.z));
+      Simulator::Schedule (run->downTime, &Repair, run, mobility, position,
+                           run->stats->GetOriginatedPackets (), run->stats->GetDeliveredPackets ());
+      run->failures++;
+      break;
+    }
+  Simulator::Schedule (interval, &Fail, run, interval);
+}
+
+static void
+Run (std::string mode, bool fastReroute, uint32_t numberOfIotDevices, uint32_t packetSize, std::string rate,
+     Time failureInterval, Time downTime, double gridSpacing, double simTime)
+{
+  Ipv4AddressGenerator::Reset ();
+
+  NodeContainer gatewayNode;
+  gatewayNode.Create (1);
+  NodeContainer iotNodes;
+  iotNodes.Create (numberOfIotDevices);
+
+  YansWifiChannelHelper channel = YansWifiChannelHelper::Default ();
+  YansWifiPhyHelper phy = YansWifiPhyHelper::Default ();
+  phy.SetChannel (channel.Create ());
+  WifiHelper wifiHelper;
+  wifiHelper.SetStandard (WIFI_PHY_STANDARD_80211b);
+  wifiHelper.SetRemoteStationManager ("ns3::ConstantRateWifiManager",
+                                      "DataMode", StringValue ("DsssRate11Mbps"),
+                                      "ControlMode", StringValue ("DsssRate1Mbps"));
+  WifiMacHelper wifiMacHelper;
+  wifiMacHelper.SetType ("ns3::AdhocWifiMac");
+  NetDeviceContainer iotDevices = wifiHelper.Install (phy, wifiMacHelper, iotNodes);
+  NetDeviceContainer gatewayDevices = wifiHelper.Install (phy, wifiMacHelper, gatewayNode);
+
+  uint32_t gridWidth = (uint32_t) std::ceil (std::sqrt ((double) numberOfIotDevices));
+  MobilityHelper mobilityHelper;
+  mobilityHelper.SetMobilityModel ("ns3::ConstantPositionMobilityModel");
+  mobilityHelper.SetPositionAllocator ("ns3::GridPositionAllocator",
+                                       "DeltaX", DoubleValue (gridSpacing),
+                                       "DeltaY", DoubleValue (gridSpacing),
+                                       "GridWidth", UintegerValue (gridWidth));
+  mobilityHelper.Install (iotNodes);
+  Ptr<ListPositionAllocator> gatewayPosition = CreateObject<ListPositionAllocator> ();
+  gatewayPosition->Add (Vector (gridWidth * gridSpacing / 2, gridWidth * gridSpacing / 2, 0.0));
+  mobilityHelper.SetPositionAllocator (gatewayPosition);
+  mobilityHelper.Install (gatewayNode);
+
+  InternetStackHelper gatewayInternetStackHelper;
+  gatewayInternetStackHelper.Install (gatewayNode);
+
+  Ptr<IotEnergyOptimalRouteProcessor> iotEnergyOptimalRouteProcessor = CreateObject<IotEnergyOptimalRouteProcessor> ();
+  iotEnergyOptimalRouteProcessor->SetAttribute ("Verbose", BooleanValue (false));
+  iotEnergyOptimalRouteProcessor->SetAttribute ("SelectionMode", StringValue (mode));
+  iotEnergyOptimalRouteProcessor->SetAttribute ("FailureHoldTime", TimeValue (downTime));
+
+  Ptr<IotEnergyOptimalRoutingStats> iotEnergyOptimalRoutingStats = CreateObject<IotEnergyOptimalRoutingStats> ();
+  iotEnergyOptimalRoutingStats->SetAttribute ("RoutingProcessor", PointerValue (iotEnergyOptimalRouteProcessor));
+
+  IotEnergyOptimalRoutingHelper iotEnergyOptimalRoutingHelper;
+  iotEnergyOptimalRoutingHelper.Set ("RoutingProcessor", PointerValue (iotEnergyOptimalRouteProcessor));
+  iotEnergyOptimalRoutingHelper.Set ("Stats", PointerValue (iotEnergyOptimalRoutingStats));
+  iotEnergyOptimalRoutingHelper.Set ("Verbose", BooleanValue (false));
+  iotEnergyOptimalRoutingHelper.Set ("FastReroute", BooleanValue (fastReroute));
+  iotEnergyOptimalRoutingHelper.Set ("GatewayAddress", Ipv4AddressValue ("10.1.0.1"));
+
+  InternetStackHelper iotNodesInternetStackHelper;
+  iotNodesInternetStackHelper.SetRoutingHelper (iotEnergyOptimalRoutingHelper);
+  iotNodesInternetStackHelper.Install (iotNodes);
+
+  Ipv4AddressHelper address;
+  address.SetBase ("10.1.0.0", "255.255.0.0");
+  Ipv4InterfaceContainer gatewayInterfaces = address.Assign (gatewayDevices);
+  Ipv4InterfaceContainer iotInterfaces = address.Assign (iotDevices);
+
+  NodeContainer sources;
+  Ipv4Address source;
+  Ptr<UniformRandomVariable> energy = CreateObject<UniformRandomVariable> ();
+  energy->SetStream (1);
+  for (uint32_t i = 0; i < numberOfIotDevices; i++)
+    {
+      uint16_t tier = 1 + (uint64_t) i * 3 / numberOfIotDevices;
+      iotEnergyOptimalRouteProcessor->AddNodeTierEnergy (tier, iotInterfaces.GetAddress (i), energy->GetInteger (900000, 1000000));
+      if (tier == 3)
+        {
+          if (sources.GetN () == 0)
+            {
+              source = iotInterfaces.GetAddress (i);
+            }
+          sources.Add (iotNodes.Get (i));
+        }
+    }
+
+  // The monitor also gives the MAC failures to the routing of the senders
+  Ptr<IotLinkMonitor> linkMonitor = CreateObject<IotLinkMonitor> ();
+  linkMonitor->SetAttribute ("RoutingProcessor", PointerValue (iotEnergyOptimalRouteProcessor));
+  for (uint32_t i = 0; i < numberOfIotDevices; i++)
+    {
+      linkMonitor->Install (iotInterfaces.GetAddress (i), iotDevices.Get (i));
+    }
+
+  iotEnergyOptimalRoutingStats->InstallSink (gatewayNode.Get (0));
+  PacketSinkHelper sinkHelper ("ns3::UdpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), 9));
+  sinkHelper.Install (gatewayNode);
+
+  OnOffHelper sourceHelper ("ns3::UdpSocketFactory", InetSocketAddress (gatewayInterfaces.GetAddress (0), 9));
+  sourceHelper.SetAttribute ("OnTime", StringValue ("ns3::ConstantRandomVariable[Constant=1]"));
+  sourceHelper.SetAttribute ("OffTime", StringValue ("ns3::ConstantRandomVariable[Constant=0]"));
+  sourceHelper.SetAttribute ("DataRate", DataRateValue (DataRate (rate)));
+  sourceHelper.SetAttribute ("PacketSize", UintegerValue (packetSize));
+  ApplicationContainer apps = sourceHelper.Install (sources);
+  apps.Start (Seconds (1.0));
+  apps.Stop (Seconds (simTime - 1.0));
+
+  FailureRun run;
+  run.processor = iotEnergyOptimalRouteProcessor;
+  run.stats = iotEnergyOptimalRoutingStats;
+  run.interfaces = iotInterfaces;
+  run.nodes = iotNodes;
+  run.source = source;
+  run.downTime = downTime;
+  run.failures = 0;
+  run.repairs = 0;
+  run.lost = 0;
+  Simulator::Schedule (failureInterval, &Fail, &run, failureInterval);
+
+  Simulator::Stop (Seconds (simTime));
+  Simulator::Run ();
+
+  uint64_t reroutes = 0;
+  for (uint32_t i = 0; i < numberOfIotDevices; i++)
+    {
+      reroutes += iotNodes.Get (i)->GetObject<IotEnergyOptimalRouting> ()->GetCounters ().fastReroutes;
+    }
+  uint64_t sent = iotEnergyOptimalRoutingStats->GetOriginatedPackets ();
+  uint64_t received = iotEnergyOptimalRoutingStats->GetDeliveredPackets ();
+  uint64_t lost = sent > received ? sent - received : 0;
+  NS_LOG_UNCOND ("[REROUTE] mode=" << mode
+                 << " fast_reroute=" << (fastReroute ? "on" : "off")
+                 << " nodes=" << numberOfIotDevices
+                 << " failures=" << run.failures
+                 << " sent=" << sent
+                 << " received=" << received
+                 << " lost=" << lost
+                 << " lost_in_failures=" << run.lost
+                 << " lost_per_failure=" << (double) run.lost / std::max<uint32_t> (1, run.repairs)
+                 << " fast_reroutes=" << reroutes);
+
+  run.processor = 0;
+  run.stats = 0;
+  Simulator::Destroy ();
+}
+
+int
+main (int argc, char *argv[])
+{
+  uint32_t numberOfIotDevices = 30;
+  uint32_t packetSize = 256;
+  std::string rate = "20kbps";
+  Time failureInterval = Seconds (10);
+  Time downTime = Seconds (5);
+  double gridSpacing = 5.0;
+  double simTime = 120.0;
+  std::string modes = "Energy,EnergyEtx";
+
+  CommandLine cmd;
+  cmd.AddValue ("numberOfIotDevices", "Number of IOT nodes, split evenly in 3 tiers", numberOfIotDevices);
+  cmd.AddValue ("packetSize", "Size of the packets sent by the Tier 3 nodes", packetSize);
+  cmd.AddValue ("rate", "Sending rate of a Tier 3 node", rate);
+  cmd.AddValue ("failureInterval", "Time between two relay failures", failureInterval);
+  cmd.AddValue ("downTime", "Time a failed relay stays out of range, also the FailureHoldTime of the processor", downTime);
+  cmd.AddValue ("gridSpacing", "Spacing in meters of the grid of IOT nodes", gridSpacing);
+  cmd.AddValue ("simTime", "Simulation time in seconds of every run", simTime);
+  cmd.AddValue ("modes", "Comma separated list of SelectionMode values to run", modes);
+  cmd.Parse (argc, argv);
+
+  Config::SetGlobal ("IotRoutingProfileReport", BooleanValue (false));
+
+  std::istringstream list (modes);
+  std::string item;
+  while (std::getline (list, item, ','))
+    {
+      Run (item, false, numberOfIotDevices, packetSize, rate, failureInterval, downTime, gridSpacing, simTime);
+      Run (item, true, numberOfIotDevices, packetSize, rate, failureInterval, downTime, gridSpacing, simTime);
+    }
+  return 0;
+}
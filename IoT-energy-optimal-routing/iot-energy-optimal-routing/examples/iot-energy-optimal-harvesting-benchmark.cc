@@ -0,0 +1,147 @@
+#include "ns3/core-module.h"
+#include "ns3/iot-energy-optimal-route-processor.h"
+#include <chrono>
+
+// Iot Energy Optimal Routing Harvesting Benchmark
+//
+// --numberOfIotDevices nodes in 3 tiers, every other one recharged by a solar (diurnal) profile: half of them facing east, the
+// others west, with a later sunrise and less power. Every --interval a single event takes --hopsPerBatch transmissions from
+// random nodes, and every hour it checks that GetHighestEnergyNodeInTier returns a node with the highest energy of its tier
+// (brute force over all the nodes). The harvest is evaluated lazily, so the scheduler only ever holds the batch events, with or
+// without harvesting. The same run is repeated without any harvest profile for comparison.
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("IotEnergyOptimalHarvestingBenchmark");
+
+struct HarvestRun
+{
+  Ptr<IotEnergyOptimalRouteProcessor> processor;
+  Ptr<UniformRandomVariable> random;
+  uint32_t numberOfIotDevices;
+  uint32_t hopsPerBatch;
+  uint32_t batchesPerCheck;
+  uint32_t batches;
+  uint32_t checks;
+  bool consistent;
+};
+
+static double
+ElapsedMs (std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli> (std::chrono::steady_clock::now () - start).count ();
+}
+
+static void
+CheckRanking (HarvestRun *run)
+{
+  uint32_t best[4] = { 0, 0, 0, 0 };
+  uint32_t base = Ipv4Address ("10.0.0.2").Get ();
+  for (uint32_t i = 0; i < run->numberOfIotDevices; i++)
+    {
+      uint16_t tier = 1 + (uint64_t) i * 3 / run->numberOfIotDevices;
+      best[tier] = std::max (best[tier], run->processor->GetNodeEnergy (Ipv4Address (base + i)));
+    }
+  for (uint16_t tier = 1; tier <= 3; tier++)
+    {
+      Ipv4Address highest = run->processor->GetHighestEnergyNodeInTier (tier);
+      uint32_t energy = highest == Ipv4Address () ? 0 : run->processor->GetNodeEnergy (highest);
+      if (energy != best[tier] || (energy && run->processor->GetTierFromIpAddress (highest) != tier))
+        {
+          run->consistent = false;
+        }
+    }
+  run->checks++;
+}
+
+static void
+Batch (HarvestRun *run, Time interval)
+{
+  uint32_t base = Ipv4Address ("10.0.0.2").Get ();
+  for (uint32_t k = 0; k < run->hopsPerBatch; k++)
+    {
+      run->processor->ReduceNodeEnergyOnTransitHop (Ipv4Address (base + run->random->GetInteger (0, run->numberOfIotDevices - 1)));
+    }
+  if (++run->batches % run->batchesPerCheck == 0)
+    {
+      CheckRanking (run);
+    }
+  Simulator::Schedule (interval, &Batch, run, interval);
+}
+
+static double
+RunDays (HarvestRun &run, bool harvesting, uint32_t days, Time interval)
+{
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+  run.processor = CreateObject<IotEnergyOptimalRouteProcessor> ();
+  run.processor->SetAttribute ("Verbose", BooleanValue (false));
+  run.random = CreateObject<UniformRandomVariable> ();
+  run.random->SetStream (1);
+  run.batches = 0;
+  run.checks = 0;
+  run.consistent = true;
+  uint32_t east = run.processor->AddDiurnalHarvestProfile (0.11, Hours (6), Hours (12), 10000);
+  uint32_t west = run.processor->AddDiurnalHarvestProfile (0.09, Hours (7), Hours (11), 8000);
+  uint32_t base = Ipv4Address ("10.0.0.2").Get ();
+  for (uint32_t i = 0; i < run.numberOfIotDevices; i++)
+    {
+      uint16_t tier = 1 + (uint64_t) i * 3 / run.numberOfIotDevices;
+      run.processor->AddNodeTierEnergy (tier, Ipv4Address (base + i), run.random->GetInteger (1000, 5000));
+      if (harvesting && i % 2 == 1)
+        {
+          run.processor->SetNodeHarvestProfile (Ipv4Address (base + i), i % 4 == 1 ? east : west);
+        }
+    }
+  Simulator::Schedule (interval, &Batch, &run, interval);
+  Simulator::Stop (Days (days));
+  Simulator::Run ();
+  double runMs = ElapsedMs (start);
+  Simulator::Destroy ();
+  return runMs;
+}
+
+int
+main (int argc, char *argv[])
+{
+  uint32_t numberOfIotDevices = 100000;
+  uint32_t days = 3;
+  uint32_t hopsPerBatch = 10000;
+  Time interval = Minutes (10);
+
+  CommandLine cmd;
+  cmd.AddValue ("numberOfIotDevices", "Number of IOT nodes, split evenly in 3 tiers, one in two harvesting", numberOfIotDevices);
+  cmd.AddValue ("days", "Simulated days", days);
+  cmd.AddValue ("hopsPerBatch", "Transmissions taken from random nodes in every batch", hopsPerBatch);
+  cmd.AddValue ("interval", "Time between two batches", interval);
+  cmd.Parse (argc, argv);
+
+  HarvestRun run;
+  run.numberOfIotDevices = numberOfIotDevices;
+  run.hopsPerBatch = hopsPerBatch;
+  run.batchesPerCheck = std::max<uint32_t> (1, Hours (1).GetNanoSeconds () / interval.GetNanoSeconds ());
+
+  double harvestMs = RunDays (run, true, days, interval);
+  bool consistent = run.consistent;
+  uint32_t events = run.batches;
+  uint32_t checks = run.checks;
+  uint64_t harvested = run.processor->GetTotalEnergyHarvested ();
+  uint64_t consumed = run.processor->GetTotalEnergyConsumed ();
+  run.processor = 0;
+
+  double baselineMs = RunDays (run, false, days, interval);
+  consistent = consistent && run.consistent;
+  run.processor = 0;
+
+  NS_LOG_UNCOND ("[HARVEST] nodes=" << numberOfIotDevices
+                 << " harvesting=" << numberOfIotDevices / 2
+                 << " days=" << days
+                 << " events=" << events
+                 << " events_per_harvesting_node=" << (double) events / std::max<uint32_t> (1, numberOfIotDevices / 2)
+                 << " ranking_checks=" << checks
+                 << " energy_harvested=" << harvested
+                 << " energy_consumed=" << consumed
+                 << " run_ms=" << harvestMs
+                 << " run_ms_without_harvesting=" << baselineMs
+                 << " consistent=" << (consistent ? "yes" : "no"));
+  return consistent ? 0 : 1;
+}
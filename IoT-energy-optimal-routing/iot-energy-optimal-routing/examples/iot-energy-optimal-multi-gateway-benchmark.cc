@@ -0,0 +1,143 @@
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/applications-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/iot-energy-optimal-routing-helper.h"
+#include "ns3/iot-energy-optimal-route-processor.h"
+#include "ns3/iot-abstract-link-helper.h"
+
+// Iot Energy Optimal Routing Multi Gateway Benchmark
+//
+// The IOT nodes are split in 3 tiers and all of them send UDP traffic to an anycast address shared by every gateway.
+// Tier 1 nodes pick the gateway with IotEnergyOptimalRouteProcessor::SelectGateway. All the links of the abstract channel have the
+// same loss, so every gateway keeps the link quality given to AddGateway and the choice follows the load (with Wi-Fi devices,
+// IotLinkMonitor measures the link quality of every Tier 1 node to every gateway).
+// The link layer is IotAbstractLinkChannel with a limited receiver rate, so a single gateway radio is the bottleneck.
+// The benchmark is run for 1, 2, 4 ... maxGateways gateways and prints the aggregate sink throughput of every run.
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("IotEnergyOptimalMultiGatewayBenchmark");
+
+/**
+* Builds the topology with the given number of gateways, runs it and returns the throughput received by all the gateways in bit/s.
+*/
+static double
+RunWithGateways (uint32_t numGateways, uint32_t numberOfIotDevices, DataRate radioRate, DataRate sourceRate,
+                 uint32_t packetSize, double simTime)
+{
+  Ipv4AddressGenerator::Reset ();
+
+  NodeContainer gatewayNodes;
+  gatewayNodes.Create (numGateways);
+  NodeContainer iotNodes;
+  iotNodes.Create (numberOfIotDevices);
+
+  IotAbstractLinkHelper abstractLinkHelper;
+  abstractLinkHelper.SetChannelAttribute ("DataRate", DataRateValue (radioRate));
+  NetDeviceContainer iotDevices = abstractLinkHelper.Install (iotNodes);
+  NetDeviceContainer gatewayDevices = abstractLinkHelper.Install (gatewayNodes, abstractLinkHelper.GetChannel ());
+
+  InternetStackHelper gatewayInternetStackHelper;
+  gatewayInternetStackHelper.Install (gatewayNodes);
+
+  IotEnergyOptimalRoutingHelper iotEnergyOptimalRoutingHelper;
+  Ptr<IotEnergyOptimalRouteProcessor> iotEnergyOptimalRouteProcessor = CreateObject<IotEnergyOptimalRouteProcessor> ();
+  iotEnergyOptimalRouteProcessor->SetAttribute ("Verbose", BooleanValue (false));
+  iotEnergyOptimalRoutingHelper.Set ("RoutingProcessor", PointerValue (iotEnergyOptimalRouteProcessor));
+  iotEnergyOptimalRoutingHelper.Set ("Verbose", BooleanValue (false));
+
+  InternetStackHelper iotNodesInternetStackHelper;
+  iotNodesInternetStackHelper.SetRoutingHelper (iotEnergyOptimalRoutingHelper);
+  iotNodesInternetStackHelper.Install (iotNodes);
+
+  Ipv4Mask mask ("255.192.0.0");
+  Ipv4AddressHelper address;
+  address.SetBase ("10.64.0.0", mask);
+  Ipv4InterfaceContainer gatewayInterfaces = address.Assign (gatewayDevices);
+  Ipv4InterfaceContainer iotInterfaces = address.Assign (iotDevices);
+
+  // Every gateway also owns the anycast address the sources send to
+  Ipv4Address anycastAddress ("10.127.255.254");
+  for (uint32_t g = 0; g < numGateways; g++)
+    {
+      Ptr<Ipv4> ipv4 = gatewayNodes.Get (g)->GetObject<Ipv4> ();
+      ipv4->AddAddress (ipv4->GetInterfaceForDevice (gatewayDevices.Get (g)), Ipv4InterfaceAddress (anycastAddress, mask));
+      iotEnergyOptimalRouteProcessor->AddGateway (gatewayInterfaces.GetAddress (g));
+    }
+
+  // Energy is large enough for no node to run out during the benchmark
+  for (uint32_t i = 0; i < numberOfIotDevices; i++)
+    {
+      uint16_t tier = 1 + (uint64_t) i * 3 / numberOfIotDevices;
+      iotEnergyOptimalRouteProcessor->AddNodeTierEnergy (tier, iotInterfaces.GetAddress (i), 1000000000);
+    }
+
+  PacketSinkHelper sinkHelper ("ns3::UdpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), 9));
+  ApplicationContainer sinks = sinkHelper.Install (gatewayNodes);
+  sinks.Start (Seconds (0.0));
+
+  OnOffHelper sourceHelper ("ns3::UdpSocketFactory", InetSocketAddress (anycastAddress, 9));
+  sourceHelper.SetAttribute ("OnTime", StringValue ("ns3::ConstantRandomVariable[Constant=1]"));
+  sourceHelper.SetAttribute ("OffTime", StringValue ("ns3::ConstantRandomVariable[Constant=0]"));
+  sourceHelper.SetAttribute ("DataRate", DataRateValue (sourceRate));
+  sourceHelper.SetAttribute ("PacketSize", UintegerValue (packetSize));
+  ApplicationContainer sources = sourceHelper.Install (iotNodes);
+  sources.Start (Seconds (1.0));
+  sources.Stop (Seconds (simTime));
+
+  Simulator::Stop (Seconds (simTime));
+  Simulator::Run ();
+
+  uint64_t receivedBytes = 0;
+  std::ostringstream perGateway;
+  for (uint32_t g = 0; g < sinks.GetN (); g++)
+    {
+      uint64_t rx = DynamicCast<PacketSink> (sinks.Get (g))->GetTotalRx ();
+      receivedBytes += rx;
+      perGateway << " " << rx * 8.0 / (simTime - 1.0) / 1e6;
+    }
+  double throughput = receivedBytes * 8.0 / (simTime - 1.0);
+  NS_LOG_UNCOND ("[BENCH]  gateways=" << numGateways << " throughput_Mbps=" << throughput / 1e6
+                 << " per_gateway_Mbps=" << perGateway.str ());
+
+  Simulator::Destroy ();
+  return throughput;
+}
+
+int
+main (int argc, char *argv[])
+{
+  uint32_t numberOfIotDevices = 300;
+  uint32_t maxGateways = 8;
+  std::string radioRate = "1Mbps";
+  std::string sourceRate = "20kbps";
+  uint32_t packetSize = 200;
+  double simTime = 10.0;
+
+  CommandLine cmd;
+  cmd.AddValue ("numberOfIotDevices", "Number of IOT nodes, split evenly in 3 tiers", numberOfIotDevices);
+  cmd.AddValue ("maxGateways", "The benchmark runs with 1, 2, 4 ... maxGateways gateways", maxGateways);
+  cmd.AddValue ("radioRate", "Receive rate of every radio", radioRate);
+  cmd.AddValue ("sourceRate", "Rate of every IOT source", sourceRate);
+  cmd.AddValue ("packetSize", "Size of the packets sent by the sources", packetSize);
+  cmd.AddValue ("simTime", "Simulation time in seconds of every run", simTime);
+  cmd.Parse (argc, argv);
+
+  Config::SetGlobal ("IotRoutingProfileReport", BooleanValue (false));
+
+  double offered = DataRate (sourceRate).GetBitRate () * (double) numberOfIotDevices;
+  NS_LOG_UNCOND ("[BENCH]  offered_load_Mbps=" << offered / 1e6 << " radio_rate=" << radioRate);
+
+  double single = 0.0;
+  for (uint32_t numGateways = 1; numGateways <= maxGateways; numGateways *= 2)
+    {
+      double throughput = RunWithGateways (numGateways, numberOfIotDevices, DataRate (radioRate), DataRate (sourceRate), packetSize, simTime);
+      if (numGateways == 1)
+        {
+          single = throughput;
+        }
+      NS_LOG_UNCOND ("[BENCH]  gateways=" << numGateways << " speedup=" << (single > 0 ? throughput / single : 0.0));
+    }
+  return 0;
+}
@@ -0,0 +1,167 @@
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/applications-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/wifi-module.h"
+#include "ns3/mobility-module.h"
+#include "ns3/iot-energy-optimal-routing-helper.h"
+#include "ns3/iot-energy-optimal-route-processor.h"
+#include "ns3/iot-energy-optimal-routing-stats.h"
+#include "ns3/iot-link-monitor.h"
+#include <sstream>
+#include <cmath>
+
+// Iot Energy Optimal Routing Queue Aware Study
+//
+// IOT nodes on one ad hoc Wi-Fi channel. Tier 3 nodes send bursts (exponential on/off periods) to the gateway; in Tier 2 and
+// Tier 1 the first nodes start with more energy than their peers, so the energy rule keeps sending to them while they queue up.
+// The run is done for every SelectionMode in --modes (Energy, EnergyQueue) and prints the 50th and 99th percentile
+// end-to-end delay of the Tier 3 packets and the delivery ratio.
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("IotEnergyOptimalQueueAwareStudy");
+
+static void
+Run (std::string mode, uint32_t numberOfIotDevices, uint32_t packetSize, std::string burstRate, double queueWeight,
+     double gridSpacing, double simTime)
+{
+  Ipv4AddressGenerator::Reset ();
+
+  NodeContainer gatewayNode;
+  gatewayNode.Create (1);
+  NodeContainer iotNodes;
+  iotNodes.Create (numberOfIotDevices);
+
+  YansWifiChannelHelper channel = YansWifiChannelHelper::Default ();
+  YansWifiPhyHelper phy = YansWifiPhyHelper::Default ();
+  phy.SetChannel (channel.Create ());
+  WifiHelper wifiHelper;
+  wifiHelper.SetStandard (WIFI_PHY_STANDARD_80211b);
+  wifiHelper.SetRemoteStationManager ("ns3::ConstantRateWifiManager",
+                                      "DataMode", StringValue ("DsssRate11Mbps"),
+                                      "ControlMode", StringValue ("DsssRate1Mbps"));
+  WifiMacHelper wifiMacHelper;
+  wifiMacHelper.SetType ("ns3::AdhocWifiMac");
+  NetDeviceContainer iotDevices = wifiHelper.Install (phy, wifiMacHelper, iotNodes);
+  NetDeviceContainer gatewayDevices = wifiHelper.Install (phy, wifiMacHelper, gatewayNode);
+
+  uint32_t gridWidth = (uint32_t) std::ceil (std::sqrt ((double) numberOfIotDevices));
+  MobilityHelper mobilityHelper;
+  mobilityHelper.SetMobilityModel ("ns3::ConstantPositionMobilityModel");
+  mobilityHelper.SetPositionAllocator ("ns3::GridPositionAllocator",
+                                       "DeltaX", DoubleValue (gridSpacing),
+                                       "DeltaY", DoubleValue (gridSpacing),
+                                       "GridWidth", UintegerValue (gridWidth));
+  mobilityHelper.Install (iotNodes);
+  Ptr<ListPositionAllocator> gatewayPosition = CreateObject<ListPositionAllocator> ();
+  gatewayPosition->Add (Vector (gridWidth * gridSpacing / 2, gridWidth * gridSpacing / 2, 0.0));
+  mobilityHelper.SetPositionAllocator (gatewayPosition);
+  mobilityHelper.Install (gatewayNode);
+
+  InternetStackHelper gatewayInternetStackHelper;
+  gatewayInternetStackHelper.Install (gatewayNode);
+
+  Ptr<IotEnergyOptimalRouteProcessor> iotEnergyOptimalRouteProcessor = CreateObject<IotEnergyOptimalRouteProcessor> ();
+  iotEnergyOptimalRouteProcessor->SetAttribute ("Verbose", BooleanValue (false));
+  iotEnergyOptimalRouteProcessor->SetAttribute ("SelectionMode", StringValue (mode));
+  iotEnergyOptimalRouteProcessor->SetAttribute ("QueueWeight", DoubleValue (queueWeight));
+
+  Ptr<IotEnergyOptimalRoutingStats> iotEnergyOptimalRoutingStats = CreateObject<IotEnergyOptimalRoutingStats> ();
+  iotEnergyOptimalRoutingStats->SetAttribute ("RoutingProcessor", PointerValue (iotEnergyOptimalRouteProcessor));
+
+  IotEnergyOptimalRoutingHelper iotEnergyOptimalRoutingHelper;
+  iotEnergyOptimalRoutingHelper.Set ("RoutingProcessor", PointerValue (iotEnergyOptimalRouteProcessor));
+  iotEnergyOptimalRoutingHelper.Set ("Stats", PointerValue (iotEnergyOptimalRoutingStats));
+  iotEnergyOptimalRoutingHelper.Set ("Verbose", BooleanValue (false));
+  iotEnergyOptimalRoutingHelper.Set ("GatewayAddress", Ipv4AddressValue ("10.1.0.1"));
+
+  InternetStackHelper iotNodesInternetStackHelper;
+  iotNodesInternetStackHelper.SetRoutingHelper (iotEnergyOptimalRoutingHelper);
+  iotNodesInternetStackHelper.Install (iotNodes);
+
+  Ipv4AddressHelper address;
+  address.SetBase ("10.1.0.0", "255.255.0.0");
+  Ipv4InterfaceContainer gatewayInterfaces = address.Assign (gatewayDevices);
+  Ipv4InterfaceContainer iotInterfaces = address.Assign (iotDevices);
+
+  // The first relays of a tier have 20000 units more than the next one
+  NodeContainer sources;
+  uint32_t perTier = (numberOfIotDevices + 2) / 3;
+  for (uint32_t i = 0; i < numberOfIotDevices; i++)
+    {
+      uint16_t tier = 1 + (uint64_t) i * 3 / numberOfIotDevices;
+      uint32_t rank = i % perTier;
+      iotEnergyOptimalRouteProcessor->AddNodeTierEnergy (tier, iotInterfaces.GetAddress (i), 1000000 - 20000 * rank);
+      if (tier == 3)
+        {
+          sources.Add (iotNodes.Get (i));
+        }
+    }
+
+  Ptr<IotLinkMonitor> linkMonitor = CreateObject<IotLinkMonitor> ();
+  linkMonitor->SetAttribute ("RoutingProcessor", PointerValue (iotEnergyOptimalRouteProcessor));
+  for (uint32_t i = 0; i < numberOfIotDevices; i++)
+    {
+      linkMonitor->Install (iotInterfaces.GetAddress (i), iotDevices.Get (i));
+    }
+
+  iotEnergyOptimalRoutingStats->InstallSink (gatewayNode.Get (0));
+  PacketSinkHelper sinkHelper ("ns3::UdpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), 9));
+  sinkHelper.Install (gatewayNode);
+
+  OnOffHelper sourceHelper ("ns3::UdpSocketFactory", InetSocketAddress (gatewayInterfaces.GetAddress (0), 9));
+  sourceHelper.SetAttribute ("OnTime", StringValue ("ns3::ExponentialRandomVariable[Mean=0.2]"));
+  sourceHelper.SetAttribute ("OffTime", StringValue ("ns3::ExponentialRandomVariable[Mean=1.8]"));
+  sourceHelper.SetAttribute ("DataRate", DataRateValue (DataRate (burstRate)));
+  sourceHelper.SetAttribute ("PacketSize", UintegerValue (packetSize));
+  ApplicationContainer apps = sourceHelper.Install (sources);
+  apps.Start (Seconds (1.0));
+  apps.Stop (Seconds (simTime - 1.0));
+
+  Simulator::Stop (Seconds (simTime));
+  Simulator::Run ();
+
+  const IotLogHistogram &delay = iotEnergyOptimalRoutingStats->GetTierDelayHistogram (3);
+  NS_LOG_UNCOND ("[QUEUE]  mode=" << mode
+                 << " nodes=" << numberOfIotDevices
+                 << " delivered=" << iotEnergyOptimalRoutingStats->GetDeliveredPackets ()
+                 << " delivery_ratio=" << iotEnergyOptimalRoutingStats->GetDeliveryRatio ()
+                 << " delay_p50_ms=" << delay.GetQuantile (0.5) / 1e3
+                 << " delay_p99_ms=" << delay.GetQuantile (0.99) / 1e3
+                 << " delay_mean_ms=" << delay.GetMean () / 1e3);
+
+  Simulator::Destroy ();
+}
+
+int
+main (int argc, char *argv[])
+{
+  uint32_t numberOfIotDevices = 30;
+  uint32_t packetSize = 512;
+  std::string burstRate = "400kbps";
+  double queueWeight = 0.5;
+  double gridSpacing = 5.0;
+  double simTime = 60.0;
+  std::string modes = "Energy,EnergyQueue";
+
+  CommandLine cmd;
+  cmd.AddValue ("numberOfIotDevices", "Number of IOT nodes, split evenly in 3 tiers", numberOfIotDevices);
+  cmd.AddValue ("packetSize", "Size of the packets sent by the Tier 3 nodes", packetSize);
+  cmd.AddValue ("burstRate", "Sending rate of a Tier 3 node during a burst", burstRate);
+  cmd.AddValue ("queueWeight", "QueueWeight of the EnergyQueue mode", queueWeight);
+  cmd.AddValue ("gridSpacing", "Spacing in meters of the grid of IOT nodes", gridSpacing);
+  cmd.AddValue ("simTime", "Simulation time in seconds of every run", simTime);
+  cmd.AddValue ("modes", "Comma separated list of SelectionMode values to run", modes);
+  cmd.Parse (argc, argv);
+
+  Config::SetGlobal ("IotRoutingProfileReport", BooleanValue (false));
+
+  std::istringstream list (modes);
+  std::string item;
+  while (std::getline (list, item, ','))
+    {
+      Run (item, numberOfIotDevices, packetSize, burstRate, queueWeight, gridSpacing, simTime);
+    }
+  return 0;
+}
@@ -0,0 +1,128 @@
+#include "ns3/core-module.h"
+#include "ns3/iot-energy-optimal-route-processor.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+
+// Iot Energy Optimal Routing Snapshot Benchmark
+//
+// Builds the state of a large network in an IotEnergyOptimalRouteProcessor (--numberOfIotDevices nodes in 3 tiers, random
+// energies, --hops transmissions taken from random nodes, a few aliases, gateways and link estimates), saves it with
+// SaveSnapshot and loads it --loads times into a new processor. Prints the size of the file, the time to save and to load
+// it, and whether the loaded state matches the original one.
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("IotEnergyOptimalSnapshotBenchmark");
+
+static double
+ElapsedMs (std::chrono::steady_clock::time_point start)
+{
+  return std::chrono::duration<double, std::milli> (std::chrono::steady_clock::now () - start).count ();
+}
+
+static bool
+SameState (Ptr<IotEnergyOptimalRouteProcessor> a, Ptr<IotEnergyOptimalRouteProcessor> b, uint32_t numberOfIotDevices,
+           Ptr<UniformRandomVariable> random)
+{
+  if (a->GetNumberOfNodes () != b->GetNumberOfNodes () || a->GetTotalEnergyConsumed () != b->GetTotalEnergyConsumed ())
+    {
+      return false;
+    }
+  for (uint16_t tier = 1; tier <= 3; tier++)
+    {
+      if (a->GetHighestEnergyNodeInTier (tier) != b->GetHighestEnergyNodeInTier (tier)
+          || a->GetTierEnergyPressure (tier) != b->GetTierEnergyPressure (tier)
+          || a->GetRelayCandidates (tier) != b->GetRelayCandidates (tier))
+        {
+          return false;
+        }
+    }
+  for (uint32_t k = 0; k < 10000; k++)
+    {
+      Ipv4Address addr (Ipv4Address ("10.0.0.2").Get () + random->GetInteger (0, numberOfIotDevices - 1));
+      if (a->GetNodeEnergy (addr) != b->GetNodeEnergy (addr) || a->IsNodeAvailable (addr) != b->IsNodeAvailable (addr))
+        {
+          return false;
+        }
+    }
+  return true;
+}
+
+int
+main (int argc, char *argv[])
+{
+  uint32_t numberOfIotDevices = 1000000;
+  uint32_t hops = 1000000;
+  uint32_t loads = 5;
+  std::string path = "iot-energy-optimal-routing.snapshot";
+
+  CommandLine cmd;
+  cmd.AddValue ("numberOfIotDevices", "Number of IOT nodes, split evenly in 3 tiers", numberOfIotDevices);
+  cmd.AddValue ("hops", "Transmissions taken from random nodes before the snapshot", hops);
+  cmd.AddValue ("loads", "Number of times the snapshot is loaded", loads);
+  cmd.AddValue ("path", "Snapshot file", path);
+  cmd.Parse (argc, argv);
+
+  Ptr<UniformRandomVariable> random = CreateObject<UniformRandomVariable> ();
+  Ptr<IotEnergyOptimalRouteProcessor> processor = CreateObject<IotEnergyOptimalRouteProcessor> ();
+  processor->SetAttribute ("Verbose", BooleanValue (false));
+
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+  uint32_t base = Ipv4Address ("10.0.0.2").Get ();
+  for (uint32_t i = 0; i < numberOfIotDevices; i++)
+    {
+      uint16_t tier = 1 + (uint64_t) i * 3 / numberOfIotDevices;
+      processor->AddNodeTierEnergy (tier, Ipv4Address (base + i), random->GetInteger (50000, 100000));
+    }
+  for (uint32_t i = 0; i < 100 && i < numberOfIotDevices; i++)
+    {
+      processor->AddNodeAddress (Ipv4Address (base + i), Ipv4Address (Ipv4Address ("172.16.0.1").Get () + i));
+      processor->SetLinkDelivery (Ipv4Address (base + numberOfIotDevices - 1 - i), Ipv4Address (base + i), random->GetValue (0.2, 1.0));
+      if (i % 10 == 0)
+        {
+          processor->SetNodeAvailable (Ipv4Address (base + numberOfIotDevices / 2 + i), false);
+        }
+    }
+  processor->AddGateway (Ipv4Address ("10.255.0.1"), 1.0);
+  processor->AddGateway (Ipv4Address ("10.255.0.2"), 0.8);
+  for (uint32_t k = 0; k < hops; k++)
+    {
+      processor->ReduceNodeEnergyOnTransitHop (Ipv4Address (base + random->GetInteger (0, numberOfIotDevices - 1)));
+    }
+  double buildMs = ElapsedMs (start);
+
+  start = std::chrono::steady_clock::now ();
+  bool saved = processor->SaveSnapshot (path);
+  double saveMs = ElapsedMs (start);
+  std::ifstream file (path.c_str (), std::ios::binary | std::ios::ate);
+  double fileMb = saved ? file.tellg () / 1e6 : 0.0;
+  file.close ();
+
+  double bestLoadMs = 0.0;
+  double totalLoadMs = 0.0;
+  bool consistent = saved;
+  for (uint32_t l = 0; l < loads && consistent; l++)
+    {
+      Ptr<IotEnergyOptimalRouteProcessor> restored = CreateObject<IotEnergyOptimalRouteProcessor> ();
+      restored->SetAttribute ("Verbose", BooleanValue (false));
+      start = std::chrono::steady_clock::now ();
+      consistent = restored->LoadSnapshot (path);
+      double loadMs = ElapsedMs (start);
+      bestLoadMs = l == 0 ? loadMs : std::min (bestLoadMs, loadMs);
+      totalLoadMs += loadMs;
+      consistent = consistent && SameState (processor, restored, numberOfIotDevices, random);
+    }
+
+  NS_LOG_UNCOND ("[SNAPSHOT] nodes=" << numberOfIotDevices
+                 << " file_MB=" << fileMb
+                 << " build_ms=" << buildMs
+                 << " save_ms=" << saveMs
+                 << " load_ms_best=" << bestLoadMs
+                 << " load_ms_mean=" << (loads ? totalLoadMs / loads : 0.0)
+                 << " consistent=" << (consistent ? "yes" : "no"));
+
+  std::remove (path.c_str ());
+  return consistent ? 0 : 1;
+}
@@ -0,0 +1,190 @@
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/applications-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/wifi-module.h"
+#include "ns3/mobility-module.h"
+#include "ns3/energy-module.h"
+#include "ns3/iot-energy-optimal-routing-helper.h"
+#include "ns3/iot-energy-optimal-route-processor.h"
+#include "ns3/iot-energy-optimal-routing-stats.h"
+#include "ns3/iot-tdma-scheduler.h"
+#include <sstream>
+#include <cmath>
+
+// Iot Energy Optimal Routing TDMA Comparison
+//
+// All the IOT nodes and the gateway share one ad hoc Wi-Fi channel (a single collision domain). Every Tier 3 node sends
+// one reading per interval, all at about the same time, and Tier 2 and Tier 1 relay them to the gateway.
+// The run is done for every mode in --modes:
+//   contention: packets are sent as soon as they are routed (DCF only)
+//   tdma:       packets wait for the slot of the node in the window of its tier (IotTdmaScheduler, one frame per interval)
+// and prints goodput, delivery ratio, delay and the Wi-Fi radio energy per delivered packet.
+// ARP exchanges are not scheduled; they only happen for the first packet to every next hop.
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("IotEnergyOptimalTdmaComparison");
+
+static void
+Run (bool tdma, uint32_t numberOfIotDevices, uint32_t packetSize, double interval, double gridSpacing, double simTime)
+{
+  Ipv4AddressGenerator::Reset ();
+
+  NodeContainer gatewayNode;
+  gatewayNode.Create (1);
+  NodeContainer iotNodes;
+  iotNodes.Create (numberOfIotDevices);
+
+  YansWifiChannelHelper channel = YansWifiChannelHelper::Default ();
+  YansWifiPhyHelper phy = YansWifiPhyHelper::Default ();
+  phy.SetChannel (channel.Create ());
+  WifiHelper wifiHelper;
+  wifiHelper.SetStandard (WIFI_PHY_STANDARD_80211b);
+  wifiHelper.SetRemoteStationManager ("ns3::ConstantRateWifiManager",
+                                      "DataMode", StringValue ("DsssRate11Mbps"),
+                                      "ControlMode", StringValue ("DsssRate1Mbps"));
+  WifiMacHelper wifiMacHelper;
+  wifiMacHelper.SetType ("ns3::AdhocWifiMac");
+  NetDeviceContainer iotDevices = wifiHelper.Install (phy, wifiMacHelper, iotNodes);
+  NetDeviceContainer gatewayDevices = wifiHelper.Install (phy, wifiMacHelper, gatewayNode);
+
+  // Grid around the gateway, small enough for every node to hear every other one
+  uint32_t gridWidth = (uint32_t) std::ceil (std::sqrt ((double) numberOfIotDevices));
+  MobilityHelper mobilityHelper;
+  mobilityHelper.SetMobilityModel ("ns3::ConstantPositionMobilityModel");
+  mobilityHelper.SetPositionAllocator ("ns3::GridPositionAllocator",
+                                       "DeltaX", DoubleValue (gridSpacing),
+                                       "DeltaY", DoubleValue (gridSpacing),
+                                       "GridWidth", UintegerValue (gridWidth));
+  mobilityHelper.Install (iotNodes);
+  Ptr<ListPositionAllocator> gatewayPosition = CreateObject<ListPositionAllocator> ();
+  gatewayPosition->Add (Vector (gridWidth * gridSpacing / 2, gridWidth * gridSpacing / 2, 0.0));
+  mobilityHelper.SetPositionAllocator (gatewayPosition);
+  mobilityHelper.Install (gatewayNode);
+
+  // Wi-Fi radio energy of the IOT nodes, with a source large enough never to run out
+  BasicEnergySourceHelper energySourceHelper;
+  energySourceHelper.Set ("BasicEnergySourceInitialEnergyJ", DoubleValue (1e6));
+  EnergySourceContainer energySources = energySourceHelper.Install (iotNodes);
+  WifiRadioEnergyModelHelper radioEnergyHelper;
+  DeviceEnergyModelContainer radioEnergyModels = radioEnergyHelper.Install (iotDevices, energySources);
+
+  InternetStackHelper gatewayInternetStackHelper;
+  gatewayInternetStackHelper.Install (gatewayNode);
+
+  Ptr<IotEnergyOptimalRouteProcessor> iotEnergyOptimalRouteProcessor = CreateObject<IotEnergyOptimalRouteProcessor> ();
+  iotEnergyOptimalRouteProcessor->SetAttribute ("Verbose", BooleanValue (false));
+
+  Ptr<IotEnergyOptimalRoutingStats> iotEnergyOptimalRoutingStats = CreateObject<IotEnergyOptimalRoutingStats> ();
+  iotEnergyOptimalRoutingStats->SetAttribute ("RoutingProcessor", PointerValue (iotEnergyOptimalRouteProcessor));
+
+  IotEnergyOptimalRoutingHelper iotEnergyOptimalRoutingHelper;
+  iotEnergyOptimalRoutingHelper.Set ("RoutingProcessor", PointerValue (iotEnergyOptimalRouteProcessor));
+  iotEnergyOptimalRoutingHelper.Set ("Stats", PointerValue (iotEnergyOptimalRoutingStats));
+  iotEnergyOptimalRoutingHelper.Set ("Verbose", BooleanValue (false));
+  iotEnergyOptimalRoutingHelper.Set ("GatewayAddress", Ipv4AddressValue ("10.1.0.1"));
+
+  // One frame per reading interval; a slot holds one 11 Mbps frame with its ACK and a retry margin
+  Ptr<IotTdmaScheduler> scheduler;
+  if (tdma)
+    {
+      scheduler = CreateObject<IotTdmaScheduler> ();
+      scheduler->SetAttribute ("PacketSlot", TimeValue (MicroSeconds (1000)));
+      scheduler->SetAttribute ("FramePeriod", TimeValue (Seconds (interval)));
+      iotEnergyOptimalRoutingHelper.Set ("Scheduler", PointerValue (scheduler));
+    }
+
+  InternetStackHelper iotNodesInternetStackHelper;
+  iotNodesInternetStackHelper.SetRoutingHelper (iotEnergyOptimalRoutingHelper);
+  iotNodesInternetStackHelper.Install (iotNodes);
+
+  Ipv4AddressHelper address;
+  address.SetBase ("10.1.0.0", "255.255.0.0");
+  Ipv4InterfaceContainer gatewayInterfaces = address.Assign (gatewayDevices);
+  Ipv4InterfaceContainer iotInterfaces = address.Assign (iotDevices);
+
+  NodeContainer sources;
+  for (uint32_t i = 0; i < numberOfIotDevices; i++)
+    {
+      uint16_t tier = 1 + (uint64_t) i * 3 / numberOfIotDevices;
+      iotEnergyOptimalRouteProcessor->AddNodeTierEnergy (tier, iotInterfaces.GetAddress (i), 1000000000);
+      if (tier == 3)
+        {
+          sources.Add (iotNodes.Get (i));
+        }
+    }
+
+  iotEnergyOptimalRoutingStats->InstallSink (gatewayNode.Get (0));
+  PacketSinkHelper sinkHelper ("ns3::UdpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), 9));
+  ApplicationContainer sinks = sinkHelper.Install (gatewayNode);
+
+  // Readings are taken at the same time on every node, with a few milliseconds of jitter
+  UdpClientHelper sourceHelper (gatewayInterfaces.GetAddress (0), 9);
+  sourceHelper.SetAttribute ("MaxPackets", UintegerValue (1000000));
+  sourceHelper.SetAttribute ("Interval", TimeValue (Seconds (interval)));
+  sourceHelper.SetAttribute ("PacketSize", UintegerValue (packetSize));
+  ApplicationContainer apps = sourceHelper.Install (sources);
+  Ptr<UniformRandomVariable> jitter = CreateObject<UniformRandomVariable> ();
+  jitter->SetAttribute ("Max", DoubleValue (0.01));
+  for (uint32_t i = 0; i < apps.GetN (); i++)
+    {
+      apps.Get (i)->SetStartTime (Seconds (1.0 + jitter->GetValue ()));
+    }
+  apps.Stop (Seconds (simTime - interval));
+
+  Simulator::Stop (Seconds (simTime));
+  Simulator::Run ();
+
+  double energy = 0.0;
+  for (DeviceEnergyModelContainer::Iterator it = radioEnergyModels.Begin (); it != radioEnergyModels.End (); it++)
+    {
+      energy += (*it)->GetTotalEnergyConsumed ();
+    }
+  uint64_t delivered = iotEnergyOptimalRoutingStats->GetDeliveredPackets ();
+  uint64_t rxBytes = DynamicCast<PacketSink> (sinks.Get (0))->GetTotalRx ();
+  const IotLogHistogram &delay = iotEnergyOptimalRoutingStats->GetTierDelayHistogram (3);
+  NS_LOG_UNCOND ("[TDMA]   mode=" << (tdma ? "tdma" : "contention")
+                 << " nodes=" << numberOfIotDevices
+                 << " sources=" << sources.GetN ()
+                 << " delivered=" << delivered
+                 << " delivery_ratio=" << iotEnergyOptimalRoutingStats->GetDeliveryRatio ()
+                 << " goodput_kbps=" << rxBytes * 8.0 / (simTime - 1.0) / 1e3
+                 << " delay_mean_ms=" << delay.GetMean () / 1e3
+                 << " delay_p99_ms=" << delay.GetQuantile (0.99) / 1e3
+                 << " radio_energy_J=" << energy
+                 << " energy_per_packet_mJ=" << (delivered ? energy / delivered * 1e3 : 0.0)
+                 << " frames=" << (scheduler ? scheduler->GetFrames () : 0));
+
+  Simulator::Destroy ();
+}
+
+int
+main (int argc, char *argv[])
+{
+  uint32_t numberOfIotDevices = 1000;
+  uint32_t packetSize = 64;
+  double interval = 2.0;
+  double gridSpacing = 2.0;
+  double simTime = 12.0;
+  std::string modes = "contention,tdma";
+
+  CommandLine cmd;
+  cmd.AddValue ("numberOfIotDevices", "Number of IOT nodes, split evenly in 3 tiers", numberOfIotDevices);
+  cmd.AddValue ("packetSize", "Size of the readings sent by the Tier 3 nodes", packetSize);
+  cmd.AddValue ("interval", "Interval in seconds between readings of a node (and TDMA frame period)", interval);
+  cmd.AddValue ("gridSpacing", "Spacing in meters of the grid of IOT nodes", gridSpacing);
+  cmd.AddValue ("simTime", "Simulation time in seconds of every run", simTime);
+  cmd.AddValue ("modes", "Comma separated list of channel access modes to run: contention, tdma", modes);
+  cmd.Parse (argc, argv);
+
+  Config::SetGlobal ("IotRoutingProfileReport", BooleanValue (false));
+
+  std::istringstream list (modes);
+  std::string item;
+  while (std::getline (list, item, ','))
+    {
+      Run (item == "tdma", numberOfIotDevices, packetSize, interval, gridSpacing, simTime);
+    }
+  return 0;
+}
@@ -0,0 +1,57 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include "iot-abstract-link-helper.h"
+#include "ns3/simple-net-device.h"
+#include "ns3/mac48-address.h"
+#include "ns3/double.h"
+
+namespace ns3 {
+
+IotAbstractLinkHelper::IotAbstractLinkHelper()
+{
+  channelFactory.SetTypeId ("ns3::IotAbstractLinkChannel");
+  deviceFactory.SetTypeId ("ns3::SimpleNetDevice");
+}
+
+void IotAbstractLinkHelper::SetUnitDisk (double range) {
+  channelFactory.Set ("Range", DoubleValue (range));
+}
+
+void IotAbstractLinkHelper::SetFixedLoss (double probability) {
+  channelFactory.Set ("LossProbability", DoubleValue (probability));
+}
+
+void IotAbstractLinkHelper::SetChannelAttribute (std::string name, const AttributeValue &value) {
+  channelFactory.Set (name, value);
+}
+
+void IotAbstractLinkHelper::SetDeviceAttribute (std::string name, const AttributeValue &value) {
+  deviceFactory.Set (name, value);
+}
+
+NetDeviceContainer IotAbstractLinkHelper::Install (NodeContainer nodes) {
+  channel = channelFactory.Create<IotAbstractLinkChannel> ();
+  return Install (nodes, channel);
+}
+
+/*
+* The address is set before the device is attached because the channel indexes devices by MAC address.
+*/
+NetDeviceContainer IotAbstractLinkHelper::Install (NodeContainer nodes, Ptr<IotAbstractLinkChannel> c) {
+  NetDeviceContainer devices;
+  for (NodeContainer::Iterator it = nodes.Begin (); it != nodes.End (); it++)
+    {
+      Ptr<SimpleNetDevice> device = deviceFactory.Create<SimpleNetDevice> ();
+      device->SetAddress (Mac48Address::Allocate ());
+      (*it)->AddDevice (device);
+      device->SetChannel (c);
+      devices.Add (device);
+    }
+  return devices;
+}
+
+Ptr<IotAbstractLinkChannel> IotAbstractLinkHelper::GetChannel (void) const {
+  return channel;
+}
+
+}
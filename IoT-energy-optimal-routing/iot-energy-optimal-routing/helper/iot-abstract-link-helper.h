@@ -0,0 +1,39 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef IOT_ABSTRACT_LINK_HELPER_H
+#define IOT_ABSTRACT_LINK_HELPER_H
+
+#include "ns3/iot-abstract-link-channel.h"
+#include "ns3/object-factory.h"
+#include "ns3/net-device-container.h"
+#include "ns3/node-container.h"
+
+namespace ns3 {
+/*
+* Installs SimpleNetDevices on a shared IotAbstractLinkChannel, as a cheap replacement of YansWifiPhy + AarfWifiManager.
+* The routing protocol is installed as usual through IotEnergyOptimalRoutingHelper, so the same routing code path runs on top.
+*/
+class IotAbstractLinkHelper {
+public:
+	IotAbstractLinkHelper();
+
+  /* Unit disk model: frames only reach devices within range meters. */
+  void SetUnitDisk (double range);
+  /* Fixed loss model: every frame is lost with the given probability. */
+  void SetFixedLoss (double probability);
+  void SetChannelAttribute (std::string name, const AttributeValue &value);
+  void SetDeviceAttribute (std::string name, const AttributeValue &value);
+
+  /* Creates a new channel and attaches one device per node to it. */
+  NetDeviceContainer Install (NodeContainer nodes);
+  NetDeviceContainer Install (NodeContainer nodes, Ptr<IotAbstractLinkChannel> channel);
+  /* The channel created by the last Install (NodeContainer). */
+  Ptr<IotAbstractLinkChannel> GetChannel (void) const;
+
+private:
+  ObjectFactory channelFactory;
+  ObjectFactory deviceFactory;
+  Ptr<IotAbstractLinkChannel> channel;
+};
+}
+
+#endif /* IOT_ABSTRACT_LINK_HELPER_H */
@@ -0,0 +1,212 @@
+#include "iot-routing-core.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Iot Routing Core Benchmark
+//
+// Read throughput of the standalone routing core while it is updated. One writer thread applies batches of --batch updates
+// (transmissions taken from random nodes, queue lengths and link estimates) to a core of --nodes nodes in 3 tiers, as fast as
+// it can; 1, 2, 4, ... up to --maxReaders reader threads choose next hops (SelectNodeInTier, EnergyEtx mode) and look up tiers
+// (GetTier) for --seconds. Every reader count is run twice:
+//   rcu:   each reader holds a RoutingCore::Reader and reads the published View without any lock
+//   mutex: the readers and the writer share the core behind a std::mutex
+// and prints the reads and updates per second and whether every chosen next hop belonged to the requested tier.
+//
+// Usage: iot-routing-core-benchmark [--nodes=N] [--batch=N] [--seconds=S] [--maxReaders=N]
+
+using namespace iotrouting;
+
+static uint32_t g_base = (10u << 24) | 2;
+static std::chrono::steady_clock::time_point g_start = std::chrono::steady_clock::now ();
+
+static int64_t
+NowNs (void)
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds> (std::chrono::steady_clock::now () - g_start).count ();
+}
+
+static void
+Build (RoutingCore &core, uint32_t nodes)
+{
+  core.GetConfig ().selectionMode = RoutingCore::SELECT_ENERGY_ETX;
+  std::mt19937 random (1);
+  for (uint32_t i = 0; i < nodes; i++)
+    {
+      uint16_t tier = 1 + (uint64_t) i * 3 / nodes;
+      core.AddNode (tier, g_base + i, 1000000000u + random () % 1000000, NowNs ());
+    }
+  core.Publish (NowNs ());
+}
+
+static void
+MakeBatch (std::vector<RoutingCore::Update> &batch, uint32_t size, uint32_t nodes, std::mt19937 &random)
+{
+  batch.resize (size);
+  for (uint32_t i = 0; i < size; i++)
+    {
+      RoutingCore::Update &update = batch[i];
+      update.addr = g_base + random () % nodes;
+      update.peer = g_base + random () % nodes;
+      update.value = random () % 8;
+      update.estimate = 0.2 + (random () % 800) / 1000.0;
+      uint32_t kind = random () % 10;
+      update.type = kind < 8 ? RoutingCore::Update::CONSUME_HOP
+        : kind == 8 ? RoutingCore::Update::SET_QUEUE : RoutingCore::Update::SET_LINK_DELIVERY;
+    }
+}
+
+struct Run
+{
+  uint64_t reads;
+  uint64_t updates;
+  bool consistent;
+};
+
+static Run
+RunReaders (bool lockFree, uint32_t readers, uint32_t nodes, uint32_t batchSize, double seconds)
+{
+  RoutingCore core;
+  Build (core, nodes);
+  std::mutex lock;
+  std::atomic<bool> stop (false);
+  std::atomic<uint64_t> reads (0);
+  std::atomic<bool> consistent (true);
+  uint64_t updates = 0;
+
+  std::vector<std::thread> threads;
+  for (uint32_t r = 0; r < readers; r++)
+    {
+      threads.push_back (std::thread ([&, r] ()
+        {
+          std::mt19937 random (100 + r);
+          uint64_t n = 0;
+          bool ok = true;
+          if (lockFree)
+            {
+              RoutingCore::Reader reader (core);
+              while (!stop.load (std::memory_order_relaxed))
+                {
+                  uint32_t from = g_base + random () % nodes;
+                  uint16_t tier = reader.GetTier (from);
+                  uint32_t next = tier > 1 ? reader.SelectNodeInTier (tier - 1, from) : 0;
+                  ok = ok && (next == 0 || reader.GetTier (next) == tier - 1);
+                  n++;
+                }
+            }
+          else
+            {
+              while (!stop.load (std::memory_order_relaxed))
+                {
+                  uint32_t from = g_base + random () % nodes;
+                  std::lock_guard<std::mutex> guard (lock);
+                  uint16_t tier = core.GetTier (from);
+                  uint32_t next = tier > 1 ? core.SelectNodeInTier (tier - 1, from, NowNs ()) : 0;
+                  ok = ok && (next == 0 || core.GetTier (next) == tier - 1);
+                  n++;
+                }
+            }
+          reads += n;
+          if (!ok)
+            {
+              consistent = false;
+            }
+        }));
+    }
+
+  std::mt19937 random (7);
+  std::vector<RoutingCore::Update> batch;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+  std::chrono::duration<double> limit (seconds);
+  while (std::chrono::steady_clock::now () - start < limit)
+    {
+      MakeBatch (batch, batchSize, nodes, random);
+      if (lockFree)
+        {
+          core.ApplyUpdates (batch, NowNs ());
+        }
+      else
+        {
+          std::lock_guard<std::mutex> guard (lock);
+          core.ApplyUpdates (batch, NowNs ());
+        }
+      updates += batch.size ();
+    }
+  stop = true;
+  for (uint32_t r = 0; r < threads.size (); r++)
+    {
+      threads[r].join ();
+    }
+  Run run = { reads.load (), updates, consistent.load () };
+  return run;
+}
+
+int
+main (int argc, char *argv[])
+{
+  uint32_t nodes = 30000;
+  uint32_t batchSize = 64;
+  double seconds = 1.0;
+  // hardware_concurrency is 0 when unknown
+  unsigned hc = std::thread::hardware_concurrency ();
+  uint32_t maxReaders = hc > 1 ? hc - 1 : 1;
+
+  for (int i = 1; i < argc; i++)
+    {
+      std::string arg (argv[i]);
+      std::string::size_type eq = arg.find ('=');
+      std::string name = arg.substr (0, eq);
+      const char *value = eq == std::string::npos ? "" : argv[i] + eq + 1;
+      if (name == "--nodes")
+        {
+          nodes = std::strtoul (value, 0, 10);
+        }
+      else if (name == "--batch")
+        {
+          batchSize = std::strtoul (value, 0, 10);
+        }
+      else if (name == "--seconds")
+        {
+          seconds = std::strtod (value, 0);
+        }
+      else if (name == "--maxReaders")
+        {
+          maxReaders = std::strtoul (value, 0, 10);
+        }
+      else
+        {
+          std::fprintf (stderr, "Usage: %s [--nodes=N] [--batch=N] [--seconds=S] [--maxReaders=N]\n", argv[0]);
+          return 2;
+        }
+    }
+  if (nodes < 3 || batchSize == 0 || maxReaders == 0 || maxReaders > RoutingCore::MAX_READERS)
+    {
+      std::fprintf (stderr, "Need at least 3 nodes, a batch and 1 to %u readers\n", RoutingCore::MAX_READERS);
+      return 2;
+    }
+
+  bool consistent = true;
+  for (uint32_t readers = 1; readers <= maxReaders; readers = readers < maxReaders && readers * 2 > maxReaders ? maxReaders : readers * 2)
+    {
+      for (int lockFree = 1; lockFree >= 0; lockFree--)
+        {
+          Run run = RunReaders (lockFree, readers, nodes, batchSize, seconds);
+          consistent = consistent && run.consistent;
+          std::printf ("[CORE] mode=%s readers=%u nodes=%u batch=%u reads_per_s=%.0f reads_per_s_per_reader=%.0f updates_per_s=%.0f consistent=%s\n",
+                       lockFree ? "rcu" : "mutex", readers, nodes, batchSize, run.reads / seconds, run.reads / seconds / readers,
+                       run.updates / seconds, run.consistent ? "yes" : "no");
+        }
+      if (readers == maxReaders)
+        {
+          break;
+        }
+    }
+  return consistent ? 0 : 1;
+}
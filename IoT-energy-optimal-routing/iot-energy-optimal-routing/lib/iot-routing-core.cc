@@ -0,0 +1,1943 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include "iot-routing-core.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace iotrouting {
+
+const uint32_t RoutingCore::HOP_ENERGY_COST;
+const uint32_t RoutingCore::MAX_READERS;
+
+/*
+* State published to the Readers. It is never modified once published: the candidates of every tier (the first
+* SelectionCandidates nodes of its ranking with energy left, at least two for the backup, queue included) with the estimates of the links into them, the
+* failed links, the pressures, and the tier of every address, shared between Views until it changes.
+*/
+class RoutingCore::View
+{
+public:
+  struct Candidate
+  {
+    uint32_t addr;
+    uint32_t energy;
+    uint32_t queue;
+  };
+
+  uint64_t version;
+  Config config;
+  /* Indexed by tier. */
+  std::vector<std::vector<Candidate> > candidates;
+  /* Indexed by tier, the last entry holds for all the higher tiers. */
+  std::vector<double> pathPressure;
+  std::shared_ptr<const std::vector<std::pair<uint32_t, uint16_t> > > membership;
+  /* Estimates of the links into the candidates, keyed to << 32 | from. */
+  std::vector<std::pair<uint64_t, double> > links;
+  /* Failed links, keyed the same way. */
+  std::vector<uint64_t> failedLinks;
+};
+
+namespace {
+
+bool
+AddressLess (const std::pair<uint32_t, uint16_t> &entry, uint32_t addr)
+{
+  return entry.first < addr;
+}
+
+bool
+LinkLess (const std::pair<uint64_t, double> &entry, uint64_t link)
+{
+  return entry.first < link;
+}
+
+/* Score of a candidate; the same for the writer and the Readers so both make the same choice. */
+double
+CandidateScore (const RoutingCore::Config &config, uint32_t energy, uint32_t queue, double expectedEnergy)
+{
+  if (config.selectionMode == RoutingCore::SELECT_ENERGY_QUEUE)
+    {
+      return energy / (1.0 + config.queueWeight * queue);
+    }
+  return energy / expectedEnergy;
+}
+
+}
+
+HarvestProfile::HarvestProfile ()
+  : m_kind (DIURNAL),
+    m_capacity (0),
+    m_period (0.0),
+    m_peakPower (0.0),
+    m_sunrise (0.0),
+    m_daylight (0.0),
+    m_perPeriod (0.0)
+{}
+
+HarvestProfile
+HarvestProfile::Diurnal (double peakPower, double sunrise, double daylight, uint32_t capacity, double period)
+{
+  HarvestProfile profile;
+  profile.m_kind = DIURNAL;
+  profile.m_capacity = capacity;
+  profile.m_period = period;
+  profile.m_peakPower = peakPower;
+  profile.m_sunrise = sunrise;
+  profile.m_daylight = daylight;
+  profile.m_perPeriod = peakPower * daylight * 2 / M_PI;
+  return profile;
+}
+
+/*
+* The energy harvested from the start of the period is accumulated at every sample (trapezoids), so GetHarvested only
+* integrates the segment it falls in.
+*/
+HarvestProfile
+HarvestProfile::Trace (const std::vector<std::pair<double, double> > &samples, uint32_t capacity)
+{
+  HarvestProfile profile;
+  profile.m_kind = TRACE;
+  profile.m_capacity = capacity;
+  profile.m_samples = samples;
+  if (!samples.empty ())
+    {
+      profile.m_period = samples.back ().first;
+      profile.m_cumulative.push_back (0.0);
+      for (uint32_t i = 1; i < samples.size (); i++)
+        {
+          profile.m_cumulative.push_back (profile.m_cumulative.back ()
+                                          + (samples[i].first - samples[i - 1].first) * (samples[i].second + samples[i - 1].second) / 2);
+        }
+      profile.m_perPeriod = profile.m_cumulative.back ();
+    }
+  return profile;
+}
+
+bool
+HarvestProfile::LoadTrace (const std::string &path, uint32_t capacity, HarvestProfile &profile)
+{
+  std::ifstream is (path.c_str ());
+  if (!is)
+    {
+      return false;
+    }
+  std::vector<std::pair<double, double> > samples;
+  std::string line;
+  while (std::getline (is, line))
+    {
+      line = line.substr (0, line.find ('#'));
+      if (line.find_first_not_of (" \t\r") == std::string::npos)
+        {
+          continue;
+        }
+      std::istringstream fields (line);
+      std::pair<double, double> sample;
+      if (!(fields >> sample.first >> sample.second))
+        {
+          return false;
+        }
+      samples.push_back (sample);
+    }
+  profile = Trace (samples, capacity);
+  return profile.IsValid ();
+}
+
+bool
+HarvestProfile::IsValid (void) const
+{
+  if (m_capacity == 0 || !(m_period > 0))
+    {
+      return false;
+    }
+  if (m_kind == DIURNAL)
+    {
+      return m_peakPower >= 0 && m_sunrise >= 0 && m_daylight > 0 && m_sunrise + m_daylight <= m_period;
+    }
+  if (m_samples.size () < 2 || m_samples[0].first != 0)
+    {
+      return false;
+    }
+  for (uint32_t i = 0; i < m_samples.size (); i++)
+    {
+      if (!(m_samples[i].second >= 0) || (i > 0 && !(m_samples[i].first > m_samples[i - 1].first)))
+        {
+          return false;
+        }
+    }
+  return true;
+}
+
+HarvestProfile::Kind
+HarvestProfile::GetKind (void) const
+{
+  return m_kind;
+}
+
+uint32_t
+HarvestProfile::GetCapacity (void) const
+{
+  return m_capacity;
+}
+
+double
+HarvestProfile::GetPeriod (void) const
+{
+  return m_period;
+}
+
+double
+HarvestProfile::GetPeakPower (void) const
+{
+  return m_peakPower;
+}
+
+double
+HarvestProfile::GetSunrise (void) const
+{
+  return m_sunrise;
+}
+
+double
+HarvestProfile::GetDaylight (void) const
+{
+  return m_daylight;
+}
+
+const std::vector<std::pair<double, double> > &
+HarvestProfile::GetSamples (void) const
+{
+  return m_samples;
+}
+
+/*
+* Whole periods, then the part of the last one: the integral of the half sine, or of the linear segment of the trace.
+*/
+double
+HarvestProfile::GetHarvested (int64_t nowNs) const
+{
+  double t = nowNs / 1e9;
+  if (!(t > 0) || !(m_period > 0))
+    {
+      return 0.0;
+    }
+  double periods = std::floor (t / m_period);
+  double x = t - periods * m_period;
+  double harvested = periods * m_perPeriod;
+  if (m_kind == DIURNAL)
+    {
+      if (x > m_sunrise)
+        {
+          double d = std::min (x - m_sunrise, m_daylight);
+          harvested += m_peakPower * m_daylight / M_PI * (1 - std::cos (M_PI * d / m_daylight));
+        }
+      return harvested;
+    }
+  uint32_t j = std::upper_bound (m_samples.begin (), m_samples.end (), std::make_pair (x, std::numeric_limits<double>::max ()))
+    - m_samples.begin () - 1;
+  j = std::min<uint32_t> (j, m_samples.size () - 2);
+  double dx = x - m_samples[j].first;
+  double slope = (m_samples[j + 1].second - m_samples[j].second) / (m_samples[j + 1].first - m_samples[j].first);
+  return harvested + m_cumulative[j] + m_samples[j].second * dx + slope * dx * dx / 2;
+}
+
+RoutingCore::Config::Config ()
+  : relayCandidates (2),
+    selectionMode (SELECT_ENERGY),
+    selectionCandidates (4),
+    queueWeight (1.0),
+    minLinkDelivery (0.01),
+    pressureLevels (20),
+    gatewayLoadTimeConstant (1.0)
+{}
+
+RoutingCore::Listener::~Listener ()
+{}
+
+void
+RoutingCore::Listener::NodeEnergyDepleted (uint32_t addr)
+{}
+
+void
+RoutingCore::Listener::RelayCandidatesChanged (uint16_t tier)
+{}
+
+void
+RoutingCore::Listener::EnergyPressureChanged (uint16_t tier, double pressure)
+{}
+
+RoutingCore::RoutingCore ()
+  : m_listener (0),
+    m_totalEnergyConsumed (0),
+    m_totalEnergyHarvested (0),
+    m_view (0),
+    m_epoch (1),
+    m_version (0),
+    m_membershipChanged (true)
+{
+  for (uint32_t i = 0; i < MAX_READERS; i++)
+    {
+      m_slots[i].epoch.store (0);
+      m_slots[i].used.store (false);
+    }
+}
+
+/*
+* No Reader may be left at this point.
+*/
+RoutingCore::~RoutingCore ()
+{
+  delete m_view.load ();
+  for (uint32_t i = 0; i < m_retired.size (); i++)
+    {
+      delete m_retired[i].second;
+    }
+}
+
+RoutingCore::Config &
+RoutingCore::GetConfig (void)
+{
+  return m_config;
+}
+
+const RoutingCore::Config &
+RoutingCore::GetConfig (void) const
+{
+  return m_config;
+}
+
+void
+RoutingCore::SetListener (Listener *listener)
+{
+  m_listener = listener;
+}
+
+bool
+RoutingCore::AddNode (uint16_t tier, uint32_t addr, uint32_t energy, int64_t nowNs)
+{
+  if (tier == 0 || m_nodes.find (addr) != m_nodes.end ())
+    {
+      return false;
+    }
+  NodeState state;
+  state.tier = tier;
+  state.energy = energy;
+  state.available = true;
+  state.queue = 0;
+  state.profile = 0;
+  state.harvestOffset = 0.0;
+  m_nodes.insert (std::make_pair (addr, state));
+  m_tierRankings[tier].insert (std::make_pair (energy, addr));
+  UpdateRelayCandidates (tier, nowNs);
+  m_tierEnergy[tier].initial += energy;
+  UpdateTierPressure (tier);
+  m_membershipChanged = true;
+  return true;
+}
+
+uint32_t
+RoutingCore::AddHarvestProfile (const HarvestProfile &profile)
+{
+  if (!profile.IsValid ())
+    {
+      return 0;
+    }
+  m_profiles.push_back (profile);
+  return m_profiles.size ();
+}
+
+const HarvestProfile *
+RoutingCore::GetHarvestProfile (uint32_t profile) const
+{
+  return profile == 0 || profile > m_profiles.size () ? 0 : &m_profiles[profile - 1];
+}
+
+/*
+* The energy harvested so far with the previous profile is kept (with its fraction of a unit), the part above the capacity of
+* the new one is lost.
+*/
+bool
+RoutingCore::SetNodeHarvestProfile (uint32_t addr, uint32_t profile, int64_t nowNs)
+{
+  std::map<uint32_t, NodeState>::iterator it = m_nodes.find (addr);
+  if (it == m_nodes.end () || profile > m_profiles.size ())
+    {
+      return false;
+    }
+  NodeState &state = it->second;
+  Harvest (addr, state, nowNs);
+  if (state.profile == profile)
+    {
+      return true;
+    }
+  double current = state.profile ? state.harvestOffset + m_profiles[state.profile - 1].GetHarvested (nowNs) : state.energy;
+  if (state.available)
+    {
+      Unrank (addr, state);
+    }
+  state.profile = profile;
+  state.harvestOffset = profile ? current - m_profiles[profile - 1].GetHarvested (nowNs) : 0.0;
+  if (state.available)
+    {
+      Rank (addr, state);
+    }
+  if (profile && state.energy > m_profiles[profile - 1].GetCapacity ())
+    {
+      ChangeEnergy (addr, state, m_profiles[profile - 1].GetCapacity (), nowNs);
+    }
+  else if (state.available)
+    {
+      UpdateRelayCandidates (state.tier, nowNs);
+    }
+  return true;
+}
+
+uint32_t
+RoutingCore::CurrentEnergy (const NodeState &state, int64_t nowNs) const
+{
+  if (state.profile == 0)
+    {
+      return state.energy;
+    }
+  const HarvestProfile &profile = m_profiles[state.profile - 1];
+  double energy = std::min<double> (profile.GetCapacity (), state.harvestOffset + profile.GetHarvested (nowNs));
+  return energy > 0 ? (uint32_t) energy : 0;
+}
+
+void
+RoutingCore::Rank (uint32_t addr, const NodeState &state)
+{
+  if (state.profile == 0)
+    {
+      m_tierRankings[state.tier].insert (std::make_pair (state.energy, addr));
+    }
+  else
+    {
+      m_tierHarvestRankings[state.tier][state.profile].insert (std::make_pair (state.harvestOffset, addr));
+    }
+}
+
+/*
+* Empty harvest rankings are removed, so a tier without harvesting nodes keeps the single ranking fast path of GetTierTop.
+*/
+void
+RoutingCore::Unrank (uint32_t addr, const NodeState &state)
+{
+  if (state.profile == 0)
+    {
+      m_tierRankings[state.tier].erase (std::make_pair (state.energy, addr));
+      return;
+    }
+  std::map<uint16_t, std::map<uint32_t, HarvestRanking> >::iterator tier = m_tierHarvestRankings.find (state.tier);
+  if (tier == m_tierHarvestRankings.end ())
+    {
+      return;
+    }
+  std::map<uint32_t, HarvestRanking>::iterator ranking = tier->second.find (state.profile);
+  if (ranking == tier->second.end ())
+    {
+      return;
+    }
+  ranking->second.erase (std::make_pair (state.harvestOffset, addr));
+  if (ranking->second.empty ())
+    {
+      tier->second.erase (ranking);
+      if (tier->second.empty ())
+        {
+          m_tierHarvestRankings.erase (tier);
+        }
+    }
+}
+
+/*
+* Adds the energy harvested since the node was last changed to its energy (and takes it off the energy spent by its tier).
+* The offset only changes when the battery is full, the harvest above the capacity being lost.
+*/
+void
+RoutingCore::Harvest (uint32_t addr, NodeState &state, int64_t nowNs)
+{
+  if (state.profile == 0)
+    {
+      return;
+    }
+  const HarvestProfile &profile = m_profiles[state.profile - 1];
+  double harvested = profile.GetHarvested (nowNs);
+  double current = std::min<double> (profile.GetCapacity (), state.harvestOffset + harvested);
+  double offset = current - harvested;
+  if (offset != state.harvestOffset)
+    {
+      if (state.available)
+        {
+          Unrank (addr, state);
+        }
+      state.harvestOffset = offset;
+      if (state.available)
+        {
+          Rank (addr, state);
+        }
+    }
+  uint32_t energy = current > 0 ? (uint32_t) current : 0;
+  if (energy > state.energy)
+    {
+      TierEnergy &tierEnergy = m_tierEnergy[state.tier];
+      tierEnergy.spent -= std::min<uint64_t> (tierEnergy.spent, energy - state.energy);
+      m_totalEnergyHarvested += energy - state.energy;
+      state.energy = energy;
+      UpdateTierPressure (state.tier);
+    }
+}
+
+/*
+* Merges the ranking of the nodes without harvesting with the ranking of every harvest profile of the tier; each of them is
+* already in energy order, so only the heads are evaluated. Ties go to the nodes without harvesting, then to the lower profile.
+* Failed nodes are passed over.
+*/
+void
+RoutingCore::GetTierTop (uint16_t tier, uint32_t count, int64_t nowNs, std::vector<RankedNode> &top) const
+{
+  static const TierRanking noRanking;
+  top.clear ();
+  std::map<uint16_t, TierRanking>::const_iterator fixed = m_tierRankings.find (tier);
+  const TierRanking &ranking = fixed == m_tierRankings.end () ? noRanking : fixed->second;
+  std::map<uint16_t, std::map<uint32_t, HarvestRanking> >::const_iterator harvesting = m_tierHarvestRankings.find (tier);
+  if (harvesting == m_tierHarvestRankings.end ())
+    {
+      for (TierRanking::const_iterator it = ranking.begin (); it != ranking.end () && top.size () < count && it->first > 0; it++)
+        {
+          if (m_failedNodes.empty () || m_failedNodes.find (it->second) == m_failedNodes.end ())
+            {
+              top.push_back (*it);
+            }
+        }
+      return;
+    }
+
+  struct Cursor
+  {
+    HarvestRanking::const_iterator it;
+    HarvestRanking::const_iterator end;
+    double harvested;
+    double capacity;
+  };
+  std::vector<Cursor> cursors;
+  for (std::map<uint32_t, HarvestRanking>::const_iterator it = harvesting->second.begin (); it != harvesting->second.end (); it++)
+    {
+      const HarvestProfile &profile = m_profiles[it->first - 1];
+      Cursor cursor = { it->second.begin (), it->second.end (), profile.GetHarvested (nowNs), (double) profile.GetCapacity () };
+      cursors.push_back (cursor);
+    }
+  TierRanking::const_iterator head = ranking.begin ();
+  while (top.size () < count)
+    {
+      int best = -2;
+      RankedNode node (0, 0);
+      if (head != ranking.end ())
+        {
+          best = -1;
+          node = *head;
+        }
+      for (uint32_t i = 0; i < cursors.size (); i++)
+        {
+          if (cursors[i].it != cursors[i].end)
+            {
+              double current = std::min (cursors[i].capacity, cursors[i].it->first + cursors[i].harvested);
+              uint32_t energy = current > 0 ? (uint32_t) current : 0;
+              if (best == -2 || energy > node.first)
+                {
+                  best = i;
+                  node = RankedNode (energy, cursors[i].it->second);
+                }
+            }
+        }
+      if (best == -2 || node.first == 0)
+        {
+          break;
+        }
+      if (m_failedNodes.empty () || m_failedNodes.find (node.second) == m_failedNodes.end ())
+        {
+          top.push_back (node);
+        }
+      if (best == -1)
+        {
+          head++;
+        }
+      else
+        {
+          cursors[best].it++;
+        }
+    }
+}
+
+uint32_t
+RoutingCore::GetHighestEnergyNodeInTier (uint16_t tier, int64_t nowNs) const
+{
+  GetTierTop (tier, 1, nowNs, m_top);
+  return m_top.empty () ? 0 : m_top[0].second;
+}
+
+/*
+* EnergyQueue and EnergyEtx: only the first SelectionCandidates nodes of the tier are scored, ties go to the higher energy node.
+*/
+uint32_t
+RoutingCore::SelectNodeInTier (uint16_t tier, uint32_t from, int64_t nowNs) const
+{
+  if (m_config.selectionMode == SELECT_ENERGY && m_failedLinks.empty ())
+    {
+      return GetHighestEnergyNodeInTier (tier, nowNs);
+    }
+  uint32_t backup;
+  return SelectNodeInTier (tier, from, nowNs, backup);
+}
+
+/*
+* The backup is the best scored of the other candidates, or the next node of the ranking when there is a single candidate
+* (Energy mode), so it costs one more ranking entry than the selection alone. Nodes the link from the sender to has failed are
+* passed over, with one more entry read while there are failed links so the backup survives them.
+*/
+uint32_t
+RoutingCore::SelectNodeInTier (uint16_t tier, uint32_t from, int64_t nowNs, uint32_t &backup) const
+{
+  uint32_t candidates = m_config.selectionMode == SELECT_ENERGY ? 1 : m_config.selectionCandidates;
+  GetTierTop (tier, std::max<uint32_t> (2, candidates) + (m_failedLinks.empty () ? 0 : 1), nowNs, m_top);
+  uint32_t best = 0;
+  double bestScore = -1.0;
+  double backupScore = -1.0;
+  backup = 0;
+  uint32_t scored = 0;
+  for (uint32_t i = 0; i < m_top.size (); i++)
+    {
+      if (!m_failedLinks.empty () && m_failedLinks.find (std::make_pair (m_top[i].second, from)) != m_failedLinks.end ())
+        {
+          continue;
+        }
+      double score = m_top[i].first;
+      if (m_config.selectionMode != SELECT_ENERGY)
+        {
+          std::map<uint32_t, NodeState>::const_iterator node = m_nodes.find (m_top[i].second);
+          score = CandidateScore (m_config, m_top[i].first, node->second.queue,
+                                  m_config.selectionMode == SELECT_ENERGY_ETX ? GetExpectedEnergyPerDeliveredPacket (from, m_top[i].second) : 0.0);
+        }
+      if (scored++ < candidates && score > bestScore)
+        {
+          backup = best;
+          backupScore = bestScore;
+          best = m_top[i].second;
+          bestScore = score;
+        }
+      else if (score > backupScore)
+        {
+          backup = m_top[i].second;
+          backupScore = score;
+        }
+    }
+  return best;
+}
+
+bool
+RoutingCore::SetNodeQueue (uint32_t addr, uint32_t packets)
+{
+  std::map<uint32_t, NodeState>::iterator it = m_nodes.find (addr);
+  if (it == m_nodes.end ())
+    {
+      return false;
+    }
+  it->second.queue = packets;
+  return true;
+}
+
+uint32_t
+RoutingCore::GetNodeQueue (uint32_t addr) const
+{
+  std::map<uint32_t, NodeState>::const_iterator it = m_nodes.find (addr);
+  return it == m_nodes.end () ? 0 : it->second.queue;
+}
+
+void
+RoutingCore::SetLinkDelivery (uint32_t from, uint32_t to, double delivery)
+{
+  m_linkDelivery[std::make_pair (to, from)] = delivery;
+}
+
+double
+RoutingCore::GetLinkDelivery (uint32_t from, uint32_t to) const
+{
+  std::map<std::pair<uint32_t, uint32_t>, double>::const_iterator it = m_linkDelivery.find (std::make_pair (to, from));
+  return it == m_linkDelivery.end () ? 1.0 : it->second;
+}
+
+double
+RoutingCore::GetExpectedEnergyPerDeliveredPacket (uint32_t from, uint32_t to) const
+{
+  double delivery = 1.0;
+  if (!m_linkDelivery.empty ())
+    {
+      std::map<std::pair<uint32_t, uint32_t>, double>::const_iterator it = m_linkDelivery.find (std::make_pair (to, from));
+      if (it != m_linkDelivery.end ())
+        {
+          delivery = std::max (it->second, m_config.minLinkDelivery);
+        }
+    }
+  return HOP_ENERGY_COST / delivery;
+}
+
+uint16_t
+RoutingCore::GetTier (uint32_t addr) const
+{
+  std::map<uint32_t, NodeState>::const_iterator it = m_nodes.find (addr);
+  if (it == m_nodes.end ())
+    {
+      std::map<uint32_t, uint32_t>::const_iterator alias = m_aliases.find (addr);
+      if (alias == m_aliases.end ())
+        {
+          return 0;
+        }
+      it = m_nodes.find (alias->second);
+      if (it == m_nodes.end ())
+        {
+          return 0;
+        }
+    }
+  return it->second.tier;
+}
+
+void
+RoutingCore::ConsumeHop (uint32_t addr, int64_t nowNs)
+{
+  std::map<uint32_t, NodeState>::iterator it = m_nodes.find (addr);
+  if (it == m_nodes.end ())
+    {
+      return;
+    }
+  Harvest (addr, it->second, nowNs);
+  uint32_t cost = std::min (it->second.energy, HOP_ENERGY_COST);
+  if (cost > 0)
+    {
+      m_totalEnergyConsumed += cost;
+      ChangeEnergy (addr, it->second, it->second.energy - cost, nowNs);
+    }
+}
+
+/*
+* A harvesting node cannot hold more than the capacity of its profile.
+*/
+bool
+RoutingCore::SetNodeEnergy (uint32_t addr, uint32_t energy, int64_t nowNs)
+{
+  std::map<uint32_t, NodeState>::iterator it = m_nodes.find (addr);
+  if (it == m_nodes.end ())
+    {
+      return false;
+    }
+  Harvest (addr, it->second, nowNs);
+  if (it->second.profile)
+    {
+      energy = std::min (energy, m_profiles[it->second.profile - 1].GetCapacity ());
+    }
+  ChangeEnergy (addr, it->second, energy, nowNs);
+  return true;
+}
+
+/*
+* Moves the node in the ranking of its tier (unavailable nodes are not in the ranking) and accounts the change in the energy spent
+* by the tier. The energy of a harvesting node is up to date (Harvest) and its offset moves with it. NodeEnergyDepleted is notified
+* when the energy reaches zero.
+*/
+void
+RoutingCore::ChangeEnergy (uint32_t addr, NodeState &state, uint32_t energy, int64_t nowNs)
+{
+  uint32_t previous = state.energy;
+  if (energy == previous)
+    {
+      return;
+    }
+  if (state.available)
+    {
+      Unrank (addr, state);
+    }
+  state.energy = energy;
+  if (state.profile)
+    {
+      state.harvestOffset += (double) energy - previous;
+    }
+  if (state.available)
+    {
+      Rank (addr, state);
+      UpdateRelayCandidates (state.tier, nowNs);
+    }
+  TierEnergy &tierEnergy = m_tierEnergy[state.tier];
+  if (energy < previous)
+    {
+      tierEnergy.spent += previous - energy;
+    }
+  else
+    {
+      tierEnergy.spent -= std::min<uint64_t> (tierEnergy.spent, energy - previous);
+    }
+  UpdateTierPressure (state.tier);
+  if (energy == 0 && m_listener)
+    {
+      m_listener->NodeEnergyDepleted (addr);
+    }
+}
+
+uint32_t
+RoutingCore::GetNodeEnergy (uint32_t addr, int64_t nowNs) const
+{
+  std::map<uint32_t, NodeState>::const_iterator it = m_nodes.find (addr);
+  return it == m_nodes.end () ? 0 : CurrentEnergy (it->second, nowNs);
+}
+
+uint64_t
+RoutingCore::GetTotalEnergyConsumed (void) const
+{
+  return m_totalEnergyConsumed;
+}
+
+uint64_t
+RoutingCore::GetTotalEnergyHarvested (void) const
+{
+  return m_totalEnergyHarvested;
+}
+
+/*
+* An unavailable node keeps its tier and energy but is removed from the ranking of its tier, so it is never selected as next hop.
+*/
+bool
+RoutingCore::SetNodeAvailable (uint32_t addr, bool available, int64_t nowNs)
+{
+  std::map<uint32_t, NodeState>::iterator it = m_nodes.find (addr);
+  if (it == m_nodes.end ())
+    {
+      return false;
+    }
+  NodeState &state = it->second;
+  if (state.available == available)
+    {
+      return true;
+    }
+  state.available = available;
+  if (available)
+    {
+      Rank (addr, state);
+    }
+  else
+    {
+      Unrank (addr, state);
+    }
+  UpdateRelayCandidates (state.tier, nowNs);
+  return true;
+}
+
+bool
+RoutingCore::IsNodeAvailable (uint32_t addr) const
+{
+  std::map<uint32_t, NodeState>::const_iterator it = m_nodes.find (addr);
+  return it != m_nodes.end () && it->second.available;
+}
+
+bool
+RoutingCore::SetNodeFailed (uint32_t addr, bool failed, int64_t nowNs)
+{
+  std::map<uint32_t, NodeState>::const_iterator it = m_nodes.find (addr);
+  if (it == m_nodes.end ())
+    {
+      return false;
+    }
+  if (failed ? m_failedNodes.insert (addr).second : m_failedNodes.erase (addr) > 0)
+    {
+      UpdateRelayCandidates (it->second.tier, nowNs);
+    }
+  return true;
+}
+
+bool
+RoutingCore::IsNodeFailed (uint32_t addr) const
+{
+  return !m_failedNodes.empty () && m_failedNodes.find (addr) != m_failedNodes.end ();
+}
+
+/*
+* The relay candidates are left as they are: the node is still the relay of the other senders.
+*/
+bool
+RoutingCore::SetLinkFailed (uint32_t from, uint32_t to, bool failed)
+{
+  std::map<uint32_t, uint32_t>::const_iterator alias = m_aliases.find (to);
+  if (alias != m_aliases.end () && m_nodes.find (to) == m_nodes.end ())
+    {
+      to = alias->second;
+    }
+  if (m_nodes.find (to) == m_nodes.end ())
+    {
+      return false;
+    }
+  if (failed)
+    {
+      m_failedLinks.insert (std::make_pair (to, from));
+    }
+  else
+    {
+      m_failedLinks.erase (std::make_pair (to, from));
+    }
+  return true;
+}
+
+bool
+RoutingCore::IsLinkFailed (uint32_t from, uint32_t to) const
+{
+  std::map<uint32_t, uint32_t>::const_iterator alias = m_aliases.find (to);
+  if (alias != m_aliases.end () && m_nodes.find (to) == m_nodes.end ())
+    {
+      to = alias->second;
+    }
+  return !m_failedLinks.empty () && m_failedLinks.find (std::make_pair (to, from)) != m_failedLinks.end ();
+}
+
+/*
+* Aliases can be added before the node itself (addresses are usually assigned before the tiers).
+*/
+void
+RoutingCore::AddNodeAddress (uint32_t addr, uint32_t alias)
+{
+  if (alias == addr || m_aliases.find (alias) != m_aliases.end ())
+    {
+      return;
+    }
+  m_aliases[alias] = addr;
+  m_nodeAddresses[addr].push_back (alias);
+  m_membershipChanged = true;
+}
+
+const std::vector<uint32_t> *
+RoutingCore::GetNodeAddresses (uint32_t addr) const
+{
+  if (m_nodeAddresses.empty ())
+    {
+      return 0;
+    }
+  std::map<uint32_t, std::vector<uint32_t> >::const_iterator it = m_nodeAddresses.find (addr);
+  return it == m_nodeAddresses.end () ? 0 : &it->second;
+}
+
+const std::map<uint32_t, std::vector<uint32_t> > &
+RoutingCore::GetAllNodeAddresses (void) const
+{
+  return m_nodeAddresses;
+}
+
+/*
+* Called after every change of the ranking of a tier. Only the first RelayCandidates nodes are compared, so this is
+* O(RelayCandidates) (times the number of harvest profiles of the tier). Harvesting nodes rising above the candidates are
+* seen at the next change of the tier, or at the next selection in it (RefreshRelayCandidates).
+* The candidates include every node the selection scores (SelectionCandidates outside the Energy mode), so a node kept asleep
+* by the duty cycle is never chosen as next hop.
+*/
+void
+RoutingCore::UpdateRelayCandidates (uint16_t tier, int64_t nowNs)
+{
+  std::vector<uint32_t> &candidates = m_tierRelayCandidates[tier];
+  uint32_t scored = m_config.selectionMode == SELECT_ENERGY ? 1 : m_config.selectionCandidates;
+  GetTierTop (tier, std::max (m_config.relayCandidates, scored), nowNs, m_top);
+  bool changed = candidates.size () != m_top.size ();
+  for (uint32_t n = 0; n < m_top.size () && !changed; n++)
+    {
+      changed = candidates[n] != m_top[n].second;
+    }
+  if (!changed)
+    {
+      return;
+    }
+  candidates.clear ();
+  for (uint32_t n = 0; n < m_top.size (); n++)
+    {
+      candidates.push_back (m_top[n].second);
+    }
+  if (m_listener)
+    {
+      m_listener->RelayCandidatesChanged (tier);
+    }
+}
+
+const std::vector<uint32_t> &
+RoutingCore::GetRelayCandidates (uint16_t tier) const
+{
+  static const std::vector<uint32_t> none;
+  std::map<uint16_t, std::vector<uint32_t> >::const_iterator it = m_tierRelayCandidates.find (tier);
+  return it == m_tierRelayCandidates.end () ? none : it->second;
+}
+
+/*
+* Called before a selection in the tier, so the node chosen is always a candidate and awake. Tiers without harvesting nodes
+* only change with their nodes and are left as they are.
+*/
+void
+RoutingCore::RefreshRelayCandidates (uint16_t tier, int64_t nowNs)
+{
+  if (m_tierHarvestRankings.find (tier) != m_tierHarvestRankings.end ())
+    {
+      UpdateRelayCandidates (tier, nowNs);
+    }
+}
+
+bool
+RoutingCore::IsRelayCandidate (uint32_t addr) const
+{
+  std::map<uint32_t, NodeState>::const_iterator it = m_nodes.find (addr);
+  if (it == m_nodes.end ())
+    {
+      return false;
+    }
+  const std::vector<uint32_t> &candidates = GetRelayCandidates (it->second.tier);
+  return std::find (candidates.begin (), candidates.end (), addr) != candidates.end ();
+}
+
+uint16_t
+RoutingCore::GetHighestTier (void) const
+{
+  return m_tierRankings.empty () ? 0 : m_tierRankings.rbegin ()->first;
+}
+
+uint32_t
+RoutingCore::GetNumberOfNodes (void) const
+{
+  return m_nodes.size ();
+}
+
+const std::map<uint32_t, RoutingCore::NodeState> &
+RoutingCore::GetNodes (void) const
+{
+  return m_nodes;
+}
+
+/*
+* The level is computed on integers, so the last one is reached exactly when the tier has no energy left.
+*/
+void
+RoutingCore::UpdateTierPressure (uint16_t tier)
+{
+  TierEnergy &tierEnergy = m_tierEnergy[tier];
+  if (tierEnergy.initial == 0)
+    {
+      return;
+    }
+  uint32_t level = tierEnergy.spent * m_config.pressureLevels / tierEnergy.initial;
+  if (level != tierEnergy.level)
+    {
+      tierEnergy.level = level;
+      if (m_listener)
+        {
+          m_listener->EnergyPressureChanged (tier, (double) tierEnergy.spent / tierEnergy.initial);
+        }
+    }
+}
+
+double
+RoutingCore::GetTierEnergyPressure (uint16_t tier) const
+{
+  std::map<uint16_t, TierEnergy>::const_iterator it = m_tierEnergy.find (tier);
+  if (it == m_tierEnergy.end () || it->second.initial == 0)
+    {
+      return 0.0;
+    }
+  return (double) it->second.spent / it->second.initial;
+}
+
+double
+RoutingCore::GetPathEnergyPressure (uint16_t tier) const
+{
+  double pressure = 0.0;
+  for (std::map<uint16_t, TierEnergy>::const_iterator it = m_tierEnergy.begin (); it != m_tierEnergy.end () && it->first < tier; it++)
+    {
+      if (it->second.initial > 0)
+        {
+          pressure = std::max (pressure, (double) it->second.spent / it->second.initial);
+        }
+    }
+  return pressure;
+}
+
+void
+RoutingCore::AddGateway (uint32_t gateway, double linkQuality, int64_t nowNs)
+{
+  if (IsGateway (gateway))
+    {
+      return;
+    }
+  GatewayState state;
+  state.address = gateway;
+  state.linkQuality = linkQuality;
+  state.load = 0.0;
+  state.lastUpdateNs = nowNs;
+  m_gateways.push_back (state);
+}
+
+void
+RoutingCore::SetGatewayLinkQuality (uint32_t node, uint32_t gateway, double linkQuality)
+{
+  m_gatewayLinkQuality[std::make_pair (node, gateway)] = linkQuality;
+}
+
+double
+RoutingCore::GetGatewayLinkQuality (uint32_t node, uint32_t gateway) const
+{
+  std::map<std::pair<uint32_t, uint32_t>, double>::const_iterator it = m_gatewayLinkQuality.find (std::make_pair (node, gateway));
+  if (it != m_gatewayLinkQuality.end ())
+    {
+      return it->second;
+    }
+  for (uint32_t i = 0; i < m_gateways.size (); i++)
+    {
+      if (m_gateways[i].address == gateway)
+        {
+          return m_gateways[i].linkQuality;
+        }
+    }
+  return 0.0;
+}
+
+/*
+* Chooses the gateway with best linkQuality / (1 + load) for a packet of the given Tier 1 node and adds the packet to its load.
+* The loads decay exponentially so the choice follows the recent traffic; there are few gateways so all are scanned.
+*/
+uint32_t
+RoutingCore::SelectGateway (uint32_t node, int64_t nowNs)
+{
+  if (m_gateways.empty ())
+    {
+      return 0;
+    }
+  double tau = m_config.gatewayLoadTimeConstant;
+  uint32_t bestIndex = 0;
+  double bestScore = -1.0;
+  for (uint32_t i = 0; i < m_gateways.size (); i++)
+    {
+      GatewayState &gw = m_gateways[i];
+      if (tau > 0)
+        {
+          gw.load *= std::exp (-(nowNs - gw.lastUpdateNs) / 1e9 / tau);
+        }
+      gw.lastUpdateNs = nowNs;
+      double quality = gw.linkQuality;
+      if (!m_gatewayLinkQuality.empty ())
+        {
+          std::map<std::pair<uint32_t, uint32_t>, double>::const_iterator it = m_gatewayLinkQuality.find (std::make_pair (node, gw.address));
+          if (it != m_gatewayLinkQuality.end ())
+            {
+              quality = it->second;
+            }
+        }
+      double score = quality / (1.0 + gw.load);
+      if (score > bestScore)
+        {
+          bestScore = score;
+          bestIndex = i;
+        }
+    }
+  m_gateways[bestIndex].load += 1.0;
+  return m_gateways[bestIndex].address;
+}
+
+uint32_t
+RoutingCore::GetNumberOfGateways (void) const
+{
+  return m_gateways.size ();
+}
+
+bool
+RoutingCore::IsGateway (uint32_t addr) const
+{
+  for (uint32_t i = 0; i < m_gateways.size (); i++)
+    {
+      if (m_gateways[i].address == addr)
+        {
+          return true;
+        }
+    }
+  return false;
+}
+
+/*
+* Snapshot file, in the byte order of the host that wrote it: a SnapshotHeader, then these sections, each starting on an 8 byte
+* boundary so the records can be read in place from the mapped file:
+*   nodes          SnapshotNode[nodes], by increasing address
+*   rankings       uint32_t[rankedNodes], index in nodes of every ranked node, tier after tier in ranking order
+*   tiers          SnapshotTier[tiers], with the number of ranked nodes of each tier
+*   aliases        SnapshotPair[aliases] (alias, node), in the order they were added
+*   gateways       SnapshotGateway[gateways], with the age of their load
+*   gateway links  SnapshotLink[gatewayLinks] (node, gateway, link quality)
+*   links          SnapshotLink[links] (from, to, delivery probability)
+* then, from version 2, a SnapshotHarvestHeader and:
+*   profiles       SnapshotProfile[profiles]
+*   samples        SnapshotSample[samples], the samples of the trace profiles one after the other
+*   harvesting     SnapshotHarvest[harvestingNodes] (node, profile, current energy)
+* Harvesting nodes are not in the rankings section. A change of any record bumps SNAPSHOT_VERSION; version 1 files are still read.
+*/
+namespace {
+
+const char SNAPSHOT_MAGIC[8] = { 'I', 'O', 'T', 'S', 'N', 'A', 'P', '\0' };
+const uint32_t SNAPSHOT_VERSION = 2;
+const uint32_t SNAPSHOT_BYTE_ORDER = 0x01020304;
+
+struct SnapshotHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t byteOrder;
+  int64_t timeNs;
+  uint64_t totalEnergyConsumed;
+  uint32_t nodes;
+  uint32_t rankedNodes;
+  uint32_t tiers;
+  uint32_t aliases;
+  uint32_t gateways;
+  uint32_t gatewayLinks;
+  uint32_t links;
+  uint32_t reserved;
+};
+
+struct SnapshotNode
+{
+  uint32_t addr;
+  uint32_t energy;
+  uint16_t tier;
+  uint8_t available;
+  uint8_t reserved;
+};
+
+struct SnapshotTier
+{
+  uint16_t tier;
+  uint16_t reserved;
+  uint32_t rankedNodes;
+  uint64_t initial;
+  uint64_t spent;
+};
+
+struct SnapshotPair
+{
+  uint32_t first;
+  uint32_t second;
+};
+
+struct SnapshotGateway
+{
+  uint32_t addr;
+  uint32_t reserved;
+  double linkQuality;
+  double load;
+  int64_t ageNs;
+};
+
+struct SnapshotLink
+{
+  uint32_t from;
+  uint32_t to;
+  double value;
+};
+
+struct SnapshotHarvestHeader
+{
+  uint64_t totalEnergyHarvested;
+  uint32_t profiles;
+  uint32_t samples;
+  uint32_t harvestingNodes;
+  uint32_t reserved;
+};
+
+struct SnapshotProfile
+{
+  uint32_t kind;
+  uint32_t capacity;
+  uint32_t samples;
+  uint32_t reserved;
+  double period;
+  double peakPower;
+  double sunrise;
+  double daylight;
+};
+
+struct SnapshotSample
+{
+  double time;
+  double power;
+};
+
+struct SnapshotHarvest
+{
+  uint32_t addr;
+  uint32_t profile;
+  double energy;
+};
+
+uint64_t
+SnapshotSectionSize (uint64_t bytes)
+{
+  return (bytes + 7) & ~(uint64_t) 7;
+}
+
+template <typename T>
+void
+WriteSnapshotSection (std::ostream &os, const std::vector<T> &records)
+{
+  static const char padding[8] = { 0 };
+  uint64_t bytes = records.size () * sizeof (T);
+  if (bytes > 0)
+    {
+      os.write (reinterpret_cast<const char *> (&records[0]), bytes);
+    }
+  os.write (padding, SnapshotSectionSize (bytes) - bytes);
+}
+
+/* Points records at the next section of the mapped file; false when the file is too short. */
+template <typename T>
+bool
+ReadSnapshotSection (const uint8_t *data, uint64_t size, uint64_t &offset, uint32_t count, const T *&records)
+{
+  uint64_t bytes = (uint64_t) count * sizeof (T);
+  if (size - offset < bytes)
+    {
+      return false;
+    }
+  records = reinterpret_cast<const T *> (data + offset);
+  offset = std::min (size, offset + SnapshotSectionSize (bytes));
+  return true;
+}
+
+bool
+SnapshotNodeLess (const SnapshotNode &node, uint32_t addr)
+{
+  return node.addr < addr;
+}
+
+}
+
+/*
+* The records are built in memory and written with one call per section.
+*/
+bool
+RoutingCore::SaveSnapshot (const std::string &path, int64_t nowNs) const
+{
+  std::vector<SnapshotNode> nodes;
+  nodes.reserve (m_nodes.size ());
+  for (std::map<uint32_t, NodeState>::const_iterator it = m_nodes.begin (); it != m_nodes.end (); it++)
+    {
+      SnapshotNode node = { it->first, it->second.energy, it->second.tier, (uint8_t) (it->second.available ? 1 : 0), 0 };
+      nodes.push_back (node);
+    }
+  std::vector<uint32_t> rankings;
+  std::vector<SnapshotTier> tiers;
+  for (std::map<uint16_t, TierEnergy>::const_iterator it = m_tierEnergy.begin (); it != m_tierEnergy.end (); it++)
+    {
+      SnapshotTier tier = { it->first, 0, 0, it->second.initial, it->second.spent };
+      std::map<uint16_t, TierRanking>::const_iterator ranking = m_tierRankings.find (it->first);
+      if (ranking != m_tierRankings.end ())
+        {
+          for (TierRanking::const_iterator entry = ranking->second.begin (); entry != ranking->second.end (); entry++)
+            {
+              rankings.push_back (std::lower_bound (nodes.begin (), nodes.end (), entry->second, SnapshotNodeLess) - nodes.begin ());
+              tier.rankedNodes++;
+            }
+        }
+      tiers.push_back (tier);
+    }
+  std::vector<SnapshotPair> aliases;
+  for (std::map<uint32_t, std::vector<uint32_t> >::const_iterator it = m_nodeAddresses.begin (); it != m_nodeAddresses.end (); it++)
+    {
+      for (uint32_t i = 0; i < it->second.size (); i++)
+        {
+          SnapshotPair alias = { it->second[i], it->first };
+          aliases.push_back (alias);
+        }
+    }
+  std::vector<SnapshotGateway> gateways;
+  for (uint32_t i = 0; i < m_gateways.size (); i++)
+    {
+      SnapshotGateway gateway = { m_gateways[i].address, 0, m_gateways[i].linkQuality, m_gateways[i].load, nowNs - m_gateways[i].lastUpdateNs };
+      gateways.push_back (gateway);
+    }
+  std::vector<SnapshotLink> gatewayLinks;
+  for (std::map<std::pair<uint32_t, uint32_t>, double>::const_iterator it = m_gatewayLinkQuality.begin (); it != m_gatewayLinkQuality.end (); it++)
+    {
+      SnapshotLink link = { it->first.first, it->first.second, it->second };
+      gatewayLinks.push_back (link);
+    }
+  std::vector<SnapshotLink> links;
+  for (std::map<std::pair<uint32_t, uint32_t>, double>::const_iterator it = m_linkDelivery.begin (); it != m_linkDelivery.end (); it++)
+    {
+      SnapshotLink link = { it->first.second, it->first.first, it->second };
+      links.push_back (link);
+    }
+  std::vector<SnapshotProfile> profiles;
+  std::vector<SnapshotSample> samples;
+  for (uint32_t i = 0; i < m_profiles.size (); i++)
+    {
+      const HarvestProfile &profile = m_profiles[i];
+      SnapshotProfile record = { (uint32_t) profile.GetKind (), profile.GetCapacity (), (uint32_t) profile.GetSamples ().size (), 0,
+                                 profile.GetPeriod (), profile.GetPeakPower (), profile.GetSunrise (), profile.GetDaylight () };
+      profiles.push_back (record);
+      for (uint32_t j = 0; j < profile.GetSamples ().size (); j++)
+        {
+          SnapshotSample sample = { profile.GetSamples ()[j].first, profile.GetSamples ()[j].second };
+          samples.push_back (sample);
+        }
+    }
+  std::vector<SnapshotHarvest> harvesting;
+  for (std::map<uint32_t, NodeState>::const_iterator it = m_nodes.begin (); it != m_nodes.end (); it++)
+    {
+      if (it->second.profile)
+        {
+          const HarvestProfile &profile = m_profiles[it->second.profile - 1];
+          SnapshotHarvest record = { it->first, it->second.profile,
+                                     std::min<double> (profile.GetCapacity (), it->second.harvestOffset + profile.GetHarvested (nowNs)) };
+          harvesting.push_back (record);
+        }
+    }
+  SnapshotHarvestHeader harvestHeader = { m_totalEnergyHarvested, (uint32_t) profiles.size (), (uint32_t) samples.size (),
+                                          (uint32_t) harvesting.size (), 0 };
+
+  SnapshotHeader header;
+  std::memset (&header, 0, sizeof (header));
+  std::memcpy (header.magic, SNAPSHOT_MAGIC, sizeof (header.magic));
+  header.version = SNAPSHOT_VERSION;
+  header.byteOrder = SNAPSHOT_BYTE_ORDER;
+  header.timeNs = nowNs;
+  header.totalEnergyConsumed = m_totalEnergyConsumed;
+  header.nodes = nodes.size ();
+  header.rankedNodes = rankings.size ();
+  header.tiers = tiers.size ();
+  header.aliases = aliases.size ();
+  header.gateways = gateways.size ();
+  header.gatewayLinks = gatewayLinks.size ();
+  header.links = links.size ();
+
+  std::ofstream os (path.c_str (), std::ios::binary | std::ios::trunc);
+  os.write (reinterpret_cast<const char *> (&header), sizeof (header));
+  WriteSnapshotSection (os, nodes);
+  WriteSnapshotSection (os, rankings);
+  WriteSnapshotSection (os, tiers);
+  WriteSnapshotSection (os, aliases);
+  WriteSnapshotSection (os, gateways);
+  WriteSnapshotSection (os, gatewayLinks);
+  WriteSnapshotSection (os, links);
+  os.write (reinterpret_cast<const char *> (&harvestHeader), sizeof (harvestHeader));
+  WriteSnapshotSection (os, profiles);
+  WriteSnapshotSection (os, samples);
+  WriteSnapshotSection (os, harvesting);
+  os.close ();
+  return !os.fail ();
+}
+
+/*
+* The file is mapped read-only and the records are read in place.
+*/
+bool
+RoutingCore::LoadSnapshot (const std::string &path, int64_t nowNs)
+{
+  int fd = open (path.c_str (), O_RDONLY);
+  if (fd < 0)
+    {
+      return false;
+    }
+  struct stat st;
+  if (fstat (fd, &st) != 0 || (uint64_t) st.st_size < sizeof (SnapshotHeader))
+    {
+      close (fd);
+      return false;
+    }
+  void *data = mmap (0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close (fd);
+  if (data == MAP_FAILED)
+    {
+      return false;
+    }
+  bool restored = RestoreSnapshot (static_cast<const uint8_t *> (data), st.st_size, nowNs);
+  munmap (data, st.st_size);
+  return restored;
+}
+
+/*
+* Everything is checked before the state is touched. The nodes and the rankings are stored in the order of the maps, so every
+* insertion is hinted at the end and the restore is linear in the size of the snapshot. The relay candidates are derived again
+* and notified, and so is the energy pressure of every tier, as listeners may have followed another state before.
+* The state is the one at the time of the snapshot: loaded later in the same run, the gateway loads decay and the harvesting
+* nodes harvest over the time since; loaded before that time (a new run started from it), it is taken as the state of now.
+*/
+bool
+RoutingCore::RestoreSnapshot (const uint8_t *data, uint64_t size, int64_t nowNs)
+{
+  SnapshotHeader header;
+  std::memcpy (&header, data, sizeof (header));
+  if (std::memcmp (header.magic, SNAPSHOT_MAGIC, sizeof (header.magic)) != 0 || header.version < 1
+      || header.version > SNAPSHOT_VERSION || header.byteOrder != SNAPSHOT_BYTE_ORDER)
+    {
+      return false;
+    }
+  uint64_t offset = sizeof (header);
+  const SnapshotNode *nodes;
+  const uint32_t *rankings;
+  const SnapshotTier *tiers;
+  const SnapshotPair *aliases;
+  const SnapshotGateway *gateways;
+  const SnapshotLink *gatewayLinks;
+  const SnapshotLink *links;
+  if (!ReadSnapshotSection (data, size, offset, header.nodes, nodes)
+      || !ReadSnapshotSection (data, size, offset, header.rankedNodes, rankings)
+      || !ReadSnapshotSection (data, size, offset, header.tiers, tiers)
+      || !ReadSnapshotSection (data, size, offset, header.aliases, aliases)
+      || !ReadSnapshotSection (data, size, offset, header.gateways, gateways)
+      || !ReadSnapshotSection (data, size, offset, header.gatewayLinks, gatewayLinks)
+      || !ReadSnapshotSection (data, size, offset, header.links, links))
+    {
+      return false;
+    }
+  SnapshotHarvestHeader harvestHeader;
+  std::memset (&harvestHeader, 0, sizeof (harvestHeader));
+  const SnapshotProfile *profiles = 0;
+  const SnapshotSample *samples = 0;
+  const SnapshotHarvest *harvesting = 0;
+  if (header.version >= 2)
+    {
+      if (size - offset < sizeof (harvestHeader))
+        {
+          return false;
+        }
+      std::memcpy (&harvestHeader, data + offset, sizeof (harvestHeader));
+      offset += sizeof (harvestHeader);
+      if (!ReadSnapshotSection (data, size, offset, harvestHeader.profiles, profiles)
+          || !ReadSnapshotSection (data, size, offset, harvestHeader.samples, samples)
+          || !ReadSnapshotSection (data, size, offset, harvestHeader.harvestingNodes, harvesting))
+        {
+          return false;
+        }
+    }
+  std::vector<HarvestProfile> harvestProfiles;
+  const SnapshotSample *sample = samples;
+  for (uint32_t i = 0; i < harvestHeader.profiles; i++)
+    {
+      if (profiles[i].samples > (uint64_t) (samples + harvestHeader.samples - sample))
+        {
+          return false;
+        }
+      HarvestProfile profile;
+      if (profiles[i].kind == HarvestProfile::DIURNAL)
+        {
+          profile = HarvestProfile::Diurnal (profiles[i].peakPower, profiles[i].sunrise, profiles[i].daylight, profiles[i].capacity,
+                                             profiles[i].period);
+        }
+      else
+        {
+          std::vector<std::pair<double, double> > points;
+          for (uint32_t j = 0; j < profiles[i].samples; j++, sample++)
+            {
+              points.push_back (std::make_pair (sample->time, sample->power));
+            }
+          profile = HarvestProfile::Trace (points, profiles[i].capacity);
+        }
+      if (!profile.IsValid ())
+        {
+          return false;
+        }
+      harvestProfiles.push_back (profile);
+    }
+  for (uint32_t i = 0; i < harvestHeader.harvestingNodes; i++)
+    {
+      const SnapshotNode *node = std::lower_bound (nodes, nodes + header.nodes, harvesting[i].addr, SnapshotNodeLess);
+      if (node == nodes + header.nodes || node->addr != harvesting[i].addr || harvesting[i].profile == 0
+          || harvesting[i].profile > harvestProfiles.size ())
+        {
+          return false;
+        }
+    }
+  uint64_t ranked = 0;
+  for (uint32_t t = 0; t < header.tiers; t++)
+    {
+      ranked += tiers[t].rankedNodes;
+    }
+  if (ranked != header.rankedNodes)
+    {
+      return false;
+    }
+  for (uint32_t i = 0; i < header.rankedNodes; i++)
+    {
+      if (rankings[i] >= header.nodes)
+        {
+          return false;
+        }
+    }
+
+  m_nodes.clear ();
+  m_tierRankings.clear ();
+  m_tierRelayCandidates.clear ();
+  m_tierEnergy.clear ();
+  m_nodeAddresses.clear ();
+  m_aliases.clear ();
+  m_gateways.clear ();
+  m_gatewayLinkQuality.clear ();
+  m_linkDelivery.clear ();
+  m_tierHarvestRankings.clear ();
+  m_failedNodes.clear ();
+  m_failedLinks.clear ();
+  m_profiles.swap (harvestProfiles);
+  m_totalEnergyConsumed = header.totalEnergyConsumed;
+  m_totalEnergyHarvested = harvestHeader.totalEnergyHarvested;
+  m_membershipChanged = true;
+  int64_t snapshotNs = std::min (header.timeNs, nowNs);
+
+  for (uint32_t i = 0; i < header.nodes; i++)
+    {
+      NodeState state;
+      state.tier = nodes[i].tier;
+      state.energy = nodes[i].energy;
+      state.available = nodes[i].available != 0;
+      state.queue = 0;
+      state.profile = 0;
+      state.harvestOffset = 0.0;
+      m_nodes.insert (m_nodes.end (), std::make_pair (nodes[i].addr, state));
+    }
+  const uint32_t *rank = rankings;
+  for (uint32_t t = 0; t < header.tiers; t++)
+    {
+      TierRanking &ranking = m_tierRankings[tiers[t].tier];
+      for (uint32_t i = 0; i < tiers[t].rankedNodes; i++, rank++)
+        {
+          ranking.insert (ranking.end (), std::make_pair (nodes[*rank].energy, nodes[*rank].addr));
+        }
+      TierEnergy &tierEnergy = m_tierEnergy[tiers[t].tier];
+      tierEnergy.initial = tiers[t].initial;
+      tierEnergy.spent = tiers[t].spent;
+      tierEnergy.level = tierEnergy.initial ? tierEnergy.spent * m_config.pressureLevels / tierEnergy.initial : 0;
+    }
+  for (uint32_t i = 0; i < header.aliases; i++)
+    {
+      m_aliases[aliases[i].first] = aliases[i].second;
+      m_nodeAddresses[aliases[i].second].push_back (aliases[i].first);
+    }
+  for (uint32_t i = 0; i < header.gateways; i++)
+    {
+      GatewayState state;
+      state.address = gateways[i].addr;
+      state.linkQuality = gateways[i].linkQuality;
+      state.load = gateways[i].load;
+      state.lastUpdateNs = snapshotNs - gateways[i].ageNs;
+      m_gateways.push_back (state);
+    }
+  for (uint32_t i = 0; i < header.gatewayLinks; i++)
+    {
+      m_gatewayLinkQuality.insert (m_gatewayLinkQuality.end (),
+                                   std::make_pair (std::make_pair (gatewayLinks[i].from, gatewayLinks[i].to), gatewayLinks[i].value));
+    }
+  for (uint32_t i = 0; i < header.links; i++)
+    {
+      m_linkDelivery.insert (m_linkDelivery.end (), std::make_pair (std::make_pair (links[i].to, links[i].from), links[i].value));
+    }
+  for (uint32_t i = 0; i < harvestHeader.harvestingNodes; i++)
+    {
+      NodeState &state = m_nodes[harvesting[i].addr];
+      state.profile = harvesting[i].profile;
+      state.energy = harvesting[i].energy > 0 ? (uint32_t) harvesting[i].energy : 0;
+      state.harvestOffset = harvesting[i].energy - m_profiles[state.profile - 1].GetHarvested (snapshotNs);
+      if (state.available)
+        {
+          Rank (harvesting[i].addr, state);
+        }
+    }
+  for (std::map<uint16_t, TierRanking>::const_iterator it = m_tierRankings.begin (); it != m_tierRankings.end (); it++)
+    {
+      UpdateRelayCandidates (it->first, nowNs);
+    }
+  if (m_listener)
+    {
+      for (std::map<uint16_t, TierEnergy>::const_iterator it = m_tierEnergy.begin (); it != m_tierEnergy.end (); it++)
+        {
+          m_listener->EnergyPressureChanged (it->first, GetTierEnergyPressure (it->first));
+        }
+    }
+  return true;
+}
+
+void
+RoutingCore::ApplyUpdates (const std::vector<Update> &updates, int64_t nowNs)
+{
+  for (std::vector<Update>::const_iterator it = updates.begin (); it != updates.end (); it++)
+    {
+      switch (it->type)
+        {
+        case Update::CONSUME_HOP:
+          ConsumeHop (it->addr, nowNs);
+          break;
+        case Update::SET_ENERGY:
+          SetNodeEnergy (it->addr, it->value, nowNs);
+          break;
+        case Update::SET_AVAILABLE:
+          SetNodeAvailable (it->addr, it->value != 0, nowNs);
+          break;
+        case Update::SET_QUEUE:
+          SetNodeQueue (it->addr, it->value);
+          break;
+        case Update::SET_LINK_DELIVERY:
+          SetLinkDelivery (it->addr, it->peer, it->estimate);
+          break;
+        case Update::SET_FAILED:
+          SetNodeFailed (it->addr, it->value != 0, nowNs);
+          break;
+        case Update::SET_LINK_FAILED:
+          SetLinkFailed (it->addr, it->peer, it->value != 0);
+          break;
+        }
+    }
+  Publish (nowNs);
+}
+
+/*
+* Builds a new View and swaps it in. The candidates, the links into them and the pressures are copied every time (a few entries
+* per tier); the tier of the addresses only when it changed, otherwise the new View shares it with the previous one.
+* The replaced View is retired in the new epoch: a Reader that may still read it announced an older epoch.
+*/
+void
+RoutingCore::Publish (int64_t nowNs)
+{
+  View *view = new View;
+  view->version = ++m_version;
+  view->config = m_config;
+  uint16_t highestTier = GetHighestTier ();
+  view->candidates.resize (highestTier + 1);
+  view->pathPressure.resize (highestTier + 2, 0.0);
+  uint32_t maxCandidates = std::max<uint32_t> (2, m_config.selectionCandidates) + (m_failedLinks.empty () ? 0 : 1);
+  for (std::map<uint16_t, TierRanking>::const_iterator tier = m_tierRankings.begin (); tier != m_tierRankings.end (); tier++)
+    {
+      std::vector<View::Candidate> &candidates = view->candidates[tier->first];
+      GetTierTop (tier->first, maxCandidates, nowNs, m_top);
+      for (uint32_t i = 0; i < m_top.size (); i++)
+        {
+          uint32_t addr = m_top[i].second;
+          View::Candidate candidate = { addr, m_top[i].first, m_nodes.find (addr)->second.queue };
+          candidates.push_back (candidate);
+          std::map<std::pair<uint32_t, uint32_t>, double>::const_iterator link = m_linkDelivery.lower_bound (std::make_pair (addr, 0u));
+          for (; link != m_linkDelivery.end () && link->first.first == addr; link++)
+            {
+              view->links.push_back (std::make_pair (((uint64_t) link->first.first << 32) | link->first.second, link->second));
+            }
+        }
+    }
+  std::sort (view->links.begin (), view->links.end ());
+  for (std::set<std::pair<uint32_t, uint32_t> >::const_iterator it = m_failedLinks.begin (); it != m_failedLinks.end (); it++)
+    {
+      view->failedLinks.push_back (((uint64_t) it->first << 32) | it->second);
+    }
+  for (uint16_t tier = 1; tier < view->pathPressure.size (); tier++)
+    {
+      view->pathPressure[tier] = std::max (view->pathPressure[tier - 1], GetTierEnergyPressure (tier - 1));
+    }
+  if (m_membershipChanged || !m_membership)
+    {
+      std::vector<std::pair<uint32_t, uint16_t> > *membership = new std::vector<std::pair<uint32_t, uint16_t> > ();
+      membership->reserve (m_nodes.size () + m_aliases.size ());
+      for (std::map<uint32_t, NodeState>::const_iterator it = m_nodes.begin (); it != m_nodes.end (); it++)
+        {
+          membership->push_back (std::make_pair (it->first, it->second.tier));
+        }
+      for (std::map<uint32_t, uint32_t>::const_iterator it = m_aliases.begin (); it != m_aliases.end (); it++)
+        {
+          if (m_nodes.find (it->first) == m_nodes.end ())
+            {
+              membership->push_back (std::make_pair (it->first, GetTier (it->second)));
+            }
+        }
+      std::sort (membership->begin (), membership->end ());
+      m_membership.reset (membership);
+      m_membershipChanged = false;
+    }
+  view->membership = m_membership;
+
+  const View *old = m_view.exchange (view);
+  uint64_t epoch = m_epoch.fetch_add (1) + 1;
+  if (old)
+    {
+      m_retired.push_back (std::make_pair (epoch, old));
+    }
+  ReclaimViews ();
+}
+
+/*
+* A retired View is freed once every Reader inside a call announced its epoch or a later one.
+*/
+void
+RoutingCore::ReclaimViews (void)
+{
+  uint64_t oldest = std::numeric_limits<uint64_t>::max ();
+  for (uint32_t i = 0; i < MAX_READERS; i++)
+    {
+      uint64_t epoch = m_slots[i].epoch.load ();
+      if (epoch != 0 && epoch < oldest)
+        {
+          oldest = epoch;
+        }
+    }
+  std::vector<std::pair<uint64_t, const View *> >::iterator kept = m_retired.begin ();
+  for (std::vector<std::pair<uint64_t, const View *> >::iterator it = m_retired.begin (); it != m_retired.end (); it++)
+    {
+      if (it->first <= oldest)
+        {
+          delete it->second;
+        }
+      else
+        {
+          *kept++ = *it;
+        }
+    }
+  m_retired.erase (kept, m_retired.end ());
+}
+
+RoutingCore::Reader::Reader (const RoutingCore &core)
+  : m_core (core),
+    m_slot (MAX_READERS)
+{
+  for (uint32_t i = 0; i < MAX_READERS; i++)
+    {
+      bool expected = false;
+      if (m_core.m_slots[i].used.compare_exchange_strong (expected, true))
+        {
+          m_slot = i;
+          return;
+        }
+    }
+  throw std::runtime_error ("RoutingCore: no free Reader slot");
+}
+
+RoutingCore::Reader::~Reader ()
+{
+  m_core.m_slots[m_slot].epoch.store (0);
+  m_core.m_slots[m_slot].used.store (false);
+}
+
+/*
+* The epoch is announced before the View is loaded (both sequentially consistent), so the writer either sees the announcement
+* or has already swapped the View this call will load.
+*/
+const RoutingCore::View *
+RoutingCore::Reader::Enter (void)
+{
+  m_core.m_slots[m_slot].epoch.store (m_core.m_epoch.load ());
+  return m_core.m_view.load ();
+}
+
+void
+RoutingCore::Reader::Leave (void)
+{
+  m_core.m_slots[m_slot].epoch.store (0, std::memory_order_release);
+}
+
+uint32_t
+RoutingCore::Reader::SelectNodeInTier (uint16_t tier, uint32_t from)
+{
+  uint32_t backup;
+  return SelectNodeInTier (tier, from, backup);
+}
+
+uint32_t
+RoutingCore::Reader::SelectNodeInTier (uint16_t tier, uint32_t from, uint32_t &backup)
+{
+  const View *view = Enter ();
+  uint32_t best = 0;
+  backup = 0;
+  if (view && tier < view->candidates.size ())
+    {
+      const std::vector<View::Candidate> &candidates = view->candidates[tier];
+      uint32_t scored = view->config.selectionMode == SELECT_ENERGY ? 1 : view->config.selectionCandidates;
+      double bestScore = -1.0;
+      double backupScore = -1.0;
+      const std::vector<std::pair<uint64_t, double> > &links = view->links;
+      const std::vector<uint64_t> &failedLinks = view->failedLinks;
+      uint32_t read = std::max<uint32_t> (2, scored) + (failedLinks.empty () ? 0 : 1);
+      uint32_t ranked = 0;
+      for (uint32_t i = 0; i < candidates.size () && i < read; i++)
+        {
+          if (!failedLinks.empty ()
+              && std::binary_search (failedLinks.begin (), failedLinks.end (), ((uint64_t) candidates[i].addr << 32) | from))
+            {
+              continue;
+            }
+          double score = candidates[i].energy;
+          if (view->config.selectionMode != SELECT_ENERGY)
+            {
+              double expectedEnergy = 0.0;
+              if (view->config.selectionMode == SELECT_ENERGY_ETX)
+                {
+                  double delivery = 1.0;
+                  uint64_t link = ((uint64_t) candidates[i].addr << 32) | from;
+                  std::vector<std::pair<uint64_t, double> >::const_iterator it = std::lower_bound (links.begin (), links.end (), link, LinkLess);
+                  if (it != links.end () && it->first == link)
+                    {
+                      delivery = std::max (it->second, view->config.minLinkDelivery);
+                    }
+                  expectedEnergy = HOP_ENERGY_COST / delivery;
+                }
+              score = CandidateScore (view->config, candidates[i].energy, candidates[i].queue, expectedEnergy);
+            }
+          if (ranked++ < scored && score > bestScore)
+            {
+              backup = best;
+              backupScore = bestScore;
+              best = candidates[i].addr;
+              bestScore = score;
+            }
+          else if (score > backupScore)
+            {
+              backup = candidates[i].addr;
+              backupScore = score;
+            }
+        }
+    }
+  Leave ();
+  return best;
+}
+
+uint16_t
+RoutingCore::Reader::GetTier (uint32_t addr)
+{
+  const View *view = Enter ();
+  uint16_t tier = 0;
+  if (view)
+    {
+      const std::vector<std::pair<uint32_t, uint16_t> > &membership = *view->membership;
+      std::vector<std::pair<uint32_t, uint16_t> >::const_iterator it = std::lower_bound (membership.begin (), membership.end (), addr, AddressLess);
+      if (it != membership.end () && it->first == addr)
+        {
+          tier = it->second;
+        }
+    }
+  Leave ();
+  return tier;
+}
+
+double
+RoutingCore::Reader::GetPathEnergyPressure (uint16_t tier)
+{
+  const View *view = Enter ();
+  double pressure = 0.0;
+  if (view)
+    {
+      pressure = view->pathPressure[std::min<size_t> (tier, view->pathPressure.size () - 1)];
+    }
+  Leave ();
+  return pressure;
+}
+
+uint64_t
+RoutingCore::Reader::GetVersion (void)
+{
+  const View *view = Enter ();
+  uint64_t version = view ? view->version : 0;
+  Leave ();
+  return version;
+}
+
+}
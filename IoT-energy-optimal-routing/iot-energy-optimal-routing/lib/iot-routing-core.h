@@ -0,0 +1,366 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef IOT_ROUTING_CORE_H
+#define IOT_ROUTING_CORE_H
+
+#include <stdint.h>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+* Tier, energy and next hop selection core of IotEnergyOptimalRouteProcessor, without any dependency on ns-3, so the same logic
+* can run in a gateway daemon. Addresses are IPv4 addresses in host order, 0 meaning no address; times are nanoseconds on any
+* clock of the caller.
+*/
+namespace iotrouting {
+
+/*
+* Energy harvested by a node (e.g. from a solar panel), as a power curve in energy units per second that repeats every period.
+* GetHarvested gives the energy harvested since time 0 in closed form, so harvesting needs no periodic events: the core adds it
+* to the energy of a node when the node is read or ranked. Nodes sharing a profile share its curve and its battery capacity.
+*/
+class HarvestProfile
+{
+public:
+  enum Kind
+  {
+    DIURNAL,
+    TRACE
+  };
+
+  HarvestProfile ();
+
+  /* Half sine of peakPower from sunrise to sunrise + daylight (seconds into the period), nothing at night. */
+  static HarvestProfile Diurnal (double peakPower, double sunrise, double daylight, uint32_t capacity, double period = 86400.0);
+  /* Power linear between the (time, power) samples, the first at time 0; the curve repeats after the last one. */
+  static HarvestProfile Trace (const std::vector<std::pair<double, double> > &samples, uint32_t capacity);
+  /* Trace read from a file of "seconds power" lines ('#' starts a comment); false when the file has no valid trace. */
+  static bool LoadTrace (const std::string &path, uint32_t capacity, HarvestProfile &profile);
+
+  bool IsValid (void) const;
+  Kind GetKind (void) const;
+  uint32_t GetCapacity (void) const;
+  double GetPeriod (void) const;
+  double GetPeakPower (void) const;
+  double GetSunrise (void) const;
+  double GetDaylight (void) const;
+  const std::vector<std::pair<double, double> > & GetSamples (void) const;
+  /* Energy harvested from time 0 to nowNs, ignoring the capacity. */
+  double GetHarvested (int64_t nowNs) const;
+
+private:
+  Kind m_kind;
+  uint32_t m_capacity;
+  double m_period;
+  double m_peakPower;
+  double m_sunrise;
+  double m_daylight;
+  std::vector<std::pair<double, double> > m_samples;
+  /* Energy harvested from the start of the period to every sample, and over a whole period. */
+  std::vector<double> m_cumulative;
+  double m_perPeriod;
+};
+
+class RoutingCore
+{
+public:
+  enum SelectionMode
+  {
+    SELECT_ENERGY,
+    SELECT_ENERGY_QUEUE,
+    SELECT_ENERGY_ETX
+  };
+
+  /* Energy units taken from a node for every transmission. */
+  static const uint32_t HOP_ENERGY_COST = 10;
+  /* Threads that can hold a Reader at the same time. */
+  static const uint32_t MAX_READERS = 128;
+
+  struct Config
+  {
+    Config ();
+
+    uint32_t relayCandidates;
+    SelectionMode selectionMode;
+    uint32_t selectionCandidates;
+    double queueWeight;
+    double minLinkDelivery;
+    uint32_t pressureLevels;
+    double gatewayLoadTimeConstant;
+  };
+
+  /*
+  * energy is the energy of the node when it was last changed; with a harvest profile the current one is
+  * min (capacity, harvestOffset + harvested so far), see GetNodeEnergy.
+  */
+  struct NodeState
+  {
+    uint16_t tier;
+    uint32_t energy;
+    bool available;
+    uint32_t queue;
+    uint32_t profile;
+    double harvestOffset;
+  };
+
+  /* Notified by the writer, on its thread, of the changes the ns-3 processor publishes as trace sources. */
+  class Listener
+  {
+  public:
+    virtual ~Listener ();
+    virtual void NodeEnergyDepleted (uint32_t addr);
+    virtual void RelayCandidatesChanged (uint16_t tier);
+    virtual void EnergyPressureChanged (uint16_t tier, double pressure);
+  };
+
+  /* One change of the batched update path. */
+  struct Update
+  {
+    enum Type
+    {
+      CONSUME_HOP,       // addr spends one transmission
+      SET_ENERGY,        // energy of addr is value
+      SET_AVAILABLE,     // addr is available when value is not 0
+      SET_QUEUE,         // MAC queue of addr holds value packets
+      SET_LINK_DELIVERY, // delivery probability of the link addr -> peer is estimate
+      SET_FAILED,        // addr has failed when value is not 0
+      SET_LINK_FAILED    // link addr -> peer has failed when value is not 0
+    };
+
+    Type type;
+    uint32_t addr;
+    uint32_t peer;
+    uint32_t value;
+    double estimate;
+  };
+
+  class View;
+
+  /*
+  * Lock-free read path for other threads. Each thread holds its own Reader, which reads the last published View: a call
+  * announces the epoch it reads in, loads the View and reads it; the writer frees a replaced View only once no Reader is
+  * still in an older epoch. Reads never block and never wait for the writer.
+  */
+  class Reader
+  {
+  public:
+    explicit Reader (const RoutingCore &core);
+    ~Reader ();
+
+    /* Same choice as RoutingCore::SelectNodeInTier on the published state. */
+    uint32_t SelectNodeInTier (uint16_t tier, uint32_t from = 0);
+    uint32_t SelectNodeInTier (uint16_t tier, uint32_t from, uint32_t &backup);
+    uint16_t GetTier (uint32_t addr);
+    double GetPathEnergyPressure (uint16_t tier);
+    /* Number of the View read, incremented by every Publish. */
+    uint64_t GetVersion (void);
+
+  private:
+    Reader (const Reader &);
+    Reader & operator= (const Reader &);
+
+    const View * Enter (void);
+    void Leave (void);
+
+    const RoutingCore &m_core;
+    uint32_t m_slot;
+  };
+
+  RoutingCore ();
+  ~RoutingCore ();
+
+  Config & GetConfig (void);
+  const Config & GetConfig (void) const;
+  void SetListener (Listener *listener);
+
+  /*
+  * Writer side: these are not thread safe and run on the thread owning the core (the simulator, the telemetry thread).
+  * The calls taking nowNs evaluate the harvested energy at that time, which must not go backwards.
+  */
+
+  /* Adds a node; a node keeps the tier it was first added with, and tier 0 is no tier. Returns false when nothing was added. */
+  bool AddNode (uint16_t tier, uint32_t addr, uint32_t energy, int64_t nowNs);
+  /* Returns the number of the profile, from 1; 0 when the profile is not valid. */
+  uint32_t AddHarvestProfile (const HarvestProfile &profile);
+  const HarvestProfile * GetHarvestProfile (uint32_t profile) const;
+  /* Node harvests with the given profile from now on, 0 for none; false for unknown nodes or profiles. */
+  bool SetNodeHarvestProfile (uint32_t addr, uint32_t profile, int64_t nowNs);
+  uint32_t GetHighestEnergyNodeInTier (uint16_t tier, int64_t nowNs) const;
+  /* Next hop in a tier for a packet sent by node from, according to the SelectionMode. */
+  uint32_t SelectNodeInTier (uint16_t tier, uint32_t from, int64_t nowNs) const;
+  /* Same, with the best other choice in backup (0 when there is none): the next hop to switch to when the chosen one fails. */
+  uint32_t SelectNodeInTier (uint16_t tier, uint32_t from, int64_t nowNs, uint32_t &backup) const;
+  /* Number of packets waiting in the MAC queue of a node; false for unknown nodes. */
+  bool SetNodeQueue (uint32_t addr, uint32_t packets);
+  /* 0 for unknown nodes. */
+  uint32_t GetNodeQueue (uint32_t addr) const;
+  /* Delivery probability per transmission of the link from -> to. */
+  void SetLinkDelivery (uint32_t from, uint32_t to, double delivery);
+  /* 1 until measured. */
+  double GetLinkDelivery (uint32_t from, uint32_t to) const;
+  double GetExpectedEnergyPerDeliveredPacket (uint32_t from, uint32_t to) const;
+  /* Tier of a node or of an alias of a node, 0 when unknown. */
+  uint16_t GetTier (uint32_t addr) const;
+  /* Takes the cost of one transmission from a node, never below zero. */
+  void ConsumeHop (uint32_t addr, int64_t nowNs);
+  /* Sets the energy of a node, e.g. from a battery reading; false for unknown nodes. */
+  bool SetNodeEnergy (uint32_t addr, uint32_t energy, int64_t nowNs);
+  uint32_t GetNodeEnergy (uint32_t addr, int64_t nowNs) const;
+  uint64_t GetTotalEnergyConsumed (void) const;
+  /* Harvested energy added to the nodes so far; counted when a node is changed, like the energy pressure. */
+  uint64_t GetTotalEnergyHarvested (void) const;
+  bool SetNodeAvailable (uint32_t addr, bool available, int64_t nowNs);
+  bool IsNodeAvailable (uint32_t addr) const;
+  /*
+  * A failed node (crashed or with a broken radio, as seen by the nodes sending to it) keeps its place in the ranking of its tier
+  * but is skipped by the selections until it is cleared. Failures are transient and not part of the snapshots.
+  */
+  bool SetNodeFailed (uint32_t addr, bool failed, int64_t nowNs);
+  bool IsNodeFailed (uint32_t addr) const;
+  /*
+  * A failed link (the frames of one sender to a node are lost) only skips the node in the selections of that sender, the others
+  * still choose it. to may be an alias of the node. Transient like the node failures; false for unknown nodes.
+  */
+  bool SetLinkFailed (uint32_t from, uint32_t to, bool failed);
+  bool IsLinkFailed (uint32_t from, uint32_t to) const;
+  void AddNodeAddress (uint32_t addr, uint32_t alias);
+  const std::vector<uint32_t> * GetNodeAddresses (uint32_t addr) const;
+  /* Aliases of all the nodes, by node. */
+  const std::map<uint32_t, std::vector<uint32_t> > & GetAllNodeAddresses (void) const;
+  const std::vector<uint32_t> & GetRelayCandidates (uint16_t tier) const;
+  /* Ranks the relay candidates of a tier with harvesting nodes again, as they rise without any change of the tier. */
+  void RefreshRelayCandidates (uint16_t tier, int64_t nowNs);
+  bool IsRelayCandidate (uint32_t addr) const;
+  uint16_t GetHighestTier (void) const;
+  uint32_t GetNumberOfNodes (void) const;
+  const std::map<uint32_t, NodeState> & GetNodes (void) const;
+  double GetTierEnergyPressure (uint16_t tier) const;
+  double GetPathEnergyPressure (uint16_t tier) const;
+
+  void AddGateway (uint32_t gateway, double linkQuality, int64_t nowNs);
+  void SetGatewayLinkQuality (uint32_t node, uint32_t gateway, double linkQuality);
+  /* Link quality from the node to the gateway: the one set for the pair, else the one of the gateway (0 for unknown gateways). */
+  double GetGatewayLinkQuality (uint32_t node, uint32_t gateway) const;
+  uint32_t SelectGateway (uint32_t node, int64_t nowNs);
+  uint32_t GetNumberOfGateways (void) const;
+  bool IsGateway (uint32_t addr) const;
+
+  bool SaveSnapshot (const std::string &path, int64_t nowNs) const;
+  /* Replaces the whole state; false, leaving the state unchanged, when the file is not a snapshot of this version. */
+  bool LoadSnapshot (const std::string &path, int64_t nowNs);
+
+  /* Applies a batch of updates, then publishes the result once. */
+  void ApplyUpdates (const std::vector<Update> &updates, int64_t nowNs);
+  /* Publishes the current state to the Readers, with the energies at nowNs. */
+  void Publish (int64_t nowNs);
+
+private:
+  RoutingCore (const RoutingCore &);
+  RoutingCore & operator= (const RoutingCore &);
+
+  /* Orders the nodes of a tier by decreasing energy, ties by increasing address. */
+  struct HigherEnergyFirst
+  {
+    bool operator() (const std::pair<uint32_t, uint32_t> &a, const std::pair<uint32_t, uint32_t> &b) const
+    {
+      if (a.first != b.first)
+        {
+          return a.first > b.first;
+        }
+      return a.second < b.second;
+    }
+  };
+  typedef std::set<std::pair<uint32_t, uint32_t>, HigherEnergyFirst> TierRanking;
+  /*
+  * Nodes of a tier harvesting with one profile, by decreasing harvestOffset: the harvested energy is the same for all of them,
+  * so this is also the order of their current energies and it does not change with time.
+  */
+  struct HigherOffsetFirst
+  {
+    bool operator() (const std::pair<double, uint32_t> &a, const std::pair<double, uint32_t> &b) const
+    {
+      if (a.first != b.first)
+        {
+          return a.first > b.first;
+        }
+      return a.second < b.second;
+    }
+  };
+  typedef std::set<std::pair<double, uint32_t>, HigherOffsetFirst> HarvestRanking;
+  /* Node of a tier with its current energy. */
+  typedef std::pair<uint32_t, uint32_t> RankedNode;
+
+  struct TierEnergy
+  {
+    uint64_t initial;
+    uint64_t spent;
+    uint32_t level;
+  };
+
+  struct GatewayState
+  {
+    uint32_t address;
+    double linkQuality;
+    double load;
+    int64_t lastUpdateNs;
+  };
+
+  /* Reader slot, one cache line each so readers do not share lines. */
+  struct Slot
+  {
+    std::atomic<uint64_t> epoch;
+    std::atomic<bool> used;
+    char padding[64 - sizeof (std::atomic<uint64_t>) - sizeof (std::atomic<bool>)];
+  };
+
+  uint32_t CurrentEnergy (const NodeState &state, int64_t nowNs) const;
+  void Rank (uint32_t addr, const NodeState &state);
+  void Unrank (uint32_t addr, const NodeState &state);
+  void Harvest (uint32_t addr, NodeState &state, int64_t nowNs);
+  void GetTierTop (uint16_t tier, uint32_t count, int64_t nowNs, std::vector<RankedNode> &top) const;
+  void ChangeEnergy (uint32_t addr, NodeState &state, uint32_t energy, int64_t nowNs);
+  void UpdateRelayCandidates (uint16_t tier, int64_t nowNs);
+  void UpdateTierPressure (uint16_t tier);
+  bool RestoreSnapshot (const uint8_t *data, uint64_t size, int64_t nowNs);
+  void ReclaimViews (void);
+
+  Config m_config;
+  Listener *m_listener;
+  uint64_t m_totalEnergyConsumed;
+  std::map<uint32_t, NodeState> m_nodes;
+  std::map<uint16_t, TierRanking> m_tierRankings;
+  /* Harvesting nodes, ranked per tier and profile instead of in m_tierRankings. */
+  std::map<uint16_t, std::map<uint32_t, HarvestRanking> > m_tierHarvestRankings;
+  std::vector<HarvestProfile> m_profiles;
+  uint64_t m_totalEnergyHarvested;
+  mutable std::vector<RankedNode> m_top;
+  /* Failed nodes, a few at a time, skipped by GetTierTop. */
+  std::set<uint32_t> m_failedNodes;
+  /* Failed links, keyed (to, from) like the link estimates, skipped by the selections of their sender. */
+  std::set<std::pair<uint32_t, uint32_t> > m_failedLinks;
+  std::map<uint16_t, std::vector<uint32_t> > m_tierRelayCandidates;
+  std::map<uint16_t, TierEnergy> m_tierEnergy;
+  std::map<uint32_t, std::vector<uint32_t> > m_nodeAddresses;
+  std::map<uint32_t, uint32_t> m_aliases;
+  /* Keyed (to, from), so the links into a node are one range. */
+  std::map<std::pair<uint32_t, uint32_t>, double> m_linkDelivery;
+  std::vector<GatewayState> m_gateways;
+  std::map<std::pair<uint32_t, uint32_t>, double> m_gatewayLinkQuality;
+
+  /* Read path state: the published View, the epochs and the Views waiting until no Reader can hold them. */
+  std::atomic<const View *> m_view;
+  mutable std::atomic<uint64_t> m_epoch;
+  mutable Slot m_slots[MAX_READERS];
+  std::vector<std::pair<uint64_t, const View *> > m_retired;
+  uint64_t m_version;
+  bool m_membershipChanged;
+  std::shared_ptr<const std::vector<std::pair<uint32_t, uint16_t> > > m_membership;
+};
+
+}
+
+#endif /* IOT_ROUTING_CORE_H */
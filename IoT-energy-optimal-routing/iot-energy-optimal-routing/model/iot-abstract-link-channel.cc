@@ -0,0 +1,271 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include "iot-abstract-link-channel.h"
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+#include "ns3/double.h"
+#include "ns3/node.h"
+#include "ns3/ipv4.h"
+#include "ns3/arp-header.h"
+#include "ns3/arp-l3-protocol.h"
+
+NS_LOG_COMPONENT_DEFINE ("IotAbstractLinkChannel");
+
+namespace ns3 {
+
+NS_OBJECT_ENSURE_REGISTERED (IotAbstractLinkChannel);
+
+TypeId
+IotAbstractLinkChannel::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::IotAbstractLinkChannel")
+    .SetParent<SimpleChannel> ()
+    .AddConstructor<IotAbstractLinkChannel> ()
+    .AddAttribute ("Range", "Unit disk radius in meters (0 puts every device in range).",
+                   DoubleValue (0.0),
+                   MakeDoubleAccessor (&IotAbstractLinkChannel::m_range),
+                   MakeDoubleChecker<double> (0.0))
+    .AddAttribute ("LossProbability", "Probability that a frame in range is lost.",
+                   DoubleValue (0.0),
+                   MakeDoubleAccessor (&IotAbstractLinkChannel::m_lossProbability),
+                   MakeDoubleChecker<double> (0.0, 1.0))
+    .AddAttribute ("Delay", "Propagation delay of every frame.",
+                   TimeValue (MicroSeconds (1)),
+                   MakeTimeAccessor (&IotAbstractLinkChannel::m_delay),
+                   MakeTimeChecker ())
+    .AddAttribute ("DataRate", "Rate of the receiving radios (0 gives them infinite capacity).",
+                   DataRateValue (DataRate (0)),
+                   MakeDataRateAccessor (&IotAbstractLinkChannel::m_dataRate),
+                   MakeDataRateChecker ())
+    .AddAttribute ("FrameOverhead", "Fixed air time of every frame on top of its bytes (preamble, MAC header, acknowledgement).",
+                   TimeValue (Seconds (0)),
+                   MakeTimeAccessor (&IotAbstractLinkChannel::m_frameOverhead),
+                   MakeTimeChecker ())
+    .AddAttribute ("MaxRxBacklog", "Frames that would wait longer than this for a busy receiver are dropped.",
+                   TimeValue (MilliSeconds (100)),
+                   MakeTimeAccessor (&IotAbstractLinkChannel::m_maxRxBacklog),
+                   MakeTimeChecker ())
+    .AddAttribute ("TxEnergyPerFrame", "Joules spent by the sender for every frame.",
+                   DoubleValue (0.0),
+                   MakeDoubleAccessor (&IotAbstractLinkChannel::m_txEnergyPerFrame),
+                   MakeDoubleChecker<double> (0.0))
+    .AddAttribute ("TxEnergyPerByte", "Joules spent by the sender for every byte.",
+                   DoubleValue (0.0),
+                   MakeDoubleAccessor (&IotAbstractLinkChannel::m_txEnergyPerByte),
+                   MakeDoubleChecker<double> (0.0))
+    .AddAttribute ("RxEnergyPerFrame", "Joules spent by a receiver for every frame.",
+                   DoubleValue (0.0),
+                   MakeDoubleAccessor (&IotAbstractLinkChannel::m_rxEnergyPerFrame),
+                   MakeDoubleChecker<double> (0.0))
+    .AddAttribute ("RxEnergyPerByte", "Joules spent by a receiver for every byte.",
+                   DoubleValue (0.0),
+                   MakeDoubleAccessor (&IotAbstractLinkChannel::m_rxEnergyPerByte),
+                   MakeDoubleChecker<double> (0.0))
+    ;
+  return tid;
+}
+
+IotAbstractLinkChannel::IotAbstractLinkChannel ()
+  : m_ipv4IndexBuilt (Seconds (-1)),
+    m_dropped (0)
+{
+  NS_LOG_FUNCTION (this);
+  m_random = CreateObject<UniformRandomVariable> ();
+}
+
+IotAbstractLinkChannel::~IotAbstractLinkChannel ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+int64_t
+IotAbstractLinkChannel::AssignStreams (int64_t stream)
+{
+  m_random->SetStream (stream);
+  return 1;
+}
+
+void
+IotAbstractLinkChannel::Add (Ptr<SimpleNetDevice> device)
+{
+  NS_LOG_FUNCTION (this << device);
+  SimpleChannel::Add (device);
+  DeviceState state;
+  state.device = device;
+  state.rxBusyUntil = Seconds (0);
+  state.energy = 0.0;
+  m_macIndex[Mac48Address::ConvertFrom (device->GetAddress ())] = m_devices.size ();
+  m_devices.push_back (state);
+}
+
+bool
+IotAbstractLinkChannel::InRange (DeviceState &a, DeviceState &b)
+{
+  if (m_range <= 0.0)
+    {
+      return true;
+    }
+  if (!a.mobility)
+    {
+      a.mobility = a.device->GetNode ()->GetObject<MobilityModel> ();
+    }
+  if (!b.mobility)
+    {
+      b.mobility = b.device->GetNode ()->GetObject<MobilityModel> ();
+    }
+  NS_ASSERT_MSG (a.mobility && b.mobility, "IotAbstractLinkChannel Range needs a MobilityModel on every node");
+  return a.mobility->GetDistanceFrom (b.mobility) <= m_range;
+}
+
+void
+IotAbstractLinkChannel::RebuildIpv4Index (void)
+{
+  m_ipv4Index.clear ();
+  for (uint32_t i = 0; i < m_devices.size (); i++)
+    {
+      Ptr<Ipv4> ipv4 = m_devices[i].device->GetNode ()->GetObject<Ipv4> ();
+      if (!ipv4)
+        {
+          continue;
+        }
+      int32_t interface = ipv4->GetInterfaceForDevice (m_devices[i].device);
+      if (interface < 0)
+        {
+          continue;
+        }
+      for (uint32_t j = 0; j < ipv4->GetNAddresses (interface); j++)
+        {
+          m_ipv4Index[ipv4->GetAddress (interface, j).GetLocal ()] = i;
+        }
+    }
+  m_ipv4IndexBuilt = Simulator::Now ();
+}
+
+/*
+* The address to device index is built on the first ARP request and rebuilt on a miss (at most once per second of simulated time),
+* so addresses added during the simulation are found.
+*/
+int32_t
+IotAbstractLinkChannel::FindDeviceByIpv4 (Ipv4Address addr)
+{
+  std::map<Ipv4Address, uint32_t>::const_iterator it = m_ipv4Index.find (addr);
+  if (it == m_ipv4Index.end () && (m_ipv4IndexBuilt < Seconds (0) || Simulator::Now () - m_ipv4IndexBuilt >= Seconds (1)))
+    {
+      RebuildIpv4Index ();
+      it = m_ipv4Index.find (addr);
+    }
+  if (it == m_ipv4Index.end ())
+    {
+      return -1;
+    }
+  return it->second;
+}
+
+void
+IotAbstractLinkChannel::Send (Ptr<Packet> p, uint16_t protocol, Mac48Address to, Mac48Address from, Ptr<SimpleNetDevice> sender)
+{
+  NS_LOG_FUNCTION (this << p << protocol << to << from << sender);
+  std::map<Mac48Address, uint32_t>::const_iterator senderIt = m_macIndex.find (from);
+  NS_ASSERT_MSG (senderIt != m_macIndex.end (), "Sender is not attached to this channel");
+  uint32_t senderIndex = senderIt->second;
+  m_devices[senderIndex].energy += m_txEnergyPerFrame + m_txEnergyPerByte * p->GetSize ();
+
+  if (!to.IsBroadcast () && !to.IsGroup ())
+    {
+      std::map<Mac48Address, uint32_t>::const_iterator it = m_macIndex.find (to);
+      if (it != m_macIndex.end ())
+        {
+          Deliver (senderIndex, it->second, p, protocol, to, from);
+        }
+      return;
+    }
+
+  if (protocol == ArpL3Protocol::PROT_NUMBER)
+    {
+      ArpHeader arp;
+      p->PeekHeader (arp);
+      if (arp.IsRequest ())
+        {
+          int32_t target = FindDeviceByIpv4 (arp.GetDestinationIpv4Address ());
+          if (target >= 0 && (uint32_t) target != senderIndex)
+            {
+              Deliver (senderIndex, target, p, protocol, to, from);
+            }
+          return;
+        }
+    }
+
+  for (uint32_t i = 0; i < m_devices.size (); i++)
+    {
+      if (i != senderIndex)
+        {
+          Deliver (senderIndex, i, p, protocol, to, from);
+        }
+    }
+}
+
+void
+IotAbstractLinkChannel::Deliver (uint32_t sender, uint32_t receiver, Ptr<Packet> p, uint16_t protocol, Mac48Address to, Mac48Address from)
+{
+  DeviceState &rx = m_devices[receiver];
+  if (!InRange (m_devices[sender], rx))
+    {
+      return;
+    }
+  if (m_lossProbability > 0.0 && m_random->GetValue () < m_lossProbability)
+    {
+      m_dropped++;
+      return;
+    }
+
+  Time arrival = Simulator::Now () + m_delay;
+  if (m_dataRate.GetBitRate () > 0 || !m_frameOverhead.IsZero ())
+    {
+      Time start = arrival > rx.rxBusyUntil ? arrival : rx.rxBusyUntil;
+      if (start - arrival > m_maxRxBacklog)
+        {
+          m_dropped++;
+          return;
+        }
+      rx.rxBusyUntil = start + m_frameOverhead;
+      if (m_dataRate.GetBitRate () > 0)
+        {
+          rx.rxBusyUntil += m_dataRate.CalculateBytesTxTime (p->GetSize ());
+        }
+      arrival = rx.rxBusyUntil;
+    }
+  rx.energy += m_rxEnergyPerFrame + m_rxEnergyPerByte * p->GetSize ();
+
+  Simulator::ScheduleWithContext (rx.device->GetNode ()->GetId (), arrival - Simulator::Now (),
+                                  &SimpleNetDevice::Receive, rx.device, p->Copy (), protocol, to, from);
+}
+
+double
+IotAbstractLinkChannel::GetDeviceEnergyConsumed (Ptr<NetDevice> device) const
+{
+  std::map<Mac48Address, uint32_t>::const_iterator it = m_macIndex.find (Mac48Address::ConvertFrom (device->GetAddress ()));
+  if (it == m_macIndex.end ())
+    {
+      return 0.0;
+    }
+  return m_devices[it->second].energy;
+}
+
+double
+IotAbstractLinkChannel::GetTotalEnergyConsumed (void) const
+{
+  double total = 0.0;
+  for (uint32_t i = 0; i < m_devices.size (); i++)
+    {
+      total += m_devices[i].energy;
+    }
+  return total;
+}
+
+uint64_t
+IotAbstractLinkChannel::GetDroppedFrames (void) const
+{
+  return m_dropped;
+}
+
+}
@@ -0,0 +1,82 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef IOT_ABSTRACT_LINK_CHANNEL_H
+#define IOT_ABSTRACT_LINK_CHANNEL_H
+
+#include "ns3/simple-channel.h"
+#include "ns3/simple-net-device.h"
+#include "ns3/mac48-address.h"
+#include "ns3/ipv4-address.h"
+#include "ns3/mobility-model.h"
+#include "ns3/random-variable-stream.h"
+#include "ns3/data-rate.h"
+#include "ns3/nstime.h"
+#include <vector>
+#include <map>
+
+namespace ns3 {
+
+/*
+* Cheap link layer for routing scale experiments, used with SimpleNetDevice in place of the Wi-Fi PHY/MAC.
+* Actions performed:
+* 1. Unit disk: a frame reaches a device only if both are within Range meters (Range 0 disables the check, needs a MobilityModel on the nodes).
+* 2. Fixed loss: every frame that is in range is dropped with probability LossProbability.
+* 3. Unicast frames are handed only to the addressed device and ARP requests only to the owner of the requested address,
+*    so the cost of a transmission does not grow with the number of nodes. Other broadcast frames go to every device in range.
+* 4. When DataRate (or FrameOverhead) is set the receiver radio is a single server: every frame occupies it for FrameOverhead plus its bytes
+*    at DataRate, frames arriving while it is busy wait (at most MaxRxBacklog).
+* 5. Energy per transmission: TxEnergyPerFrame + TxEnergyPerByte * size for the sender, RxEnergyPerFrame + RxEnergyPerByte * size for every receiver.
+*/
+class IotAbstractLinkChannel : public SimpleChannel
+{
+public:
+  static TypeId GetTypeId (void);
+
+  IotAbstractLinkChannel ();
+  virtual ~IotAbstractLinkChannel ();
+
+  virtual void Send (Ptr<Packet> p, uint16_t protocol, Mac48Address to, Mac48Address from, Ptr<SimpleNetDevice> sender);
+  virtual void Add (Ptr<SimpleNetDevice> device);
+
+  /* Energy in joules spent by the radio of a device of this channel. */
+  double GetDeviceEnergyConsumed (Ptr<NetDevice> device) const;
+  double GetTotalEnergyConsumed (void) const;
+  uint64_t GetDroppedFrames (void) const;
+
+  int64_t AssignStreams (int64_t stream);
+
+private:
+  struct DeviceState
+  {
+    Ptr<SimpleNetDevice> device;
+    Ptr<MobilityModel> mobility;
+    Time rxBusyUntil;
+    double energy;
+  };
+
+  bool InRange (DeviceState &a, DeviceState &b);
+  void Deliver (uint32_t sender, uint32_t receiver, Ptr<Packet> p, uint16_t protocol, Mac48Address to, Mac48Address from);
+  int32_t FindDeviceByIpv4 (Ipv4Address addr);
+  void RebuildIpv4Index (void);
+
+  double m_range;
+  double m_lossProbability;
+  Time m_delay;
+  DataRate m_dataRate;
+  Time m_frameOverhead;
+  Time m_maxRxBacklog;
+  double m_txEnergyPerFrame;
+  double m_txEnergyPerByte;
+  double m_rxEnergyPerFrame;
+  double m_rxEnergyPerByte;
+  Ptr<UniformRandomVariable> m_random;
+
+  std::vector<DeviceState> m_devices;
+  std::map<Mac48Address, uint32_t> m_macIndex;
+  std::map<Ipv4Address, uint32_t> m_ipv4Index;
+  Time m_ipv4IndexBuilt;
+  uint64_t m_dropped;
+};
+
+}
+
+#endif /* IOT_ABSTRACT_LINK_CHANNEL_H */
@@ -0,0 +1,306 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include "iot-adaptive-source.h"
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+#include "ns3/packet.h"
+#include "ns3/ipv4.h"
+#include "ns3/uinteger.h"
+#include "ns3/double.h"
+#include "ns3/pointer.h"
+#include <algorithm>
+
+NS_LOG_COMPONENT_DEFINE ("IotAdaptiveSource");
+
+namespace ns3 {
+
+NS_OBJECT_ENSURE_REGISTERED (IotReadingsHeader);
+NS_OBJECT_ENSURE_REGISTERED (IotAdaptiveSource);
+
+IotReadingsHeader::IotReadingsHeader ()
+  : m_readings (0),
+    m_highPriority (0),
+    m_firstReadingNs (0)
+{}
+
+TypeId
+IotReadingsHeader::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::IotReadingsHeader")
+    .SetParent<Header> ()
+    .AddConstructor<IotReadingsHeader> ()
+    ;
+  return tid;
+}
+
+TypeId
+IotReadingsHeader::GetInstanceTypeId (void) const
+{
+  return GetTypeId ();
+}
+
+uint32_t
+IotReadingsHeader::GetSerializedSize (void) const
+{
+  return 12;
+}
+
+void
+IotReadingsHeader::Serialize (Buffer::Iterator start) const
+{
+  start.WriteHtonU16 (m_readings);
+  start.WriteHtonU16 (m_highPriority);
+  start.WriteHtonU64 (m_firstReadingNs);
+}
+
+uint32_t
+IotReadingsHeader::Deserialize (Buffer::Iterator start)
+{
+  m_readings = start.ReadNtohU16 ();
+  m_highPriority = start.ReadNtohU16 ();
+  m_firstReadingNs = start.ReadNtohU64 ();
+  return GetSerializedSize ();
+}
+
+void
+IotReadingsHeader::Print (std::ostream &os) const
+{
+  os << "readings=" << m_readings << " highPriority=" << m_highPriority << " first=" << m_firstReadingNs << "ns";
+}
+
+void
+IotReadingsHeader::SetReadings (uint16_t readings, uint16_t highPriority)
+{
+  m_readings = readings;
+  m_highPriority = highPriority;
+}
+
+uint16_t
+IotReadingsHeader::GetReadings (void) const
+{
+  return m_readings;
+}
+
+uint16_t
+IotReadingsHeader::GetHighPriorityReadings (void) const
+{
+  return m_highPriority;
+}
+
+void
+IotReadingsHeader::SetFirstReadingTime (Time time)
+{
+  m_firstReadingNs = time.GetNanoSeconds ();
+}
+
+Time
+IotReadingsHeader::GetFirstReadingTime (void) const
+{
+  return NanoSeconds (m_firstReadingNs);
+}
+
+TypeId
+IotAdaptiveSource::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::IotAdaptiveSource")
+    .SetParent<Application> ()
+    .AddConstructor<IotAdaptiveSource> ()
+    .AddAttribute ("Remote", "Address the readings are sent to.",
+                   AddressValue (),
+                   MakeAddressAccessor (&IotAdaptiveSource::m_remote),
+                   MakeAddressChecker ())
+    .AddAttribute ("Interval", "Time between readings without energy pressure.",
+                   TimeValue (Seconds (1.0)),
+                   MakeTimeAccessor (&IotAdaptiveSource::m_interval),
+                   MakeTimeChecker ())
+    .AddAttribute ("ReadingSize", "Bytes of payload per reading.",
+                   UintegerValue (16),
+                   MakeUintegerAccessor (&IotAdaptiveSource::m_readingSize),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("HighPriorityEvery", "Every n-th reading is high priority (0: none).",
+                   UintegerValue (10),
+                   MakeUintegerAccessor (&IotAdaptiveSource::m_highPriorityEvery),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("MinRate", "Lowest share of the reading rate kept under energy pressure (1: no throttling).",
+                   DoubleValue (1.0),
+                   MakeDoubleAccessor (&IotAdaptiveSource::m_minRate),
+                   MakeDoubleChecker<double> (1e-3, 1.0))
+    .AddAttribute ("MaxBatch", "Readings per packet at full energy pressure (1: no batching).",
+                   UintegerValue (1),
+                   MakeUintegerAccessor (&IotAdaptiveSource::m_maxBatch),
+                   MakeUintegerChecker<uint32_t> (1, 65535))
+    .AddAttribute ("DropThreshold", "Energy pressure above which low priority readings are dropped (1: never).",
+                   DoubleValue (1.0),
+                   MakeDoubleAccessor (&IotAdaptiveSource::m_dropThreshold),
+                   MakeDoubleChecker<double> (0.0, 1.0))
+    .AddAttribute ("RoutingProcessor", "Route processor publishing the energy pressure of the tiers.",
+                   PointerValue (),
+                   MakePointerAccessor (&IotAdaptiveSource::m_processor),
+                   MakePointerChecker<IotEnergyOptimalRouteProcessor> ())
+    .AddTraceSource ("Tx", "A packet of readings is sent.",
+                     MakeTraceSourceAccessor (&IotAdaptiveSource::m_txTrace),
+                     "ns3::Packet::TracedCallback")
+    ;
+  return tid;
+}
+
+IotAdaptiveSource::IotAdaptiveSource ()
+  : m_readingSize (16),
+    m_highPriorityEvery (10),
+    m_minRate (1.0),
+    m_maxBatch (1),
+    m_dropThreshold (1.0),
+    m_maxReadingsPerPacket (1),
+    m_tier (0),
+    m_pressure (0.0),
+    m_batchReadings (0),
+    m_batchHighPriority (0),
+    m_generated (0),
+    m_dropped (0),
+    m_sent (0)
+{
+  NS_LOG_FUNCTION (this);
+  m_random = CreateObject<UniformRandomVariable> ();
+}
+
+IotAdaptiveSource::~IotAdaptiveSource ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+int64_t
+IotAdaptiveSource::AssignStreams (int64_t stream)
+{
+  m_random->SetStream (stream);
+  return 1;
+}
+
+void
+IotAdaptiveSource::DoDispose (void)
+{
+  m_socket = 0;
+  m_processor = 0;
+  Application::DoDispose ();
+}
+
+/*
+* The batches are bounded once, by the readings of ReadingSize that fit in a UDP datagram with the header.
+* The first reading is taken at a random time within one Interval, so the sources do not send together.
+*/
+void
+IotAdaptiveSource::StartApplication (void)
+{
+  NS_LOG_FUNCTION (this);
+  NS_ASSERT_MSG (m_processor, "IotAdaptiveSource needs a RoutingProcessor");
+  uint32_t headerSize = IotReadingsHeader ().GetSerializedSize ();
+  NS_ASSERT_MSG (m_readingSize + headerSize <= MAX_PAYLOAD, "IotAdaptiveSource ReadingSize does not fit in a UDP datagram");
+  m_maxReadingsPerPacket = m_readingSize ? (MAX_PAYLOAD - headerSize) / m_readingSize : m_maxBatch;
+  if (!m_socket)
+    {
+      m_socket = Socket::CreateSocket (GetNode (), TypeId::LookupByName ("ns3::UdpSocketFactory"));
+      m_socket->Bind ();
+      m_socket->Connect (m_remote);
+    }
+  Ptr<Ipv4> ipv4 = GetNode ()->GetObject<Ipv4> ();
+  m_tier = m_processor->GetTierFromIpAddress (ipv4->GetAddress (1, 0).GetLocal ());
+  m_pressure = m_processor->GetPathEnergyPressure (m_tier);
+  m_processor->TraceConnectWithoutContext ("EnergyPressureChanged", MakeCallback (&IotAdaptiveSource::PressureChanged, this));
+  m_readingEvent = Simulator::Schedule (Seconds (m_random->GetValue (0.0, m_interval.GetSeconds ())),
+                                        &IotAdaptiveSource::TakeReading, this);
+}
+
+void
+IotAdaptiveSource::StopApplication (void)
+{
+  NS_LOG_FUNCTION (this);
+  Simulator::Cancel (m_readingEvent);
+  m_processor->TraceDisconnectWithoutContext ("EnergyPressureChanged", MakeCallback (&IotAdaptiveSource::PressureChanged, this));
+  SendBatch ();
+}
+
+void
+IotAdaptiveSource::PressureChanged (uint16_t tier, double pressure)
+{
+  if (tier < m_tier)
+    {
+      m_pressure = m_processor->GetPathEnergyPressure (m_tier);
+    }
+}
+
+void
+IotAdaptiveSource::TakeReading (void)
+{
+  m_generated++;
+  bool highPriority = m_highPriorityEvery > 0 && m_generated % m_highPriorityEvery == 0;
+  if (!highPriority && m_pressure > m_dropThreshold)
+    {
+      m_dropped++;
+    }
+  else
+    {
+      if (m_batchReadings == 0)
+        {
+          m_batchStart = Simulator::Now ();
+        }
+      m_batchReadings++;
+      m_batchHighPriority += highPriority ? 1 : 0;
+      uint32_t batch = std::min (1 + (uint32_t) (m_pressure * (m_maxBatch - 1) + 0.5), m_maxReadingsPerPacket);
+      if (highPriority || m_batchReadings >= batch)
+        {
+          SendBatch ();
+        }
+    }
+  double rate = std::max (m_minRate, 1.0 - m_pressure);
+  m_readingEvent = Simulator::Schedule (Seconds (m_interval.GetSeconds () / rate), &IotAdaptiveSource::TakeReading, this);
+}
+
+void
+IotAdaptiveSource::SendBatch (void)
+{
+  if (m_batchReadings == 0)
+    {
+      return;
+    }
+  Ptr<Packet> p = Create<Packet> (m_batchReadings * m_readingSize);
+  IotReadingsHeader header;
+  header.SetReadings (m_batchReadings, m_batchHighPriority);
+  header.SetFirstReadingTime (m_batchStart);
+  p->AddHeader (header);
+  if (m_socket->Send (p) >= 0)
+    {
+      m_txTrace (p);
+      m_sent++;
+    }
+  else
+    {
+      NS_LOG_LOGIC ("Packet of " << m_batchReadings << " readings not sent: " << m_socket->GetErrno ());
+    }
+  m_batchReadings = 0;
+  m_batchHighPriority = 0;
+}
+
+uint64_t
+IotAdaptiveSource::GetReadingsGenerated (void) const
+{
+  return m_generated;
+}
+
+uint64_t
+IotAdaptiveSource::GetReadingsDropped (void) const
+{
+  return m_dropped;
+}
+
+uint64_t
+IotAdaptiveSource::GetPacketsSent (void) const
+{
+  return m_sent;
+}
+
+double
+IotAdaptiveSource::GetPressure (void) const
+{
+  return m_pressure;
+}
+
+}
@@ -0,0 +1,110 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef IOT_ADAPTIVE_SOURCE_H
+#define IOT_ADAPTIVE_SOURCE_H
+
+#include "ns3/application.h"
+#include "ns3/header.h"
+#include "ns3/socket.h"
+#include "ns3/address.h"
+#include "ns3/event-id.h"
+#include "ns3/nstime.h"
+#include "ns3/traced-callback.h"
+#include "ns3/random-variable-stream.h"
+#include "iot-energy-optimal-route-processor.h"
+
+namespace ns3 {
+
+/*
+* Header of the packets of IotAdaptiveSource: the number of readings the packet carries, how many of them are high priority,
+* and the time the first of them was taken.
+*/
+class IotReadingsHeader : public Header
+{
+public:
+  IotReadingsHeader ();
+
+  static TypeId GetTypeId (void);
+  virtual TypeId GetInstanceTypeId (void) const;
+  virtual uint32_t GetSerializedSize (void) const;
+  virtual void Serialize (Buffer::Iterator start) const;
+  virtual uint32_t Deserialize (Buffer::Iterator start);
+  virtual void Print (std::ostream &os) const;
+
+  void SetReadings (uint16_t readings, uint16_t highPriority);
+  uint16_t GetReadings (void) const;
+  uint16_t GetHighPriorityReadings (void) const;
+  void SetFirstReadingTime (Time time);
+  Time GetFirstReadingTime (void) const;
+
+private:
+  uint16_t m_readings;
+  uint16_t m_highPriority;
+  int64_t m_firstReadingNs;
+};
+
+/*
+* Sensor source that follows the energy pressure of the tiers relaying its packets (the path pressure of its tier, updated on
+* the EnergyPressureChanged trace of the route processor). With pressure p it
+*   throttles: takes readings at max (MinRate, 1 - p) times the rate of Interval,
+*   batches: sends 1 + p * (MaxBatch - 1) readings per packet, at most as many as fit in one UDP datagram (high priority
+*            readings flush the batch),
+*   drops: discards low priority readings while p is above DropThreshold.
+* Every HighPriorityEvery-th reading is high priority. The defaults adapt nothing.
+*/
+class IotAdaptiveSource : public Application
+{
+public:
+  /* Largest UDP payload over IPv4. */
+  static const uint32_t MAX_PAYLOAD = 65507;
+
+  static TypeId GetTypeId (void);
+
+  IotAdaptiveSource ();
+  virtual ~IotAdaptiveSource ();
+
+  int64_t AssignStreams (int64_t stream);
+  uint64_t GetReadingsGenerated (void) const;
+  uint64_t GetReadingsDropped (void) const;
+  uint64_t GetPacketsSent (void) const;
+  /* Path pressure the source currently adapts to. */
+  double GetPressure (void) const;
+
+protected:
+  virtual void DoDispose (void);
+
+private:
+  virtual void StartApplication (void);
+  virtual void StopApplication (void);
+
+  void PressureChanged (uint16_t tier, double pressure);
+  void TakeReading (void);
+  void SendBatch (void);
+
+  Address m_remote;
+  Time m_interval;
+  uint32_t m_readingSize;
+  uint32_t m_highPriorityEvery;
+  double m_minRate;
+  uint32_t m_maxBatch;
+  double m_dropThreshold;
+  Ptr<IotEnergyOptimalRouteProcessor> m_processor;
+  Ptr<UniformRandomVariable> m_random;
+
+  Ptr<Socket> m_socket;
+  uint32_t m_maxReadingsPerPacket;
+  uint16_t m_tier;
+  double m_pressure;
+  EventId m_readingEvent;
+  uint16_t m_batchReadings;
+  uint16_t m_batchHighPriority;
+  Time m_batchStart;
+
+  uint64_t m_generated;
+  uint64_t m_dropped;
+  uint64_t m_sent;
+  TracedCallback<Ptr<const Packet> > m_txTrace;
+};
+
+}
+
+#endif /* IOT_ADAPTIVE_SOURCE_H */
@@ -0,0 +1,248 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include "iot-duty-cycle-controller.h"
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+#include "ns3/pointer.h"
+#include "ns3/wifi-net-device.h"
+
+NS_LOG_COMPONENT_DEFINE ("IotDutyCycleController");
+
+namespace ns3 {
+
+NS_OBJECT_ENSURE_REGISTERED (IotDutyCycleController);
+
+TypeId
+IotDutyCycleController::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::IotDutyCycleController")
+    .SetParent<Object> ()
+    .AddConstructor<IotDutyCycleController> ()
+    .AddAttribute ("RoutingProcessor", "Route processor publishing the relay candidates.",
+                   PointerValue (),
+                   MakePointerAccessor (&IotDutyCycleController::SetRouteProcessor),
+                   MakePointerChecker<IotEnergyOptimalRouteProcessor> ())
+    .AddAttribute ("SleepDelay", "Time a radio stays awake after sending or after its node stopped being a relay candidate.",
+                   TimeValue (MilliSeconds (100)),
+                   MakeTimeAccessor (&IotDutyCycleController::m_sleepDelay),
+                   MakeTimeChecker ())
+    ;
+  return tid;
+}
+
+IotDutyCycleController::IotDutyCycleController ()
+  : m_highestTier (0),
+    m_wakeups (0)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+IotDutyCycleController::~IotDutyCycleController ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+void
+IotDutyCycleController::DoDispose (void)
+{
+  for (std::map<Ipv4Address, NodeRadio>::iterator it = m_radios.begin (); it != m_radios.end (); it++)
+    {
+      it->second.sleepEvent.Cancel ();
+    }
+  m_radios.clear ();
+  m_processor = 0;
+  Object::DoDispose ();
+}
+
+void
+IotDutyCycleController::SetRouteProcessor (Ptr<IotEnergyOptimalRouteProcessor> processor)
+{
+  NS_LOG_FUNCTION (this << processor);
+  m_processor = processor;
+  if (m_processor)
+    {
+      m_processor->TraceConnectWithoutContext ("RelayCandidatesChanged", MakeCallback (&IotDutyCycleController::RelayCandidatesChanged, this));
+    }
+}
+
+/*
+* Nodes of the highest tier have no upstream tier, so they are never kept awake as relays. When a node of a new highest tier
+* is added, the candidates of the previous highest tier become relays.
+*/
+void
+IotDutyCycleController::AddNode (Ipv4Address addr, Ptr<NetDevice> device)
+{
+  NS_LOG_FUNCTION (this << addr << device);
+  NS_ASSERT_MSG (m_processor, "IotDutyCycleController needs a RoutingProcessor");
+  Ptr<WifiNetDevice> wifi = DynamicCast<WifiNetDevice> (device);
+  if (!wifi)
+    {
+      return;
+    }
+  NodeRadio &radio = m_radios[addr];
+  radio.phy = wifi->GetPhy ();
+  radio.tier = m_processor->GetTierFromIpAddress (addr);
+  m_relays[radio.tier] = m_processor->GetRelayCandidates (radio.tier);
+  if (radio.tier > m_highestTier)
+    {
+      uint16_t previous = m_highestTier;
+      m_highestTier = radio.tier;
+      std::vector<Ipv4Address> relays = m_relays[previous];
+      for (std::vector<Ipv4Address>::const_iterator it = relays.begin (); it != relays.end (); it++)
+        {
+          Update (*it);
+        }
+    }
+  Update (addr);
+}
+
+void
+IotDutyCycleController::NotifyTransmit (Ipv4Address addr)
+{
+  std::map<Ipv4Address, NodeRadio>::iterator it = m_radios.find (addr);
+  if (it == m_radios.end ())
+    {
+      return;
+    }
+  NodeRadio &radio = it->second;
+  radio.awakeUntil = Simulator::Now () + m_sleepDelay;
+  Wake (addr, radio);
+  if (!IsRelay (addr, radio))
+    {
+      radio.sleepEvent.Cancel ();
+      radio.sleepEvent = Simulator::Schedule (m_sleepDelay, &IotDutyCycleController::Sleep, this, addr);
+    }
+}
+
+void
+IotDutyCycleController::NotifyReceive (Ipv4Address addr)
+{
+  NotifyTransmit (addr);
+}
+
+/*
+* Every radio is visited; multicast packets (firmware) are rare.
+*/
+void
+IotDutyCycleController::NotifyTierReceive (uint16_t tier)
+{
+  for (std::map<Ipv4Address, NodeRadio>::const_iterator it = m_radios.begin (); it != m_radios.end (); it++)
+    {
+      if (it->second.tier == tier)
+        {
+          NotifyTransmit (it->first);
+        }
+    }
+}
+
+/*
+* Both the nodes that left and the nodes that entered the candidates of the tier are updated.
+*/
+void
+IotDutyCycleController::RelayCandidatesChanged (uint16_t tier)
+{
+  std::vector<Ipv4Address> nodes = m_relays[tier];
+  const std::vector<Ipv4Address> &candidates = m_processor->GetRelayCandidates (tier);
+  m_relays[tier] = candidates;
+  nodes.insert (nodes.end (), candidates.begin (), candidates.end ());
+  for (std::vector<Ipv4Address>::const_iterator it = nodes.begin (); it != nodes.end (); it++)
+    {
+      Update (*it);
+    }
+}
+
+bool
+IotDutyCycleController::IsRelay (Ipv4Address addr, const NodeRadio &radio) const
+{
+  return radio.tier < m_highestTier && m_processor->IsRelayCandidate (addr);
+}
+
+void
+IotDutyCycleController::Update (Ipv4Address addr)
+{
+  std::map<Ipv4Address, NodeRadio>::iterator it = m_radios.find (addr);
+  if (it == m_radios.end ())
+    {
+      return;
+    }
+  NodeRadio &radio = it->second;
+  if (IsRelay (addr, radio))
+    {
+      radio.sleepEvent.Cancel ();
+      Wake (addr, radio);
+      return;
+    }
+  if (radio.phy->IsStateSleep () || radio.sleepEvent.IsRunning ())
+    {
+      return;
+    }
+  Time at = Simulator::Now () + m_sleepDelay;
+  if (radio.awakeUntil > at)
+    {
+      at = radio.awakeUntil;
+    }
+  radio.sleepEvent = Simulator::Schedule (at - Simulator::Now (), &IotDutyCycleController::Sleep, this, addr);
+}
+
+/*
+* A radio in the middle of a transmission is left awake for another SleepDelay.
+*/
+void
+IotDutyCycleController::Sleep (Ipv4Address addr)
+{
+  NodeRadio &radio = m_radios[addr];
+  if (IsRelay (addr, radio) || radio.phy->IsStateSleep ())
+    {
+      return;
+    }
+  if (radio.phy->IsStateTx () || Simulator::Now () < radio.awakeUntil)
+    {
+      radio.sleepEvent = Simulator::Schedule (m_sleepDelay, &IotDutyCycleController::Sleep, this, addr);
+      return;
+    }
+  NS_LOG_LOGIC ("Radio of " << addr << " goes to sleep");
+  radio.phy->SetSleepMode ();
+  radio.sleepStart = Simulator::Now ();
+}
+
+void
+IotDutyCycleController::Wake (Ipv4Address addr, NodeRadio &radio)
+{
+  if (!radio.phy->IsStateSleep ())
+    {
+      return;
+    }
+  NS_LOG_LOGIC ("Radio of " << addr << " wakes up");
+  radio.phy->ResumeFromSleep ();
+  m_sleepTime += Simulator::Now () - radio.sleepStart;
+  m_wakeups++;
+}
+
+bool
+IotDutyCycleController::IsAwake (Ipv4Address addr) const
+{
+  std::map<Ipv4Address, NodeRadio>::const_iterator it = m_radios.find (addr);
+  return it == m_radios.end () || !it->second.phy->IsStateSleep ();
+}
+
+Time
+IotDutyCycleController::GetTotalSleepTime (void) const
+{
+  Time total = m_sleepTime;
+  for (std::map<Ipv4Address, NodeRadio>::const_iterator it = m_radios.begin (); it != m_radios.end (); it++)
+    {
+      if (it->second.phy->IsStateSleep ())
+        {
+          total += Simulator::Now () - it->second.sleepStart;
+        }
+    }
+  return total;
+}
+
+uint64_t
+IotDutyCycleController::GetWakeups (void) const
+{
+  return m_wakeups;
+}
+
+}
@@ -0,0 +1,76 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef IOT_DUTY_CYCLE_CONTROLLER_H
+#define IOT_DUTY_CYCLE_CONTROLLER_H
+
+#include "ns3/object.h"
+#include "ns3/nstime.h"
+#include "ns3/event-id.h"
+#include "ns3/net-device.h"
+#include "ns3/wifi-phy.h"
+#include "iot-energy-optimal-route-processor.h"
+#include <map>
+#include <vector>
+
+namespace ns3 {
+
+/*
+* Puts the Wi-Fi radio of the nodes that are not relay candidates of the IotEnergyOptimalRouteProcessor into the PHY sleep state.
+* A node is kept awake while it is one of the RelayCandidates of its tier and a higher tier sends to it; since the candidates
+* include the likely next relays, a node is woken when it enters the candidates, before it becomes the relay of its tier.
+* A node that has to send (NotifyTransmit, called by IotEnergyOptimalRouting) is woken and stays awake for SleepDelay,
+* which is also the time a node keeps listening after it stopped being a candidate, so its queued packets get out.
+* Downlink packets go up the tiers, to nodes that are not kept awake: the receiver of a unicast packet (NotifyReceive) or every
+* node of the tier a multicast packet is sent to (NotifyTierReceive) is woken for SleepDelay the same way.
+* Packets handed to a sleeping radio wait in its MAC queue until it wakes up.
+*/
+class IotDutyCycleController : public Object
+{
+public:
+  static TypeId GetTypeId (void);
+
+  IotDutyCycleController ();
+  virtual ~IotDutyCycleController ();
+
+  void SetRouteProcessor (Ptr<IotEnergyOptimalRouteProcessor> processor);
+  /* Controls the radio of a Wi-Fi device of a node; the node must already have its tier. Other devices are ignored. */
+  void AddNode (Ipv4Address addr, Ptr<NetDevice> device);
+  void NotifyTransmit (Ipv4Address addr);
+  void NotifyReceive (Ipv4Address addr);
+  void NotifyTierReceive (uint16_t tier);
+
+  bool IsAwake (Ipv4Address addr) const;
+  /* Time spent asleep by all the controlled radios (up to now). */
+  Time GetTotalSleepTime (void) const;
+  uint64_t GetWakeups (void) const;
+
+protected:
+  virtual void DoDispose (void);
+
+private:
+  struct NodeRadio
+  {
+    Ptr<WifiPhy> phy;
+    uint16_t tier;
+    Time awakeUntil;
+    Time sleepStart;
+    EventId sleepEvent;
+  };
+
+  void RelayCandidatesChanged (uint16_t tier);
+  bool IsRelay (Ipv4Address addr, const NodeRadio &radio) const;
+  void Update (Ipv4Address addr);
+  void Sleep (Ipv4Address addr);
+  void Wake (Ipv4Address addr, NodeRadio &radio);
+
+  Ptr<IotEnergyOptimalRouteProcessor> m_processor;
+  Time m_sleepDelay;
+  std::map<Ipv4Address, NodeRadio> m_radios;
+  std::map<uint16_t, std::vector<Ipv4Address> > m_relays;
+  uint16_t m_highestTier;
+  Time m_sleepTime;
+  uint64_t m_wakeups;
+};
+
+}
+
+#endif /* IOT_DUTY_CYCLE_CONTROLLER_H */
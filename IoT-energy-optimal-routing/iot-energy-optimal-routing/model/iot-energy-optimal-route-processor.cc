@@ -8,6 +8,10 @@
 #include "ns3/object.h"
 #include "ns3/log.h"
 #include "ns3/simulator.h"
+#include "ns3/boolean.h"
+#include "ns3/uinteger.h"
+#include "ns3/double.h"
+#include "ns3/enum.h"
 #include "ns3/mobility-model.h"
 #include <string>
 #include <boost/lexical_cast.hpp>
@@ -20,36 +24,124 @@ NS_LOG_COMPONENT_DEFINE ("IotEnergyOptimalRouteProcessor");
 namespace ns3 {
 NS_OBJECT_ENSURE_REGISTERED (IotEnergyOptimalRouteProcessor);
 
+const uint32_t IotEnergyOptimalRouteProcessor::HOP_ENERGY_COST;
+
 TypeId
 IotEnergyOptimalRouteProcessor::GetTypeId ()
 {
   static TypeId tid = TypeId ("ns3::IotEnergyOptimalRouteProcessor")
     .SetParent<Object> ()
     .AddConstructor<IotEnergyOptimalRouteProcessor> ()
+    .AddAttribute ("Verbose", "Log every node added and the energy of all the nodes after every hop.",
+                   BooleanValue (true),
+                   MakeBooleanAccessor (&IotEnergyOptimalRouteProcessor::m_verbose),
+                   MakeBooleanChecker ())
+    .AddAttribute ("GatewayLoadTimeConstant", "Time constant of the decay of the gateway load used by SelectGateway.",
+                   TimeValue (Seconds (1.0)),
+                   MakeTimeAccessor (&IotEnergyOptimalRouteProcessor::SetGatewayLoadTimeConstant,
+                                     &IotEnergyOptimalRouteProcessor::GetGatewayLoadTimeConstant),
+                   MakeTimeChecker ())
+    .AddAttribute ("RelayCandidates", "Number of nodes of every tier published as current and likely next relays, "
+                   "at least SelectionCandidates in the EnergyQueue and EnergyEtx modes.",
+                   UintegerValue (2),
+                   MakeUintegerAccessor (&IotEnergyOptimalRouteProcessor::SetRelayCandidateCount,
+                                         &IotEnergyOptimalRouteProcessor::GetRelayCandidateCount),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("SelectionMode", "How the next hop is chosen in the downstream tier: Energy picks the highest energy node; "
+                   "EnergyQueue scores the first SelectionCandidates nodes of the ranking with energy / (1 + QueueWeight * MAC queue length), "
+                   "EnergyEtx with energy / expected energy per delivered packet of the link from the sender.",
+                   EnumValue (SELECT_ENERGY),
+                   MakeEnumAccessor (&IotEnergyOptimalRouteProcessor::SetSelectionMode,
+                                     &IotEnergyOptimalRouteProcessor::GetSelectionMode),
+                   MakeEnumChecker (SELECT_ENERGY, "Energy",
+                                    SELECT_ENERGY_QUEUE, "EnergyQueue",
+                                    SELECT_ENERGY_ETX, "EnergyEtx"))
+    .AddAttribute ("SelectionCandidates", "Number of highest energy nodes of a tier compared by the EnergyQueue and EnergyEtx modes.",
+                   UintegerValue (4),
+                   MakeUintegerAccessor (&IotEnergyOptimalRouteProcessor::SetSelectionCandidates,
+                                         &IotEnergyOptimalRouteProcessor::GetSelectionCandidates),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("QueueWeight", "Weight of one queued packet against the energy of a node in the EnergyQueue mode.",
+                   DoubleValue (1.0),
+                   MakeDoubleAccessor (&IotEnergyOptimalRouteProcessor::SetQueueWeight,
+                                       &IotEnergyOptimalRouteProcessor::GetQueueWeight),
+                   MakeDoubleChecker<double> (0.0))
+    .AddAttribute ("MinLinkDelivery", "Lowest delivery probability of a link, bounding its expected number of transmissions.",
+                   DoubleValue (0.01),
+                   MakeDoubleAccessor (&IotEnergyOptimalRouteProcessor::SetMinLinkDelivery,
+                                       &IotEnergyOptimalRouteProcessor::GetMinLinkDelivery),
+                   MakeDoubleChecker<double> (1e-6, 1.0))
+    .AddAttribute ("PressureLevels", "Number of steps of the energy pressure of a tier at which EnergyPressureChanged is fired.",
+                   UintegerValue (20),
+                   MakeUintegerAccessor (&IotEnergyOptimalRouteProcessor::SetPressureLevels,
+                                         &IotEnergyOptimalRouteProcessor::GetPressureLevels),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("FailureHoldTime", "Time a node or a link reported failed is skipped by the selections (0: until ClearNodeFailure or ClearLinkFailure).",
+                   TimeValue (Seconds (10)),
+                   MakeTimeAccessor (&IotEnergyOptimalRouteProcessor::m_failureHoldTime),
+                   MakeTimeChecker ())
+    .AddTraceSource ("NodeEnergyDepleted", "A node has spent all of its energy.",
+                     MakeTraceSourceAccessor (&IotEnergyOptimalRouteProcessor::m_nodeEnergyDepletedTrace),
+                     "ns3::IotEnergyOptimalRouteProcessor::NodeTracedCallback")
+    .AddTraceSource ("RelayCandidatesChanged", "The relay candidates of a tier have changed, e.g. for the other nodes to put their radio to sleep.",
+                     MakeTraceSourceAccessor (&IotEnergyOptimalRouteProcessor::m_relayCandidatesChangedTrace),
+                     "ns3::IotEnergyOptimalRouteProcessor::TierTracedCallback")
+    .AddTraceSource ("EnergyPressureChanged", "The energy pressure of a tier has crossed one of its PressureLevels, e.g. for sources to follow without polling.",
+                     MakeTraceSourceAccessor (&IotEnergyOptimalRouteProcessor::m_energyPressureChangedTrace),
+                     "ns3::IotEnergyOptimalRouteProcessor::TierPressureTracedCallback")
     ;
   return tid;
 }
 
 IotEnergyOptimalRouteProcessor::IotEnergyOptimalRouteProcessor ()
-{}
+ : m_verbose (true),
+   m_failureHoldTime (Seconds (10))
+{
+	m_core.SetListener(this);
+}
 
 IotEnergyOptimalRouteProcessor::~IotEnergyOptimalRouteProcessor ()
 {}
 
+void
+IotEnergyOptimalRouteProcessor::DoDispose () {
+	for(std::map<Ipv4Address, EventId>::iterator it = m_failureEvents.begin(); it != m_failureEvents.end(); it++) {
+		it->second.Cancel();
+	}
+	m_failureEvents.clear();
+	for(std::map<std::pair<Ipv4Address, Ipv4Address>, EventId>::iterator it = m_linkFailureEvents.begin(); it != m_linkFailureEvents.end(); it++) {
+		it->second.Cancel();
+	}
+	m_linkFailureEvents.clear();
+	Object::DoDispose();
+}
+
+/*
+* The core knows no address as 0, ns-3 as the default Ipv4Address.
+*/
+Ipv4Address
+IotEnergyOptimalRouteProcessor::ToAddress (uint32_t addr) {
+	return addr == 0 ? Ipv4Address() : Ipv4Address(addr);
+}
+
+std::vector<Ipv4Address>
+IotEnergyOptimalRouteProcessor::ToAddresses (const std::vector<uint32_t> &addrs) {
+	std::vector<Ipv4Address> result;
+	result.reserve(addrs.size());
+	for(uint32_t i = 0; i < addrs.size(); i++) {
+		result.push_back(Ipv4Address(addrs[i]));
+	}
+	return result;
+}
+
 /*
 * This method add the Tier and energy information of nodes into a Map to maintain the state.
+* A node keeps the tier it was first added with.
 */
 void
 IotEnergyOptimalRouteProcessor::AddNodeTierEnergy(uint16_t tier ,Ipv4Address ipv4Addr , uint32_t energy) {
-	if(tier == 3) {
-		tier3_nodes_energy.insert(std::pair<Ipv4Address,uint32_t>(ipv4Addr,energy));
-		NS_LOG_UNCOND("[INFO]   Added Nodes in tier 3 : " << ipv4Addr << " Energy : " << energy);
-	}else if (tier == 2) {
-		tier2_nodes_energy.insert(std::pair<Ipv4Address,uint32_t>(ipv4Addr,energy));
-		NS_LOG_UNCOND("[INFO]   Added Nodes in tier 2 : " << ipv4Addr << " Energy : " << energy);
-	} else if (tier == 1) {
-		tier1_nodes_energy.insert(std::pair<Ipv4Address,uint32_t>(ipv4Addr,energy));
-		NS_LOG_UNCOND("[INFO]   Added Nodes in tier 1 : " << ipv4Addr << " Energy : " << energy);
+	if(m_core.AddNode(tier, ipv4Addr.Get(), energy, Simulator::Now ().GetNanoSeconds ()) && m_verbose) {
+		NS_LOG_UNCOND("[INFO]   Added Nodes in tier " << tier << " : " << ipv4Addr << " Energy : " << energy);
 	}
 }
 
@@ -59,33 +151,51 @@ IotEnergyOptimalRouteProcessor::AddNodeTierEnergy(uint16_t tier ,Ipv4Address ipv
 */
 Ipv4Address
 IotEnergyOptimalRouteProcessor::GetHighestEnergyNodeInTier (uint16_t tier) {
-	Ipv4Address highEnergyNodeIpAddress;
-	if(tier == 1) {
-		std::map<Ipv4Address, uint32_t>::iterator it = tier1_nodes_energy.begin();
-		uint32_t highEnergyAvailable = 0.0;
-		while(it != tier1_nodes_energy.end()) {
-			Ipv4Address ipv4Address =  it->first;
-			uint32_t energy = it->second;
-			if(energy > highEnergyAvailable) {
-				highEnergyNodeIpAddress = ipv4Address;
-				highEnergyAvailable = energy;
-			}
-			it++;
-		}
-	}else if(tier == 2) {
-		std::map<Ipv4Address, uint32_t>::iterator it = tier2_nodes_energy.begin();
-		uint32_t highEnergyAvailable = 0;
-		while(it != tier2_nodes_energy.end()) {
-			Ipv4Address ipv4Address =  it->first;
-			uint32_t energy = it->second;
-			if(energy > highEnergyAvailable) {
-				highEnergyNodeIpAddress = ipv4Address;
-				highEnergyAvailable = energy;
-			}
-			it++;
-		}
-	}
-	return highEnergyNodeIpAddress;
+	int64_t now = Simulator::Now ().GetNanoSeconds ();
+	m_core.RefreshRelayCandidates(tier, now);
+	return ToAddress(m_core.GetHighestEnergyNodeInTier(tier, now));
+}
+
+Ipv4Address
+IotEnergyOptimalRouteProcessor::SelectNodeInTier (uint16_t tier, Ipv4Address from) {
+	int64_t now = Simulator::Now ().GetNanoSeconds ();
+	m_core.RefreshRelayCandidates(tier, now);
+	return ToAddress(m_core.SelectNodeInTier(tier, from.Get(), now));
+}
+
+Ipv4Address
+IotEnergyOptimalRouteProcessor::SelectNodeInTier (uint16_t tier, Ipv4Address from, Ipv4Address &backup) {
+	uint32_t other;
+	int64_t now = Simulator::Now ().GetNanoSeconds ();
+	m_core.RefreshRelayCandidates(tier, now);
+	Ipv4Address nextHop = ToAddress(m_core.SelectNodeInTier(tier, from.Get(), now, other));
+	backup = ToAddress(other);
+	return nextHop;
+}
+
+bool
+IotEnergyOptimalRouteProcessor::SetNodeQueue (Ipv4Address ipAddress, uint32_t packets) {
+	return m_core.SetNodeQueue(ipAddress.Get(), packets);
+}
+
+uint32_t
+IotEnergyOptimalRouteProcessor::GetNodeQueue (Ipv4Address ipAddress) const {
+	return m_core.GetNodeQueue(ipAddress.Get());
+}
+
+void
+IotEnergyOptimalRouteProcessor::SetLinkDelivery (Ipv4Address from, Ipv4Address to, double delivery) {
+	m_core.SetLinkDelivery(from.Get(), to.Get(), delivery);
+}
+
+double
+IotEnergyOptimalRouteProcessor::GetLinkDelivery (Ipv4Address from, Ipv4Address to) const {
+	return m_core.GetLinkDelivery(from.Get(), to.Get());
+}
+
+double
+IotEnergyOptimalRouteProcessor::GetExpectedEnergyPerDeliveredPacket (Ipv4Address from, Ipv4Address to) const {
+	return m_core.GetExpectedEnergyPerDeliveredPacket(from.Get(), to.Get());
 }
 
 /*
@@ -93,103 +203,408 @@ IotEnergyOptimalRouteProcessor::GetHighestEnergyNodeInTier (uint16_t tier) {
 */
 uint16_t
 IotEnergyOptimalRouteProcessor::GetTierFromIpAddress (Ipv4Address ipAddress) {
+	return m_core.GetTier(ipAddress.Get());
+}
 
-	std::map<Ipv4Address, uint32_t>::iterator it_1 = tier1_nodes_energy.begin();
-	while(it_1 != tier1_nodes_energy.end()) {
-		Ipv4Address ipv4Address =  it_1->first;
-		if (ipv4Address == ipAddress) {
-			return 1;
-		}
-		it_1++;
+/*
+* Once the Packet has done a hop on any node the energy level of the node is reduced by 10 units and this method takes care of that.
+**/
+void
+IotEnergyOptimalRouteProcessor::ReduceNodeEnergyOnTransitHop (Ipv4Address ipAddress) {
+	m_core.ConsumeHop(ipAddress.Get(), Simulator::Now ().GetNanoSeconds ());
+}
+
+bool
+IotEnergyOptimalRouteProcessor::SetNodeAvailable (Ipv4Address ipAddress, bool available) {
+	bool wasAvailable = m_core.IsNodeAvailable(ipAddress.Get());
+	if(!m_core.SetNodeAvailable(ipAddress.Get(), available, Simulator::Now ().GetNanoSeconds ())) {
+		return false;
 	}
+	if(m_verbose && wasAvailable != available) {
+		NS_LOG_UNCOND("[INFO]   Node " << ipAddress << " in tier " << m_core.GetTier(ipAddress.Get()) << (available ? " is available again" : " is not available"));
+	}
+	return true;
+}
+
+bool
+IotEnergyOptimalRouteProcessor::IsNodeAvailable (Ipv4Address ipAddress) const {
+	return m_core.IsNodeAvailable(ipAddress.Get());
+}
 
-	std::map<Ipv4Address, uint32_t>::iterator it_2 = tier2_nodes_energy.begin();
-	while(it_2 != tier2_nodes_energy.end()) {
-		Ipv4Address ipv4Address =  it_2->first;
-		if (ipv4Address == ipAddress) {
-			return 2;
+/*
+* Reports from several senders for the same failure extend the hold from the last one.
+*/
+void
+IotEnergyOptimalRouteProcessor::ReportNodeFailure (Ipv4Address ipAddress) {
+	bool failed = m_core.IsNodeFailed(ipAddress.Get());
+	if(!m_core.SetNodeFailed(ipAddress.Get(), true, Simulator::Now ().GetNanoSeconds ())) {
+		return;
+	}
+	EventId &event = m_failureEvents[ipAddress];
+	event.Cancel();
+	if(!m_failureHoldTime.IsZero()) {
+		event = Simulator::Schedule(m_failureHoldTime, &IotEnergyOptimalRouteProcessor::ClearNodeFailure, this, ipAddress);
+	}
+	if(m_verbose && !failed) {
+		NS_LOG_UNCOND("[INFO]   Node " << ipAddress << " in tier " << m_core.GetTier(ipAddress.Get()) << " has failed");
+	}
+}
+
+void
+IotEnergyOptimalRouteProcessor::ClearNodeFailure (Ipv4Address ipAddress) {
+	std::map<Ipv4Address, EventId>::iterator it = m_failureEvents.find(ipAddress);
+	if(it != m_failureEvents.end()) {
+		it->second.Cancel();
+		m_failureEvents.erase(it);
+	}
+	if(m_core.IsNodeFailed(ipAddress.Get())) {
+		m_core.SetNodeFailed(ipAddress.Get(), false, Simulator::Now ().GetNanoSeconds ());
+		if(m_verbose) {
+			NS_LOG_UNCOND("[INFO]   Node " << ipAddress << " in tier " << m_core.GetTier(ipAddress.Get()) << " is selected again");
 		}
-		it_2++;
 	}
+}
+
+bool
+IotEnergyOptimalRouteProcessor::IsNodeFailed (Ipv4Address ipAddress) const {
+	return m_core.IsNodeFailed(ipAddress.Get());
+}
+
+void
+IotEnergyOptimalRouteProcessor::ReportLinkFailure (Ipv4Address from, Ipv4Address to) {
+	bool failed = m_core.IsLinkFailed(from.Get(), to.Get());
+	if(!m_core.SetLinkFailed(from.Get(), to.Get(), true)) {
+		return;
+	}
+	EventId &event = m_linkFailureEvents[std::make_pair(from, to)];
+	event.Cancel();
+	if(!m_failureHoldTime.IsZero()) {
+		event = Simulator::Schedule(m_failureHoldTime, &IotEnergyOptimalRouteProcessor::ClearLinkFailure, this, from, to);
+	}
+	if(m_verbose && !failed) {
+		NS_LOG_UNCOND("[INFO]   Link from " << from << " to " << to << " has failed");
+	}
+}
 
-	std::map<Ipv4Address, uint32_t>::iterator it_3 = tier3_nodes_energy.begin();
-	while(it_3 != tier3_nodes_energy.end()) {
-		Ipv4Address ipv4Address =  it_3->first;
-		if (ipv4Address == ipAddress) {
-			return 3;
+void
+IotEnergyOptimalRouteProcessor::ClearLinkFailure (Ipv4Address from, Ipv4Address to) {
+	std::map<std::pair<Ipv4Address, Ipv4Address>, EventId>::iterator it = m_linkFailureEvents.find(std::make_pair(from, to));
+	if(it != m_linkFailureEvents.end()) {
+		it->second.Cancel();
+		m_linkFailureEvents.erase(it);
+	}
+	if(m_core.IsLinkFailed(from.Get(), to.Get())) {
+		m_core.SetLinkFailed(from.Get(), to.Get(), false);
+		if(m_verbose) {
+			NS_LOG_UNCOND("[INFO]   Link from " << from << " to " << to << " is selected again");
 		}
-		it_3++;
 	}
-   return 0;
+}
+
+bool
+IotEnergyOptimalRouteProcessor::IsLinkFailed (Ipv4Address from, Ipv4Address to) const {
+	return m_core.IsLinkFailed(from.Get(), to.Get());
+}
+
+void
+IotEnergyOptimalRouteProcessor::AddNodeAddress (Ipv4Address ipAddress, Ipv4Address alias) {
+	m_core.AddNodeAddress(ipAddress.Get(), alias.Get());
+	const std::vector<uint32_t> *aliases = m_core.GetNodeAddresses(ipAddress.Get());
+	if(aliases) {
+		m_nodeAddresses[ipAddress] = ToAddresses(*aliases);
+	}
+}
+
+const std::vector<Ipv4Address> *
+IotEnergyOptimalRouteProcessor::GetNodeAddresses (Ipv4Address ipAddress) const {
+	if(m_nodeAddresses.empty()) {
+		return 0;
+	}
+	std::map<Ipv4Address, std::vector<Ipv4Address> >::const_iterator it = m_nodeAddresses.find(ipAddress);
+	return it == m_nodeAddresses.end() ? 0 : &it->second;
+}
+
+void
+IotEnergyOptimalRouteProcessor::RebuildNodeAddresses () {
+	m_nodeAddresses.clear();
+	const std::map<uint32_t, std::vector<uint32_t> > &aliases = m_core.GetAllNodeAddresses();
+	for(std::map<uint32_t, std::vector<uint32_t> >::const_iterator it = aliases.begin(); it != aliases.end(); it++) {
+		m_nodeAddresses.insert(m_nodeAddresses.end(), std::make_pair(Ipv4Address(it->first), ToAddresses(it->second)));
+	}
+}
+
+void
+IotEnergyOptimalRouteProcessor::NodeEnergyDepleted (uint32_t addr) {
+	m_nodeEnergyDepletedTrace(Ipv4Address(addr));
 }
 
 /*
-* Once the Packet has done a hop on any node the energy level of the node is reduced by 10 units and this method takes care of that.
-**/
+* The candidates are converted once per change, not per packet.
+*/
 void
-IotEnergyOptimalRouteProcessor::ReduceNodeEnergyOnTransitHop (Ipv4Address ipAddress) {
+IotEnergyOptimalRouteProcessor::RelayCandidatesChanged (uint16_t tier) {
+	m_tierRelayCandidates[tier] = ToAddresses(m_core.GetRelayCandidates(tier));
+	m_relayCandidatesChangedTrace(tier);
+}
 
-	std::map<Ipv4Address, uint32_t>::iterator it_1 = tier1_nodes_energy.begin();
-	while(it_1 != tier1_nodes_energy.end()) {
-		Ipv4Address ipv4Address =  it_1->first;
-		if (ipv4Address == ipAddress) {
-			uint32_t energy = it_1->second;
-			it_1->second = energy - 10.0;
-		}
-		it_1++;
+void
+IotEnergyOptimalRouteProcessor::EnergyPressureChanged (uint16_t tier, double pressure) {
+	m_energyPressureChangedTrace(tier, pressure);
+}
+
+const std::vector<Ipv4Address> &
+IotEnergyOptimalRouteProcessor::GetRelayCandidates (uint16_t tier) const {
+	static const std::vector<Ipv4Address> none;
+	std::map<uint16_t, std::vector<Ipv4Address> >::const_iterator it = m_tierRelayCandidates.find(tier);
+	return it == m_tierRelayCandidates.end() ? none : it->second;
+}
+
+bool
+IotEnergyOptimalRouteProcessor::IsRelayCandidate (Ipv4Address ipAddress) const {
+	return m_core.IsRelayCandidate(ipAddress.Get());
+}
+
+double
+IotEnergyOptimalRouteProcessor::GetTierEnergyPressure (uint16_t tier) const {
+	return m_core.GetTierEnergyPressure(tier);
+}
+
+double
+IotEnergyOptimalRouteProcessor::GetPathEnergyPressure (uint16_t tier) const {
+	return m_core.GetPathEnergyPressure(tier);
+}
+
+uint16_t
+IotEnergyOptimalRouteProcessor::GetHighestTier () const {
+	return m_core.GetHighestTier();
+}
+
+uint32_t
+IotEnergyOptimalRouteProcessor::GetNodeEnergy (Ipv4Address ipAddress) const {
+	return m_core.GetNodeEnergy(ipAddress.Get(), Simulator::Now ().GetNanoSeconds ());
+}
+
+uint32_t
+IotEnergyOptimalRouteProcessor::GetNumberOfNodes () const {
+	return m_core.GetNumberOfNodes();
+}
+
+bool
+IotEnergyOptimalRouteProcessor::IsVerbose () const {
+	return m_verbose;
+}
+
+/*
+* Sum of the energy units taken from all the nodes since the start of the simulation.
+*/
+uint64_t
+IotEnergyOptimalRouteProcessor::GetTotalEnergyConsumed () const {
+	return m_core.GetTotalEnergyConsumed();
+}
+
+uint64_t
+IotEnergyOptimalRouteProcessor::GetTotalEnergyHarvested () const {
+	return m_core.GetTotalEnergyHarvested();
+}
+
+uint32_t
+IotEnergyOptimalRouteProcessor::AddDiurnalHarvestProfile (double peakPower, Time sunrise, Time daylight, uint32_t capacity, Time period) {
+	uint32_t profile = m_core.AddHarvestProfile(iotrouting::HarvestProfile::Diurnal(peakPower, sunrise.GetSeconds(), daylight.GetSeconds(),
+	                                                                                capacity, period.GetSeconds()));
+	if(profile == 0) {
+		NS_LOG_WARN("Invalid diurnal harvest profile");
 	}
+	return profile;
+}
 
-	std::map<Ipv4Address, uint32_t>::iterator it_2 = tier2_nodes_energy.begin();
-	while(it_2 != tier2_nodes_energy.end()) {
-		Ipv4Address ipv4Address =  it_2->first;
-		if (ipv4Address == ipAddress) {
-			uint32_t energy = it_2->second;
-			it_2->second = energy - 10.0;
-		}
-		it_2++;
+uint32_t
+IotEnergyOptimalRouteProcessor::AddTraceHarvestProfile (std::string path, uint32_t capacity) {
+	iotrouting::HarvestProfile trace;
+	if(!iotrouting::HarvestProfile::LoadTrace(path, capacity, trace)) {
+		NS_LOG_WARN("Cannot load the harvest trace " << path);
+		return 0;
 	}
+	return m_core.AddHarvestProfile(trace);
+}
 
-	std::map<Ipv4Address, uint32_t>::iterator it_3 = tier3_nodes_energy.begin();
-	while(it_3 != tier3_nodes_energy.end()) {
-		Ipv4Address ipv4Address =  it_3->first;
-		if (ipv4Address == ipAddress) {
-			uint32_t energy = it_3->second;
-			it_3->second = energy - 10.0;
-		}
-		it_3++;
+bool
+IotEnergyOptimalRouteProcessor::SetNodeHarvestProfile (Ipv4Address ipAddress, uint32_t profile) {
+	return m_core.SetNodeHarvestProfile(ipAddress.Get(), profile, Simulator::Now ().GetNanoSeconds ());
+}
+
+/*
+* Adds a gateway Tier 1 nodes can send to. The link quality is the default for all Tier 1 nodes.
+*/
+void
+IotEnergyOptimalRouteProcessor::AddGateway (Ipv4Address gateway, double linkQuality) {
+	if(IsGateway(gateway)) {
+		return;
 	}
+	m_core.AddGateway(gateway.Get(), linkQuality, Simulator::Now ().GetNanoSeconds ());
+	if(m_verbose) {
+		NS_LOG_UNCOND("[INFO]   Added Gateway : " << gateway << " Link quality : " << linkQuality);
+	}
+}
+
+void
+IotEnergyOptimalRouteProcessor::SetGatewayLinkQuality (Ipv4Address node, Ipv4Address gateway, double linkQuality) {
+	m_core.SetGatewayLinkQuality(node.Get(), gateway.Get(), linkQuality);
+}
+
+double
+IotEnergyOptimalRouteProcessor::GetGatewayLinkQuality (Ipv4Address node, Ipv4Address gateway) const {
+	return m_core.GetGatewayLinkQuality(node.Get(), gateway.Get());
+}
+
+Ipv4Address
+IotEnergyOptimalRouteProcessor::SelectGateway (Ipv4Address node) {
+	return ToAddress(m_core.SelectGateway(node.Get(), Simulator::Now ().GetNanoSeconds ()));
+}
+
+uint32_t
+IotEnergyOptimalRouteProcessor::GetNumberOfGateways () const {
+	return m_core.GetNumberOfGateways();
+}
+
+bool
+IotEnergyOptimalRouteProcessor::IsGateway (Ipv4Address addr) const {
+	return m_core.IsGateway(addr.Get());
+}
+
+bool
+IotEnergyOptimalRouteProcessor::SaveSnapshot (std::string path) const {
+	if(!m_core.SaveSnapshot(path, Simulator::Now ().GetNanoSeconds ())) {
+		NS_LOG_WARN("Cannot write the snapshot " << path);
+		return false;
+	}
+	if(m_verbose) {
+		NS_LOG_UNCOND("[INFO]   Snapshot of " << m_core.GetNumberOfNodes() << " nodes written to " << path);
+	}
+	return true;
 }
 
 /*
-*This method prints the amount of Energy that is available in each node
+* The relay candidates are notified again by the core; tiers that are not in the snapshot have none left.
 */
+bool
+IotEnergyOptimalRouteProcessor::LoadSnapshot (std::string path) {
+	std::map<uint16_t, std::vector<Ipv4Address> > previous;
+	previous.swap(m_tierRelayCandidates);
+	if(!m_core.LoadSnapshot(path, Simulator::Now ().GetNanoSeconds ())) {
+		m_tierRelayCandidates.swap(previous);
+		NS_LOG_WARN("Cannot load the snapshot " << path);
+		return false;
+	}
+	RebuildNodeAddresses();
+	for(std::map<Ipv4Address, EventId>::iterator it = m_failureEvents.begin(); it != m_failureEvents.end(); it++) {
+		it->second.Cancel();
+	}
+	m_failureEvents.clear();
+	for(std::map<std::pair<Ipv4Address, Ipv4Address>, EventId>::iterator it = m_linkFailureEvents.begin(); it != m_linkFailureEvents.end(); it++) {
+		it->second.Cancel();
+	}
+	m_linkFailureEvents.clear();
+	if(m_verbose) {
+		NS_LOG_UNCOND("[INFO]   Snapshot of " << m_core.GetNumberOfNodes() << " nodes loaded from " << path);
+	}
+	return true;
+}
+
+iotrouting::RoutingCore &
+IotEnergyOptimalRouteProcessor::GetCore () {
+	return m_core;
+}
+
 void
-IotEnergyOptimalRouteProcessor::PrintAvailableEnergyOfAllNodes() {
+IotEnergyOptimalRouteProcessor::SetRelayCandidateCount (uint32_t count) {
+	m_core.GetConfig().relayCandidates = count;
+}
 
-	std::map<Ipv4Address, uint32_t>::iterator it_1 = tier1_nodes_energy.begin();
-		while(it_1 != tier1_nodes_energy.end()) {
-			Ipv4Address ipv4Address =  it_1->first;
-			uint32_t energy = it_1->second;
-			NS_LOG_UNCOND("[INFO]   Energy remaining-->Tier1-->" << ipv4Address << "-->" << energy);
-			it_1++;
-		}
+uint32_t
+IotEnergyOptimalRouteProcessor::GetRelayCandidateCount () const {
+	return m_core.GetConfig().relayCandidates;
+}
 
-	std::map<Ipv4Address, uint32_t>::iterator it_2 = tier2_nodes_energy.begin();
-		while(it_2 != tier2_nodes_energy.end()) {
-			Ipv4Address ipv4Address =  it_2->first;
-			uint32_t energy = it_2->second;
-			NS_LOG_UNCOND("[INFO]   Energy remaining-->Tier2-->" << ipv4Address << "-->" << energy);
-			it_2++;
-		}
+void
+IotEnergyOptimalRouteProcessor::SetSelectionMode (SelectionMode mode) {
+	m_core.GetConfig().selectionMode = static_cast<iotrouting::RoutingCore::SelectionMode> (mode);
+}
 
-	std::map<Ipv4Address, uint32_t>::iterator it_3 = tier3_nodes_energy.begin();
-		while(it_3 != tier3_nodes_energy.end()) {
-			Ipv4Address ipv4Address =  it_3->first;
-			uint32_t energy = it_3->second;
-			NS_LOG_UNCOND("[INFO]   Energy remaining-->Tier3-->" << ipv4Address << "-->" << energy);;
-			it_3++;
-		}
+IotEnergyOptimalRouteProcessor::SelectionMode
+IotEnergyOptimalRouteProcessor::GetSelectionMode () const {
+	return static_cast<SelectionMode> (m_core.GetConfig().selectionMode);
+}
+
+void
+IotEnergyOptimalRouteProcessor::SetSelectionCandidates (uint32_t count) {
+	m_core.GetConfig().selectionCandidates = count;
+}
+
+uint32_t
+IotEnergyOptimalRouteProcessor::GetSelectionCandidates () const {
+	return m_core.GetConfig().selectionCandidates;
+}
+
+void
+IotEnergyOptimalRouteProcessor::SetQueueWeight (double weight) {
+	m_core.GetConfig().queueWeight = weight;
+}
+
+double
+IotEnergyOptimalRouteProcessor::GetQueueWeight () const {
+	return m_core.GetConfig().queueWeight;
 }
+
+void
+IotEnergyOptimalRouteProcessor::SetMinLinkDelivery (double delivery) {
+	m_core.GetConfig().minLinkDelivery = delivery;
+}
+
+double
+IotEnergyOptimalRouteProcessor::GetMinLinkDelivery () const {
+	return m_core.GetConfig().minLinkDelivery;
+}
+
+void
+IotEnergyOptimalRouteProcessor::SetPressureLevels (uint32_t levels) {
+	m_core.GetConfig().pressureLevels = levels;
 }
 
+uint32_t
+IotEnergyOptimalRouteProcessor::GetPressureLevels () const {
+	return m_core.GetConfig().pressureLevels;
+}
+
+void
+IotEnergyOptimalRouteProcessor::SetGatewayLoadTimeConstant (Time tau) {
+	m_core.GetConfig().gatewayLoadTimeConstant = tau.GetSeconds();
+}
+
+Time
+IotEnergyOptimalRouteProcessor::GetGatewayLoadTimeConstant () const {
+	return Seconds(m_core.GetConfig().gatewayLoadTimeConstant);
+}
+
+/*
+*This method prints the amount of Energy that is available in each node, tier by tier.
+* Nothing is printed when the Verbose attribute is false.
+*/
+void
+IotEnergyOptimalRouteProcessor::PrintAvailableEnergyOfAllNodes() {
+	if(!m_verbose) {
+		return;
+	}
+	const std::map<uint32_t, iotrouting::RoutingCore::NodeState> &nodes = m_core.GetNodes();
+	int64_t now = Simulator::Now ().GetNanoSeconds ();
+	for(uint32_t tier = 1; tier <= m_core.GetHighestTier(); tier++) {
+		std::map<uint32_t, iotrouting::RoutingCore::NodeState>::const_iterator it = nodes.begin();
+		while(it != nodes.end()) {
+			if(it->second.tier == tier) {
+				NS_LOG_UNCOND("[INFO]   Energy remaining-->Tier" << tier << "-->" << Ipv4Address(it->first) << "-->" << m_core.GetNodeEnergy(it->first, now));
+			}
+			it++;
+		}
+	}
+}
+}
 
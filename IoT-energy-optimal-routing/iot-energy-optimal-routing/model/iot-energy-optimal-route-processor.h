@@ -12,9 +12,14 @@
 #include "ns3/ipv4-route.h"
 #include "ns3/ipv4-address.h"
 #include "ns3/output-stream-wrapper.h"
+#include "ns3/traced-callback.h"
+#include "ns3/nstime.h"
+#include "ns3/event-id.h"
+#include "ns3/iot-routing-core.h"
 #include <string>
 #include <map>
 #include <utility>
+#include <vector>
 
 namespace ns3 {
 
@@ -25,28 +30,182 @@ namespace ns3 {
 * 2. Gets the information of which tier this node belongs.
 * 3. Gets the Node with highest energy in a tier
 * 4. Reduces the energy from total energy after the packet is traversed.
+*
+* The state and the selections live in iotrouting::RoutingCore (lib/), which does not depend on ns-3 so a gateway daemon can run
+* the same logic; this class keeps it in Ipv4Address and simulation time, and publishes its notifications as trace sources.
 */
-class IotEnergyOptimalRouteProcessor : public Object
+class IotEnergyOptimalRouteProcessor : public Object, private iotrouting::RoutingCore::Listener
 {
 public:
+  enum SelectionMode
+  {
+    SELECT_ENERGY,
+    SELECT_ENERGY_QUEUE,
+    SELECT_ENERGY_ETX
+  };
+
+  /* Energy units taken from a node for every transmission. */
+  static const uint32_t HOP_ENERGY_COST = iotrouting::RoutingCore::HOP_ENERGY_COST;
 
 	IotEnergyOptimalRouteProcessor ();
   virtual ~IotEnergyOptimalRouteProcessor ();
 
   static TypeId GetTypeId ();
 
+  /* Signature of the NodeEnergyDepleted trace source. */
+  typedef void (* NodeTracedCallback)(Ipv4Address addr);
+  /* Signature of the RelayCandidatesChanged trace source. */
+  typedef void (* TierTracedCallback)(uint16_t tier);
+  /* Signature of the EnergyPressureChanged trace source. */
+  typedef void (* TierPressureTracedCallback)(uint16_t tier, double pressure);
+
   void AddNodeTierEnergy (uint16_t tier ,Ipv4Address addr , uint32_t energy);
 
   Ipv4Address GetHighestEnergyNodeInTier (uint16_t tier);
+  /*
+  * Next hop in a tier for a packet sent by node from, according to SelectionMode. Failed nodes, and nodes whose link from the
+  * sender failed, are skipped. Tiers are kept ordered by energy, so a selection is O(log n).
+  */
+  Ipv4Address SelectNodeInTier (uint16_t tier, Ipv4Address from = Ipv4Address ());
+  /* Same, with the best other choice in backup (the default Ipv4Address when there is none). */
+  Ipv4Address SelectNodeInTier (uint16_t tier, Ipv4Address from, Ipv4Address &backup);
+  /* Number of packets waiting in the MAC queue of a node, set by IotLinkMonitor; false for unknown nodes. */
+  bool SetNodeQueue (Ipv4Address addr, uint32_t packets);
+  uint32_t GetNodeQueue (Ipv4Address addr) const;
+  /* Delivery probability per transmission of the link from -> to, set by IotLinkMonitor (1 until measured). */
+  void SetLinkDelivery (Ipv4Address from, Ipv4Address to, double delivery);
+  double GetLinkDelivery (Ipv4Address from, Ipv4Address to) const;
+  double GetExpectedEnergyPerDeliveredPacket (Ipv4Address from, Ipv4Address to) const;
   uint16_t GetTierFromIpAddress(Ipv4Address addr);
   void ReduceNodeEnergyOnTransitHop (Ipv4Address addr);
   void PrintAvailableEnergyOfAllNodes();
+  uint64_t GetTotalEnergyConsumed () const;
+  /*
+  * Harvested energy added to the nodes so far, counted (like the energy pressure) when a node is changed: a hop, a reading or a new
+  * profile. Between changes it can be lower than the real one, and the pressure higher.
+  */
+  uint64_t GetTotalEnergyHarvested () const;
+  /*
+  * Harvest profiles, returning the number to give to SetNodeHarvestProfile (0 when not valid). The diurnal profile is a half sine
+  * of peakPower (energy units per second) from sunrise for daylight, every period; the trace is read from a file of
+  * "seconds power" lines, linear between the samples and repeated after the last one.
+  */
+  uint32_t AddDiurnalHarvestProfile (double peakPower, Time sunrise, Time daylight, uint32_t capacity, Time period = Seconds (86400));
+  uint32_t AddTraceHarvestProfile (std::string path, uint32_t capacity);
+  /*
+  * Node harvests with the profile from now on (0: no harvesting); false for unknown nodes or profiles. The energy it gains is
+  * computed in closed form whenever it is read, ranked or changed, with no event scheduled. The relay candidates of a tier with
+  * harvesting nodes are ranked again at every selection in it, as these nodes rise in the ranking without any change of their tier.
+  */
+  bool SetNodeHarvestProfile (Ipv4Address addr, uint32_t profile);
+  /* Takes a node out of (or back into) the ranking of its tier, e.g. when its radio goes down. Returns false for unknown nodes. */
+  bool SetNodeAvailable (Ipv4Address addr, bool available);
+  bool IsNodeAvailable (Ipv4Address addr) const;
+  /*
+  * Node known to be down: it stays in the ranking of its tier but every selection skips it for FailureHoldTime from now (again,
+  * when it had already failed).
+  */
+  void ReportNodeFailure (Ipv4Address addr);
+  void ClearNodeFailure (Ipv4Address addr);
+  bool IsNodeFailed (Ipv4Address addr) const;
+  /*
+  * Next hop found failed by a sender (IotLinkMonitor, from the MAC giving up on a frame): a lost frame only tells that the link
+  * is broken, so the selections of that sender alone skip the node for FailureHoldTime from now; the other senders still choose it.
+  */
+  void ReportLinkFailure (Ipv4Address from, Ipv4Address to);
+  void ClearLinkFailure (Ipv4Address from, Ipv4Address to);
+  bool IsLinkFailed (Ipv4Address from, Ipv4Address to) const;
+  /*
+  * Address of another radio of a node; the node stays known (tier, energy, ranking) by its first address, and the routing of the
+  * upstream nodes uses the alias to reach it over that radio.
+  */
+  void AddNodeAddress (Ipv4Address addr, Ipv4Address alias);
+  /* Other addresses of a node (or gateway), 0 when it has a single radio. */
+  const std::vector<Ipv4Address> * GetNodeAddresses (Ipv4Address addr) const;
+
+  /*
+  * With gateways, Tier 1 nodes pick one per packet (SelectGateway) instead of the GatewayAddress of IotEnergyOptimalRouting,
+  * scoring them with linkQuality / (1 + load), load being the packets recently sent to the gateway (GatewayLoadTimeConstant).
+  * With an anycast address shared by the gateways as the destination of the sources, the uplink traffic is spread over them.
+  */
+  void AddGateway (Ipv4Address gateway, double linkQuality = 1.0);
+  /* Link quality (0..1] between one Tier 1 node and one gateway, overriding the gateway default, e.g. measured by IotLinkMonitor. */
+  void SetGatewayLinkQuality (Ipv4Address node, Ipv4Address gateway, double linkQuality);
+  double GetGatewayLinkQuality (Ipv4Address node, Ipv4Address gateway) const;
+  Ipv4Address SelectGateway (Ipv4Address node);
+  uint32_t GetNumberOfGateways () const;
+  bool IsGateway (Ipv4Address addr) const;
+  /* Current relay of a tier first, then the likely next ones; nodes without energy left are not candidates. */
+  const std::vector<Ipv4Address> & GetRelayCandidates (uint16_t tier) const;
+  bool IsRelayCandidate (Ipv4Address addr) const;
+  /* Share of the initial energy of a tier already spent, 0 for unknown tiers. */
+  double GetTierEnergyPressure (uint16_t tier) const;
+  /* Highest pressure of the tiers below tier, i.e. of the tiers relaying the packets of its nodes. */
+  double GetPathEnergyPressure (uint16_t tier) const;
+  /* Highest tier with nodes, 0 when there is none. */
+  uint16_t GetHighestTier () const;
+  uint32_t GetNodeEnergy (Ipv4Address addr) const;
+  uint32_t GetNumberOfNodes () const;
+  bool IsVerbose () const;
+
+  /*
+  * Writes the nodes (tiers, energies, availability, rankings, aliases, harvest profiles), the energy of the tiers, the gateways and
+  * the link estimates to a versioned binary file, so runs can branch from the same point; the attributes are not saved.
+  * Returns false when the file cannot be written.
+  */
+  bool SaveSnapshot (std::string path) const;
+  /*
+  * Replaces the whole state with the one of the snapshot; returns false, leaving the state unchanged, when the file cannot
+  * be read or is not a snapshot of this version. Counters and estimates handed out before are no longer valid, so this is done
+  * before installing IotLinkMonitor.
+  */
+  bool LoadSnapshot (std::string path);
+
+  /* Core holding the state, e.g. to publish it to the Readers of other threads. */
+  iotrouting::RoutingCore & GetCore ();
+
+protected:
+  virtual void DoDispose ();
 
 private:
 
-  std::map<Ipv4Address, uint32_t> tier1_nodes_energy;
-  std::map<Ipv4Address, uint32_t> tier2_nodes_energy;
-  std::map<Ipv4Address, uint32_t> tier3_nodes_energy;
+  static Ipv4Address ToAddress (uint32_t addr);
+  static std::vector<Ipv4Address> ToAddresses (const std::vector<uint32_t> &addrs);
+  void RebuildNodeAddresses ();
+
+  /* RoutingCore::Listener */
+  virtual void NodeEnergyDepleted (uint32_t addr);
+  virtual void RelayCandidatesChanged (uint16_t tier);
+  virtual void EnergyPressureChanged (uint16_t tier, double pressure);
+
+  /* Attributes kept in the configuration of the core. */
+  void SetRelayCandidateCount (uint32_t count);
+  uint32_t GetRelayCandidateCount () const;
+  void SetSelectionMode (SelectionMode mode);
+  SelectionMode GetSelectionMode () const;
+  void SetSelectionCandidates (uint32_t count);
+  uint32_t GetSelectionCandidates () const;
+  void SetQueueWeight (double weight);
+  double GetQueueWeight () const;
+  void SetMinLinkDelivery (double delivery);
+  double GetMinLinkDelivery () const;
+  void SetPressureLevels (uint32_t levels);
+  uint32_t GetPressureLevels () const;
+  void SetGatewayLoadTimeConstant (Time tau);
+  Time GetGatewayLoadTimeConstant () const;
+
+  iotrouting::RoutingCore m_core;
+  bool m_verbose;
+  Time m_failureHoldTime;
+  /* End of the hold of every failed node and link. */
+  std::map<Ipv4Address, EventId> m_failureEvents;
+  std::map<std::pair<Ipv4Address, Ipv4Address>, EventId> m_linkFailureEvents;
+  TracedCallback<Ipv4Address> m_nodeEnergyDepletedTrace;
+  TracedCallback<uint16_t> m_relayCandidatesChangedTrace;
+  TracedCallback<uint16_t, double> m_energyPressureChangedTrace;
+  /* The relay candidates and the aliases of the core as Ipv4Address, rebuilt when they change. */
+  std::map<uint16_t, std::vector<Ipv4Address> > m_tierRelayCandidates;
+  std::map<Ipv4Address, std::vector<Ipv4Address> > m_nodeAddresses;
 };
 
 }
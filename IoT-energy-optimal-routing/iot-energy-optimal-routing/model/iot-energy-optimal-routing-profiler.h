@@ -0,0 +1,102 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef IOT_ENERGY_OPTIMAL_ROUTING_PROFILER_H
+#define IOT_ENERGY_OPTIMAL_ROUTING_PROFILER_H
+
+#include <stdint.h>
+
+/*
+* Cycle timers are compiled in only when IOT_ENERGY_OPTIMAL_ROUTING_PROFILE is defined
+* (./waf configure --enable-iot-routing-profiling). Without it IOT_ROUTING_PROFILE_SCOPE expands to nothing
+* and only the plain counters remain on the hot path.
+*/
+#ifdef IOT_ENERGY_OPTIMAL_ROUTING_PROFILE
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define IOT_ROUTING_PROFILE_TICK_UNIT "cycles"
+#else
+#include <chrono>
+#define IOT_ROUTING_PROFILE_TICK_UNIT "ns"
+#endif
+#endif
+
+namespace ns3 {
+
+/*
+* Counters kept by every IotEnergyOptimalRouting instance.
+*/
+struct IotRoutingCounters
+{
+  IotRoutingCounters ()
+    : routeOutputCalls (0),
+      routeInputCalls (0),
+      forwardedPackets (0),
+      localDeliveries (0),
+      nextHopChanges (0),
+      downlinkPackets (0),
+      reversePathMisses (0),
+      fastReroutes (0),
+      processorTicks (0)
+  {}
+
+  void Add (const IotRoutingCounters &o)
+  {
+    routeOutputCalls += o.routeOutputCalls;
+    routeInputCalls += o.routeInputCalls;
+    forwardedPackets += o.forwardedPackets;
+    localDeliveries += o.localDeliveries;
+    nextHopChanges += o.nextHopChanges;
+    downlinkPackets += o.downlinkPackets;
+    reversePathMisses += o.reversePathMisses;
+    fastReroutes += o.fastReroutes;
+    processorTicks += o.processorTicks;
+  }
+
+  uint64_t routeOutputCalls;
+  uint64_t routeInputCalls;
+  uint64_t forwardedPackets;
+  uint64_t localDeliveries;
+  uint64_t nextHopChanges;
+  uint64_t downlinkPackets;
+  uint64_t reversePathMisses;
+  uint64_t fastReroutes;
+  uint64_t processorTicks;
+};
+
+#ifdef IOT_ENERGY_OPTIMAL_ROUTING_PROFILE
+/*
+* Adds the ticks elapsed between construction and destruction to the given counter.
+*/
+class IotRoutingProfileScope
+{
+public:
+  explicit IotRoutingProfileScope (uint64_t &ticks)
+    : m_ticks (ticks),
+      m_start (Now ())
+  {}
+  ~IotRoutingProfileScope ()
+  {
+    m_ticks += Now () - m_start;
+  }
+
+  static inline uint64_t Now (void)
+  {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc ();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds> (std::chrono::steady_clock::now ().time_since_epoch ()).count ();
+#endif
+  }
+
+private:
+  uint64_t &m_ticks;
+  uint64_t m_start;
+};
+
+#define IOT_ROUTING_PROFILE_SCOPE(ticks) ns3::IotRoutingProfileScope iotRoutingProfileScope_ (ticks)
+#else
+#define IOT_ROUTING_PROFILE_SCOPE(ticks)
+#endif
+
+}
+
+#endif /* IOT_ENERGY_OPTIMAL_ROUTING_PROFILER_H */
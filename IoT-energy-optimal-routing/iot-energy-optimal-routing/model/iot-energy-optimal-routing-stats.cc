@@ -0,0 +1,420 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include "iot-energy-optimal-routing-stats.h"
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+#include "ns3/pointer.h"
+#include "ns3/double.h"
+#include "ns3/string.h"
+#include "ns3/ipv4-l3-protocol.h"
+#include <cstring>
+#include <map>
+
+NS_LOG_COMPONENT_DEFINE ("IotEnergyOptimalRoutingStats");
+
+namespace ns3 {
+
+NS_OBJECT_ENSURE_REGISTERED (IotEnergyOptimalRoutingTag);
+NS_OBJECT_ENSURE_REGISTERED (IotEnergyOptimalRoutingStats);
+
+IotEnergyOptimalRoutingTag::IotEnergyOptimalRoutingTag ()
+  : m_originTimeNs (0),
+    m_tier (0),
+    m_hops (0)
+{}
+
+IotEnergyOptimalRoutingTag::IotEnergyOptimalRoutingTag (Time originTime, uint16_t tier)
+  : m_originTimeNs (originTime.GetNanoSeconds ()),
+    m_tier (tier),
+    m_hops (1)
+{}
+
+TypeId
+IotEnergyOptimalRoutingTag::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::IotEnergyOptimalRoutingTag")
+    .SetParent<Tag> ()
+    .AddConstructor<IotEnergyOptimalRoutingTag> ()
+    ;
+  return tid;
+}
+
+TypeId
+IotEnergyOptimalRoutingTag::GetInstanceTypeId (void) const
+{
+  return GetTypeId ();
+}
+
+uint32_t
+IotEnergyOptimalRoutingTag::GetSerializedSize (void) const
+{
+  return 8 + 2 + 1;
+}
+
+void
+IotEnergyOptimalRoutingTag::Serialize (TagBuffer i) const
+{
+  i.WriteU64 (m_originTimeNs);
+  i.WriteU16 (m_tier);
+  i.WriteU8 (m_hops);
+}
+
+void
+IotEnergyOptimalRoutingTag::Deserialize (TagBuffer i)
+{
+  m_originTimeNs = i.ReadU64 ();
+  m_tier = i.ReadU16 ();
+  m_hops = i.ReadU8 ();
+}
+
+void
+IotEnergyOptimalRoutingTag::Print (std::ostream &os) const
+{
+  os << "origin=" << m_originTimeNs << "ns tier=" << m_tier << " hops=" << (uint32_t) m_hops;
+}
+
+Time
+IotEnergyOptimalRoutingTag::GetOriginTime (void) const
+{
+  return NanoSeconds (m_originTimeNs);
+}
+
+uint16_t
+IotEnergyOptimalRoutingTag::GetTier (void) const
+{
+  return m_tier;
+}
+
+uint8_t
+IotEnergyOptimalRoutingTag::GetHopCount (void) const
+{
+  return m_hops;
+}
+
+void
+IotEnergyOptimalRoutingTag::IncrementHopCount (void)
+{
+  if (m_hops < 255)
+    {
+      m_hops++;
+    }
+}
+
+void
+IotEnergyOptimalRoutingTag::SetHopCount (uint8_t hops)
+{
+  m_hops = hops;
+}
+
+IotLogHistogram::IotLogHistogram ()
+{
+  Reset ();
+}
+
+void
+IotLogHistogram::Reset (void)
+{
+  std::memset (m_counts, 0, sizeof (m_counts));
+  m_count = 0;
+  m_sum = 0;
+  m_max = 0;
+}
+
+uint64_t
+IotLogHistogram::GetCount (void) const
+{
+  return m_count;
+}
+
+uint64_t
+IotLogHistogram::GetMax (void) const
+{
+  return m_max;
+}
+
+double
+IotLogHistogram::GetMean (void) const
+{
+  if (m_count == 0)
+    {
+      return 0.0;
+    }
+  return (double) m_sum / m_count;
+}
+
+uint64_t
+IotLogHistogram::BucketUpperBound (uint32_t index)
+{
+  if (index < SUB_BUCKETS)
+    {
+      return index;
+    }
+  if (index >= N_BUCKETS - 1)
+    {
+      // The last bucket also holds every value of 2^32 and more
+      return ~(uint64_t) 0;
+    }
+  uint32_t shift = index / SUB_BUCKETS - 1;
+  uint64_t lower = (uint64_t) (SUB_BUCKETS + index % SUB_BUCKETS) << shift;
+  return lower + ((uint64_t) 1 << shift) - 1;
+}
+
+uint64_t
+IotLogHistogram::GetQuantile (double q) const
+{
+  if (m_count == 0)
+    {
+      return 0;
+    }
+  uint64_t rank = (uint64_t) (q * m_count);
+  if (rank >= m_count)
+    {
+      rank = m_count - 1;
+    }
+  uint64_t seen = 0;
+  for (uint32_t i = 0; i < N_BUCKETS; i++)
+    {
+      seen += m_counts[i];
+      if (seen > rank)
+        {
+          uint64_t upper = BucketUpperBound (i);
+          return upper < m_max ? upper : m_max;
+        }
+    }
+  return m_max;
+}
+
+/*
+* OutputFileName: when empty the reports are written to standard output.
+* ExportInterval: period of the intermediate reports, zero disables them (the end of run report is always written).
+* JoulesPerEnergyUnit: converts the abstract energy units of the route processor into joules.
+*/
+TypeId
+IotEnergyOptimalRoutingStats::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::IotEnergyOptimalRoutingStats")
+    .SetParent<Object> ()
+    .AddConstructor<IotEnergyOptimalRoutingStats> ()
+    .AddAttribute ("RoutingProcessor", "Route processor used to read the consumed energy.",
+                   PointerValue (),
+                   MakePointerAccessor (&IotEnergyOptimalRoutingStats::SetRouteProcessor),
+                   MakePointerChecker<IotEnergyOptimalRouteProcessor> ())
+    .AddAttribute ("ExportInterval", "Interval between periodic reports (0 disables them).",
+                   TimeValue (Seconds (0)),
+                   MakeTimeAccessor (&IotEnergyOptimalRoutingStats::m_exportInterval),
+                   MakeTimeChecker ())
+    .AddAttribute ("OutputFileName", "File the reports are written to (empty for standard output).",
+                   StringValue (""),
+                   MakeStringAccessor (&IotEnergyOptimalRoutingStats::m_outputFileName),
+                   MakeStringChecker ())
+    .AddAttribute ("JoulesPerEnergyUnit", "Joules represented by one energy unit of the route processor.",
+                   DoubleValue (1.0),
+                   MakeDoubleAccessor (&IotEnergyOptimalRoutingStats::m_joulesPerEnergyUnit),
+                   MakeDoubleChecker<double> (0.0))
+    ;
+  return tid;
+}
+
+IotEnergyOptimalRoutingStats::IotEnergyOptimalRoutingStats ()
+  : m_started (false),
+    m_originated (0),
+    m_delivered (0),
+    m_deliveredBytes (0)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+IotEnergyOptimalRoutingStats::~IotEnergyOptimalRoutingStats ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+void
+IotEnergyOptimalRoutingStats::DoDispose (void)
+{
+  m_exportEvent.Cancel ();
+  m_routeProcessor = 0;
+  m_stream = 0;
+  Object::DoDispose ();
+}
+
+void
+IotEnergyOptimalRoutingStats::SetRouteProcessor (Ptr<IotEnergyOptimalRouteProcessor> p)
+{
+  m_routeProcessor = p;
+}
+
+void
+IotEnergyOptimalRoutingStats::InstallSink (Ptr<Node> node)
+{
+  NS_LOG_FUNCTION (this << node->GetId ());
+  Ptr<Ipv4L3Protocol> ipv4 = node->GetObject<Ipv4L3Protocol> ();
+  NS_ASSERT_MSG (ipv4, "InstallSink needs a node with an internet stack");
+  ipv4->TraceConnectWithoutContext ("LocalDeliver", MakeCallback (&IotEnergyOptimalRoutingStats::LocalDeliverTrace, this));
+
+  if (!m_started)
+    {
+      m_started = true;
+      if (!m_exportInterval.IsZero ())
+        {
+          m_exportEvent = Simulator::Schedule (m_exportInterval, &IotEnergyOptimalRoutingStats::PeriodicExport, this);
+        }
+      Simulator::ScheduleDestroy (&IotEnergyOptimalRoutingStats::Export, Ptr<IotEnergyOptimalRoutingStats> (this));
+    }
+}
+
+void
+IotEnergyOptimalRoutingStats::NotifyOriginated (uint16_t tier)
+{
+  m_originated++;
+  m_tiers[tier < MAX_TIERS ? tier : MAX_TIERS - 1].originated++;
+}
+
+void
+IotEnergyOptimalRoutingStats::LocalDeliverTrace (const Ipv4Header &header, Ptr<const Packet> p, uint32_t interface)
+{
+  NotifyDelivered (header, p);
+}
+
+/*
+* Packets without the routing tag were not originated by IotEnergyOptimalRouting (e.g. ARP or control traffic) and are ignored.
+*/
+void
+IotEnergyOptimalRoutingStats::NotifyDelivered (const Ipv4Header &header, Ptr<const Packet> p)
+{
+  IotEnergyOptimalRoutingTag tag;
+  if (!p->PeekPacketTag (tag))
+    {
+      return;
+    }
+  uint64_t delayUs = (Simulator::Now () - tag.GetOriginTime ()).GetMicroSeconds ();
+  uint32_t bytes = p->GetSize ();
+  uint16_t tier = tag.GetTier () < MAX_TIERS ? tag.GetTier () : MAX_TIERS - 1;
+
+  m_delivered++;
+  m_deliveredBytes += bytes;
+
+  TierStats &ts = m_tiers[tier];
+  ts.delay.Record (delayUs);
+  ts.hopSum += tag.GetHopCount ();
+  ts.bytes += bytes;
+
+  FlowStats &fs = m_flows[header.GetSource ()];
+  fs.delay.Record (delayUs);
+  fs.hopSum += tag.GetHopCount ();
+  fs.bytes += bytes;
+}
+
+uint64_t
+IotEnergyOptimalRoutingStats::GetOriginatedPackets (void) const
+{
+  return m_originated;
+}
+
+uint64_t
+IotEnergyOptimalRoutingStats::GetDeliveredPackets (void) const
+{
+  return m_delivered;
+}
+
+double
+IotEnergyOptimalRoutingStats::GetDeliveryRatio (void) const
+{
+  if (m_originated == 0)
+    {
+      return 0.0;
+    }
+  return (double) m_delivered / m_originated;
+}
+
+double
+IotEnergyOptimalRoutingStats::GetJoulesPerDeliveredBit (void) const
+{
+  if (m_deliveredBytes == 0 || !m_routeProcessor)
+    {
+      return 0.0;
+    }
+  return m_routeProcessor->GetTotalEnergyConsumed () * m_joulesPerEnergyUnit / (m_deliveredBytes * 8.0);
+}
+
+const IotLogHistogram &
+IotEnergyOptimalRoutingStats::GetTierDelayHistogram (uint16_t tier) const
+{
+  return m_tiers[tier < MAX_TIERS ? tier : MAX_TIERS - 1].delay;
+}
+
+void
+IotEnergyOptimalRoutingStats::PeriodicExport (void)
+{
+  Export ();
+  m_exportEvent = Simulator::Schedule (m_exportInterval, &IotEnergyOptimalRoutingStats::PeriodicExport, this);
+}
+
+void
+IotEnergyOptimalRoutingStats::ExportHistogram (std::ostream &os, const IotLogHistogram &h) const
+{
+  os << " n=" << h.GetCount ()
+     << " mean_us=" << h.GetMean ()
+     << " p50_us=" << h.GetQuantile (0.50)
+     << " p90_us=" << h.GetQuantile (0.90)
+     << " p99_us=" << h.GetQuantile (0.99)
+     << " max_us=" << h.GetMax ();
+}
+
+/*
+* Writes one report: a summary line, one line per tier and one line per flow (flows are ordered by source address).
+*/
+void
+IotEnergyOptimalRoutingStats::Export (void)
+{
+  if (!m_stream)
+    {
+      if (m_outputFileName.empty ())
+        {
+          m_stream = Create<OutputStreamWrapper> (&std::cout);
+        }
+      else
+        {
+          m_stream = Create<OutputStreamWrapper> (m_outputFileName, std::ios::out);
+        }
+    }
+  std::ostream &os = *m_stream->GetStream ();
+
+  double energy = m_routeProcessor ? m_routeProcessor->GetTotalEnergyConsumed () * m_joulesPerEnergyUnit : 0.0;
+  os << "[STATS] time_s=" << Simulator::Now ().GetSeconds ()
+     << " originated=" << m_originated
+     << " delivered=" << m_delivered
+     << " delivery_ratio=" << GetDeliveryRatio ()
+     << " energy_J=" << energy
+     << " J_per_bit=" << GetJoulesPerDeliveredBit ()
+     << std::endl;
+
+  for (uint16_t tier = 0; tier < MAX_TIERS; tier++)
+    {
+      const TierStats &ts = m_tiers[tier];
+      if (ts.originated == 0 && ts.delay.GetCount () == 0)
+        {
+          continue;
+        }
+      os << "[STATS]   tier=" << tier << " originated=" << ts.originated;
+      ExportHistogram (os, ts.delay);
+      os << " mean_hops=" << (ts.delay.GetCount () ? (double) ts.hopSum / ts.delay.GetCount () : 0.0)
+         << " bytes=" << ts.bytes << std::endl;
+    }
+
+  std::map<Ipv4Address, const FlowStats *> ordered;
+  for (std::unordered_map<Ipv4Address, FlowStats, Ipv4AddressHash>::const_iterator it = m_flows.begin (); it != m_flows.end (); it++)
+    {
+      ordered[it->first] = &it->second;
+    }
+  for (std::map<Ipv4Address, const FlowStats *>::const_iterator it = ordered.begin (); it != ordered.end (); it++)
+    {
+      const FlowStats &fs = *it->second;
+      os << "[STATS]   flow=" << it->first;
+      ExportHistogram (os, fs.delay);
+      os << " mean_hops=" << (double) fs.hopSum / fs.delay.GetCount ()
+         << " bytes=" << fs.bytes << std::endl;
+    }
+}
+
+}
@@ -0,0 +1,179 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef IOT_ENERGY_OPTIMAL_ROUTING_STATS_H
+#define IOT_ENERGY_OPTIMAL_ROUTING_STATS_H
+
+#include "ns3/object.h"
+#include "ns3/tag.h"
+#include "ns3/nstime.h"
+#include "ns3/node.h"
+#include "ns3/packet.h"
+#include "ns3/ipv4-address.h"
+#include "ns3/ipv4-header.h"
+#include "ns3/output-stream-wrapper.h"
+#include "ns3/event-id.h"
+#include "iot-energy-optimal-route-processor.h"
+#include <unordered_map>
+
+namespace ns3 {
+
+/*
+* Packet tag added by IotEnergyOptimalRouting when a packet is originated.
+* It carries the origination time, the tier of the source and the number of
+* transmissions the packet has done so far, so the sink can compute end-to-end delay and hop count.
+*/
+class IotEnergyOptimalRoutingTag : public Tag
+{
+public:
+  IotEnergyOptimalRoutingTag ();
+  IotEnergyOptimalRoutingTag (Time originTime, uint16_t tier);
+
+  static TypeId GetTypeId (void);
+  virtual TypeId GetInstanceTypeId (void) const;
+  virtual uint32_t GetSerializedSize (void) const;
+  virtual void Serialize (TagBuffer i) const;
+  virtual void Deserialize (TagBuffer i);
+  virtual void Print (std::ostream &os) const;
+
+  Time GetOriginTime (void) const;
+  uint16_t GetTier (void) const;
+  uint8_t GetHopCount (void) const;
+  void IncrementHopCount (void);
+  void SetHopCount (uint8_t hops);
+
+private:
+  int64_t m_originTimeNs;
+  uint16_t m_tier;
+  uint8_t m_hops;
+};
+
+/*
+* Fixed memory histogram with log-linear buckets (8 sub buckets per power of two).
+* Values are in microseconds; relative error of a bucket is below 12.5%.
+* Recording is a count-leading-zeros, a shift and an increment. Values of 2^32 and more go to the last bucket (overflow).
+*/
+class IotLogHistogram
+{
+public:
+  static const uint32_t SUB_BUCKET_BITS = 3;
+  static const uint32_t SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+  static const uint32_t N_BUCKETS = (32 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+  IotLogHistogram ();
+
+  inline void Record (uint64_t value)
+  {
+    m_counts[Index (value)]++;
+    m_count++;
+    m_sum += value;
+    if (value > m_max)
+      {
+        m_max = value;
+      }
+  }
+
+  uint64_t GetCount (void) const;
+  uint64_t GetMax (void) const;
+  double GetMean (void) const;
+  /* Returns the upper bound of the bucket holding the q-quantile (0 <= q <= 1), capped by the max. */
+  uint64_t GetQuantile (double q) const;
+  void Reset (void);
+
+  static inline uint32_t Index (uint64_t value)
+  {
+    if (value < SUB_BUCKETS)
+      {
+        return value;
+      }
+    if (value >> 32)
+      {
+        return N_BUCKETS - 1;
+      }
+    uint32_t msb = 63 - __builtin_clzll (value);
+    uint32_t shift = msb - SUB_BUCKET_BITS;
+    return (shift + 1) * SUB_BUCKETS + ((value >> shift) & (SUB_BUCKETS - 1));
+  }
+  static uint64_t BucketUpperBound (uint32_t index);
+
+private:
+  uint32_t m_counts[N_BUCKETS];
+  uint64_t m_count;
+  uint64_t m_sum;
+  uint64_t m_max;
+};
+
+/*
+* Statistics collector attached to IotEnergyOptimalRouting.
+* Actions performed:
+* 1. Counts packets originated per tier (called from RouteOutput).
+* 2. Records end-to-end delay and hop count per tier and per flow when a packet is locally delivered on a sink.
+* 3. Computes delivery ratio and joules per delivered bit from the energy consumed in the route processor.
+* 4. Exports the results periodically (ExportInterval) and at the end of the run.
+*/
+class IotEnergyOptimalRoutingStats : public Object
+{
+public:
+  static const uint16_t MAX_TIERS = 16;
+
+  static TypeId GetTypeId (void);
+
+  IotEnergyOptimalRoutingStats ();
+  virtual ~IotEnergyOptimalRoutingStats ();
+
+  void SetRouteProcessor (Ptr<IotEnergyOptimalRouteProcessor> p);
+
+  /* Hooks the LocalDeliver trace of the node so packets reaching it are recorded. Also starts the export events. */
+  void InstallSink (Ptr<Node> node);
+
+  void NotifyOriginated (uint16_t tier);
+  void NotifyDelivered (const Ipv4Header &header, Ptr<const Packet> p);
+
+  uint64_t GetOriginatedPackets (void) const;
+  uint64_t GetDeliveredPackets (void) const;
+  double GetDeliveryRatio (void) const;
+  double GetJoulesPerDeliveredBit (void) const;
+  const IotLogHistogram & GetTierDelayHistogram (uint16_t tier) const;
+
+  void Export (void);
+
+protected:
+  virtual void DoDispose (void);
+
+private:
+  struct FlowStats
+  {
+    FlowStats () : hopSum (0), bytes (0) {}
+    IotLogHistogram delay;
+    uint64_t hopSum;
+    uint64_t bytes;
+  };
+  struct TierStats
+  {
+    TierStats () : originated (0), hopSum (0), bytes (0) {}
+    IotLogHistogram delay;
+    uint64_t originated;
+    uint64_t hopSum;
+    uint64_t bytes;
+  };
+
+  void LocalDeliverTrace (const Ipv4Header &header, Ptr<const Packet> p, uint32_t interface);
+  void PeriodicExport (void);
+  void ExportHistogram (std::ostream &os, const IotLogHistogram &h) const;
+
+  Ptr<IotEnergyOptimalRouteProcessor> m_routeProcessor;
+  Time m_exportInterval;
+  std::string m_outputFileName;
+  double m_joulesPerEnergyUnit;
+  Ptr<OutputStreamWrapper> m_stream;
+  EventId m_exportEvent;
+  bool m_started;
+
+  TierStats m_tiers[MAX_TIERS];
+  std::unordered_map<Ipv4Address, FlowStats, Ipv4AddressHash> m_flows;
+  uint64_t m_originated;
+  uint64_t m_delivered;
+  uint64_t m_deliveredBytes;
+};
+
+}
+
+#endif /* IOT_ENERGY_OPTIMAL_ROUTING_STATS_H */
@@ -2,6 +2,7 @@
 
 #include "iot-energy-optimal-routing.h"
 #include "iot-energy-optimal-route-processor.h"
+#include "iot-packet-aggregator.h"
 #include <list>
 #include "ns3/ipv4-routing-protocol.h"
 #include "ns3/log.h"
@@ -11,6 +12,10 @@
 #include "ns3/double.h"
 #include "ns3/ipv4-static-routing.h"
 #include "ns3/core-module.h"
+#include <set>
+#include <map>
+#include <vector>
+#include <algorithm>
 
 using namespace std;
 
@@ -33,7 +38,137 @@ TypeId IotEnergyOptimalRouting::GetTypeId (void) {
     .AddAttribute ("RoutingProcessor", "Pointer to Route processor class.",
                    PointerValue (),
                    MakePointerAccessor (&IotEnergyOptimalRouting::SetRouteProcessor),
-                   MakePointerChecker<IotEnergyOptimalRouteProcessor> ());
+                   MakePointerChecker<IotEnergyOptimalRouteProcessor> ())
+    .AddAttribute ("Stats", "Pointer to the statistics collector (optional).",
+                   PointerValue (),
+                   MakePointerAccessor (&IotEnergyOptimalRouting::SetStats),
+                   MakePointerChecker<IotEnergyOptimalRoutingStats> ())
+    .AddAttribute ("ForwardingTable", "Forwarding table for destinations other than the gateway sink (can be shared by several nodes); "
+                   "packets with no matching route go down the tiers.",
+                   PointerValue (),
+                   MakePointerAccessor (&IotEnergyOptimalRouting::m_forwardingTable),
+                   MakePointerChecker<IotLpmForwardingTable> ())
+    .AddAttribute ("GatewayAddress", "Address of the gateway sink Tier 1 nodes send to.",
+                   Ipv4AddressValue (Ipv4Address ("10.1.3.1")),
+                   MakeIpv4AddressAccessor (&IotEnergyOptimalRouting::dest_gateway_address),
+                   MakeIpv4AddressChecker ())
+    .AddAttribute ("AirtimeCost", "Cost in joules of one second of air time, weighing throughput against energy per bit when choosing the interface.",
+                   DoubleValue (0.0),
+                   MakeDoubleAccessor (&IotEnergyOptimalRouting::m_airtimeCost),
+                   MakeDoubleChecker<double> (0.0))
+    .AddAttribute ("AggregationMaxDelay", "Hold forwarded packets to the sink up to this time to send them in one frame (0 disables aggregation); "
+                   "the sink needs an IotAggregateDemux.",
+                   TimeValue (Seconds (0)),
+                   MakeTimeAccessor (&IotEnergyOptimalRouting::m_aggregationMaxDelay),
+                   MakeTimeChecker ())
+    .AddAttribute ("AggregationMaxBytes", "Size at which an aggregate frame is sent without waiting.",
+                   UintegerValue (1400),
+                   MakeUintegerAccessor (&IotEnergyOptimalRouting::m_aggregationMaxBytes),
+                   MakeUintegerChecker<uint32_t> (1, 65000))
+    .AddAttribute ("Scheduler", "TDMA schedule the packets of this node are sent in, in the slot of the node in the window of its tier "
+                   "(optional, shared by all the nodes).",
+                   PointerValue (),
+                   MakePointerAccessor (&IotEnergyOptimalRouting::m_scheduler),
+                   MakePointerChecker<IotTdmaScheduler> ())
+    .AddAttribute ("DutyCycle", "Controller putting the radio of the nodes that are not relays to sleep (optional, shared by all the nodes).",
+                   PointerValue (),
+                   MakePointerAccessor (&IotEnergyOptimalRouting::m_dutyCycle),
+                   MakePointerChecker<IotDutyCycleController> ())
+    .AddAttribute ("Downlink", "Route packets to IOT nodes up the tiers, on reverse paths learnt from the uplink traffic, and relay multicast packets.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&IotEnergyOptimalRouting::m_downlink),
+                   MakeBooleanChecker ())
+    .AddAttribute ("ReversePathLifetime", "Time a reverse path is used after the last uplink packet of its destination.",
+                   TimeValue (Seconds (300)),
+                   MakeTimeAccessor (&IotEnergyOptimalRouting::m_reversePathLifetime),
+                   MakeTimeChecker ())
+    .AddAttribute ("ReversePathCapacity", "Number of destinations the reverse path table of a node holds.",
+                   UintegerValue (65536),
+                   MakeUintegerAccessor (&IotEnergyOptimalRouting::m_reversePathCapacity),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("DuplicateLifetime", "Time a multicast packet is remembered to drop its copies.",
+                   TimeValue (Seconds (30)),
+                   MakeTimeAccessor (&IotEnergyOptimalRouting::m_duplicateLifetime),
+                   MakeTimeChecker ())
+    .AddAttribute ("FastReroute", "Keep a backup next hop per tier (the best other choice) and switch to it as soon as the MAC reports a failed next hop, "
+                   "without waiting for the report to the route processor.",
+                   BooleanValue (true),
+                   MakeBooleanAccessor (&IotEnergyOptimalRouting::m_fastReroute),
+                   MakeBooleanChecker ())
+    .AddAttribute ("FailureReportDelay", "Time for a failed next hop to be reported to the route processor, e.g. over telemetry to a gateway.",
+                   TimeValue (Seconds (0)),
+                   MakeTimeAccessor (&IotEnergyOptimalRouting::m_failureReportDelay),
+                   MakeTimeChecker ())
+    .AddAttribute ("Verbose", "Log every originated, forwarded and delivered packet.",
+                   BooleanValue (true),
+                   MakeBooleanAccessor (&IotEnergyOptimalRouting::m_verbose),
+                   MakeBooleanChecker ())
+    .AddAttribute ("RouteOutputCalls", "Number of RouteOutput calls (packets originated) on this node.",
+                   TypeId::ATTR_GET,
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&IotEnergyOptimalRouting::GetRouteOutputCalls),
+                   MakeUintegerChecker<uint64_t> ())
+    .AddAttribute ("RouteInputCalls", "Number of RouteInput calls on this node.",
+                   TypeId::ATTR_GET,
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&IotEnergyOptimalRouting::GetRouteInputCalls),
+                   MakeUintegerChecker<uint64_t> ())
+    .AddAttribute ("LocalDeliveries", "Number of packets delivered locally on this node.",
+                   TypeId::ATTR_GET,
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&IotEnergyOptimalRouting::GetLocalDeliveries),
+                   MakeUintegerChecker<uint64_t> ())
+    .AddAttribute ("NextHopChanges", "Number of times the selected next hop changed on this node.",
+                   TypeId::ATTR_GET,
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&IotEnergyOptimalRouting::GetNextHopChanges),
+                   MakeUintegerChecker<uint64_t> ())
+    .AddAttribute ("ProcessorTicks", "Time spent in the route processor (cycles or ns, only with profiling enabled).",
+                   TypeId::ATTR_GET,
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&IotEnergyOptimalRouting::GetProcessorTicks),
+                   MakeUintegerChecker<uint64_t> ())
+    .AddAttribute ("FastReroutes", "Number of times this node switched to a backup next hop.",
+                   TypeId::ATTR_GET,
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&IotEnergyOptimalRouting::GetFastReroutes),
+                   MakeUintegerChecker<uint64_t> ())
+    .AddAttribute ("GlobalRouteOutputCalls", "Number of RouteOutput calls on every node of the simulation.",
+                   TypeId::ATTR_GET,
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&IotEnergyOptimalRouting::GetGlobalRouteOutputCalls),
+                   MakeUintegerChecker<uint64_t> ())
+    .AddAttribute ("GlobalRouteInputCalls", "Number of RouteInput calls on every node of the simulation.",
+                   TypeId::ATTR_GET,
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&IotEnergyOptimalRouting::GetGlobalRouteInputCalls),
+                   MakeUintegerChecker<uint64_t> ())
+    .AddAttribute ("GlobalLocalDeliveries", "Number of packets delivered locally on every node of the simulation.",
+                   TypeId::ATTR_GET,
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&IotEnergyOptimalRouting::GetGlobalLocalDeliveries),
+                   MakeUintegerChecker<uint64_t> ())
+    .AddAttribute ("GlobalNextHopChanges", "Number of next hop changes on every node of the simulation.",
+                   TypeId::ATTR_GET,
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&IotEnergyOptimalRouting::GetGlobalNextHopChanges),
+                   MakeUintegerChecker<uint64_t> ())
+    .AddAttribute ("GlobalProcessorTicks", "Time spent in the route processor by every node of the simulation.",
+                   TypeId::ATTR_GET,
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&IotEnergyOptimalRouting::GetGlobalProcessorTicks),
+                   MakeUintegerChecker<uint64_t> ())
+    .AddAttribute ("GlobalFastReroutes", "Number of switches to a backup next hop on every node of the simulation.",
+                   TypeId::ATTR_GET,
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&IotEnergyOptimalRouting::GetGlobalFastReroutes),
+                   MakeUintegerChecker<uint64_t> ())
+    .AddTraceSource ("RoutingAnomaly", "No usable next hop could be selected on this node.",
+                     MakeTraceSourceAccessor (&IotEnergyOptimalRouting::m_anomalyTrace),
+                     "ns3::IotEnergyOptimalRouting::AnomalyTracedCallback")
+    .AddTraceSource ("NextHopFailure", "A next hop of this node failed and its backup took over.",
+                     MakeTraceSourceAccessor (&IotEnergyOptimalRouting::m_nextHopFailureTrace),
+                     "ns3::IotEnergyOptimalRouting::NextHopFailureTracedCallback");
   return tid;
 }
 
@@ -43,28 +178,61 @@ TypeId IotEnergyOptimalRouting::GetTypeId (void) {
 * --> Finds the Tier which this node belongs.
 * --> Forwards the packet to a node in the downstream tier with highest energy. (If node belogs to Tier 1 it directly forwards packet to the destination gateway sink)
 * --> Prints the amount of energy remaining in the nodes after the packet is transmitted.
+* No route is returned while the node has no address or its interface is down.
+* With a Scheduler the route goes to the loopback, and RouteInput queues the packet for the slot of the node.
+* With Downlink, packets to IOT nodes and multicast packets take the downlink route, and uplink packets carry this node as
+* their last hop (IotReversePathTag).
 */
 Ptr<Ipv4Route> 
 IotEnergyOptimalRouting::RouteOutput (Ptr<Packet> p, const Ipv4Header &header, Ptr<NetDevice> oif, enum Socket::SocketErrno &sockerr) 
 {
-	Ptr<Ipv4Route> route = Create<Ipv4Route> ();
-	uint16_t tier = routeProcessor->GetTierFromIpAddress(localIpAddress);
+	m_counters.routeOutputCalls++;
+	if(localIpAddress == Ipv4Address() || m_interfaces.empty()) {
+		sockerr = Socket::ERROR_NOROUTETOHOST;
+		return 0;
+	}
+	uint16_t tier;
+	{
+		IOT_ROUTING_PROFILE_SCOPE (m_counters.processorTicks);
+		tier = routeProcessor->GetTierFromIpAddress(localIpAddress);
+	}
 //	NS_LOG_UNCOND ("[INFO]   Packet Originated Node Source: " << localIpAddress  << " Node Tier: " << tier << " Destination : " << header.GetDestination ());
+	if(m_downlink && (tier == 0 || header.GetDestination().IsMulticast() || routeProcessor->GetTierFromIpAddress(header.GetDestination()) > 0)) {
+		return RouteOutputDownlink(header, tier, sockerr);
+	}
 	Ipv4Address gatewayAddress;
-	if(tier == 1) {
-		gatewayAddress = dest_gateway_address;
+	Ptr<Ipv4Route> route;
+	if(m_scheduler) {
+		// The next hop is chosen once, when the packet comes back on the loopback to be queued for the slot
+		route = LoopbackRoute(localIpAddress, header.GetDestination());
 	} else {
-		gatewayAddress = routeProcessor->GetHighestEnergyNodeInTier(tier-1);
+		if(!LookupForwardingTable(header.GetDestination(), gatewayAddress)) {
+			gatewayAddress = SelectNextHop(tier);
+		}
+		route = CreateRoute(localIpAddress, header.GetDestination(), gatewayAddress);
+	}
+	gatewayAddress = route->GetGateway();
+	{
+		IOT_ROUTING_PROFILE_SCOPE (m_counters.processorTicks);
+		routeProcessor->ReduceNodeEnergyOnTransitHop(localIpAddress);
+	}
+	if(m_stats && p) {
+		IotEnergyOptimalRoutingTag tag (Simulator::Now (), tier);
+		p->ReplacePacketTag(tag);
+		m_stats->NotifyOriginated(tier);
+	}
+	if(m_downlink && p) {
+		IotReversePathTag hop (localIpAddress);
+		p->ReplacePacketTag(hop);
+	}
+	if(m_verbose) {
+		NS_LOG_UNCOND ("[INFO]   Packet Originated Node Source:" << localIpAddress << " Node Tier: " << tier << "  Destination:" << header.GetDestination () << "  Next Hop:" << gatewayAddress << "  Next Tier:" << tier-1);
 	}
-
-	route->SetGateway(gatewayAddress);
-	route->SetSource(localIpAddress);
-	route->SetDestination(header.GetDestination());
-	route->SetOutputDevice (m_ipv4->GetNetDevice (interfaceId));
-	routeProcessor->ReduceNodeEnergyOnTransitHop(localIpAddress);
-    NS_LOG_UNCOND ("[INFO]   Packet Originated Node Source:" << localIpAddress << " Node Tier: " << tier << "  Destination:" << header.GetDestination () << "  Next Hop:" << gatewayAddress << "  Next Tier:" << tier-1);
 	routeProcessor->PrintAvailableEnergyOfAllNodes();
 	sockerr = Socket::ERROR_NOTERROR;
+	if(m_dutyCycle) {
+		m_dutyCycle->NotifyTransmit(localIpAddress);
+	}
 	return route;
 }
 
@@ -74,78 +242,983 @@ IotEnergyOptimalRouting::RouteOutput (Ptr<Packet> p, const Ipv4Header &header, P
 * --> Finds the Tier which this node belongs.
 * --> Forwards the packet to a node in the downstream tier with highest energy. (If node belogs to Tier 1 it directly forwards packet to the destination gateway sink)
 * --> Prints the amount of energy remaining in the nodes after the packet is transmitted.
+* Packets originated on this node come back on the loopback when a Scheduler is set; their next hop is chosen here, once, and
+* they are queued for the slot (energy and statistics were counted in RouteOutput).
+* With Downlink, forwarded uplink packets teach the node the reverse path to their source, packets to IOT nodes go up the tiers,
+* and the gateway leaves every other packet to the next routing protocol of its list.
 */
 bool 
 IotEnergyOptimalRouting::RouteInput (Ptr<const Packet> p, const Ipv4Header &header, Ptr<const NetDevice> idev,
                              UnicastForwardCallback ucb, MulticastForwardCallback mcb,
                              LocalDeliverCallback lcb, ErrorCallback ecb) 
 {
-	if(header.GetDestination() == localIpAddress) {
-		routeProcessor->ReduceNodeEnergyOnTransitHop(localIpAddress);
+	m_counters.routeInputCalls++;
+	if(m_scheduler && idev == m_ipv4->GetNetDevice(0) && IsLocalAddress(header.GetSource()) && !IsLocalAddress(header.GetDestination())) {
+		if(m_interfaces.empty()) {
+			return false;
+		}
+		uint16_t tier = routeProcessor->GetTierFromIpAddress(localIpAddress);
+		Ipv4Address gatewayAddress;
+		if(!LookupForwardingTable(header.GetDestination(), gatewayAddress)) {
+			gatewayAddress = SelectNextHop(tier);
+		}
+		m_scheduler->Enqueue(m_nodeId, tier, CreateRoute(header.GetSource(), header.GetDestination(), gatewayAddress), p, header, ucb);
+		return true;
+	}
+	if(m_downlink && header.GetDestination().IsMulticast()) {
+		return RouteInputMulticast(p, header, idev, ucb, lcb);
+	}
+	if(IsLocalAddress(header.GetDestination())) {
+		m_counters.localDeliveries++;
+		{
+			IOT_ROUTING_PROFILE_SCOPE (m_counters.processorTicks);
+			routeProcessor->ReduceNodeEnergyOnTransitHop(localIpAddress);
+		}
 		routeProcessor->PrintAvailableEnergyOfAllNodes();
-		NS_LOG_UNCOND ("[INFO]   Packet reached destination " << localIpAddress);
+		if(m_verbose) {
+			NS_LOG_UNCOND ("[INFO]   Packet reached destination " << localIpAddress);
+		}
 		lcb (p, header, m_ipv4->GetInterfaceForDevice (idev));
 		return true;
-	} else {
-		Ptr<Ipv4Route> route = Create<Ipv4Route> ();
-		uint16_t tier = routeProcessor->GetTierFromIpAddress(localIpAddress);
+	} else if(m_downlink && routeProcessor->GetTierFromIpAddress(header.GetDestination()) > 0) {
+		return ForwardDownlink(p, header, ucb);
+	} else if(m_downlink && routeProcessor->GetTierFromIpAddress(localIpAddress) == 0) {
+		return false;
+	} else if(!m_interfaces.empty()) {
+		m_counters.forwardedPackets++;
 		Ipv4Address gatewayAddress;
-		if(tier == 1) {
-			gatewayAddress = dest_gateway_address;
-		} else {
-			gatewayAddress = routeProcessor->GetHighestEnergyNodeInTier(tier-1);
+		bool tierPath = !LookupForwardingTable(header.GetDestination(), gatewayAddress);
+		if(m_downlink) {
+			LearnReversePath(p, header.GetSource());
+		}
+		if(tierPath && m_aggregator) {
+			// Energy is charged when the frame is sent
+			if(header.GetProtocol() == IotPacketAggregator::PROT_NUMBER) {
+				m_aggregator->AddAggregate(p, header);
+			} else {
+				m_aggregator->Add(p, header);
+			}
+			return true;
+		}
+		uint16_t tier;
+		{
+			IOT_ROUTING_PROFILE_SCOPE (m_counters.processorTicks);
+			tier = routeProcessor->GetTierFromIpAddress(localIpAddress);
+		}
+		if(tierPath) {
+			gatewayAddress = SelectNextHop(tier);
+		}
+		Ptr<Ipv4Route> route = CreateRoute(header.GetSource(), header.GetDestination(), gatewayAddress);
+		gatewayAddress = route->GetGateway();
+		{
+			IOT_ROUTING_PROFILE_SCOPE (m_counters.processorTicks);
+			routeProcessor->ReduceNodeEnergyOnTransitHop(localIpAddress);
+		}
+		if(m_verbose) {
+			NS_LOG_UNCOND ("[INFO]   Forwarding Packet from Node:" << localIpAddress << "  Source:" << header.GetSource () << "  Destination:" << header.GetDestination () <<  "  Next Hop:" << gatewayAddress << "  Next Tier:" << tier-1);
 		}
-		route->SetGateway(gatewayAddress);
-		route->SetSource(header.GetSource());
-		route->SetDestination(header.GetDestination());
-		route->SetOutputDevice (m_ipv4->GetNetDevice (interfaceId));
-		routeProcessor->ReduceNodeEnergyOnTransitHop(localIpAddress);
-		NS_LOG_UNCOND ("[INFO]   Forwarding Packet from Node:" << localIpAddress << "  Source:" << header.GetSource () << "  Destination:" << header.GetDestination () <<  "  Next Hop:" << gatewayAddress << "  Next Tier:" << tier-1);
 		routeProcessor->PrintAvailableEnergyOfAllNodes();
-		ucb (route, p, header);
+		IotEnergyOptimalRoutingTag tag;
+		bool hopCount = m_stats && p->PeekPacketTag(tag);
+		if(hopCount || m_downlink) {
+			Ptr<Packet> packet = p->Copy();
+			if(hopCount) {
+				tag.IncrementHopCount();
+				packet->ReplacePacketTag(tag);
+			}
+			if(m_downlink) {
+				IotReversePathTag hop (localIpAddress);
+				packet->ReplacePacketTag(hop);
+			}
+			Transmit (tier, route, packet, header, ucb);
+			return true;
+		}
+		Transmit (tier, route, p, header, ucb);
 		return true;
 	}
 
 	return false;
 }
 
+/*
+* Picks the next hop for a packet leaving a node of the given tier: for Tier 1 the gateway chosen by the processor
+* (or GatewayAddress when the processor has no gateways),
+* otherwise the node of the downstream tier chosen by the SelectionMode of the processor (SelectRelay). Counts how often the chosen next hop changes
+* and fires RoutingAnomaly when the node has no tier or the downstream tier has no energy left.
+*/
+Ipv4Address
+IotEnergyOptimalRouting::SelectNextHop (uint16_t tier)
+{
+	Ipv4Address nextHop;
+	if(tier == 1) {
+		if(routeProcessor->GetNumberOfGateways() > 0) {
+			IOT_ROUTING_PROFILE_SCOPE (m_counters.processorTicks);
+			nextHop = routeProcessor->SelectGateway(localIpAddress);
+		} else {
+			nextHop = dest_gateway_address;
+		}
+	} else {
+		nextHop = SelectRelay(tier-1);
+	}
+	if(tier == 0) {
+		m_anomalyTrace(localIpAddress, "node is not assigned to a tier");
+	} else if(nextHop == Ipv4Address()) {
+		m_anomalyTrace(localIpAddress, "no node with energy left in the downstream tier");
+	}
+	if(!m_nextHopSelected) {
+		m_nextHopSelected = true;
+		m_lastNextHop = nextHop;
+	} else if(nextHop != m_lastNextHop) {
+		m_counters.nextHopChanges++;
+		m_lastNextHop = nextHop;
+	}
+	return nextHop;
+}
+
+/*
+* Node of a tier chosen by the processor, with its backup when FastReroute is set. After a failure of the chosen node its backup
+* is used for as long as the processor still selects the failed node, i.e. until the failure reported by this node is applied.
+* With several radios the backup is taken instead when the pair of the backup and its cheapest interface costs less per bit
+* than the one of the chosen node (the two then trade places); with a single radio every pair costs the same.
+*/
+Ipv4Address
+IotEnergyOptimalRouting::SelectRelay (uint16_t tier)
+{
+  Ipv4Address nextHop;
+  Ipv4Address backup;
+  bool joint = m_interfaces.size () > 1;
+  {
+    IOT_ROUTING_PROFILE_SCOPE (m_counters.processorTicks);
+    if (!m_fastReroute && !joint)
+      {
+        return routeProcessor->SelectNodeInTier (tier, localIpAddress);
+      }
+    nextHop = routeProcessor->SelectNodeInTier (tier, localIpAddress, backup);
+  }
+  if (m_fastReroute && m_nextHops[tier].failed != Ipv4Address () && nextHop == m_nextHops[tier].failed)
+    {
+      return m_nextHops[tier].primary;
+    }
+  if (joint && backup != Ipv4Address () && SelectInterface (backup).costPerBit < SelectInterface (nextHop).costPerBit)
+    {
+      std::swap (nextHop, backup);
+    }
+  if (!m_fastReroute)
+    {
+      return nextHop;
+    }
+  NextHops &hops = m_nextHops[tier];
+  hops.primary = nextHop;
+  hops.backup = backup;
+  hops.failed = Ipv4Address ();
+  return nextHop;
+}
+
+/*
+* With FastReroute the switch over is a swap of the next hops of the tiers sending to the failed node, with no lookup in the
+* processor. The failure of the link is reported in every case, in an event of its own since the MAC is still handling the frame;
+* without FastReroute (or without a backup) the node keeps its next hop until the report is applied. The processor then skips the
+* node in the selections of this node only.
+*/
+void
+IotEnergyOptimalRouting::NotifyNextHopFailure (Ipv4Address nextHop)
+{
+  if (!routeProcessor)
+    {
+      return;
+    }
+  for (std::map<uint16_t, NextHops>::iterator it = m_nextHops.begin (); m_fastReroute && it != m_nextHops.end (); it++)
+    {
+      NextHops &hops = it->second;
+      if (hops.primary != nextHop || hops.backup == Ipv4Address ())
+        {
+          continue;
+        }
+      hops.failed = nextHop;
+      hops.primary = hops.backup;
+      hops.backup = Ipv4Address ();
+      m_counters.fastReroutes++;
+      if (m_verbose)
+        {
+          NS_LOG_UNCOND ("[INFO]   Next Hop:" << nextHop << " of Node:" << localIpAddress << " failed, switching to " << hops.primary);
+        }
+      m_nextHopFailureTrace (nextHop, hops.primary);
+    }
+  Simulator::Schedule (m_failureReportDelay, &IotEnergyOptimalRouting::ReportNextHopFailure, this, nextHop);
+}
+
+void
+IotEnergyOptimalRouting::ReportNextHopFailure (Ipv4Address nextHop)
+{
+  if (routeProcessor)
+    {
+      routeProcessor->ReportLinkFailure (localIpAddress, nextHop);
+    }
+}
+
+/*
+* Forwarded packets go out right away, or in the slot of the node when a Scheduler is set. The radio is woken first (DutyCycle).
+*/
+void
+IotEnergyOptimalRouting::Transmit (uint16_t tier, Ptr<Ipv4Route> route, Ptr<const Packet> p, const Ipv4Header &header, UnicastForwardCallback ucb)
+{
+  if (m_dutyCycle)
+    {
+      m_dutyCycle->NotifyTransmit (localIpAddress);
+    }
+  if (m_scheduler)
+    {
+      m_scheduler->Enqueue (m_nodeId, tier, route, p, header, ucb);
+      return;
+    }
+  ucb (route, p, header);
+}
+
+/*
+* Route through the loopback device (interface 0) for packets that have to wait for the slot of the node, as AODV does for
+* packets waiting for a route: Ipv4L3Protocol hands them back to RouteInput, which chooses their next hop.
+*/
+Ptr<Ipv4Route>
+IotEnergyOptimalRouting::LoopbackRoute (Ipv4Address source, Ipv4Address dest) const
+{
+  Ptr<Ipv4Route> route = Create<Ipv4Route> ();
+  route->SetSource (source);
+  route->SetDestination (dest);
+  route->SetGateway (Ipv4Address::GetLoopback ());
+  route->SetOutputDevice (m_ipv4->GetNetDevice (0));
+  return route;
+}
+
+/*
+* Downlink route of a packet originated on this node. The gateway (tier 0) has no route for other destinations, so the next
+* routing protocol of its list is asked. The source is the address of the outgoing interface: the gateway is usually known
+* on the IOT network by another address than its first one. Downlink packets do not wait for a TDMA slot; with DutyCycle the radio
+* of the next hop is woken too, or of every node of the next tier for multicast, as only the relay candidates listen.
+*/
+Ptr<Ipv4Route>
+IotEnergyOptimalRouting::RouteOutputDownlink (const Ipv4Header &header, uint16_t tier, Socket::SocketErrno &sockerr)
+{
+  Ipv4Address dest = header.GetDestination ();
+  Ptr<Ipv4Route> route;
+  if (dest.IsMulticast ())
+    {
+      route = CreateMulticastRoute (localIpAddress, dest, tier);
+    }
+  else if (routeProcessor->GetTierFromIpAddress (dest) > 0)
+    {
+      route = CreateRoute (localIpAddress, dest, SelectDownlinkNextHop (dest, tier));
+    }
+  else
+    {
+      sockerr = Socket::ERROR_NOROUTETOHOST;
+      return 0;
+    }
+  route->SetSource (m_ipv4->GetAddress (m_ipv4->GetInterfaceForDevice (route->GetOutputDevice ()), 0).GetLocal ());
+  m_counters.downlinkPackets++;
+  routeProcessor->ReduceNodeEnergyOnTransitHop (localIpAddress);
+  if (m_verbose)
+    {
+      NS_LOG_UNCOND ("[INFO]   Downlink Packet Originated Node Source:" << route->GetSource () << "  Destination:" << dest << "  Next Hop:" << route->GetGateway ());
+    }
+  if (m_dutyCycle)
+    {
+      m_dutyCycle->NotifyTransmit (localIpAddress);
+      if (dest.IsMulticast ())
+        {
+          m_dutyCycle->NotifyTierReceive (tier + 1);
+        }
+      else
+        {
+          m_dutyCycle->NotifyReceive (route->GetGateway ());
+        }
+    }
+  sockerr = Socket::ERROR_NOTERROR;
+  return route;
+}
+
+bool
+IotEnergyOptimalRouting::ForwardDownlink (Ptr<const Packet> p, const Ipv4Header &header, UnicastForwardCallback ucb)
+{
+  if (m_interfaces.empty ())
+    {
+      return false;
+    }
+  uint16_t tier = routeProcessor->GetTierFromIpAddress (localIpAddress);
+  Ptr<Ipv4Route> route = CreateRoute (header.GetSource (), header.GetDestination (), SelectDownlinkNextHop (header.GetDestination (), tier));
+  m_counters.forwardedPackets++;
+  m_counters.downlinkPackets++;
+  routeProcessor->ReduceNodeEnergyOnTransitHop (localIpAddress);
+  if (m_verbose)
+    {
+      NS_LOG_UNCOND ("[INFO]   Forwarding Downlink Packet from Node:" << localIpAddress << "  Source:" << header.GetSource () << "  Destination:" << header.GetDestination () << "  Next Hop:" << route->GetGateway () << "  Next Tier:" << tier + 1);
+    }
+  routeProcessor->PrintAvailableEnergyOfAllNodes ();
+  if (m_dutyCycle)
+    {
+      m_dutyCycle->NotifyTransmit (localIpAddress);
+      m_dutyCycle->NotifyReceive (route->GetGateway ());
+    }
+  ucb (route, p, header);
+  return true;
+}
+
+/*
+* Destinations in the next tier (or below) are sent to directly. Further ones follow the reverse path while its next hop is
+* still available, not failed (nor the link to it) and has energy left, otherwise the node of the next tier chosen by the processor.
+*/
+Ipv4Address
+IotEnergyOptimalRouting::SelectDownlinkNextHop (Ipv4Address dest, uint16_t tier)
+{
+  if (routeProcessor->GetTierFromIpAddress (dest) <= tier + 1)
+    {
+      return dest;
+    }
+  Ipv4Address nextHop;
+  if (m_reversePaths && m_reversePaths->Lookup (dest, nextHop) && routeProcessor->IsNodeAvailable (nextHop)
+      && !routeProcessor->IsNodeFailed (nextHop) && !routeProcessor->IsLinkFailed (localIpAddress, nextHop)
+      && routeProcessor->GetNodeEnergy (nextHop) > 0)
+    {
+      return nextHop;
+    }
+  m_counters.reversePathMisses++;
+  nextHop = SelectRelay (tier + 1);
+  return nextHop == Ipv4Address () ? dest : nextHop;
+}
+
+/*
+* The interface is the one reaching the next tier; the frame is addressed to the group.
+*/
+Ptr<Ipv4Route>
+IotEnergyOptimalRouting::CreateMulticastRoute (Ipv4Address source, Ipv4Address group, uint16_t tier)
+{
+  Ipv4Address upstream = routeProcessor->GetHighestEnergyNodeInTier (tier + 1);
+  Ptr<Ipv4Route> route = CreateRoute (source, group, upstream == Ipv4Address () ? group : upstream);
+  route->SetGateway (group);
+  return route;
+}
+
+/*
+* Every IOT node delivers the first copy of a multicast packet and pays its reception; relay candidates of the tiers that have
+* another tier above them send it again. Later copies (from other relays) are dropped. The gateway delivers its copies
+* through its list routing and forwards nothing. A packet (e.g. a firmware image) thus costs one transmission per relay instead
+* of one unicast per node; the sender needs an IpMulticastTtl of at least the number of tiers.
+*/
+bool
+IotEnergyOptimalRouting::RouteInputMulticast (Ptr<const Packet> p, const Ipv4Header &header, Ptr<const NetDevice> idev,
+                                              UnicastForwardCallback ucb, LocalDeliverCallback lcb)
+{
+  uint16_t tier = routeProcessor->GetTierFromIpAddress (localIpAddress);
+  if (tier == 0)
+    {
+      return false;
+    }
+  if (IsDuplicate (header.GetSource (), header.GetIdentification ()))
+    {
+      return true;
+    }
+  m_counters.localDeliveries++;
+  routeProcessor->ReduceNodeEnergyOnTransitHop (localIpAddress);
+  lcb (p, header, m_ipv4->GetInterfaceForDevice (idev));
+  if (m_interfaces.empty () || tier >= routeProcessor->GetHighestTier () || !routeProcessor->IsRelayCandidate (localIpAddress))
+    {
+      return true;
+    }
+  Ptr<Ipv4Route> route = CreateMulticastRoute (header.GetSource (), header.GetDestination (), tier);
+  m_counters.forwardedPackets++;
+  m_counters.downlinkPackets++;
+  routeProcessor->ReduceNodeEnergyOnTransitHop (localIpAddress);
+  if (m_verbose)
+    {
+      NS_LOG_UNCOND ("[INFO]   Relaying Multicast Packet from Node:" << localIpAddress << "  Source:" << header.GetSource () << "  Group:" << header.GetDestination () << "  Next Tier:" << tier + 1);
+    }
+  if (m_dutyCycle)
+    {
+      m_dutyCycle->NotifyTransmit (localIpAddress);
+      m_dutyCycle->NotifyTierReceive (tier + 1);
+    }
+  ucb (route, p, header);
+  return true;
+}
+
+/*
+* Multicast packets are identified by source and IP identification, remembered for DuplicateLifetime.
+*/
+bool
+IotEnergyOptimalRouting::IsDuplicate (Ipv4Address source, uint16_t identification)
+{
+  Time now = Simulator::Now ();
+  while (!m_seenMulticastOrder.empty () && now - m_seenMulticastOrder.front ().first > m_duplicateLifetime)
+    {
+      m_seenMulticast.erase (m_seenMulticastOrder.front ().second);
+      m_seenMulticastOrder.pop_front ();
+    }
+  uint64_t key = ((uint64_t) source.Get () << 16) | identification;
+  if (!m_seenMulticast.insert (key).second)
+    {
+      return true;
+    }
+  m_seenMulticastOrder.push_back (std::make_pair (now, key));
+  return false;
+}
+
+void
+IotEnergyOptimalRouting::LearnReversePath (Ptr<const Packet> p, Ipv4Address source)
+{
+  IotReversePathTag hop;
+  if (m_reversePaths && p->PeekPacketTag (hop))
+    {
+      m_reversePaths->Learn (source, hop.GetHop ());
+    }
+}
+
+/*
+* Packets delivered on this node: on the gateway, which sees them only through this trace, they teach the reverse paths
+* to the Tier 1 nodes.
+*/
+void
+IotEnergyOptimalRouting::LocalDeliverTrace (const Ipv4Header &header, Ptr<const Packet> p, uint32_t interface)
+{
+  LearnReversePath (p, header.GetSource ());
+}
+
+Ptr<IotReversePathTable>
+IotEnergyOptimalRouting::GetReversePathTable (void) const
+{
+  return m_reversePaths;
+}
+
+/*
+* Sends a frame of the aggregator down the tiers. The frame costs one hop of energy whatever the number of packets it carries.
+*/
+void
+IotEnergyOptimalRouting::SendAggregate (Ipv4Address dest, Ptr<Packet> frame)
+{
+  if (m_interfaces.empty ())
+    {
+      NS_LOG_LOGIC ("No interface left, aggregate frame dropped");
+      return;
+    }
+  Ptr<Ipv4Route> route;
+  if (m_scheduler)
+    {
+      // Like an originated packet, the frame gets its next hop on the loopback
+      route = LoopbackRoute (localIpAddress, dest);
+    }
+  else
+    {
+      uint16_t tier = routeProcessor->GetTierFromIpAddress (localIpAddress);
+      route = CreateRoute (localIpAddress, dest, SelectNextHop (tier));
+    }
+  routeProcessor->ReduceNodeEnergyOnTransitHop (localIpAddress);
+  if (m_verbose)
+    {
+      NS_LOG_UNCOND ("[INFO]   Forwarding Aggregate from Node:" << localIpAddress << "  Destination:" << dest << "  Next Hop:" << route->GetGateway () << "  Size:" << frame->GetSize ());
+    }
+  routeProcessor->PrintAvailableEnergyOfAllNodes ();
+  if (m_dutyCycle)
+    {
+      m_dutyCycle->NotifyTransmit (localIpAddress);
+    }
+  m_ipv4->Send (frame, localIpAddress, dest, IotPacketAggregator::PROT_NUMBER, route);
+}
+
+Ptr<IotPacketAggregator>
+IotEnergyOptimalRouting::GetAggregator (void) const
+{
+  return m_aggregator;
+}
+
+/*
+* The interfaces are kept ordered by cost per bit: energy per bit + AirtimeCost / throughput.
+* Interfaces without a cost set come first (cost 0), in interface order, which is the single radio case.
+*/
+bool
+IotEnergyOptimalRouting::IsCheaper (const InterfaceState &a, const InterfaceState &b)
+{
+  return a.costPerBit < b.costPerBit;
+}
+
+void
+IotEnergyOptimalRouting::UpdateInterfaces (void)
+{
+  m_interfaces.clear ();
+  if (!m_ipv4)
+    {
+      return;
+    }
+  for (uint32_t i = 0; i < m_ipv4->GetNInterfaces (); i++)
+    {
+      if (!m_ipv4->IsUp (i) || m_ipv4->GetNAddresses (i) == 0)
+        {
+          continue;
+        }
+      Ipv4InterfaceAddress address = m_ipv4->GetAddress (i, 0);
+      if (address.GetLocal () == Ipv4Address::GetLoopback ())
+        {
+          continue;
+        }
+      InterfaceState state;
+      state.interface = i;
+      state.local = address.GetLocal ();
+      state.mask = address.GetMask ();
+      state.energyPerBit = 0.0;
+      state.costPerBit = 0.0;
+      std::map<uint32_t, RadioCost>::const_iterator it = m_radioCosts.find (i);
+      if (it != m_radioCosts.end ())
+        {
+          state.energyPerBit = it->second.energyPerBit;
+          state.costPerBit = it->second.energyPerBit + (it->second.throughput > 0 ? m_airtimeCost / it->second.throughput : 0.0);
+        }
+      m_interfaces.push_back (state);
+    }
+  std::stable_sort (m_interfaces.begin (), m_interfaces.end (), &IotEnergyOptimalRouting::IsCheaper);
+  m_neighbourInterfaces.clear ();
+  if (routeProcessor && localIpAddress != Ipv4Address ())
+    {
+      routeProcessor->SetNodeAvailable (localIpAddress, !m_interfaces.empty ());
+    }
+}
+
+/*
+* The outgoing interface is the cheapest interface on the network of the next hop or of another address of the next hop node,
+* which then becomes the gateway of the route. When none matches the cheapest interface is used with the next hop as is.
+* The cost of a pair is the energy per bit of the interface plus AirtimeCost / throughput, with the throughput of the link to
+* the neighbour when one is set (SetLinkThroughput). The result is kept per neighbour until the interfaces, their costs or the
+* addresses of the neighbour change, so a packet costs one lookup.
+*/
+const IotEnergyOptimalRouting::NeighbourInterface &
+IotEnergyOptimalRouting::SelectInterface (Ipv4Address nextHop)
+{
+  const std::vector<Ipv4Address> *aliases = routeProcessor->GetNodeAddresses (nextHop);
+  uint32_t count = aliases ? aliases->size () : 0;
+  std::map<Ipv4Address, NeighbourInterface>::iterator cached = m_neighbourInterfaces.find (nextHop);
+  if (cached != m_neighbourInterfaces.end () && cached->second.aliases == count)
+    {
+      return cached->second;
+    }
+  NeighbourInterface best;
+  best.aliases = count;
+  best.index = 0;
+  best.gateway = nextHop;
+  best.costPerBit = m_interfaces.front ().costPerBit;
+  bool found = false;
+  for (uint32_t i = 0; i < m_interfaces.size (); i++)
+    {
+      const InterfaceState &interface = m_interfaces[i];
+      Ipv4Address gateway;
+      if (interface.mask.IsMatch (interface.local, nextHop))
+        {
+          gateway = nextHop;
+        }
+      else
+        {
+          for (uint32_t j = 0; j < count; j++)
+            {
+              if (interface.mask.IsMatch (interface.local, (*aliases)[j]))
+                {
+                  gateway = (*aliases)[j];
+                  break;
+                }
+            }
+        }
+      if (gateway == Ipv4Address ())
+        {
+          continue;
+        }
+      double cost = interface.costPerBit;
+      std::map<std::pair<uint32_t, Ipv4Address>, double>::const_iterator link = m_linkThroughputs.find (std::make_pair (interface.interface, nextHop));
+      if (link != m_linkThroughputs.end () && link->second > 0)
+        {
+          cost = interface.energyPerBit + m_airtimeCost / link->second;
+        }
+      if (!found || cost < best.costPerBit)
+        {
+          found = true;
+          best.index = i;
+          best.gateway = gateway;
+          best.costPerBit = cost;
+        }
+    }
+  return m_neighbourInterfaces[nextHop] = best;
+}
+
+Ptr<Ipv4Route>
+IotEnergyOptimalRouting::CreateRoute (Ipv4Address source, Ipv4Address dest, Ipv4Address nextHop)
+{
+  const NeighbourInterface &neighbour = SelectInterface (nextHop);
+  Ptr<Ipv4Route> route = Create<Ipv4Route> ();
+  route->SetGateway (neighbour.gateway);
+  route->SetSource (source);
+  route->SetDestination (dest);
+  route->SetOutputDevice (m_ipv4->GetNetDevice (m_interfaces[neighbour.index].interface));
+  return route;
+}
+
+bool
+IotEnergyOptimalRouting::IsLocalAddress (Ipv4Address addr) const
+{
+  if (addr == localIpAddress)
+    {
+      return true;
+    }
+  for (std::vector<InterfaceState>::const_iterator it = m_interfaces.begin (); it != m_interfaces.end (); it++)
+    {
+      if (it->local == addr)
+        {
+          return true;
+        }
+    }
+  return false;
+}
+
+void
+IotEnergyOptimalRouting::SetInterfaceCost (uint32_t interface, double energyPerBit, double throughput)
+{
+  NS_LOG_FUNCTION (this << interface << energyPerBit << throughput);
+  RadioCost cost;
+  cost.energyPerBit = energyPerBit;
+  cost.throughput = throughput;
+  m_radioCosts[interface] = cost;
+  UpdateInterfaces ();
+}
+
+void
+IotEnergyOptimalRouting::SetLinkThroughput (uint32_t interface, Ipv4Address neighbour, double throughput)
+{
+  NS_LOG_FUNCTION (this << interface << neighbour << throughput);
+  m_linkThroughputs[std::make_pair (interface, neighbour)] = throughput;
+  m_neighbourInterfaces.clear ();
+}
+
+/*
+* Finds the next hop of a destination that is not the gateway sink. Returns false when the packet has to go down the tiers:
+* sink destinations, no matching route, or a route added with AddTierRouteTo.
+*/
+bool
+IotEnergyOptimalRouting::LookupForwardingTable (Ipv4Address dest, Ipv4Address &nextHop) const
+{
+	if(!m_forwardingTable || m_forwardingTable->GetNRoutes() == 0 || dest == dest_gateway_address) {
+		return false;
+	}
+	const IotLpmRoute *route = m_forwardingTable->Lookup(dest);
+	if(route == 0 || route->viaTiers || routeProcessor->IsGateway(dest)) {
+		return false;
+	}
+	nextHop = route->nextHop == Ipv4Address::GetAny() ? dest : route->nextHop;
+	return true;
+}
+
+/*
+* The counters of disposed instances are kept so the profile printed at Simulator::Destroy covers every node.
+* Nodes are disposed by the NodeList before the report event runs.
+*/
+struct IotRoutingProfileRegistry
+{
+  std::set<IotEnergyOptimalRouting *> live;
+  std::map<uint32_t, IotRoutingCounters> disposed;
+  bool reportScheduled;
+  IotRoutingProfileRegistry () : reportScheduled (false) {}
+};
+
+static IotRoutingProfileRegistry &
+GetProfileRegistry (void)
+{
+  static IotRoutingProfileRegistry registry;
+  return registry;
+}
+
+static GlobalValue g_iotRoutingProfileReport ("IotRoutingProfileReport",
+                                              "Print the IotEnergyOptimalRouting profile report at Simulator::Destroy",
+                                              BooleanValue (true),
+                                              MakeBooleanChecker ());
+
+const IotRoutingCounters &
+IotEnergyOptimalRouting::GetCounters (void) const
+{
+  return m_counters;
+}
+
+IotRoutingCounters
+IotEnergyOptimalRouting::GetGlobalCounters (void)
+{
+  IotRoutingProfileRegistry &registry = GetProfileRegistry ();
+  IotRoutingCounters total;
+  for (std::map<uint32_t, IotRoutingCounters>::const_iterator it = registry.disposed.begin (); it != registry.disposed.end (); it++)
+    {
+      total.Add (it->second);
+    }
+  for (std::set<IotEnergyOptimalRouting *>::const_iterator it = registry.live.begin (); it != registry.live.end (); it++)
+    {
+      total.Add ((*it)->m_counters);
+    }
+  return total;
+}
+
+/*
+* Compact profile: global totals followed by the five nodes with most RouteInput + RouteOutput calls.
+*/
+void
+IotEnergyOptimalRouting::PrintProfileReport (std::ostream &os)
+{
+  IotRoutingProfileRegistry &registry = GetProfileRegistry ();
+  std::map<uint32_t, IotRoutingCounters> perNode = registry.disposed;
+  for (std::set<IotEnergyOptimalRouting *>::const_iterator it = registry.live.begin (); it != registry.live.end (); it++)
+    {
+      perNode[(*it)->m_nodeId].Add ((*it)->m_counters);
+    }
+  IotRoutingCounters total = GetGlobalCounters ();
+
+  os << "[PROFILE] nodes=" << perNode.size ()
+     << " route_output=" << total.routeOutputCalls
+     << " route_input=" << total.routeInputCalls
+     << " forwarded=" << total.forwardedPackets
+     << " local_deliveries=" << total.localDeliveries
+     << " next_hop_changes=" << total.nextHopChanges;
+#ifdef IOT_ENERGY_OPTIMAL_ROUTING_PROFILE
+  uint64_t calls = total.routeOutputCalls + total.routeInputCalls;
+  os << " processor_" << IOT_ROUTING_PROFILE_TICK_UNIT << "=" << total.processorTicks
+     << " per_call=" << (calls ? total.processorTicks / calls : 0);
+#endif
+  os << std::endl;
+
+  std::vector<std::pair<uint64_t, uint32_t> > hot;
+  for (std::map<uint32_t, IotRoutingCounters>::const_iterator it = perNode.begin (); it != perNode.end (); it++)
+    {
+      hot.push_back (std::make_pair (it->second.routeInputCalls + it->second.routeOutputCalls, it->first));
+    }
+  std::sort (hot.rbegin (), hot.rend ());
+  for (uint32_t i = 0; i < hot.size () && i < 5; i++)
+    {
+      const IotRoutingCounters &c = perNode[hot[i].second];
+      os << "[PROFILE]   node=" << hot[i].second
+         << " route_output=" << c.routeOutputCalls
+         << " route_input=" << c.routeInputCalls
+         << " local_deliveries=" << c.localDeliveries
+         << " next_hop_changes=" << c.nextHopChanges;
+#ifdef IOT_ENERGY_OPTIMAL_ROUTING_PROFILE
+      os << " processor_" << IOT_ROUTING_PROFILE_TICK_UNIT << "=" << c.processorTicks;
+#endif
+      os << std::endl;
+    }
+}
+
+static void
+IotRoutingPrintProfileAtDestroy (void)
+{
+  BooleanValue enabled;
+  g_iotRoutingProfileReport.GetValue (enabled);
+  if (enabled.Get ())
+    {
+      IotEnergyOptimalRouting::PrintProfileReport (std::cout);
+    }
+  IotRoutingProfileRegistry &registry = GetProfileRegistry ();
+  registry.disposed.clear ();
+  registry.reportScheduled = false;
+}
+
 /*
 * All the Remaining functions are default virtual functions or constructors or destructors or any helper functions to set the variables.
 */
 IotEnergyOptimalRouting::IotEnergyOptimalRouting () {
   interfaceId = 32;
+  m_nodeId = 0;
+  m_airtimeCost = 0.0;
+  m_aggregationMaxBytes = 1400;
+  m_verbose = true;
+  m_nextHopSelected = false;
+  m_fastReroute = true;
+  m_downlink = false;
+  m_reversePathCapacity = 65536;
   dest_gateway_address = Ipv4Address("10.1.3.1");
   NS_LOG_FUNCTION_NOARGS ();
 }
 
 IotEnergyOptimalRouting::~IotEnergyOptimalRouting () {
   NS_LOG_FUNCTION_NOARGS ();
+  GetProfileRegistry ().live.erase (this);
+}
+
+void IotEnergyOptimalRouting::DoDispose () {
+  IotRoutingProfileRegistry &registry = GetProfileRegistry ();
+  if (registry.live.erase (this))
+    {
+      registry.disposed[m_nodeId].Add (m_counters);
+    }
+  m_ipv4 = 0;
+  routeProcessor = 0;
+  m_stats = 0;
+  m_forwardingTable = 0;
+  m_scheduler = 0;
+  m_dutyCycle = 0;
+  m_reversePaths = 0;
+  m_seenMulticast.clear ();
+  m_seenMulticastOrder.clear ();
+  m_nextHops.clear ();
+  m_neighbourInterfaces.clear ();
+  if (m_aggregator)
+    {
+      m_aggregator->Dispose ();
+      m_aggregator = 0;
+    }
+  Ipv4RoutingProtocol::DoDispose ();
 }
 
+/*
+* Interface and address changes update the list of usable interfaces. The node is taken out of (or put back into) the ranking
+* of its tier in the processor when it loses its last interface (or gets one back), so the next packet of any node already
+* picks another next hop.
+*/
 void IotEnergyOptimalRouting::NotifyInterfaceUp (uint32_t interface) {
   NS_LOG_FUNCTION (this << interface);
+  UpdateInterfaces ();
 }
 
 void IotEnergyOptimalRouting::NotifyInterfaceDown (uint32_t interface) {
   NS_LOG_FUNCTION (this << interface);
+  UpdateInterfaces ();
 }
 
+/*
+* The first address of the node is the one it is known by in the processor; the addresses of its other radios are
+* added to the processor as aliases. The loopback is ignored.
+*/
 void IotEnergyOptimalRouting::NotifyAddAddress (uint32_t interface, Ipv4InterfaceAddress address) {
-  interfaceId = interface;
-  localIpAddress = address.GetLocal ();
+  NS_LOG_FUNCTION (this << interface << address);
+  if (address.GetLocal () == Ipv4Address::GetLoopback ())
+    {
+      return;
+    }
+  if (localIpAddress == Ipv4Address ())
+    {
+      interfaceId = interface;
+      localIpAddress = address.GetLocal ();
+    }
+  else if (routeProcessor)
+    {
+      routeProcessor->AddNodeAddress (localIpAddress, address.GetLocal ());
+    }
+  UpdateInterfaces ();
 }
 
 void IotEnergyOptimalRouting::NotifyRemoveAddress (uint32_t interface, Ipv4InterfaceAddress address) {
   NS_LOG_FUNCTION(this << interface << address);
+  if (address.GetLocal () == localIpAddress)
+    {
+      if (routeProcessor)
+        {
+          routeProcessor->SetNodeAvailable (localIpAddress, false);
+        }
+      localIpAddress = Ipv4Address ();
+    }
+  UpdateInterfaces ();
 }
 
 void IotEnergyOptimalRouting::SetIpv4 (Ptr<Ipv4> ipv4) {
   NS_LOG_FUNCTION(this << ipv4);
   m_ipv4 = ipv4;
+  Ptr<Node> node = m_ipv4->GetObject<Node> ();
+  m_nodeId = node ? node->GetId () : 0;
+  IotRoutingProfileRegistry &registry = GetProfileRegistry ();
+  registry.live.insert (this);
+  if (m_aggregationMaxDelay.IsStrictlyPositive () && !m_aggregator)
+    {
+      m_aggregator = CreateObject<IotPacketAggregator> ();
+      m_aggregator->SetAttribute ("MaxDelay", TimeValue (m_aggregationMaxDelay));
+      m_aggregator->SetAttribute ("MaxBytes", UintegerValue (m_aggregationMaxBytes));
+      m_aggregator->SetFlushCallback (MakeCallback (&IotEnergyOptimalRouting::SendAggregate, this));
+    }
+  if (m_downlink && !m_reversePaths)
+    {
+      m_reversePaths = CreateObject<IotReversePathTable> ();
+      m_reversePaths->SetAttribute ("Lifetime", TimeValue (m_reversePathLifetime));
+      m_reversePaths->SetAttribute ("Capacity", UintegerValue (m_reversePathCapacity));
+      m_ipv4->TraceConnectWithoutContext ("LocalDeliver", MakeCallback (&IotEnergyOptimalRouting::LocalDeliverTrace, this));
+    }
+  if (!registry.reportScheduled)
+    {
+      registry.reportScheduled = true;
+      Simulator::ScheduleDestroy (&IotRoutingPrintProfileAtDestroy);
+    }
 }
 
 void IotEnergyOptimalRouting::PrintRoutingTable (Ptr<OutputStreamWrapper> stream, Time::Unit unit) const {
-  *stream->GetStream () << "Node: " << m_ipv4->GetObject<Node> ()->GetId ();
+  std::ostream *os = stream->GetStream ();
+  *os << "Node: " << m_ipv4->GetObject<Node> ()->GetId ()
+      << ", Time: " << Now ().As (unit)
+      << ", Local time: " << m_ipv4->GetObject<Node> ()->GetLocalTime ().As (unit)
+      << ", IotEnergyOptimalRouting table" << std::endl;
+  *os << "Sink " << dest_gateway_address << " via tier " << (routeProcessor ? routeProcessor->GetTierFromIpAddress (localIpAddress) : 0);
+  if (routeProcessor && routeProcessor->GetNumberOfGateways () > 0)
+    {
+      *os << " (" << routeProcessor->GetNumberOfGateways () << " gateways)";
+    }
+  *os << std::endl;
+  for (std::vector<InterfaceState>::const_iterator it = m_interfaces.begin (); it != m_interfaces.end (); it++)
+    {
+      *os << "Interface " << it->interface << " " << it->local << "/" << it->mask.GetPrefixLength ()
+          << " cost per bit " << it->costPerBit << std::endl;
+    }
+  for (std::map<uint16_t, NextHops>::const_iterator it = m_nextHops.begin (); it != m_nextHops.end (); it++)
+    {
+      *os << "Tier " << it->first << " next hop " << it->second.primary << " backup " << it->second.backup;
+      if (it->second.failed != Ipv4Address ())
+        {
+          *os << " (replacing failed " << it->second.failed << ")";
+        }
+      *os << std::endl;
+    }
+  if (m_forwardingTable)
+    {
+      m_forwardingTable->Print (*os);
+    }
+  if (m_reversePaths)
+    {
+      m_reversePaths->Print (*os);
+    }
+  *os << std::endl;
+}
+
+Ptr<IotLpmForwardingTable>
+IotEnergyOptimalRouting::GetForwardingTable (void) const
+{
+  return m_forwardingTable;
+}
+
+/*
+* The routes are added to the forwarding table of this node, which may be shared with other nodes.
+*/
+void
+IotEnergyOptimalRouting::AddNetworkRouteTo (Ipv4Address network, Ipv4Mask networkMask, Ipv4Address nextHop)
+{
+  NS_LOG_FUNCTION (this << network << networkMask << nextHop);
+  if (!m_forwardingTable)
+    {
+      m_forwardingTable = CreateObject<IotLpmForwardingTable> ();
+    }
+  m_forwardingTable->AddRoute (network, networkMask, nextHop);
+}
+
+void
+IotEnergyOptimalRouting::AddNetworkRouteTo (Ipv4Address network, Ipv4Mask networkMask)
+{
+  AddNetworkRouteTo (network, networkMask, Ipv4Address::GetAny ());
+}
+
+void
+IotEnergyOptimalRouting::AddHostRouteTo (Ipv4Address dest, Ipv4Address nextHop)
+{
+  AddNetworkRouteTo (dest, Ipv4Mask::GetOnes (), nextHop);
+}
+
+void
+IotEnergyOptimalRouting::AddTierRouteTo (Ipv4Address network, Ipv4Mask networkMask)
+{
+  NS_LOG_FUNCTION (this << network << networkMask);
+  if (!m_forwardingTable)
+    {
+      m_forwardingTable = CreateObject<IotLpmForwardingTable> ();
+    }
+  m_forwardingTable->AddTierRoute (network, networkMask);
 }
 
 void IotEnergyOptimalRouting::SetRouteProcessor (Ptr<IotEnergyOptimalRouteProcessor> p)
@@ -153,5 +1226,59 @@ void IotEnergyOptimalRouting::SetRouteProcessor (Ptr<IotEnergyOptimalRouteProces
   NS_LOG_FUNCTION(p);
   routeProcessor = p;
 }
+
+uint64_t IotEnergyOptimalRouting::GetRouteOutputCalls () const {
+  return m_counters.routeOutputCalls;
+}
+
+uint64_t IotEnergyOptimalRouting::GetRouteInputCalls () const {
+  return m_counters.routeInputCalls;
+}
+
+uint64_t IotEnergyOptimalRouting::GetLocalDeliveries () const {
+  return m_counters.localDeliveries;
+}
+
+uint64_t IotEnergyOptimalRouting::GetNextHopChanges () const {
+  return m_counters.nextHopChanges;
+}
+
+uint64_t IotEnergyOptimalRouting::GetProcessorTicks () const {
+  return m_counters.processorTicks;
+}
+
+uint64_t IotEnergyOptimalRouting::GetFastReroutes () const {
+  return m_counters.fastReroutes;
+}
+
+uint64_t IotEnergyOptimalRouting::GetGlobalRouteOutputCalls () const {
+  return GetGlobalCounters ().routeOutputCalls;
+}
+
+uint64_t IotEnergyOptimalRouting::GetGlobalRouteInputCalls () const {
+  return GetGlobalCounters ().routeInputCalls;
+}
+
+uint64_t IotEnergyOptimalRouting::GetGlobalLocalDeliveries () const {
+  return GetGlobalCounters ().localDeliveries;
+}
+
+uint64_t IotEnergyOptimalRouting::GetGlobalNextHopChanges () const {
+  return GetGlobalCounters ().nextHopChanges;
+}
+
+uint64_t IotEnergyOptimalRouting::GetGlobalProcessorTicks () const {
+  return GetGlobalCounters ().processorTicks;
+}
+
+uint64_t IotEnergyOptimalRouting::GetGlobalFastReroutes () const {
+  return GetGlobalCounters ().fastReroutes;
+}
+
+void IotEnergyOptimalRouting::SetStats (Ptr<IotEnergyOptimalRoutingStats> stats)
+{
+  NS_LOG_FUNCTION(stats);
+  m_stats = stats;
+}
 }
 
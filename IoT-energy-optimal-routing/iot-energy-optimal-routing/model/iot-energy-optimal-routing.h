@@ -2,19 +2,39 @@
 #ifndef IOT_ENERGY_OPTIMAL_ROUTING_H
 #define IOT_ENERGY_OPTIMAL_ROUTING_H
 
+#include <deque>
 #include <list>
+#include <map>
+#include <set>
+#include <vector>
 #include "ns3/ipv4-routing-protocol.h"
+#include "ns3/traced-callback.h"
 #include "iot-energy-optimal-route-processor.h"
+#include "iot-energy-optimal-routing-stats.h"
+#include "iot-energy-optimal-routing-profiler.h"
+#include "iot-lpm-forwarding-table.h"
+#include "iot-packet-aggregator.h"
+#include "iot-tdma-scheduler.h"
+#include "iot-duty-cycle-controller.h"
+#include "iot-reverse-path-table.h"
 
 namespace ns3 {
 /*
 *This is the main class which implements Ipv4RoutingProtocol and is used by nodes to route packets to next nodes
+* Packets to the gateway sink go down the tiers, to the node of the next tier chosen by the IotEnergyOptimalRouteProcessor; other
+* destinations are looked up in the forwarding table first. The gateway runs the protocol too, in an Ipv4ListRouting before its
+* static routing, for the Downlink packets to the IOT nodes.
 */
 class IotEnergyOptimalRouting : public Ipv4RoutingProtocol
 {
 public:
   static TypeId GetTypeId (void);
 
+  /* Signature of the RoutingAnomaly trace source. */
+  typedef void (* AnomalyTracedCallback)(Ipv4Address node, const std::string &reason);
+  /* Signature of the NextHopFailure trace source. */
+  typedef void (* NextHopFailureTracedCallback)(Ipv4Address failed, Ipv4Address backup);
+
   IotEnergyOptimalRouting();
   virtual ~IotEnergyOptimalRouting();
 
@@ -30,14 +50,137 @@ public:
   virtual void SetIpv4 (Ptr<Ipv4> ipv4);
   virtual void PrintRoutingTable (Ptr<OutputStreamWrapper> stream, Time::Unit unit) const;
   void SetRouteProcessor (Ptr<IotEnergyOptimalRouteProcessor> p);
+  void SetStats (Ptr<IotEnergyOptimalRoutingStats> stats);
+
+  void AddNetworkRouteTo (Ipv4Address network, Ipv4Mask networkMask, Ipv4Address nextHop);
+  /* Route to a destination that is in radio range of this node. */
+  void AddNetworkRouteTo (Ipv4Address network, Ipv4Mask networkMask);
+  void AddHostRouteTo (Ipv4Address dest, Ipv4Address nextHop);
+  /* Destinations behind the gateway (the backhaul): sent down the tiers like the sink traffic. */
+  void AddTierRouteTo (Ipv4Address network, Ipv4Mask networkMask);
+  Ptr<IotLpmForwardingTable> GetForwardingTable (void) const;
+
+  /* Energy per bit in joules and expected throughput in bit/s of the radio of an interface. */
+  void SetInterfaceCost (uint32_t interface, double energyPerBit, double throughput);
+  /* Expected throughput in bit/s of the radio of an interface to one neighbour, e.g. a lower rate to a far node. */
+  void SetLinkThroughput (uint32_t interface, Ipv4Address neighbour, double throughput);
+  /* Aggregator of the forwarded packets, 0 when aggregation is disabled. */
+  Ptr<IotPacketAggregator> GetAggregator (void) const;
+  /* Reverse paths learnt by this node, 0 when Downlink is disabled. */
+  Ptr<IotReversePathTable> GetReversePathTable (void) const;
+  /*
+  * A frame to a next hop of this node could not be delivered (crash or radio fault of the next hop, or a broken link), e.g.
+  * reported by IotLinkMonitor. The link is reported to the processor FailureReportDelay later.
+  */
+  void NotifyNextHopFailure (Ipv4Address nextHop);
+
+  const IotRoutingCounters & GetCounters (void) const;
+  /* Sum of the counters of every instance of the simulation, also readable as the Global* attributes of any instance. */
+  static IotRoutingCounters GetGlobalCounters (void);
+  static void PrintProfileReport (std::ostream &os);
 
 protected:
+  virtual void DoDispose (void);
+
 private:
+  /* Up interface with an address, precomputed on every interface or address change. */
+  struct InterfaceState
+  {
+    uint32_t interface;
+    Ipv4Address local;
+    Ipv4Mask mask;
+    double energyPerBit;
+    double costPerBit;
+  };
+  /* Cheapest interface to a neighbour and the address of the neighbour on its network, computed on the first packet to it. */
+  struct NeighbourInterface
+  {
+    uint32_t aliases;
+    uint32_t index;
+    Ipv4Address gateway;
+    double costPerBit;
+  };
+  struct RadioCost
+  {
+    double energyPerBit;
+    double throughput;
+  };
+  /* Last next hop chosen in a tier with its backup; failed is the next hop the backup replaces until the processor skips it. */
+  struct NextHops
+  {
+    Ipv4Address primary;
+    Ipv4Address backup;
+    Ipv4Address failed;
+  };
+
+  static bool IsCheaper (const InterfaceState &a, const InterfaceState &b);
+  void UpdateInterfaces (void);
+  const NeighbourInterface & SelectInterface (Ipv4Address nextHop);
+  Ptr<Ipv4Route> CreateRoute (Ipv4Address source, Ipv4Address dest, Ipv4Address nextHop);
+  bool IsLocalAddress (Ipv4Address addr) const;
+  void SendAggregate (Ipv4Address dest, Ptr<Packet> frame);
+  void Transmit (uint16_t tier, Ptr<Ipv4Route> route, Ptr<const Packet> p, const Ipv4Header &header, UnicastForwardCallback ucb);
+  Ptr<Ipv4Route> LoopbackRoute (Ipv4Address source, Ipv4Address dest) const;
+  Ipv4Address SelectNextHop (uint16_t tier);
+  Ipv4Address SelectRelay (uint16_t tier);
+  void ReportNextHopFailure (Ipv4Address nextHop);
+  Ptr<Ipv4Route> RouteOutputDownlink (const Ipv4Header &header, uint16_t tier, Socket::SocketErrno &sockerr);
+  bool ForwardDownlink (Ptr<const Packet> p, const Ipv4Header &header, UnicastForwardCallback ucb);
+  bool RouteInputMulticast (Ptr<const Packet> p, const Ipv4Header &header, Ptr<const NetDevice> idev,
+                            UnicastForwardCallback ucb, LocalDeliverCallback lcb);
+  Ipv4Address SelectDownlinkNextHop (Ipv4Address dest, uint16_t tier);
+  Ptr<Ipv4Route> CreateMulticastRoute (Ipv4Address source, Ipv4Address group, uint16_t tier);
+  bool IsDuplicate (Ipv4Address source, uint16_t identification);
+  void LearnReversePath (Ptr<const Packet> p, Ipv4Address source);
+  void LocalDeliverTrace (const Ipv4Header &header, Ptr<const Packet> p, uint32_t interface);
+  bool LookupForwardingTable (Ipv4Address dest, Ipv4Address &nextHop) const;
+  uint64_t GetRouteOutputCalls () const;
+  uint64_t GetRouteInputCalls () const;
+  uint64_t GetLocalDeliveries () const;
+  uint64_t GetNextHopChanges () const;
+  uint64_t GetProcessorTicks () const;
+  uint64_t GetFastReroutes () const;
+  uint64_t GetGlobalRouteOutputCalls () const;
+  uint64_t GetGlobalRouteInputCalls () const;
+  uint64_t GetGlobalLocalDeliveries () const;
+  uint64_t GetGlobalNextHopChanges () const;
+  uint64_t GetGlobalProcessorTicks () const;
+  uint64_t GetGlobalFastReroutes () const;
+
   Ptr<IotEnergyOptimalRouteProcessor> routeProcessor;
+  Ptr<IotEnergyOptimalRoutingStats> m_stats;
+  Ptr<IotLpmForwardingTable> m_forwardingTable;
   Ipv4Address localIpAddress;
   Ipv4Address dest_gateway_address;
   Ptr<Ipv4> m_ipv4;
   uint32_t interfaceId;
+  uint32_t m_nodeId;
+  bool m_verbose;
+  Ipv4Address m_lastNextHop;
+  bool m_nextHopSelected;
+  bool m_fastReroute;
+  Time m_failureReportDelay;
+  std::map<uint16_t, NextHops> m_nextHops;
+  std::vector<InterfaceState> m_interfaces;
+  std::map<uint32_t, RadioCost> m_radioCosts;
+  std::map<std::pair<uint32_t, Ipv4Address>, double> m_linkThroughputs;
+  std::map<Ipv4Address, NeighbourInterface> m_neighbourInterfaces;
+  double m_airtimeCost;
+  Time m_aggregationMaxDelay;
+  uint32_t m_aggregationMaxBytes;
+  Ptr<IotPacketAggregator> m_aggregator;
+  Ptr<IotTdmaScheduler> m_scheduler;
+  Ptr<IotDutyCycleController> m_dutyCycle;
+  bool m_downlink;
+  Time m_reversePathLifetime;
+  uint32_t m_reversePathCapacity;
+  Ptr<IotReversePathTable> m_reversePaths;
+  Time m_duplicateLifetime;
+  std::set<uint64_t> m_seenMulticast;
+  std::deque<std::pair<Time, uint64_t> > m_seenMulticastOrder;
+  IotRoutingCounters m_counters;
+  TracedCallback<Ipv4Address, const std::string &> m_anomalyTrace;
+  TracedCallback<Ipv4Address, Ipv4Address> m_nextHopFailureTrace;
 };
 
 } //namespace ns3
@@ -0,0 +1,232 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include "iot-link-monitor.h"
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+#include "ns3/pointer.h"
+#include "ns3/double.h"
+#include "ns3/boolean.h"
+#include "ns3/wifi-net-device.h"
+#include "ns3/txop.h"
+
+NS_LOG_COMPONENT_DEFINE ("IotLinkMonitor");
+
+namespace ns3 {
+
+NS_OBJECT_ENSURE_REGISTERED (IotLinkMonitor);
+
+TypeId
+IotLinkMonitor::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::IotLinkMonitor")
+    .SetParent<Object> ()
+    .AddConstructor<IotLinkMonitor> ()
+    .AddAttribute ("RoutingProcessor", "Route processor holding the queue counters of the nodes.",
+                   PointerValue (),
+                   MakePointerAccessor (&IotLinkMonitor::SetRouteProcessor),
+                   MakePointerChecker<IotEnergyOptimalRouteProcessor> ())
+    .AddAttribute ("EtxWeight", "Weight of the last transmission in the delivery probability of a link.",
+                   DoubleValue (0.1),
+                   MakeDoubleAccessor (&IotLinkMonitor::m_etxWeight),
+                   MakeDoubleChecker<double> (0.0, 1.0))
+    .AddAttribute ("ChargeRetransmissions", "Take the hop cost from the sender for every retransmission.",
+                   BooleanValue (true),
+                   MakeBooleanAccessor (&IotLinkMonitor::m_chargeRetransmissions),
+                   MakeBooleanChecker ())
+    ;
+  return tid;
+}
+
+IotLinkMonitor::IotLinkMonitor ()
+  : m_etxWeight (0.1),
+    m_chargeRetransmissions (true)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+IotLinkMonitor::~IotLinkMonitor ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+void
+IotLinkMonitor::DoDispose (void)
+{
+  for (std::map<Ipv4Address, Ptr<Device> >::iterator it = m_devices.begin (); it != m_devices.end (); it++)
+    {
+      it->second->Detach ();
+    }
+  m_devices.clear ();
+  m_nodeOfMac.clear ();
+  m_gatewayOfMac.clear ();
+  m_processor = 0;
+  Object::DoDispose ();
+}
+
+void
+IotLinkMonitor::SetRouteProcessor (Ptr<IotEnergyOptimalRouteProcessor> processor)
+{
+  m_processor = processor;
+}
+
+void
+IotLinkMonitor::Install (Ipv4Address addr, Ptr<NetDevice> device)
+{
+  NS_LOG_FUNCTION (this << addr << device);
+  NS_ASSERT_MSG (m_processor, "IotLinkMonitor needs a RoutingProcessor");
+  Ptr<WifiNetDevice> wifi = DynamicCast<WifiNetDevice> (device);
+  if (wifi && m_processor->IsGateway (addr))
+    {
+      m_gatewayOfMac[Mac48Address::ConvertFrom (device->GetAddress ())] = addr;
+      return;
+    }
+  if (!wifi)
+    {
+      return;
+    }
+  PointerValue txop;
+  wifi->GetMac ()->GetAttribute ("Txop", txop);
+  Ptr<WifiMacQueue> queue = txop.Get<Txop> ()->GetWifiMacQueue ();
+  if (!m_processor->SetNodeQueue (addr, queue->QueueBase::GetNPackets ()))
+    {
+      return;
+    }
+  Ptr<Device> state = Create<Device> (this, addr, device->GetNode ()->GetObject<IotEnergyOptimalRouting> (), queue);
+  queue->TraceConnectWithoutContext ("Enqueue", MakeCallback (&Device::QueueChanged, state));
+  queue->TraceConnectWithoutContext ("Dequeue", MakeCallback (&Device::QueueChanged, state));
+  queue->TraceConnectWithoutContext ("Drop", MakeCallback (&Device::QueueChanged, state));
+  wifi->GetMac ()->TraceConnectWithoutContext ("TxOkHeader", MakeCallback (&Device::TxOk, state));
+  wifi->GetMac ()->TraceConnectWithoutContext ("TxErrHeader", MakeCallback (&Device::TxErr, state));
+  wifi->GetPhy ()->TraceConnectWithoutContext ("PhyTxBegin", MakeCallback (&Device::PhyTxBegin, state));
+  m_devices[addr] = state;
+  m_nodeOfMac[Mac48Address::ConvertFrom (device->GetAddress ())] = addr;
+}
+
+uint32_t
+IotLinkMonitor::GetQueueLength (Ipv4Address addr) const
+{
+  std::map<Ipv4Address, Ptr<Device> >::const_iterator it = m_devices.find (addr);
+  return it == m_devices.end () ? 0 : it->second->GetQueueLength ();
+}
+
+IotLinkMonitor::Device::Device (IotLinkMonitor *monitor, Ipv4Address addr, Ptr<IotEnergyOptimalRouting> routing,
+                                Ptr<WifiMacQueue> queue)
+  : m_monitor (monitor),
+    m_addr (addr),
+    m_routing (routing),
+    m_queue (queue)
+{
+}
+
+/*
+* The count of the queue itself is read: WifiMacQueue::GetNPackets would also remove the expired packets, from within a trace
+* of the queue.
+*/
+void
+IotLinkMonitor::Device::QueueChanged (Ptr<const WifiMacQueueItem> item)
+{
+  if (!m_monitor)
+    {
+      return;
+    }
+  m_monitor->m_processor->SetNodeQueue (m_addr, m_queue->QueueBase::GetNPackets ());
+}
+
+/*
+* Control frames and acknowledgements are not attempts on a link; only retransmissions are counted here, the outcome of the
+* last attempt comes with TxOk or TxErr.
+*/
+void
+IotLinkMonitor::Device::PhyTxBegin (Ptr<const Packet> p)
+{
+  WifiMacHeader header;
+  if (!m_monitor || !p->PeekHeader (header) || !header.IsData ())
+    {
+      return;
+    }
+  if (header.IsRetry () && !header.GetAddr1 ().IsGroup ())
+    {
+      UpdateLink (header.GetAddr1 (), false);
+      if (m_monitor->m_chargeRetransmissions)
+        {
+          m_monitor->m_processor->ReduceNodeEnergyOnTransitHop (m_addr);
+        }
+    }
+}
+
+void
+IotLinkMonitor::Device::TxOk (const WifiMacHeader &header)
+{
+  if (header.IsData () && !header.GetAddr1 ().IsGroup ())
+    {
+      UpdateLink (header.GetAddr1 (), true);
+    }
+}
+
+/*
+* The MAC gave up on the frame after its last retry: besides the lost attempt, the routing of the sender learns that its link
+* to the receiver failed.
+*/
+void
+IotLinkMonitor::Device::TxErr (const WifiMacHeader &header)
+{
+  if (!header.IsData () || header.GetAddr1 ().IsGroup ())
+    {
+      return;
+    }
+  UpdateLink (header.GetAddr1 (), false);
+  if (!m_monitor || !m_routing)
+    {
+      return;
+    }
+  std::map<Mac48Address, Ipv4Address>::const_iterator node = m_monitor->m_nodeOfMac.find (header.GetAddr1 ());
+  if (node != m_monitor->m_nodeOfMac.end ())
+    {
+      m_routing->NotifyNextHopFailure (node->second);
+    }
+}
+
+/*
+* The estimate of a link lives in the processor, only for receivers installed on the monitor. The link to a gateway updates
+* the gateway link quality of the sender instead.
+*/
+void
+IotLinkMonitor::Device::UpdateLink (Mac48Address receiver, bool delivered)
+{
+  if (!m_monitor)
+    {
+      return;
+    }
+  double weight = m_monitor->m_etxWeight;
+  std::map<Mac48Address, Ipv4Address>::const_iterator gateway = m_monitor->m_gatewayOfMac.find (receiver);
+  if (gateway != m_monitor->m_gatewayOfMac.end ())
+    {
+      double quality = m_monitor->m_processor->GetGatewayLinkQuality (m_addr, gateway->second);
+      m_monitor->m_processor->SetGatewayLinkQuality (m_addr, gateway->second,
+                                                     (1.0 - weight) * quality + weight * (delivered ? 1.0 : 0.0));
+      return;
+    }
+  std::map<Mac48Address, Ipv4Address>::const_iterator node = m_monitor->m_nodeOfMac.find (receiver);
+  if (node != m_monitor->m_nodeOfMac.end ())
+    {
+      double delivery = m_monitor->m_processor->GetLinkDelivery (m_addr, node->second);
+      m_monitor->m_processor->SetLinkDelivery (m_addr, node->second,
+                                               (1.0 - weight) * delivery + weight * (delivered ? 1.0 : 0.0));
+    }
+}
+
+void
+IotLinkMonitor::Device::Detach (void)
+{
+  m_monitor = 0;
+  m_routing = 0;
+  m_queue = 0;
+}
+
+uint32_t
+IotLinkMonitor::Device::GetQueueLength (void) const
+{
+  return m_queue ? m_queue->QueueBase::GetNPackets () : 0;
+}
+
+}
@@ -0,0 +1,87 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef IOT_LINK_MONITOR_H
+#define IOT_LINK_MONITOR_H
+
+#include "ns3/object.h"
+#include "ns3/nstime.h"
+#include "ns3/packet.h"
+#include "ns3/net-device.h"
+#include "ns3/simple-ref-count.h"
+#include "ns3/mac48-address.h"
+#include "ns3/wifi-mac-header.h"
+#include "ns3/wifi-mac-queue.h"
+#include "iot-energy-optimal-route-processor.h"
+#include "iot-energy-optimal-routing.h"
+#include <map>
+
+namespace ns3 {
+
+/*
+* Follows the Wi-Fi devices of the nodes through their MAC and PHY traces and keeps their state in the IotEnergyOptimalRouteProcessor
+* up to date, so the next hop selection reads it without querying anything per packet.
+*
+* Queue (EnergyQueue SelectionMode): the counter of a node is the number of packets in the WifiMacQueue of the Txop of its MAC,
+* read on every Enqueue, Dequeue and Drop of that queue. Packets past the MaxDelay of the queue leave it (and the counter) when
+* the MAC next looks at the queue.
+*
+* Links (EnergyEtx SelectionMode): every transmission of a unicast data frame updates the delivery probability of the link to the
+* receiver, an exponentially weighted average (EtxWeight) of the attempts: a retransmission counts the previous attempt as lost,
+* TxOkHeader as delivered and TxErrHeader as lost, so each attempt is one O(1) update. Receivers are the nodes installed
+* on the monitor. With ChargeRetransmissions the sender pays the hop cost again for every retransmission.
+*
+* Gateways: the devices of the gateways of the processor are installed too (after AddGateway); they are not followed, but the links
+* of the Tier 1 nodes to them are measured the same way and give the link quality of SelectGateway (SetGatewayLinkQuality).
+*
+* Failures: a TxErrHeader to a node installed on the monitor is given to the IotEnergyOptimalRouting of the sender
+* (NotifyNextHopFailure), which switches to its backup next hop and reports the failed link, not the node: other senders may
+* still reach it.
+*/
+class IotLinkMonitor : public Object
+{
+public:
+  static TypeId GetTypeId (void);
+
+  IotLinkMonitor ();
+  virtual ~IotLinkMonitor ();
+
+  void SetRouteProcessor (Ptr<IotEnergyOptimalRouteProcessor> processor);
+  /* Follows a Wi-Fi device of a node known to the processor, or registers the device of a gateway; other devices are ignored. */
+  void Install (Ipv4Address addr, Ptr<NetDevice> device);
+  uint32_t GetQueueLength (Ipv4Address addr) const;
+
+protected:
+  virtual void DoDispose (void);
+
+private:
+  /* State of one device, connected to its traces. */
+  class Device : public SimpleRefCount<Device>
+  {
+  public:
+    Device (IotLinkMonitor *monitor, Ipv4Address addr, Ptr<IotEnergyOptimalRouting> routing, Ptr<WifiMacQueue> queue);
+    void QueueChanged (Ptr<const WifiMacQueueItem> item);
+    void PhyTxBegin (Ptr<const Packet> p);
+    void TxOk (const WifiMacHeader &header);
+    void TxErr (const WifiMacHeader &header);
+    void Detach (void);
+    uint32_t GetQueueLength (void) const;
+
+  private:
+    void UpdateLink (Mac48Address receiver, bool delivered);
+
+    IotLinkMonitor *m_monitor;
+    Ipv4Address m_addr;
+    Ptr<IotEnergyOptimalRouting> m_routing;
+    Ptr<WifiMacQueue> m_queue;
+  };
+
+  Ptr<IotEnergyOptimalRouteProcessor> m_processor;
+  double m_etxWeight;
+  bool m_chargeRetransmissions;
+  std::map<Ipv4Address, Ptr<Device> > m_devices;
+  std::map<Mac48Address, Ipv4Address> m_nodeOfMac;
+  std::map<Mac48Address, Ipv4Address> m_gatewayOfMac;
+};
+
+}
+
+#endif /* IOT_LINK_MONITOR_H */
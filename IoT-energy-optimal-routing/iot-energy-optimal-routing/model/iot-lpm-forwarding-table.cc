@@ -0,0 +1,237 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include "iot-lpm-forwarding-table.h"
+#include "ns3/log.h"
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+
+NS_LOG_COMPONENT_DEFINE ("IotLpmForwardingTable");
+
+namespace ns3 {
+
+NS_OBJECT_ENSURE_REGISTERED (IotLpmForwardingTable);
+
+static inline uint32_t
+PrefixMask (uint8_t length)
+{
+  return length == 0 ? 0 : 0xffffffffu << (32 - length);
+}
+
+/* Bit of addr at position (0 is the most significant bit). */
+static inline uint32_t
+BitAt (uint32_t addr, uint8_t position)
+{
+  return (addr >> (31 - position)) & 1;
+}
+
+TypeId
+IotLpmForwardingTable::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::IotLpmForwardingTable")
+    .SetParent<Object> ()
+    .AddConstructor<IotLpmForwardingTable> ()
+    ;
+  return tid;
+}
+
+/*
+* Node 0 is the root (0.0.0.0/0); it is never a child, so 0 also marks a missing child.
+*/
+IotLpmForwardingTable::IotLpmForwardingTable ()
+  : m_nRoutes (0)
+{
+  NS_LOG_FUNCTION (this);
+  NewNode (0, 0);
+}
+
+IotLpmForwardingTable::~IotLpmForwardingTable ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+uint32_t
+IotLpmForwardingTable::NewNode (uint32_t prefix, uint8_t length)
+{
+  TrieNode node;
+  node.prefix = prefix & PrefixMask (length);
+  node.length = length;
+  node.hasRoute = false;
+  node.route.viaTiers = false;
+  node.child[0] = 0;
+  node.child[1] = 0;
+  m_nodes.push_back (node);
+  return m_nodes.size () - 1;
+}
+
+void
+IotLpmForwardingTable::AddRoute (Ipv4Address network, Ipv4Mask mask, Ipv4Address nextHop)
+{
+  NS_LOG_FUNCTION (this << network << mask << nextHop);
+  IotLpmRoute route;
+  route.nextHop = nextHop;
+  route.viaTiers = false;
+  Insert (network.Get (), mask.GetPrefixLength (), route);
+}
+
+void
+IotLpmForwardingTable::AddTierRoute (Ipv4Address network, Ipv4Mask mask)
+{
+  NS_LOG_FUNCTION (this << network << mask);
+  IotLpmRoute route;
+  route.viaTiers = true;
+  Insert (network.Get (), mask.GetPrefixLength (), route);
+}
+
+/*
+* Walks down while the child prefix is contained in the new one. When the new prefix and the child diverge (or the new
+* prefix is shorter), a node for their common prefix is inserted above the child.
+*/
+void
+IotLpmForwardingTable::Insert (uint32_t prefix, uint8_t length, const IotLpmRoute &route)
+{
+  prefix &= PrefixMask (length);
+  uint32_t current = 0;
+  while (m_nodes[current].length < length)
+    {
+      uint32_t bit = BitAt (prefix, m_nodes[current].length);
+      uint32_t child = m_nodes[current].child[bit];
+      if (child == 0)
+        {
+          uint32_t leaf = NewNode (prefix, length);
+          m_nodes[current].child[bit] = leaf;
+          current = leaf;
+          break;
+        }
+      uint32_t childPrefix = m_nodes[child].prefix;
+      uint8_t childLength = m_nodes[child].length;
+      uint32_t diff = prefix ^ childPrefix;
+      uint8_t common = diff == 0 ? 32 : __builtin_clz (diff);
+      common = std::min (common, std::min (length, childLength));
+      if (common == childLength)
+        {
+          current = child;
+          continue;
+        }
+      uint32_t split = NewNode (prefix, common);
+      m_nodes[split].child[BitAt (childPrefix, common)] = child;
+      m_nodes[current].child[bit] = split;
+      current = split;
+      if (common < length)
+        {
+          uint32_t leaf = NewNode (prefix, length);
+          m_nodes[split].child[BitAt (prefix, common)] = leaf;
+          current = leaf;
+        }
+      break;
+    }
+  if (!m_nodes[current].hasRoute)
+    {
+      m_nRoutes++;
+    }
+  m_nodes[current].hasRoute = true;
+  m_nodes[current].route = route;
+}
+
+bool
+IotLpmForwardingTable::RemoveRoute (Ipv4Address network, Ipv4Mask mask)
+{
+  NS_LOG_FUNCTION (this << network << mask);
+  uint8_t length = mask.GetPrefixLength ();
+  uint32_t prefix = network.Get () & PrefixMask (length);
+  uint32_t current = 0;
+  while (m_nodes[current].length < length)
+    {
+      current = m_nodes[current].child[BitAt (prefix, m_nodes[current].length)];
+      if (current == 0)
+        {
+          return false;
+        }
+    }
+  TrieNode &node = m_nodes[current];
+  if (node.length != length || node.prefix != prefix || !node.hasRoute)
+    {
+      return false;
+    }
+  node.hasRoute = false;
+  m_nRoutes--;
+  return true;
+}
+
+const IotLpmRoute *
+IotLpmForwardingTable::Lookup (Ipv4Address dest) const
+{
+  uint32_t addr = dest.Get ();
+  const IotLpmRoute *best = 0;
+  uint32_t current = 0;
+  do
+    {
+      const TrieNode &node = m_nodes[current];
+      if (((addr ^ node.prefix) & PrefixMask (node.length)) != 0)
+        {
+          break;
+        }
+      if (node.hasRoute)
+        {
+          best = &node.route;
+        }
+      if (node.length == 32)
+        {
+          break;
+        }
+      current = node.child[BitAt (addr, node.length)];
+    }
+  while (current != 0);
+  return best;
+}
+
+uint32_t
+IotLpmForwardingTable::GetNRoutes (void) const
+{
+  return m_nRoutes;
+}
+
+/*
+* Routes are printed in prefix order (a depth first walk of the trie).
+*/
+void
+IotLpmForwardingTable::Print (std::ostream &os) const
+{
+  os << "Destination     Genmask         Next Hop" << std::endl;
+  PrintNode (os, 0);
+}
+
+void
+IotLpmForwardingTable::PrintNode (std::ostream &os, uint32_t index) const
+{
+  const TrieNode &node = m_nodes[index];
+  if (node.hasRoute)
+    {
+      std::ostringstream dest, mask;
+      dest << Ipv4Address (node.prefix);
+      mask << Ipv4Mask (PrefixMask (node.length));
+      os << std::setiosflags (std::ios::left) << std::setw (16) << dest.str () << std::setw (16) << mask.str ();
+      if (node.route.viaTiers)
+        {
+          os << "tiers";
+        }
+      else if (node.route.nextHop == Ipv4Address::GetAny ())
+        {
+          os << "on-link";
+        }
+      else
+        {
+          os << node.route.nextHop;
+        }
+      os << std::endl;
+    }
+  for (uint32_t bit = 0; bit < 2; bit++)
+    {
+      if (node.child[bit] != 0)
+        {
+          PrintNode (os, node.child[bit]);
+        }
+    }
+}
+
+}
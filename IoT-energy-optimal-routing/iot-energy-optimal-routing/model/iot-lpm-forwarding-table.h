@@ -0,0 +1,67 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef IOT_LPM_FORWARDING_TABLE_H
+#define IOT_LPM_FORWARDING_TABLE_H
+
+#include "ns3/object.h"
+#include "ns3/ipv4-address.h"
+#include <ostream>
+#include <vector>
+
+namespace ns3 {
+
+/*
+* Route of the forwarding table.
+* nextHop Ipv4Address::GetAny () means the destination is on link; viaTiers sends the packet up the tiers to the gateway,
+* which forwards it with its own routing (used for the backhaul behind the gateway).
+*/
+struct IotLpmRoute
+{
+  Ipv4Address nextHop;
+  bool viaTiers;
+};
+
+/*
+* Longest prefix match forwarding table of IotEnergyOptimalRouting, used for destinations that are not the gateway sink.
+* It is a path compressed binary trie: only nodes holding a route or branching are stored, so a lookup visits at most one
+* node per branching point of the prefixes it matches (a handful for the tables of an IOT site), whatever the prefix lengths.
+* Nodes live in one vector and refer to their children by index.
+* The table is an Object so that a single instance can be shared by all nodes through the ForwardingTable attribute.
+*/
+class IotLpmForwardingTable : public Object
+{
+public:
+  static TypeId GetTypeId (void);
+
+  IotLpmForwardingTable ();
+  virtual ~IotLpmForwardingTable ();
+
+  void AddRoute (Ipv4Address network, Ipv4Mask mask, Ipv4Address nextHop);
+  void AddTierRoute (Ipv4Address network, Ipv4Mask mask);
+  /* Removing a route keeps the trie nodes; they are reused if the prefix is added again. */
+  bool RemoveRoute (Ipv4Address network, Ipv4Mask mask);
+  /* Returns the route of the longest prefix containing dest, 0 when there is none. */
+  const IotLpmRoute * Lookup (Ipv4Address dest) const;
+  uint32_t GetNRoutes (void) const;
+  void Print (std::ostream &os) const;
+
+private:
+  struct TrieNode
+  {
+    uint32_t prefix;
+    uint8_t length;
+    bool hasRoute;
+    IotLpmRoute route;
+    uint32_t child[2];
+  };
+
+  void Insert (uint32_t prefix, uint8_t length, const IotLpmRoute &route);
+  uint32_t NewNode (uint32_t prefix, uint8_t length);
+  void PrintNode (std::ostream &os, uint32_t index) const;
+
+  std::vector<TrieNode> m_nodes;
+  uint32_t m_nRoutes;
+};
+
+}
+
+#endif /* IOT_LPM_FORWARDING_TABLE_H */
@@ -0,0 +1,408 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include "iot-packet-aggregator.h"
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+#include "ns3/uinteger.h"
+#include "ns3/ipv4-interface.h"
+#include "ns3/ipv6-interface.h"
+#include "ns3/ipv6-header.h"
+
+NS_LOG_COMPONENT_DEFINE ("IotPacketAggregator");
+
+namespace ns3 {
+
+NS_OBJECT_ENSURE_REGISTERED (IotAggregateEntryHeader);
+NS_OBJECT_ENSURE_REGISTERED (IotPacketAggregator);
+NS_OBJECT_ENSURE_REGISTERED (IotAggregateDemux);
+
+const uint8_t IotPacketAggregator::PROT_NUMBER;
+
+IotAggregateEntryHeader::IotAggregateEntryHeader ()
+  : m_length (0),
+    m_hasTag (false),
+    m_hops (0),
+    m_tier (0),
+    m_originTimeNs (0)
+{}
+
+TypeId
+IotAggregateEntryHeader::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::IotAggregateEntryHeader")
+    .SetParent<Header> ()
+    .AddConstructor<IotAggregateEntryHeader> ()
+    ;
+  return tid;
+}
+
+TypeId
+IotAggregateEntryHeader::GetInstanceTypeId (void) const
+{
+  return GetTypeId ();
+}
+
+uint32_t
+IotAggregateEntryHeader::GetSerializedSize (void) const
+{
+  return 14;
+}
+
+void
+IotAggregateEntryHeader::Serialize (Buffer::Iterator start) const
+{
+  start.WriteHtonU16 (m_length);
+  start.WriteU8 (m_hasTag ? 1 : 0);
+  start.WriteU8 (m_hops);
+  start.WriteHtonU16 (m_tier);
+  start.WriteHtonU64 (m_originTimeNs);
+}
+
+uint32_t
+IotAggregateEntryHeader::Deserialize (Buffer::Iterator start)
+{
+  m_length = start.ReadNtohU16 ();
+  m_hasTag = start.ReadU8 () != 0;
+  m_hops = start.ReadU8 ();
+  m_tier = start.ReadNtohU16 ();
+  m_originTimeNs = start.ReadNtohU64 ();
+  return GetSerializedSize ();
+}
+
+void
+IotAggregateEntryHeader::Print (std::ostream &os) const
+{
+  os << "length=" << m_length;
+  if (m_hasTag)
+    {
+      os << " tier=" << m_tier << " hops=" << (uint32_t) m_hops << " origin=" << m_originTimeNs << "ns";
+    }
+}
+
+void
+IotAggregateEntryHeader::SetLength (uint16_t length)
+{
+  m_length = length;
+}
+
+uint16_t
+IotAggregateEntryHeader::GetLength (void) const
+{
+  return m_length;
+}
+
+void
+IotAggregateEntryHeader::SetTag (const IotEnergyOptimalRoutingTag &tag)
+{
+  m_hasTag = true;
+  m_hops = tag.GetHopCount ();
+  m_tier = tag.GetTier ();
+  m_originTimeNs = tag.GetOriginTime ().GetNanoSeconds ();
+}
+
+bool
+IotAggregateEntryHeader::GetTag (IotEnergyOptimalRoutingTag &tag) const
+{
+  if (!m_hasTag)
+    {
+      return false;
+    }
+  tag = IotEnergyOptimalRoutingTag (NanoSeconds (m_originTimeNs), m_tier);
+  tag.SetHopCount (m_hops);
+  return true;
+}
+
+void
+IotAggregateEntryHeader::IncrementHopCount (void)
+{
+  if (m_hasTag && m_hops < 255)
+    {
+      m_hops++;
+    }
+}
+
+/*
+* MaxDelay: longest time a packet waits in the aggregator.
+* MaxBytes: a frame is sent as soon as it reaches this size; a packet that would make it larger goes into the next frame.
+*/
+TypeId
+IotPacketAggregator::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::IotPacketAggregator")
+    .SetParent<Object> ()
+    .AddConstructor<IotPacketAggregator> ()
+    .AddAttribute ("MaxDelay", "Longest time a forwarded packet is held before its frame is sent.",
+                   TimeValue (MilliSeconds (50)),
+                   MakeTimeAccessor (&IotPacketAggregator::m_maxDelay),
+                   MakeTimeChecker ())
+    .AddAttribute ("MaxBytes", "Size of the frame (without IP header) that triggers its transmission.",
+                   UintegerValue (1400),
+                   MakeUintegerAccessor (&IotPacketAggregator::m_maxBytes),
+                   MakeUintegerChecker<uint32_t> (1, 65000))
+    ;
+  return tid;
+}
+
+IotPacketAggregator::IotPacketAggregator ()
+  : m_aggregated (0),
+    m_frames (0)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+IotPacketAggregator::~IotPacketAggregator ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+void
+IotPacketAggregator::DoDispose (void)
+{
+  for (std::map<Ipv4Address, Pending>::iterator it = m_pending.begin (); it != m_pending.end (); it++)
+    {
+      it->second.timer.Cancel ();
+    }
+  m_pending.clear ();
+  m_flush = MakeNullCallback<void, Ipv4Address, Ptr<Packet> > ();
+  Object::DoDispose ();
+}
+
+void
+IotPacketAggregator::SetFlushCallback (FlushCallback cb)
+{
+  m_flush = cb;
+}
+
+void
+IotPacketAggregator::Add (Ptr<const Packet> p, const Ipv4Header &header)
+{
+  NS_LOG_FUNCTION (this << p << header);
+  Ipv4Header ipHeader = header;
+  if (ipHeader.GetTtl () <= 1)
+    {
+      NS_LOG_LOGIC ("TTL exceeded, packet dropped");
+      return;
+    }
+  ipHeader.SetTtl (ipHeader.GetTtl () - 1);
+  if (Node::ChecksumEnabled ())
+    {
+      ipHeader.EnableChecksum ();
+    }
+
+  Ptr<Packet> entry = p->Copy ();
+  IotAggregateEntryHeader entryHeader;
+  IotEnergyOptimalRoutingTag tag;
+  if (entry->RemovePacketTag (tag))
+    {
+      tag.IncrementHopCount ();
+      entryHeader.SetTag (tag);
+    }
+  entry->AddHeader (ipHeader);
+  entryHeader.SetLength (entry->GetSize ());
+  entry->AddHeader (entryHeader);
+  Append (header.GetDestination (), entry);
+}
+
+/*
+* Every carried packet is forwarded like one added alone: its TTL is decremented, and it is dropped when the TTL runs out.
+*/
+void
+IotPacketAggregator::AddAggregate (Ptr<const Packet> frame, const Ipv4Header &header)
+{
+  NS_LOG_FUNCTION (this << frame << header);
+  Ptr<Packet> rest = frame->Copy ();
+  IotAggregateEntryHeader entryHeader;
+  while (rest->GetSize () >= entryHeader.GetSerializedSize ())
+    {
+      rest->RemoveHeader (entryHeader);
+      Ptr<Packet> entry = rest->CreateFragment (0, entryHeader.GetLength ());
+      rest->RemoveAtStart (entryHeader.GetLength ());
+      Ipv4Header ipHeader;
+      entry->RemoveHeader (ipHeader);
+      if (ipHeader.GetTtl () <= 1)
+        {
+          NS_LOG_LOGIC ("TTL exceeded, carried packet dropped");
+          continue;
+        }
+      ipHeader.SetTtl (ipHeader.GetTtl () - 1);
+      if (Node::ChecksumEnabled ())
+        {
+          ipHeader.EnableChecksum ();
+        }
+      entry->AddHeader (ipHeader);
+      entryHeader.IncrementHopCount ();
+      entry->AddHeader (entryHeader);
+      Append (header.GetDestination (), entry);
+    }
+}
+
+void
+IotPacketAggregator::Append (Ipv4Address dest, Ptr<Packet> entry)
+{
+  Pending &pending = m_pending[dest];
+  if (pending.frame && pending.frame->GetSize () + entry->GetSize () > m_maxBytes)
+    {
+      Flush (dest);
+    }
+  if (!pending.frame)
+    {
+      pending.frame = Create<Packet> ();
+      pending.timer = Simulator::Schedule (m_maxDelay, &IotPacketAggregator::Flush, this, dest);
+    }
+  pending.frame->AddAtEnd (entry);
+  m_aggregated++;
+  if (pending.frame->GetSize () >= m_maxBytes)
+    {
+      Flush (dest);
+    }
+}
+
+void
+IotPacketAggregator::Flush (Ipv4Address dest)
+{
+  std::map<Ipv4Address, Pending>::iterator it = m_pending.find (dest);
+  if (it == m_pending.end () || !it->second.frame)
+    {
+      return;
+    }
+  it->second.timer.Cancel ();
+  Ptr<Packet> frame = it->second.frame;
+  it->second.frame = 0;
+  m_frames++;
+  NS_LOG_LOGIC ("Sending frame of " << frame->GetSize () << " bytes to " << dest);
+  if (!m_flush.IsNull ())
+    {
+      m_flush (dest, frame);
+    }
+}
+
+void
+IotPacketAggregator::FlushAll (void)
+{
+  for (std::map<Ipv4Address, Pending>::iterator it = m_pending.begin (); it != m_pending.end (); it++)
+    {
+      Flush (it->first);
+    }
+}
+
+uint64_t
+IotPacketAggregator::GetAggregatedPackets (void) const
+{
+  return m_aggregated;
+}
+
+uint64_t
+IotPacketAggregator::GetSentFrames (void) const
+{
+  return m_frames;
+}
+
+void
+IotPacketAggregator::Split (Ptr<const Packet> frame, std::vector<Ptr<Packet> > &packets)
+{
+  Ptr<Packet> rest = frame->Copy ();
+  IotAggregateEntryHeader entryHeader;
+  while (rest->GetSize () >= entryHeader.GetSerializedSize ())
+    {
+      rest->RemoveHeader (entryHeader);
+      Ptr<Packet> packet = rest->CreateFragment (0, entryHeader.GetLength ());
+      rest->RemoveAtStart (entryHeader.GetLength ());
+      IotEnergyOptimalRoutingTag tag;
+      if (entryHeader.GetTag (tag))
+        {
+          packet->AddPacketTag (tag);
+        }
+      packets.push_back (packet);
+    }
+}
+
+TypeId
+IotAggregateDemux::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::IotAggregateDemux")
+    .SetParent<IpL4Protocol> ()
+    .AddConstructor<IotAggregateDemux> ()
+    ;
+  return tid;
+}
+
+IotAggregateDemux::IotAggregateDemux ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+IotAggregateDemux::~IotAggregateDemux ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+void
+IotAggregateDemux::DoDispose (void)
+{
+  m_ipv4 = 0;
+  m_downTarget.Nullify ();
+  m_downTarget6.Nullify ();
+  IpL4Protocol::DoDispose ();
+}
+
+void
+IotAggregateDemux::Install (Ptr<Node> node)
+{
+  Ptr<Ipv4L3Protocol> ipv4 = node->GetObject<Ipv4L3Protocol> ();
+  NS_ASSERT_MSG (ipv4, "IotAggregateDemux needs a node with an internet stack");
+  Ptr<IotAggregateDemux> demux = CreateObject<IotAggregateDemux> ();
+  demux->m_ipv4 = ipv4;
+  ipv4->Insert (demux);
+}
+
+int
+IotAggregateDemux::GetProtocolNumber (void) const
+{
+  return IotPacketAggregator::PROT_NUMBER;
+}
+
+enum IpL4Protocol::RxStatus
+IotAggregateDemux::Receive (Ptr<Packet> p, Ipv4Header const &header, Ptr<Ipv4Interface> incomingInterface)
+{
+  NS_LOG_FUNCTION (this << p << header);
+  std::vector<Ptr<Packet> > packets;
+  IotPacketAggregator::Split (p, packets);
+  Ptr<NetDevice> device = incomingInterface->GetDevice ();
+  for (uint32_t i = 0; i < packets.size (); i++)
+    {
+      m_ipv4->Receive (device, packets[i], Ipv4L3Protocol::PROT_NUMBER, device->GetAddress (), device->GetAddress (), NetDevice::PACKET_HOST);
+    }
+  return IpL4Protocol::RX_OK;
+}
+
+enum IpL4Protocol::RxStatus
+IotAggregateDemux::Receive (Ptr<Packet> p, Ipv6Header const &header, Ptr<Ipv6Interface> incomingInterface)
+{
+  return IpL4Protocol::RX_ENDPOINT_UNREACH;
+}
+
+void
+IotAggregateDemux::SetDownTarget (IpL4Protocol::DownTargetCallback cb)
+{
+  m_downTarget = cb;
+}
+
+void
+IotAggregateDemux::SetDownTarget6 (IpL4Protocol::DownTargetCallback6 cb)
+{
+  m_downTarget6 = cb;
+}
+
+IpL4Protocol::DownTargetCallback
+IotAggregateDemux::GetDownTarget (void) const
+{
+  return m_downTarget;
+}
+
+IpL4Protocol::DownTargetCallback6
+IotAggregateDemux::GetDownTarget6 (void) const
+{
+  return m_downTarget6;
+}
+
+}
@@ -0,0 +1,139 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef IOT_PACKET_AGGREGATOR_H
+#define IOT_PACKET_AGGREGATOR_H
+
+#include "ns3/object.h"
+#include "ns3/header.h"
+#include "ns3/packet.h"
+#include "ns3/node.h"
+#include "ns3/ipv4-header.h"
+#include "ns3/ip-l4-protocol.h"
+#include "ns3/ipv4-l3-protocol.h"
+#include "ns3/event-id.h"
+#include "ns3/nstime.h"
+#include "ns3/callback.h"
+#include "iot-energy-optimal-routing-stats.h"
+#include <map>
+#include <vector>
+
+namespace ns3 {
+
+/*
+* Header in front of every packet carried in an aggregate frame: the length of the packet (IP header included) and the
+* fields of its IotEnergyOptimalRoutingTag, as packet tags do not survive the concatenation of packets.
+*/
+class IotAggregateEntryHeader : public Header
+{
+public:
+  IotAggregateEntryHeader ();
+
+  static TypeId GetTypeId (void);
+  virtual TypeId GetInstanceTypeId (void) const;
+  virtual uint32_t GetSerializedSize (void) const;
+  virtual void Serialize (Buffer::Iterator start) const;
+  virtual uint32_t Deserialize (Buffer::Iterator start);
+  virtual void Print (std::ostream &os) const;
+
+  void SetLength (uint16_t length);
+  uint16_t GetLength (void) const;
+  void SetTag (const IotEnergyOptimalRoutingTag &tag);
+  /* Returns false when the packet had no routing tag. */
+  bool GetTag (IotEnergyOptimalRoutingTag &tag) const;
+  void IncrementHopCount (void);
+
+private:
+  uint16_t m_length;
+  bool m_hasTag;
+  uint8_t m_hops;
+  uint16_t m_tier;
+  int64_t m_originTimeNs;
+};
+
+/*
+* Aggregation stage of the forwarding path of IotEnergyOptimalRouting.
+* Forwarded packets to the same destination are held until MaxDelay has passed since the first of them or MaxBytes is reached,
+* then sent as one frame with IP protocol PROT_NUMBER: a sequence of IotAggregateEntryHeader + IP header + payload.
+* Frames received from upstream nodes are unpacked into the pending frame, so a frame keeps growing down the tiers.
+* IotAggregateDemux splits the frames at the sink.
+*/
+class IotPacketAggregator : public Object
+{
+public:
+  static const uint8_t PROT_NUMBER = 253;
+
+  static TypeId GetTypeId (void);
+
+  /* Called with the destination and the frame when a frame has to be sent. */
+  typedef Callback<void, Ipv4Address, Ptr<Packet> > FlushCallback;
+
+  IotPacketAggregator ();
+  virtual ~IotPacketAggregator ();
+
+  void SetFlushCallback (FlushCallback cb);
+  /* Adds a packet being forwarded; packets whose TTL runs out are dropped. */
+  void Add (Ptr<const Packet> p, const Ipv4Header &header);
+  /* Adds the packets of a frame received from an upstream node; like Add, packets whose TTL runs out are dropped. */
+  void AddAggregate (Ptr<const Packet> frame, const Ipv4Header &header);
+  void FlushAll (void);
+
+  uint64_t GetAggregatedPackets (void) const;
+  uint64_t GetSentFrames (void) const;
+
+  /* Splits a frame back into the packets it carries, IP header included and routing tag restored. */
+  static void Split (Ptr<const Packet> frame, std::vector<Ptr<Packet> > &packets);
+
+protected:
+  virtual void DoDispose (void);
+
+private:
+  struct Pending
+  {
+    Ptr<Packet> frame;
+    EventId timer;
+  };
+
+  void Append (Ipv4Address dest, Ptr<Packet> entry);
+  void Flush (Ipv4Address dest);
+
+  Time m_maxDelay;
+  uint32_t m_maxBytes;
+  FlushCallback m_flush;
+  std::map<Ipv4Address, Pending> m_pending;
+  uint64_t m_aggregated;
+  uint64_t m_frames;
+};
+
+/*
+* Layer 4 protocol for IotPacketAggregator::PROT_NUMBER, installed on the sink. It splits the frames and hands every packet
+* back to Ipv4L3Protocol as received on the same interface, so sockets, traces and statistics see the original packets.
+*/
+class IotAggregateDemux : public IpL4Protocol
+{
+public:
+  static TypeId GetTypeId (void);
+
+  IotAggregateDemux ();
+  virtual ~IotAggregateDemux ();
+
+  static void Install (Ptr<Node> node);
+
+  virtual int GetProtocolNumber (void) const;
+  virtual enum IpL4Protocol::RxStatus Receive (Ptr<Packet> p, Ipv4Header const &header, Ptr<Ipv4Interface> incomingInterface);
+  virtual enum IpL4Protocol::RxStatus Receive (Ptr<Packet> p, Ipv6Header const &header, Ptr<Ipv6Interface> incomingInterface);
+  virtual void SetDownTarget (IpL4Protocol::DownTargetCallback cb);
+  virtual void SetDownTarget6 (IpL4Protocol::DownTargetCallback6 cb);
+  virtual IpL4Protocol::DownTargetCallback GetDownTarget (void) const;
+  virtual IpL4Protocol::DownTargetCallback6 GetDownTarget6 (void) const;
+
+protected:
+  virtual void DoDispose (void);
+
+private:
+  Ptr<Ipv4L3Protocol> m_ipv4;
+  IpL4Protocol::DownTargetCallback m_downTarget;
+  IpL4Protocol::DownTargetCallback6 m_downTarget6;
+};
+
+}
+
+#endif /* IOT_PACKET_AGGREGATOR_H */
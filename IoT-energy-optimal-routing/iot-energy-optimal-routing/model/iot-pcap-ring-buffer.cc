@@ -0,0 +1,218 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include "iot-pcap-ring-buffer.h"
+#include "iot-energy-optimal-routing.h"
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+#include "ns3/uinteger.h"
+#include "ns3/string.h"
+#include "ns3/pcap-file.h"
+#include "ns3/trace-helper.h"
+#include "ns3/ipv4-l3-protocol.h"
+#include <algorithm>
+#include <sstream>
+
+NS_LOG_COMPONENT_DEFINE ("IotPcapRingBuffer");
+
+namespace ns3 {
+
+NS_OBJECT_ENSURE_REGISTERED (IotPcapRingBuffer);
+
+/*
+* Capacity: packets kept per interface.
+* HoldOff: triggers arriving within this time after a flush are ignored (explicit Flush calls are not).
+*/
+TypeId
+IotPcapRingBuffer::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::IotPcapRingBuffer")
+    .SetParent<Object> ()
+    .AddConstructor<IotPcapRingBuffer> ()
+    .AddAttribute ("Capacity", "Number of packets kept per interface.",
+                   UintegerValue (64),
+                   MakeUintegerAccessor (&IotPcapRingBuffer::m_capacity),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("FilePrefix", "Prefix of the capture files written on a flush.",
+                   StringValue ("iot-energy-optimal-ring"),
+                   MakeStringAccessor (&IotPcapRingBuffer::m_filePrefix),
+                   MakeStringChecker ())
+    .AddAttribute ("HoldOff", "Minimum time between two triggered flushes.",
+                   TimeValue (Seconds (1.0)),
+                   MakeTimeAccessor (&IotPcapRingBuffer::m_holdOff),
+                   MakeTimeChecker ())
+    ;
+  return tid;
+}
+
+IotPcapRingBuffer::IotPcapRingBuffer ()
+  : m_lastFlush (Seconds (-1)),
+    m_flushCount (0)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+IotPcapRingBuffer::~IotPcapRingBuffer ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+void
+IotPcapRingBuffer::DoDispose (void)
+{
+  m_nodes.clear ();
+  Object::DoDispose ();
+}
+
+IotPcapRingBuffer::Ring::Ring (uint32_t capacity)
+  : m_entries (capacity),
+    m_next (0),
+    m_size (0)
+{}
+
+void
+IotPcapRingBuffer::Ring::Drain (std::vector<Entry> &out)
+{
+  uint32_t first = (m_next + m_entries.size () - m_size) % m_entries.size ();
+  for (uint32_t i = 0; i < m_size; i++)
+    {
+      Entry &e = m_entries[(first + i) % m_entries.size ()];
+      out.push_back (e);
+      e.packet = 0;
+    }
+  m_size = 0;
+  m_next = 0;
+}
+
+IotPcapRingBuffer::Ring &
+IotPcapRingBuffer::NodeRings::Get (uint32_t interface)
+{
+  while (interface >= m_rings.size ())
+    {
+      m_rings.push_back (Ring (m_capacity));
+    }
+  return m_rings[interface];
+}
+
+void
+IotPcapRingBuffer::NodeRings::Drain (std::vector<Entry> &out)
+{
+  for (std::vector<Ring>::iterator it = m_rings.begin (); it != m_rings.end (); it++)
+    {
+      it->Drain (out);
+    }
+}
+
+void
+IotPcapRingBuffer::Install (Ptr<Node> node)
+{
+  NS_LOG_FUNCTION (this << node->GetId ());
+  Ptr<Ipv4L3Protocol> ipv4 = node->GetObject<Ipv4L3Protocol> ();
+  NS_ASSERT_MSG (ipv4, "IotPcapRingBuffer needs a node with an internet stack");
+  Ptr<NodeRings> rings = Create<NodeRings> (m_capacity);
+  m_nodes.push_back (rings);
+  ipv4->TraceConnectWithoutContext ("Tx", MakeBoundCallback (&IotPcapRingBuffer::PacketTrace, rings));
+  ipv4->TraceConnectWithoutContext ("Rx", MakeBoundCallback (&IotPcapRingBuffer::PacketTrace, rings));
+}
+
+void
+IotPcapRingBuffer::Install (NodeContainer nodes)
+{
+  for (NodeContainer::Iterator it = nodes.Begin (); it != nodes.End (); it++)
+    {
+      Install (*it);
+    }
+}
+
+void
+IotPcapRingBuffer::PacketTrace (Ptr<NodeRings> rings, Ptr<const Packet> p, Ptr<Ipv4> ipv4, uint32_t interface)
+{
+  rings->Get (interface).Push (p);
+}
+
+void
+IotPcapRingBuffer::TriggerOnNodeEnergyDepleted (Ptr<IotEnergyOptimalRouteProcessor> processor)
+{
+  processor->TraceConnectWithoutContext ("NodeEnergyDepleted", MakeCallback (&IotPcapRingBuffer::NodeEnergyDepleted, this));
+}
+
+void
+IotPcapRingBuffer::TriggerOnRoutingAnomaly (NodeContainer nodes)
+{
+  for (NodeContainer::Iterator it = nodes.Begin (); it != nodes.End (); it++)
+    {
+      Ptr<IotEnergyOptimalRouting> routing = (*it)->GetObject<IotEnergyOptimalRouting> ();
+      if (routing)
+        {
+          routing->TraceConnectWithoutContext ("RoutingAnomaly", MakeCallback (&IotPcapRingBuffer::RoutingAnomaly, this));
+        }
+    }
+}
+
+void
+IotPcapRingBuffer::NodeEnergyDepleted (Ipv4Address addr)
+{
+  std::ostringstream oss;
+  oss << "node " << addr << " energy depleted";
+  Trigger (oss.str ());
+}
+
+void
+IotPcapRingBuffer::RoutingAnomaly (Ipv4Address node, const std::string &reason)
+{
+  std::ostringstream oss;
+  oss << "routing anomaly on " << node << ": " << reason;
+  Trigger (oss.str ());
+}
+
+void
+IotPcapRingBuffer::Trigger (const std::string &reason)
+{
+  if (m_flushCount > 0 && Simulator::Now () - m_lastFlush < m_holdOff)
+    {
+      NS_LOG_DEBUG ("Ignoring trigger within hold off: " << reason);
+      return;
+    }
+  Flush (reason);
+}
+
+uint32_t
+IotPcapRingBuffer::Flush (const std::string &reason)
+{
+  std::vector<Entry> entries;
+  for (std::vector<Ptr<NodeRings> >::iterator it = m_nodes.begin (); it != m_nodes.end (); it++)
+    {
+      (*it)->Drain (entries);
+    }
+  // Rings are drained oldest first; sorting on (time, drain order) merges them keeping that order for equal times.
+  std::vector<std::pair<int64_t, uint32_t> > order (entries.size ());
+  for (uint32_t i = 0; i < entries.size (); i++)
+    {
+      order[i] = std::make_pair (entries[i].timeNs, i);
+    }
+  std::sort (order.begin (), order.end ());
+
+  std::ostringstream name;
+  name << m_filePrefix << "-" << m_flushCount << ".pcap";
+  PcapFile file;
+  file.Open (name.str (), std::ios::out | std::ios::binary);
+  file.Init (PcapHelper::DLT_RAW);
+  for (uint32_t i = 0; i < order.size (); i++)
+    {
+      const Entry &e = entries[order[i].second];
+      file.Write (e.timeNs / 1000000000, (e.timeNs % 1000000000) / 1000, e.packet);
+    }
+  file.Close ();
+
+  m_flushCount++;
+  m_lastFlush = Simulator::Now ();
+  NS_LOG_UNCOND ("[INFO]   Pcap ring flushed to " << name.str () << " (" << order.size () << " packets): " << reason);
+  return order.size ();
+}
+
+uint32_t
+IotPcapRingBuffer::GetFlushCount (void) const
+{
+  return m_flushCount;
+}
+
+}
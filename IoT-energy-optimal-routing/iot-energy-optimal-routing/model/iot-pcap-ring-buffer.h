@@ -0,0 +1,104 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef IOT_PCAP_RING_BUFFER_H
+#define IOT_PCAP_RING_BUFFER_H
+
+#include "ns3/object.h"
+#include "ns3/nstime.h"
+#include "ns3/simulator.h"
+#include "ns3/packet.h"
+#include "ns3/ipv4.h"
+#include "ns3/node-container.h"
+#include "ns3/simple-ref-count.h"
+#include "iot-energy-optimal-route-processor.h"
+#include <vector>
+#include <string>
+
+namespace ns3 {
+
+/*
+* In memory capture that keeps the last Capacity IP packets sent or received on every interface of the installed nodes.
+* Nothing is written while the simulation runs; a trigger (routing anomaly, node energy depleted or an explicit Flush)
+* merges all the rings in time order into one pcap file (raw IPv4 link type) named <FilePrefix>-<n>.pcap and empties them.
+*/
+class IotPcapRingBuffer : public Object
+{
+public:
+  static TypeId GetTypeId (void);
+
+  IotPcapRingBuffer ();
+  virtual ~IotPcapRingBuffer ();
+
+  void Install (Ptr<Node> node);
+  void Install (NodeContainer nodes);
+
+  /* Flushes when a node of the processor runs out of energy. */
+  void TriggerOnNodeEnergyDepleted (Ptr<IotEnergyOptimalRouteProcessor> processor);
+  /* Flushes when IotEnergyOptimalRouting on one of the nodes reports a routing anomaly. */
+  void TriggerOnRoutingAnomaly (NodeContainer nodes);
+
+  /* Writes the rings to a new capture file. Returns the number of packets written. */
+  uint32_t Flush (const std::string &reason);
+  uint32_t GetFlushCount (void) const;
+
+protected:
+  virtual void DoDispose (void);
+
+private:
+  struct Entry
+  {
+    int64_t timeNs;
+    Ptr<const Packet> packet;
+  };
+  /*
+  * Fixed size ring of one interface; the slots are reused. The traces hand in the packet the stack goes on changing (the IP header
+  * is removed on receive, the link headers are added on send), so a copy is kept: it shares the bytes, not the headers.
+  */
+  class Ring
+  {
+  public:
+    Ring (uint32_t capacity);
+    inline void Push (Ptr<const Packet> p)
+    {
+      Entry &e = m_entries[m_next];
+      e.timeNs = Simulator::Now ().GetNanoSeconds ();
+      e.packet = p->Copy ();
+      m_next = m_next + 1 == m_entries.size () ? 0 : m_next + 1;
+      if (m_size < m_entries.size ())
+        {
+          m_size++;
+        }
+    }
+    void Drain (std::vector<Entry> &out);
+  private:
+    std::vector<Entry> m_entries;
+    uint32_t m_next;
+    uint32_t m_size;
+  };
+  /* Rings of one node, indexed by interface. Passed as the bound argument of the Ipv4L3Protocol Tx/Rx traces. */
+  class NodeRings : public SimpleRefCount<NodeRings>
+  {
+  public:
+    NodeRings (uint32_t capacity) : m_capacity (capacity) {}
+    Ring & Get (uint32_t interface);
+    void Drain (std::vector<Entry> &out);
+  private:
+    uint32_t m_capacity;
+    std::vector<Ring> m_rings;
+  };
+
+  static void PacketTrace (Ptr<NodeRings> rings, Ptr<const Packet> p, Ptr<Ipv4> ipv4, uint32_t interface);
+  void NodeEnergyDepleted (Ipv4Address addr);
+  void RoutingAnomaly (Ipv4Address node, const std::string &reason);
+  void Trigger (const std::string &reason);
+
+  uint32_t m_capacity;
+  std::string m_filePrefix;
+  Time m_holdOff;
+  Time m_lastFlush;
+  uint32_t m_flushCount;
+  std::vector<Ptr<NodeRings> > m_nodes;
+};
+
+}
+
+#endif /* IOT_PCAP_RING_BUFFER_H */
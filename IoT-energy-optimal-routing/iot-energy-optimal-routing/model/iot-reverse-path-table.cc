@@ -0,0 +1,168 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include "iot-reverse-path-table.h"
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+#include "ns3/uinteger.h"
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+
+NS_LOG_COMPONENT_DEFINE ("IotReversePathTable");
+
+namespace ns3 {
+
+NS_OBJECT_ENSURE_REGISTERED (IotReversePathTag);
+NS_OBJECT_ENSURE_REGISTERED (IotReversePathTable);
+
+IotReversePathTag::IotReversePathTag ()
+{}
+
+IotReversePathTag::IotReversePathTag (Ipv4Address hop)
+  : m_hop (hop)
+{}
+
+TypeId
+IotReversePathTag::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::IotReversePathTag")
+    .SetParent<Tag> ()
+    .AddConstructor<IotReversePathTag> ()
+    ;
+  return tid;
+}
+
+TypeId
+IotReversePathTag::GetInstanceTypeId (void) const
+{
+  return GetTypeId ();
+}
+
+uint32_t
+IotReversePathTag::GetSerializedSize (void) const
+{
+  return 4;
+}
+
+void
+IotReversePathTag::Serialize (TagBuffer i) const
+{
+  i.WriteU32 (m_hop.Get ());
+}
+
+void
+IotReversePathTag::Deserialize (TagBuffer i)
+{
+  m_hop.Set (i.ReadU32 ());
+}
+
+void
+IotReversePathTag::Print (std::ostream &os) const
+{
+  os << "hop=" << m_hop;
+}
+
+Ipv4Address
+IotReversePathTag::GetHop (void) const
+{
+  return m_hop;
+}
+
+TypeId
+IotReversePathTable::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::IotReversePathTable")
+    .SetParent<Object> ()
+    .AddConstructor<IotReversePathTable> ()
+    .AddAttribute ("Lifetime", "Time after which a reverse path not refreshed by uplink traffic is no longer used.",
+                   TimeValue (Seconds (300)),
+                   MakeTimeAccessor (&IotReversePathTable::m_lifetime),
+                   MakeTimeChecker ())
+    .AddAttribute ("Capacity", "Number of sources the table holds.",
+                   UintegerValue (65536),
+                   MakeUintegerAccessor (&IotReversePathTable::m_capacity),
+                   MakeUintegerChecker<uint32_t> (1))
+    ;
+  return tid;
+}
+
+IotReversePathTable::IotReversePathTable ()
+  : m_capacity (65536)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+IotReversePathTable::~IotReversePathTable ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+/*
+* A new source is inserted at its place in the vector; it replaces the oldest entry when the table is full (a linear scan,
+* only done for sources not seen before).
+*/
+void
+IotReversePathTable::Learn (Ipv4Address source, Ipv4Address previousHop)
+{
+  uint32_t dest = source.Get ();
+  std::vector<Entry>::iterator it = std::lower_bound (m_entries.begin (), m_entries.end (), dest, DestLess ());
+  if (it != m_entries.end () && it->dest == dest)
+    {
+      it->nextHop = previousHop.Get ();
+      it->lastSeen = Simulator::Now ();
+      return;
+    }
+  if (m_entries.size () >= m_capacity)
+    {
+      std::vector<Entry>::iterator oldest = m_entries.begin ();
+      for (std::vector<Entry>::iterator e = m_entries.begin (); e != m_entries.end (); e++)
+        {
+          if (e->lastSeen < oldest->lastSeen)
+            {
+              oldest = e;
+            }
+        }
+      NS_LOG_LOGIC ("Table full, reverse path to " << Ipv4Address (oldest->dest) << " dropped");
+      m_entries.erase (oldest);
+      it = std::lower_bound (m_entries.begin (), m_entries.end (), dest, DestLess ());
+    }
+  Entry entry;
+  entry.dest = dest;
+  entry.nextHop = previousHop.Get ();
+  entry.lastSeen = Simulator::Now ();
+  m_entries.insert (it, entry);
+}
+
+bool
+IotReversePathTable::Lookup (Ipv4Address dest, Ipv4Address &nextHop) const
+{
+  std::vector<Entry>::const_iterator it = std::lower_bound (m_entries.begin (), m_entries.end (), dest.Get (), DestLess ());
+  if (it == m_entries.end () || it->dest != dest.Get () || Simulator::Now () - it->lastSeen > m_lifetime)
+    {
+      return false;
+    }
+  nextHop = Ipv4Address (it->nextHop);
+  return true;
+}
+
+uint32_t
+IotReversePathTable::GetNEntries (void) const
+{
+  return m_entries.size ();
+}
+
+void
+IotReversePathTable::Print (std::ostream &os) const
+{
+  os << "Destination     Next Hop        Age" << std::endl;
+  for (std::vector<Entry>::const_iterator it = m_entries.begin (); it != m_entries.end (); it++)
+    {
+      std::ostringstream dest, nextHop;
+      dest << Ipv4Address (it->dest);
+      nextHop << Ipv4Address (it->nextHop);
+      os << std::setiosflags (std::ios::left) << std::setw (16) << dest.str () << std::setw (16) << nextHop.str ()
+         << (Simulator::Now () - it->lastSeen).GetSeconds () << "s" << std::endl;
+    }
+}
+
+}
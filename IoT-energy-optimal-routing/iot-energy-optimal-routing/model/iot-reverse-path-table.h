@@ -0,0 +1,79 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef IOT_REVERSE_PATH_TABLE_H
+#define IOT_REVERSE_PATH_TABLE_H
+
+#include "ns3/object.h"
+#include "ns3/tag.h"
+#include "ns3/nstime.h"
+#include "ns3/ipv4-address.h"
+#include <ostream>
+#include <vector>
+
+namespace ns3 {
+
+/*
+* Packet tag set by IotEnergyOptimalRouting on every hop of an uplink packet: the node that sent the hop.
+* The receiver learns from it the reverse path to the source of the packet.
+*/
+class IotReversePathTag : public Tag
+{
+public:
+  IotReversePathTag ();
+  IotReversePathTag (Ipv4Address hop);
+
+  static TypeId GetTypeId (void);
+  virtual TypeId GetInstanceTypeId (void) const;
+  virtual uint32_t GetSerializedSize (void) const;
+  virtual void Serialize (TagBuffer i) const;
+  virtual void Deserialize (TagBuffer i);
+  virtual void Print (std::ostream &os) const;
+
+  Ipv4Address GetHop (void) const;
+
+private:
+  Ipv4Address m_hop;
+};
+
+/*
+* Reverse paths of a node, learnt from the uplink traffic it forwards or receives: for every source, the neighbour its last packet
+* came from. Downlink packets to the source are sent back the same way.
+* Entries are 16 bytes in one vector sorted by source, so a lookup is a binary search and refreshing a known source does not move
+* anything. Entries older than Lifetime are not returned; when Capacity entries are in use the oldest one is replaced.
+*/
+class IotReversePathTable : public Object
+{
+public:
+  static TypeId GetTypeId (void);
+
+  IotReversePathTable ();
+  virtual ~IotReversePathTable ();
+
+  void Learn (Ipv4Address source, Ipv4Address previousHop);
+  /* Neighbour towards dest, false when dest is unknown or its entry expired. */
+  bool Lookup (Ipv4Address dest, Ipv4Address &nextHop) const;
+  uint32_t GetNEntries (void) const;
+  void Print (std::ostream &os) const;
+
+private:
+  struct Entry
+  {
+    uint32_t dest;
+    uint32_t nextHop;
+    Time lastSeen;
+  };
+  struct DestLess
+  {
+    bool operator() (const Entry &entry, uint32_t dest) const
+    {
+      return entry.dest < dest;
+    }
+  };
+
+  Time m_lifetime;
+  uint32_t m_capacity;
+  std::vector<Entry> m_entries;
+};
+
+}
+
+#endif /* IOT_REVERSE_PATH_TABLE_H */
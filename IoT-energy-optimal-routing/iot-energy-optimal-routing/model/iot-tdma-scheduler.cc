@@ -0,0 +1,188 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include "iot-tdma-scheduler.h"
+#include "ns3/log.h"
+#include "ns3/simulator.h"
+
+NS_LOG_COMPONENT_DEFINE ("IotTdmaScheduler");
+
+namespace ns3 {
+
+NS_OBJECT_ENSURE_REGISTERED (IotTdmaScheduler);
+
+/*
+* PacketSlot must cover the air time of the largest frame plus its acknowledgement.
+*/
+TypeId
+IotTdmaScheduler::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::IotTdmaScheduler")
+    .SetParent<Object> ()
+    .AddConstructor<IotTdmaScheduler> ()
+    .AddAttribute ("PacketSlot", "Time given to a node for each of its queued packets.",
+                   TimeValue (MilliSeconds (2)),
+                   MakeTimeAccessor (&IotTdmaScheduler::m_packetSlot),
+                   MakeTimeChecker ())
+    .AddAttribute ("GuardTime", "Idle time at the end of every tier window.",
+                   TimeValue (MicroSeconds (500)),
+                   MakeTimeAccessor (&IotTdmaScheduler::m_guard),
+                   MakeTimeChecker ())
+    .AddAttribute ("FramePeriod", "Time between the starts of two frames (longer frames are not cut).",
+                   TimeValue (Seconds (1)),
+                   MakeTimeAccessor (&IotTdmaScheduler::m_framePeriod),
+                   MakeTimeChecker ())
+    ;
+  return tid;
+}
+
+IotTdmaScheduler::IotTdmaScheduler ()
+  : m_maxTier (0),
+    m_running (false),
+    m_frames (0),
+    m_sent (0)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+IotTdmaScheduler::~IotTdmaScheduler ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+void
+IotTdmaScheduler::DoDispose (void)
+{
+  m_event.Cancel ();
+  m_queues.clear ();
+  m_backlogged.clear ();
+  Object::DoDispose ();
+}
+
+/*
+* The first packet after an idle period starts a frame on the next multiple of FramePeriod.
+*/
+void
+IotTdmaScheduler::Enqueue (uint32_t nodeId, uint16_t tier, Ptr<Ipv4Route> route, Ptr<const Packet> p, const Ipv4Header &header,
+                           Ipv4RoutingProtocol::UnicastForwardCallback ucb)
+{
+  NS_LOG_FUNCTION (this << nodeId << tier << p);
+  Pending pending;
+  pending.route = route;
+  pending.packet = p;
+  pending.header = header;
+  pending.ucb = ucb;
+  NodeQueue &queue = m_queues[nodeId];
+  queue.tier = tier;
+  queue.packets.push_back (pending);
+  m_backlogged[tier].insert (nodeId);
+  if (tier > m_maxTier)
+    {
+      m_maxTier = tier;
+    }
+  if (!m_running)
+    {
+      m_running = true;
+      int64_t period = m_framePeriod.GetTimeStep ();
+      int64_t now = Simulator::Now ().GetTimeStep ();
+      Time next = period > 0 ? TimeStep (((now + period - 1) / period) * period) : Simulator::Now ();
+      m_event = Simulator::Schedule (next - Simulator::Now (), &IotTdmaScheduler::StartFrame, this);
+    }
+}
+
+void
+IotTdmaScheduler::StartFrame (void)
+{
+  m_frameStart = Simulator::Now ();
+  m_frames++;
+  StartWindow (m_maxTier);
+}
+
+/*
+* Slots are given in node id order to the nodes of the tier that have packets queued when the window starts;
+* packets queued later wait for the next frame.
+*/
+void
+IotTdmaScheduler::StartWindow (uint16_t tier)
+{
+  Time offset = Seconds (0);
+  std::set<uint32_t> nodes;
+  nodes.swap (m_backlogged[tier]);
+  for (std::set<uint32_t>::const_iterator it = nodes.begin (); it != nodes.end (); it++)
+    {
+      uint32_t n = m_queues[*it].packets.size ();
+      for (uint32_t k = 0; k < n; k++)
+        {
+          Simulator::Schedule (offset, &IotTdmaScheduler::Transmit, this, *it);
+          offset += m_packetSlot;
+        }
+    }
+  if (!nodes.empty ())
+    {
+      offset += m_guard;
+    }
+  NS_LOG_LOGIC ("Tier " << tier << " window: " << nodes.size () << " nodes, " << offset.GetMicroSeconds () << "us");
+
+  if (tier > 1)
+    {
+      m_event = Simulator::Schedule (offset, &IotTdmaScheduler::StartWindow, this, tier - 1);
+      return;
+    }
+  Time end = Simulator::Now () + offset;
+  Time next = m_frameStart + m_framePeriod > end ? m_frameStart + m_framePeriod : end;
+  m_running = HasBacklog ();
+  if (m_running)
+    {
+      m_event = Simulator::Schedule (next - Simulator::Now (), &IotTdmaScheduler::StartFrame, this);
+    }
+}
+
+void
+IotTdmaScheduler::Transmit (uint32_t nodeId)
+{
+  NodeQueue &queue = m_queues[nodeId];
+  if (queue.packets.empty ())
+    {
+      return;
+    }
+  Pending pending = queue.packets.front ();
+  queue.packets.pop_front ();
+  m_sent++;
+  pending.ucb (pending.route, pending.packet, pending.header);
+}
+
+/*
+* Checked at the start of the Tier 1 window: its transmissions go to the sink, which is not scheduled, so they add no backlog.
+*/
+bool
+IotTdmaScheduler::HasBacklog (void) const
+{
+  for (std::map<uint16_t, std::set<uint32_t> >::const_iterator it = m_backlogged.begin (); it != m_backlogged.end (); it++)
+    {
+      if (!it->second.empty ())
+        {
+          return true;
+        }
+    }
+  return false;
+}
+
+uint64_t
+IotTdmaScheduler::GetFrames (void) const
+{
+  return m_frames;
+}
+
+uint64_t
+IotTdmaScheduler::GetSentPackets (void) const
+{
+  return m_sent;
+}
+
+uint32_t
+IotTdmaScheduler::GetQueuedPackets (uint32_t nodeId) const
+{
+  std::map<uint32_t, NodeQueue>::const_iterator it = m_queues.find (nodeId);
+  return it == m_queues.end () ? 0 : it->second.packets.size ();
+}
+
+}
@@ -0,0 +1,81 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+#ifndef IOT_TDMA_SCHEDULER_H
+#define IOT_TDMA_SCHEDULER_H
+
+#include "ns3/object.h"
+#include "ns3/nstime.h"
+#include "ns3/packet.h"
+#include "ns3/ipv4-header.h"
+#include "ns3/ipv4-route.h"
+#include "ns3/ipv4-routing-protocol.h"
+#include <deque>
+#include <map>
+#include <set>
+
+namespace ns3 {
+
+/*
+* Convergecast TDMA schedule built on the tiers of the IotEnergyOptimalRouteProcessor, shared by all the nodes of a site.
+* A frame is a sequence of tier windows from the highest tier down to Tier 1, so the packets sent in the Tier 3 window are
+* forwarded by Tier 2 and then Tier 1 in the same frame (the pipeline reaches the sink within one frame).
+* At the start of a window every node of the tier with queued packets gets a slot of PacketSlot per packet, one after the other,
+* as a coordinator announcing the schedule in a beacon would; only one node transmits at a time, so there are no collisions,
+* and nodes with nothing to send take no time. Frames start every FramePeriod (or right after the previous one when it is longer)
+* and stop while no node has anything queued.
+* IotEnergyOptimalRouting hands its packets to Enqueue instead of sending them (Scheduler attribute).
+*/
+class IotTdmaScheduler : public Object
+{
+public:
+  static TypeId GetTypeId (void);
+
+  IotTdmaScheduler ();
+  virtual ~IotTdmaScheduler ();
+
+  /* Queues a packet of a node; it is passed to ucb in the slot of the node in the window of its tier. */
+  void Enqueue (uint32_t nodeId, uint16_t tier, Ptr<Ipv4Route> route, Ptr<const Packet> p, const Ipv4Header &header,
+                Ipv4RoutingProtocol::UnicastForwardCallback ucb);
+
+  uint64_t GetFrames (void) const;
+  uint64_t GetSentPackets (void) const;
+  uint32_t GetQueuedPackets (uint32_t nodeId) const;
+
+protected:
+  virtual void DoDispose (void);
+
+private:
+  struct Pending
+  {
+    Ptr<Ipv4Route> route;
+    Ptr<const Packet> packet;
+    Ipv4Header header;
+    Ipv4RoutingProtocol::UnicastForwardCallback ucb;
+  };
+  struct NodeQueue
+  {
+    uint16_t tier;
+    std::deque<Pending> packets;
+  };
+
+  void StartFrame (void);
+  void StartWindow (uint16_t tier);
+  void Transmit (uint32_t nodeId);
+  bool HasBacklog (void) const;
+
+  Time m_packetSlot;
+  Time m_guard;
+  Time m_framePeriod;
+
+  std::map<uint32_t, NodeQueue> m_queues;
+  std::map<uint16_t, std::set<uint32_t> > m_backlogged;
+  uint16_t m_maxTier;
+  bool m_running;
+  Time m_frameStart;
+  EventId m_event;
+  uint64_t m_frames;
+  uint64_t m_sent;
+};
+
+}
+
+#endif /* IOT_TDMA_SCHEDULER_H */
@@ -2,9 +2,42 @@
 
 // Include a header file from your module to test.
 #include "ns3/iot-energy-optimal-routing.h"
+#include "ns3/iot-lpm-forwarding-table.h"
+#include "ns3/iot-reverse-path-table.h"
+#include "ns3/iot-tdma-scheduler.h"
+#include "ns3/iot-duty-cycle-controller.h"
+#include "ns3/iot-link-monitor.h"
+#include "ns3/iot-adaptive-source.h"
+#include "ns3/iot-pcap-ring-buffer.h"
+#include "ns3/iot-abstract-link-helper.h"
+#include "ns3/iot-energy-optimal-routing-helper.h"
+#include "ns3/internet-stack-helper.h"
+#include "ns3/ipv4-address-helper.h"
+#include "ns3/ipv4-address-generator.h"
+#include "ns3/simple-net-device-helper.h"
+#include "ns3/yans-wifi-helper.h"
+#include "ns3/wifi-mac-helper.h"
+#include "ns3/mobility-helper.h"
+#include "ns3/udp-socket-factory.h"
+#include "ns3/inet-socket-address.h"
+#include "ns3/udp-l4-protocol.h"
+#include "ns3/pcap-file.h"
+#include "ns3/trace-helper.h"
+#include "ns3/arp-header.h"
+#include "ns3/arp-l3-protocol.h"
+#include "ns3/data-rate.h"
+#include "ns3/boolean.h"
+#include "ns3/uinteger.h"
+#include "ns3/double.h"
+#include "ns3/string.h"
+#include "ns3/pointer.h"
+#include "ns3/config.h"
+#include "ns3/simulator.h"
 
 // An essential include is test.h
 #include "ns3/test.h"
+#include <fstream>
+#include <sstream>
 
 // Do not put your test classes in namespace ns3.  You may find it useful
 // to use the using directive to access the ns3 namespace directly
@@ -46,6 +79,1872 @@ IotEnergyOptimalRoutingTestCase1::DoRun (void)
   NS_TEST_ASSERT_MSG_EQ_TOL (0.01, 0.01, 0.001, "Numbers are not equal within tolerance");
 }
 
+// Longest prefix match of the forwarding table, including routes that split compressed trie nodes
+class IotLpmForwardingTableTestCase : public TestCase
+{
+public:
+  IotLpmForwardingTableTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+IotLpmForwardingTableTestCase::IotLpmForwardingTableTestCase ()
+  : TestCase ("IotLpmForwardingTable longest prefix match")
+{
+}
+
+void
+IotLpmForwardingTableTestCase::DoRun (void)
+{
+  Ptr<IotLpmForwardingTable> table = CreateObject<IotLpmForwardingTable> ();
+  NS_TEST_ASSERT_MSG_EQ ((table->Lookup (Ipv4Address ("10.1.1.5")) == 0), true, "Empty table has no route");
+
+  table->AddRoute (Ipv4Address ("10.1.3.0"), Ipv4Mask ("255.255.255.0"), Ipv4Address::GetAny ());
+  table->AddRoute (Ipv4Address ("10.1.3.7"), Ipv4Mask ("255.255.255.255"), Ipv4Address ("10.1.3.2"));
+  table->AddTierRoute (Ipv4Address ("10.1.1.0"), Ipv4Mask ("255.255.255.0"));
+  table->AddRoute (Ipv4Address ("10.0.0.0"), Ipv4Mask ("255.0.0.0"), Ipv4Address ("10.1.3.1"));
+  NS_TEST_ASSERT_MSG_EQ (table->GetNRoutes (), 4u, "Four routes added");
+
+  const IotLpmRoute *route = table->Lookup (Ipv4Address ("10.1.3.7"));
+  NS_TEST_ASSERT_MSG_NE ((route == 0), true, "Host route found");
+  NS_TEST_ASSERT_MSG_EQ (route->nextHop, Ipv4Address ("10.1.3.2"), "Host route wins over its network");
+  route = table->Lookup (Ipv4Address ("10.1.3.8"));
+  NS_TEST_ASSERT_MSG_EQ (route->nextHop, Ipv4Address::GetAny (), "Network route for the other hosts");
+  route = table->Lookup (Ipv4Address ("10.1.1.9"));
+  NS_TEST_ASSERT_MSG_EQ (route->viaTiers, true, "Backhaul goes down the tiers");
+  route = table->Lookup (Ipv4Address ("10.200.0.1"));
+  NS_TEST_ASSERT_MSG_EQ (route->nextHop, Ipv4Address ("10.1.3.1"), "Shortest prefix as fallback");
+  NS_TEST_ASSERT_MSG_EQ ((table->Lookup (Ipv4Address ("192.168.0.1")) == 0), true, "No default route");
+
+  NS_TEST_ASSERT_MSG_EQ (table->RemoveRoute (Ipv4Address ("10.1.3.7"), Ipv4Mask ("255.255.255.255")), true, "Host route removed");
+  route = table->Lookup (Ipv4Address ("10.1.3.7"));
+  NS_TEST_ASSERT_MSG_EQ (route->nextHop, Ipv4Address::GetAny (), "Network route after removing the host route");
+  NS_TEST_ASSERT_MSG_EQ (table->RemoveRoute (Ipv4Address ("10.1.2.0"), Ipv4Mask ("255.255.255.0")), false, "Unknown route");
+}
+
+// Bucket boundaries of the delay histogram: exact below 8, 8 sub buckets per power of two above, one overflow bucket
+class IotLogHistogramTestCase : public TestCase
+{
+public:
+  IotLogHistogramTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+IotLogHistogramTestCase::IotLogHistogramTestCase ()
+  : TestCase ("IotLogHistogram bucket boundaries and overflow")
+{
+}
+
+void
+IotLogHistogramTestCase::DoRun (void)
+{
+  NS_TEST_ASSERT_MSG_EQ (IotLogHistogram::Index (7), 7u, "One bucket per value below 8");
+  NS_TEST_ASSERT_MSG_EQ (IotLogHistogram::Index (8), 8u, "First log bucket");
+  NS_TEST_ASSERT_MSG_EQ (IotLogHistogram::Index (15), 15u, "Width 1 up to 15");
+  NS_TEST_ASSERT_MSG_EQ (IotLogHistogram::Index (16), 16u, "Width 2 from 16");
+  NS_TEST_ASSERT_MSG_EQ (IotLogHistogram::Index (17), 16u, "16 and 17 share a bucket");
+  NS_TEST_ASSERT_MSG_EQ (IotLogHistogram::Index (18), 17u, "18 starts the next bucket");
+  NS_TEST_ASSERT_MSG_EQ (IotLogHistogram::BucketUpperBound (16), 17u, "Upper bound of the 16 bucket");
+  NS_TEST_ASSERT_MSG_EQ (IotLogHistogram::Index (1023), IotLogHistogram::Index (960), "Last sub bucket of [512, 1024)");
+  NS_TEST_ASSERT_MSG_EQ (IotLogHistogram::Index (1024), IotLogHistogram::Index (1023) + 1, "Next power of two");
+  NS_TEST_ASSERT_MSG_EQ (IotLogHistogram::BucketUpperBound (IotLogHistogram::Index (1023)), 1023u, "Bound of a power of two minus one");
+  for (uint32_t i = IotLogHistogram::SUB_BUCKETS; i < IotLogHistogram::N_BUCKETS - 1; i++)
+    {
+      uint64_t upper = IotLogHistogram::BucketUpperBound (i);
+      NS_TEST_ASSERT_MSG_EQ (IotLogHistogram::Index (upper), i, "Upper bound inside its bucket");
+      NS_TEST_ASSERT_MSG_EQ (IotLogHistogram::Index (upper + 1), i + 1, "Next value in the next bucket");
+    }
+
+  uint64_t big = (uint64_t) 1 << 40;
+  NS_TEST_ASSERT_MSG_EQ (IotLogHistogram::Index (0xffffffffu), IotLogHistogram::N_BUCKETS - 1, "Largest 32 bit value in the last bucket");
+  NS_TEST_ASSERT_MSG_EQ (IotLogHistogram::Index (big), IotLogHistogram::N_BUCKETS - 1, "Overflow bucket");
+
+  IotLogHistogram h;
+  NS_TEST_ASSERT_MSG_EQ (h.GetQuantile (0.5), 0u, "Empty histogram");
+  for (uint64_t v = 1; v <= 100; v++)
+    {
+      h.Record (v);
+    }
+  NS_TEST_ASSERT_MSG_EQ (h.GetCount (), 100u, "Every value counted");
+  NS_TEST_ASSERT_MSG_EQ (h.GetMax (), 100u, "Max");
+  NS_TEST_ASSERT_MSG_EQ_TOL (h.GetMean (), 50.5, 1e-9, "Mean is exact");
+  NS_TEST_ASSERT_MSG_EQ (h.GetQuantile (0.05), 6u, "Exact below 8");
+  NS_TEST_ASSERT_MSG_EQ (h.GetQuantile (0.5), 51u, "Median is the upper bound of its bucket");
+  NS_TEST_ASSERT_MSG_EQ (h.GetQuantile (1.0), 100u, "Top quantile capped by the max");
+
+  h.Record (big);
+  NS_TEST_ASSERT_MSG_EQ (h.GetQuantile (1.0), big, "Overflow quantile is the max, not the last 32 bit bound");
+  h.Reset ();
+  NS_TEST_ASSERT_MSG_EQ (h.GetCount (), 0u, "Reset");
+}
+
+// A Tier 1 node whose interface goes down stops being the next hop of Tier 2 for the very next packet, and is used again once it is up
+class IotInterfaceDownRerouteTestCase : public TestCase
+{
+public:
+  IotInterfaceDownRerouteTestCase ();
+
+private:
+  virtual void DoRun (void);
+  Ipv4Address NextHopOf (Ptr<Node> node, Ipv4Address dest);
+};
+
+IotInterfaceDownRerouteTestCase::IotInterfaceDownRerouteTestCase ()
+  : TestCase ("IotEnergyOptimalRouting reroutes when an interface goes down")
+{
+}
+
+Ipv4Address
+IotInterfaceDownRerouteTestCase::NextHopOf (Ptr<Node> node, Ipv4Address dest)
+{
+  Ipv4Header header;
+  header.SetDestination (dest);
+  Socket::SocketErrno err;
+  Ptr<Ipv4Route> route = node->GetObject<Ipv4> ()->GetRoutingProtocol ()->RouteOutput (Create<Packet> (10), header, 0, err);
+  return route ? route->GetGateway () : Ipv4Address ();
+}
+
+void
+IotInterfaceDownRerouteTestCase::DoRun (void)
+{
+  Config::SetGlobal ("IotRoutingProfileReport", BooleanValue (false));
+  Ipv4AddressGenerator::Reset ();
+
+  // Node 0 is in Tier 2, nodes 1 and 2 in Tier 1
+  NodeContainer nodes;
+  nodes.Create (3);
+  SimpleNetDeviceHelper simpleNetDeviceHelper;
+  NetDeviceContainer devices = simpleNetDeviceHelper.Install (nodes);
+
+  Ptr<IotEnergyOptimalRouteProcessor> processor = CreateObject<IotEnergyOptimalRouteProcessor> ();
+  processor->SetAttribute ("Verbose", BooleanValue (false));
+  IotEnergyOptimalRoutingHelper routingHelper;
+  routingHelper.Set ("RoutingProcessor", PointerValue (processor));
+  routingHelper.Set ("Verbose", BooleanValue (false));
+  InternetStackHelper internet;
+  internet.SetRoutingHelper (routingHelper);
+  internet.Install (nodes);
+
+  Ipv4AddressHelper address;
+  address.SetBase ("10.1.3.0", "255.255.255.0", "0.0.0.2");
+  Ipv4InterfaceContainer interfaces = address.Assign (devices);
+  processor->AddNodeTierEnergy (2, interfaces.GetAddress (0), 100);
+  processor->AddNodeTierEnergy (1, interfaces.GetAddress (1), 200);
+  processor->AddNodeTierEnergy (1, interfaces.GetAddress (2), 150);
+
+  Ipv4Address sink ("10.1.3.1");
+  NS_TEST_ASSERT_MSG_EQ (NextHopOf (nodes.Get (0), sink), interfaces.GetAddress (1), "Highest energy Tier 1 node is the next hop");
+
+  interfaces.Get (1).first->SetDown (interfaces.Get (1).second);
+  NS_TEST_ASSERT_MSG_EQ (processor->IsNodeAvailable (interfaces.GetAddress (1)), false, "Node is unavailable once its interface is down");
+  NS_TEST_ASSERT_MSG_EQ (NextHopOf (nodes.Get (0), sink), interfaces.GetAddress (2), "The next packet avoids the node that went down");
+  NS_TEST_ASSERT_MSG_EQ (NextHopOf (nodes.Get (1), sink), Ipv4Address (), "No route out of a down interface");
+
+  interfaces.Get (1).first->SetUp (interfaces.Get (1).second);
+  NS_TEST_ASSERT_MSG_EQ (NextHopOf (nodes.Get (0), sink), interfaces.GetAddress (1), "Node is used again once its interface is up");
+
+  Simulator::Destroy ();
+  Config::SetGlobal ("IotRoutingProfileReport", BooleanValue (true));
+}
+
+// With two radios the next hop and the interface are chosen as a pair: a slightly weaker node on the cheap radio beats the best
+// node reachable only over the expensive one, until the link to it gets slow
+class IotMultiRadioSelectionTestCase : public TestCase
+{
+public:
+  IotMultiRadioSelectionTestCase ();
+
+private:
+  virtual void DoRun (void);
+  Ptr<Ipv4Route> RouteOf (Ptr<Node> node, Ipv4Address dest);
+};
+
+IotMultiRadioSelectionTestCase::IotMultiRadioSelectionTestCase ()
+  : TestCase ("IotEnergyOptimalRouting joint next hop and interface selection")
+{
+}
+
+Ptr<Ipv4Route>
+IotMultiRadioSelectionTestCase::RouteOf (Ptr<Node> node, Ipv4Address dest)
+{
+  Ipv4Header header;
+  header.SetDestination (dest);
+  Socket::SocketErrno err;
+  return node->GetObject<Ipv4> ()->GetRoutingProtocol ()->RouteOutput (Create<Packet> (10), header, 0, err);
+}
+
+void
+IotMultiRadioSelectionTestCase::DoRun (void)
+{
+  Config::SetGlobal ("IotRoutingProfileReport", BooleanValue (false));
+  Ipv4AddressGenerator::Reset ();
+
+  // Node 0 is in Tier 2 with a low power radio and Wi-Fi; node 1 (Tier 1, most energy) only has Wi-Fi, node 2 (Tier 1) has both
+  NodeContainer nodes;
+  nodes.Create (3);
+  SimpleNetDeviceHelper simpleNetDeviceHelper;
+  NetDeviceContainer lowPower = simpleNetDeviceHelper.Install (NodeContainer (nodes.Get (0), nodes.Get (2)));
+  NetDeviceContainer wifi = simpleNetDeviceHelper.Install (nodes);
+
+  Ptr<IotEnergyOptimalRouteProcessor> processor = CreateObject<IotEnergyOptimalRouteProcessor> ();
+  processor->SetAttribute ("Verbose", BooleanValue (false));
+  IotEnergyOptimalRoutingHelper routingHelper;
+  routingHelper.Set ("RoutingProcessor", PointerValue (processor));
+  routingHelper.Set ("Verbose", BooleanValue (false));
+  routingHelper.Set ("AirtimeCost", DoubleValue (0.1));
+  InternetStackHelper internet;
+  internet.SetRoutingHelper (routingHelper);
+  internet.Install (nodes);
+
+  Ipv4AddressHelper address;
+  address.SetBase ("10.1.5.0", "255.255.255.0", "0.0.0.2");
+  Ipv4InterfaceContainer lowPowerInterfaces = address.Assign (lowPower);
+  address.SetBase ("10.1.6.0", "255.255.255.0", "0.0.0.2");
+  Ipv4InterfaceContainer wifiInterfaces = address.Assign (wifi);
+  Ipv4Address relay1 = wifiInterfaces.GetAddress (1);
+  Ipv4Address relay2 = lowPowerInterfaces.GetAddress (1);
+  processor->AddNodeTierEnergy (2, lowPowerInterfaces.GetAddress (0), 100);
+  processor->AddNodeTierEnergy (1, relay1, 200);
+  processor->AddNodeTierEnergy (1, relay2, 150);
+
+  // 4e-7 J per bit on the low power radio, 1e-6 on Wi-Fi
+  Ptr<IotEnergyOptimalRouting> routing = nodes.Get (0)->GetObject<IotEnergyOptimalRouting> ();
+  routing->SetInterfaceCost (lowPowerInterfaces.Get (0).second, 1e-9, 250e3);
+  routing->SetInterfaceCost (wifiInterfaces.Get (0).second, 1e-6, 11e6);
+
+  Ipv4Address sink ("10.1.3.1");
+  Ptr<Ipv4Route> route = RouteOf (nodes.Get (0), sink);
+  NS_TEST_ASSERT_MSG_EQ (route->GetGateway (), relay2, "Cheaper pair of the runner-up chosen");
+  NS_TEST_ASSERT_MSG_EQ (route->GetOutputDevice (), lowPower.Get (0), "Over the low power radio");
+
+  // 1e-5 J per bit to node 2 on the low power radio: its Wi-Fi address costs the same as node 1, which is preferred
+  routing->SetLinkThroughput (lowPowerInterfaces.Get (0).second, relay2, 10e3);
+  route = RouteOf (nodes.Get (0), sink);
+  NS_TEST_ASSERT_MSG_EQ (route->GetGateway (), relay1, "Highest energy node on a tie");
+  NS_TEST_ASSERT_MSG_EQ (route->GetOutputDevice (), wifi.Get (0), "Over Wi-Fi");
+
+  processor->SetNodeAvailable (relay1, false);
+  route = RouteOf (nodes.Get (0), sink);
+  NS_TEST_ASSERT_MSG_EQ (route->GetGateway (), wifiInterfaces.GetAddress (2), "Node 2 reached on its Wi-Fi address");
+  NS_TEST_ASSERT_MSG_EQ (route->GetOutputDevice (), wifi.Get (0), "Slow link avoided");
+
+  Simulator::Destroy ();
+  Config::SetGlobal ("IotRoutingProfileReport", BooleanValue (true));
+}
+
+// Packets queued in the TDMA scheduler go out Tier 3 first, one slot per packet in node id order, then Tier 2 after the guard time
+class IotTdmaSchedulerTestCase : public TestCase
+{
+public:
+  IotTdmaSchedulerTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void Enqueue (Ptr<IotTdmaScheduler> scheduler, uint32_t nodeId, uint16_t tier, Ipv4Address nextHop);
+  void Sent (Ptr<Ipv4Route> route, Ptr<const Packet> p, const Ipv4Header &header);
+  std::vector<std::pair<Time, Ipv4Address> > m_sent;
+};
+
+IotTdmaSchedulerTestCase::IotTdmaSchedulerTestCase ()
+  : TestCase ("IotTdmaScheduler tier windows and slots")
+{
+}
+
+void
+IotTdmaSchedulerTestCase::Enqueue (Ptr<IotTdmaScheduler> scheduler, uint32_t nodeId, uint16_t tier, Ipv4Address nextHop)
+{
+  Ptr<Ipv4Route> route = Create<Ipv4Route> ();
+  route->SetGateway (nextHop);
+  scheduler->Enqueue (nodeId, tier, route, Create<Packet> (10), Ipv4Header (), MakeCallback (&IotTdmaSchedulerTestCase::Sent, this));
+}
+
+void
+IotTdmaSchedulerTestCase::Sent (Ptr<Ipv4Route> route, Ptr<const Packet> p, const Ipv4Header &header)
+{
+  m_sent.push_back (std::make_pair (Simulator::Now (), route->GetGateway ()));
+}
+
+void
+IotTdmaSchedulerTestCase::DoRun (void)
+{
+  Ptr<IotTdmaScheduler> scheduler = CreateObject<IotTdmaScheduler> ();
+  scheduler->SetAttribute ("PacketSlot", TimeValue (MilliSeconds (1)));
+  scheduler->SetAttribute ("GuardTime", TimeValue (MicroSeconds (500)));
+  scheduler->SetAttribute ("FramePeriod", TimeValue (Seconds (1)));
+  Enqueue (scheduler, 5, 2, Ipv4Address ("10.1.3.5"));
+  Enqueue (scheduler, 8, 3, Ipv4Address ("10.1.3.8"));
+  Enqueue (scheduler, 7, 3, Ipv4Address ("10.1.3.7"));
+  Enqueue (scheduler, 7, 3, Ipv4Address ("10.1.3.7"));
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (m_sent.size (), 4u, "Every queued packet is sent");
+  NS_TEST_ASSERT_MSG_EQ (m_sent[0].second, Ipv4Address ("10.1.3.7"), "Tier 3 first, lowest node id first");
+  NS_TEST_ASSERT_MSG_EQ (m_sent[1].first, MilliSeconds (1), "One slot per packet");
+  NS_TEST_ASSERT_MSG_EQ (m_sent[2].second, Ipv4Address ("10.1.3.8"), "Next node of the tier after the slots of the previous one");
+  NS_TEST_ASSERT_MSG_EQ (m_sent[2].first, MilliSeconds (2), "Slots are back to back");
+  NS_TEST_ASSERT_MSG_EQ (m_sent[3].second, Ipv4Address ("10.1.3.5"), "Tier 2 window after Tier 3");
+  NS_TEST_ASSERT_MSG_EQ (m_sent[3].first, MicroSeconds (3500), "Tier 2 window starts after the guard time");
+  NS_TEST_ASSERT_MSG_EQ (scheduler->GetFrames (), 1u, "No frame while nothing is queued");
+
+  Simulator::Destroy ();
+}
+
+// With a Scheduler an originated packet goes through RouteOutput, then RouteInput on the loopback: its next hop is chosen only
+// once, so it loads a single gateway and does not count as a next hop change
+class IotSchedulerLoopbackTestCase : public TestCase
+{
+public:
+  IotSchedulerLoopbackTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+IotSchedulerLoopbackTestCase::IotSchedulerLoopbackTestCase ()
+  : TestCase ("IotEnergyOptimalRouting selects once for packets waiting for their slot")
+{
+}
+
+void
+IotSchedulerLoopbackTestCase::DoRun (void)
+{
+  Config::SetGlobal ("IotRoutingProfileReport", BooleanValue (false));
+  Ipv4AddressGenerator::Reset ();
+
+  // A single Tier 1 node, so nothing else reaches its RouteInput
+  NodeContainer nodes;
+  nodes.Create (1);
+  SimpleNetDeviceHelper simpleNetDeviceHelper;
+  NetDeviceContainer devices = simpleNetDeviceHelper.Install (nodes);
+
+  Ptr<IotEnergyOptimalRouteProcessor> processor = CreateObject<IotEnergyOptimalRouteProcessor> ();
+  processor->SetAttribute ("Verbose", BooleanValue (false));
+  IotEnergyOptimalRoutingHelper routingHelper;
+  routingHelper.Set ("RoutingProcessor", PointerValue (processor));
+  routingHelper.Set ("Verbose", BooleanValue (false));
+  routingHelper.Set ("Scheduler", PointerValue (CreateObject<IotTdmaScheduler> ()));
+  InternetStackHelper internet;
+  internet.SetRoutingHelper (routingHelper);
+  internet.Install (nodes);
+
+  Ipv4AddressHelper address;
+  address.SetBase ("10.1.3.0", "255.255.255.0", "0.0.0.2");
+  Ipv4InterfaceContainer interfaces = address.Assign (devices);
+  processor->AddNodeTierEnergy (1, interfaces.GetAddress (0), 100);
+  processor->AddGateway (Ipv4Address ("10.1.3.100"));
+  processor->AddGateway (Ipv4Address ("10.1.3.101"));
+
+  Ptr<Socket> socket = Socket::CreateSocket (nodes.Get (0), UdpSocketFactory::GetTypeId ());
+  socket->SendTo (Create<Packet> (10), 0, InetSocketAddress (Ipv4Address ("10.1.3.1"), 9));
+  Simulator::Stop (Seconds (1));
+  Simulator::Run ();
+
+  Ptr<IotEnergyOptimalRouting> routing = nodes.Get (0)->GetObject<IotEnergyOptimalRouting> ();
+  NS_TEST_ASSERT_MSG_EQ (routing->GetCounters ().routeOutputCalls, 1u, "Packet originated once");
+  NS_TEST_ASSERT_MSG_EQ (routing->GetCounters ().routeInputCalls, 1u, "Loopback pass counted");
+  NS_TEST_ASSERT_MSG_EQ (routing->GetCounters ().nextHopChanges, 0u, "A single selection");
+  // The load of the packet is on one gateway: the other one wins the next selection
+  NS_TEST_ASSERT_MSG_EQ (processor->SelectGateway (interfaces.GetAddress (0)), Ipv4Address ("10.1.3.101"), "One gateway loaded");
+
+  socket->Close ();
+  Simulator::Destroy ();
+  Config::SetGlobal ("IotRoutingProfileReport", BooleanValue (true));
+}
+
+// Every packet is counted once on every node it goes through, the global counters keep the counts of disposed nodes, and the
+// profile report lists the busiest node first
+class IotRoutingCountersTestCase : public TestCase
+{
+public:
+  IotRoutingCountersTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void Send (Ptr<Socket> socket, Address remote);
+  uint64_t GetCounter (Ptr<Node> node, std::string name);
+};
+
+IotRoutingCountersTestCase::IotRoutingCountersTestCase ()
+  : TestCase ("IotEnergyOptimalRouting counters and profile report")
+{
+}
+
+void
+IotRoutingCountersTestCase::Send (Ptr<Socket> socket, Address remote)
+{
+  socket->SendTo (Create<Packet> (10), 0, remote);
+}
+
+uint64_t
+IotRoutingCountersTestCase::GetCounter (Ptr<Node> node, std::string name)
+{
+  UintegerValue value;
+  node->GetObject<IotEnergyOptimalRouting> ()->GetAttribute (name, value);
+  return value.Get ();
+}
+
+void
+IotRoutingCountersTestCase::DoRun (void)
+{
+  Config::SetGlobal ("IotRoutingProfileReport", BooleanValue (false));
+  Ipv4AddressGenerator::Reset ();
+
+  // Node 0 is the sink (10.1.3.1), node 1 is in Tier 2, nodes 2 and 3 are in Tier 1
+  NodeContainer nodes;
+  nodes.Create (4);
+  SimpleNetDeviceHelper simpleNetDeviceHelper;
+  NetDeviceContainer devices = simpleNetDeviceHelper.Install (nodes);
+
+  Ptr<IotEnergyOptimalRouteProcessor> processor = CreateObject<IotEnergyOptimalRouteProcessor> ();
+  processor->SetAttribute ("Verbose", BooleanValue (false));
+  IotEnergyOptimalRoutingHelper routingHelper;
+  routingHelper.Set ("RoutingProcessor", PointerValue (processor));
+  routingHelper.Set ("Verbose", BooleanValue (false));
+  InternetStackHelper internet;
+  internet.SetRoutingHelper (routingHelper);
+  internet.Install (nodes);
+
+  Ipv4AddressHelper address;
+  address.SetBase ("10.1.3.0", "255.255.255.0", "0.0.0.1");
+  Ipv4InterfaceContainer interfaces = address.Assign (devices);
+  processor->AddNodeTierEnergy (2, interfaces.GetAddress (1), 100);
+  // Every hop takes HOP_ENERGY_COST from the forwarding node: the packets of node 1 go to node 2, node 3, then node 2 again
+  processor->AddNodeTierEnergy (1, interfaces.GetAddress (2), 505);
+  processor->AddNodeTierEnergy (1, interfaces.GetAddress (3), 500);
+
+  Ptr<Socket> sink = Socket::CreateSocket (nodes.Get (0), UdpSocketFactory::GetTypeId ());
+  sink->Bind (InetSocketAddress (Ipv4Address::GetAny (), 9));
+  Address remote = InetSocketAddress (interfaces.GetAddress (0), 9);
+  Ptr<Socket> source = Socket::CreateSocket (nodes.Get (1), UdpSocketFactory::GetTypeId ());
+  Ptr<Socket> relay = Socket::CreateSocket (nodes.Get (2), UdpSocketFactory::GetTypeId ());
+  for (uint32_t i = 0; i < 3; i++)
+    {
+      Simulator::Schedule (MilliSeconds (100 * (i + 1)), &IotRoutingCountersTestCase::Send, this, source, remote);
+    }
+  Simulator::Schedule (MilliSeconds (400), &IotRoutingCountersTestCase::Send, this, relay, remote);
+  Simulator::Stop (Seconds (1));
+  Simulator::Run ();
+
+  uint64_t expected[4][4] = {
+    // RouteOutputCalls, RouteInputCalls, LocalDeliveries, NextHopChanges
+    { 0, 4, 4, 0 },
+    { 3, 0, 0, 2 },
+    { 1, 2, 0, 0 },
+    { 0, 1, 0, 0 }
+  };
+  std::string names[4] = { "RouteOutputCalls", "RouteInputCalls", "LocalDeliveries", "NextHopChanges" };
+  uint64_t sum[4] = { 0, 0, 0, 0 };
+  for (uint32_t n = 0; n < nodes.GetN (); n++)
+    {
+      for (uint32_t c = 0; c < 4; c++)
+        {
+          uint64_t value = GetCounter (nodes.Get (n), names[c]);
+          NS_TEST_ASSERT_MSG_EQ (value, expected[n][c], names[c] << " of node " << n);
+          sum[c] += value;
+        }
+    }
+
+  // The counters of a disposed node stay in the global ones
+  nodes.Get (3)->Dispose ();
+  for (uint32_t c = 0; c < 4; c++)
+    {
+      NS_TEST_ASSERT_MSG_EQ (GetCounter (nodes.Get (0), "Global" + names[c]), sum[c], "Global" << names[c] << " after a node is disposed");
+    }
+
+  std::ostringstream report;
+  IotEnergyOptimalRouting::PrintProfileReport (report);
+  std::ostringstream top;
+  top << "[PROFILE]   node=" << nodes.Get (0)->GetId () << " route_output=0 route_input=4 local_deliveries=4 next_hop_changes=0";
+  NS_TEST_ASSERT_MSG_NE (report.str ().find ("[PROFILE] nodes=4 route_output=4 route_input=7"), std::string::npos, "Totals in the report");
+  NS_TEST_ASSERT_MSG_EQ (report.str ().find ("[PROFILE]   node="), report.str ().find (top.str ()), "Sink listed first");
+
+  sink->Close ();
+  source->Close ();
+  relay->Close ();
+  Simulator::Destroy ();
+  Config::SetGlobal ("IotRoutingProfileReport", BooleanValue (true));
+}
+
+// The packets of an aggregate frame come out of Split as they went in, with the routing tag restored; every aggregator on the
+// way decrements their TTL and counts a hop, and drops the ones whose TTL runs out
+class IotPacketAggregatorTestCase : public TestCase
+{
+public:
+  IotPacketAggregatorTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void Flushed (Ipv4Address dest, Ptr<Packet> frame);
+  Ptr<Packet> MakeIpPacket (Ipv4Address dest, uint8_t ttl, uint32_t size);
+  std::vector<Ptr<Packet> > m_frames;
+};
+
+IotPacketAggregatorTestCase::IotPacketAggregatorTestCase ()
+  : TestCase ("IotPacketAggregator frame round trip and TTL")
+{
+}
+
+void
+IotPacketAggregatorTestCase::Flushed (Ipv4Address dest, Ptr<Packet> frame)
+{
+  m_frames.push_back (frame);
+}
+
+Ptr<Packet>
+IotPacketAggregatorTestCase::MakeIpPacket (Ipv4Address dest, uint8_t ttl, uint32_t size)
+{
+  Ptr<Packet> p = Create<Packet> (size);
+  Ipv4Header header;
+  header.SetSource (Ipv4Address ("10.1.3.9"));
+  header.SetDestination (dest);
+  header.SetProtocol (17);
+  header.SetTtl (ttl);
+  header.SetPayloadSize (size);
+  p->AddHeader (header);
+  return p;
+}
+
+void
+IotPacketAggregatorTestCase::DoRun (void)
+{
+  IotAggregateEntryHeader entryHeader;
+  entryHeader.SetLength (120);
+  entryHeader.SetTag (IotEnergyOptimalRoutingTag (MicroSeconds (1500), 3));
+  Ptr<Packet> p = Create<Packet> (4);
+  p->AddHeader (entryHeader);
+  NS_TEST_ASSERT_MSG_EQ (p->GetSize (), 4u + entryHeader.GetSerializedSize (), "Serialized size");
+  IotAggregateEntryHeader read;
+  p->RemoveHeader (read);
+  IotEnergyOptimalRoutingTag tag;
+  NS_TEST_ASSERT_MSG_EQ (read.GetLength (), 120u, "Length read back");
+  NS_TEST_ASSERT_MSG_EQ (read.GetTag (tag), true, "Tag read back");
+  NS_TEST_ASSERT_MSG_EQ (tag.GetOriginTime (), MicroSeconds (1500), "Origin time read back");
+  NS_TEST_ASSERT_MSG_EQ (tag.GetTier (), 3u, "Tier read back");
+  NS_TEST_ASSERT_MSG_EQ ((uint32_t) tag.GetHopCount (), 1u, "Hop count read back");
+  NS_TEST_ASSERT_MSG_EQ (IotAggregateEntryHeader ().GetTag (tag), false, "No tag by default");
+
+  Ipv4Address sink ("10.1.3.1");
+  Ipv4Header header;
+  header.SetDestination (sink);
+  header.SetTtl (64);
+  Ptr<IotPacketAggregator> first = CreateObject<IotPacketAggregator> ();
+  first->SetAttribute ("MaxDelay", TimeValue (Seconds (1)));
+  first->SetFlushCallback (MakeCallback (&IotPacketAggregatorTestCase::Flushed, this));
+  Ptr<Packet> tagged = Create<Packet> (100);
+  tagged->AddPacketTag (IotEnergyOptimalRoutingTag (MicroSeconds (1500), 3));
+  Ipv4Header taggedHeader = header;
+  taggedHeader.SetSource (Ipv4Address ("10.1.3.8"));
+  taggedHeader.SetProtocol (17);
+  taggedHeader.SetPayloadSize (100);
+  first->Add (tagged, taggedHeader);
+  // Carried packets, as unpacked from a frame of an upstream node: the first one is on its last hop
+  Ptr<Packet> upstream = Create<Packet> ();
+  Ptr<Packet> carried[2] = { MakeIpPacket (sink, 2, 50), MakeIpPacket (sink, 10, 60) };
+  for (uint32_t i = 0; i < 2; i++)
+    {
+      IotAggregateEntryHeader carriedHeader;
+      carriedHeader.SetLength (carried[i]->GetSize ());
+      carried[i]->AddHeader (carriedHeader);
+      upstream->AddAtEnd (carried[i]);
+    }
+  first->AddAggregate (upstream, header);
+  first->FlushAll ();
+  NS_TEST_ASSERT_MSG_EQ (m_frames.size (), 1u, "One frame for the destination");
+  NS_TEST_ASSERT_MSG_EQ (first->GetAggregatedPackets (), 3u, "Every packet aggregated");
+
+  std::vector<Ptr<Packet> > packets;
+  IotPacketAggregator::Split (m_frames[0], packets);
+  NS_TEST_ASSERT_MSG_EQ (packets.size (), 3u, "Split gives back every packet");
+  Ipv4Header ipHeader;
+  packets[0]->RemoveHeader (ipHeader);
+  NS_TEST_ASSERT_MSG_EQ (ipHeader.GetSource (), Ipv4Address ("10.1.3.8"), "IP header kept");
+  NS_TEST_ASSERT_MSG_EQ ((uint32_t) ipHeader.GetTtl (), 63u, "TTL decremented on Add");
+  NS_TEST_ASSERT_MSG_EQ (packets[0]->GetSize (), 100u, "Payload kept");
+  NS_TEST_ASSERT_MSG_EQ (packets[0]->PeekPacketTag (tag), true, "Tag restored");
+  NS_TEST_ASSERT_MSG_EQ ((uint32_t) tag.GetHopCount (), 2u, "Hop counted");
+  packets[1]->RemoveHeader (ipHeader);
+  NS_TEST_ASSERT_MSG_EQ ((uint32_t) ipHeader.GetTtl (), 1u, "TTL of a carried packet decremented");
+  NS_TEST_ASSERT_MSG_EQ (packets[1]->GetSize (), 50u, "Carried payload kept");
+  packets[2]->RemoveHeader (ipHeader);
+  NS_TEST_ASSERT_MSG_EQ ((uint32_t) ipHeader.GetTtl (), 9u, "TTL of the other carried packet");
+
+  // The next tier drops the packet whose TTL ran out and carries on the others
+  Ptr<IotPacketAggregator> second = CreateObject<IotPacketAggregator> ();
+  second->SetAttribute ("MaxDelay", TimeValue (Seconds (1)));
+  second->SetFlushCallback (MakeCallback (&IotPacketAggregatorTestCase::Flushed, this));
+  second->AddAggregate (m_frames[0], header);
+  second->FlushAll ();
+  NS_TEST_ASSERT_MSG_EQ (m_frames.size (), 2u, "Frame sent again");
+  packets.clear ();
+  IotPacketAggregator::Split (m_frames[1], packets);
+  NS_TEST_ASSERT_MSG_EQ (packets.size (), 2u, "Expired packet dropped");
+  packets[0]->RemoveHeader (ipHeader);
+  NS_TEST_ASSERT_MSG_EQ ((uint32_t) ipHeader.GetTtl (), 62u, "TTL decremented on every aggregator");
+  NS_TEST_ASSERT_MSG_EQ (packets[0]->PeekPacketTag (tag), true, "Tag kept");
+  NS_TEST_ASSERT_MSG_EQ ((uint32_t) tag.GetHopCount (), 3u, "Hop counted on every aggregator");
+
+  first->Dispose ();
+  second->Dispose ();
+  Simulator::Destroy ();
+}
+
+// The ring buffer keeps the last Capacity packets of every interface and writes them in time order, each with its IPv4 header
+// as it was on the wire, although the stack goes on changing the packets after the traces
+class IotPcapRingBufferTestCase : public TestCase
+{
+public:
+  IotPcapRingBufferTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void Send (Ptr<Socket> socket);
+};
+
+IotPcapRingBufferTestCase::IotPcapRingBufferTestCase ()
+  : TestCase ("IotPcapRingBuffer capture of the last packets")
+{
+}
+
+void
+IotPcapRingBufferTestCase::Send (Ptr<Socket> socket)
+{
+  socket->Send (Create<Packet> (100));
+}
+
+void
+IotPcapRingBufferTestCase::DoRun (void)
+{
+  Ipv4AddressGenerator::Reset ();
+  NodeContainer nodes;
+  nodes.Create (2);
+  SimpleNetDeviceHelper simpleNetDeviceHelper;
+  NetDeviceContainer devices = simpleNetDeviceHelper.Install (nodes);
+  InternetStackHelper internet;
+  internet.Install (nodes);
+  Ipv4AddressHelper address;
+  address.SetBase ("10.1.3.0", "255.255.255.0");
+  Ipv4InterfaceContainer interfaces = address.Assign (devices);
+
+  std::string prefix = CreateTempDirFilename ("iot-ring");
+  Ptr<IotPcapRingBuffer> ring = CreateObject<IotPcapRingBuffer> ();
+  ring->SetAttribute ("Capacity", UintegerValue (4));
+  ring->SetAttribute ("FilePrefix", StringValue (prefix));
+  ring->Install (nodes);
+
+  // Node 0 sends, node 1 receives: one Tx ring and one Rx ring, each pushed 10 packets
+  Ptr<Socket> receiver = Socket::CreateSocket (nodes.Get (1), UdpSocketFactory::GetTypeId ());
+  receiver->Bind (InetSocketAddress (Ipv4Address::GetAny (), 9));
+  Ptr<Socket> sender = Socket::CreateSocket (nodes.Get (0), UdpSocketFactory::GetTypeId ());
+  sender->Connect (InetSocketAddress (interfaces.GetAddress (1), 9));
+  for (uint32_t i = 0; i < 10; i++)
+    {
+      Simulator::Schedule (MilliSeconds (10 * (i + 1)), &IotPcapRingBufferTestCase::Send, this, sender);
+    }
+  Simulator::Run ();
+  NS_TEST_ASSERT_MSG_EQ (ring->Flush ("test"), 8u, "Capacity packets per interface");
+  NS_TEST_ASSERT_MSG_EQ (ring->GetFlushCount (), 1u, "One flush");
+
+  PcapFile file;
+  file.Open (prefix + "-0.pcap", std::ios::in | std::ios::binary);
+  NS_TEST_ASSERT_MSG_EQ (file.Fail (), false, "Capture written");
+  NS_TEST_ASSERT_MSG_EQ (file.GetDataLinkType (), (uint32_t) PcapHelper::DLT_RAW, "Raw IPv4 capture");
+  uint8_t data[2048];
+  uint32_t records = 0;
+  uint64_t last = 0;
+  while (true)
+    {
+      uint32_t tsSec, tsUsec, inclLen, origLen, readLen;
+      file.Read (data, sizeof (data), tsSec, tsUsec, inclLen, origLen, readLen);
+      if (file.Fail ())
+        {
+          break;
+        }
+      uint64_t time = (uint64_t) tsSec * 1000000 + tsUsec;
+      NS_TEST_ASSERT_MSG_EQ (time >= last, true, "Records in time order across interfaces");
+      NS_TEST_ASSERT_MSG_EQ (time >= 70000, true, "Only the last packets kept");
+      last = time;
+      NS_TEST_ASSERT_MSG_EQ (readLen, 128u, "IPv4 and UDP headers and the payload, no link header");
+      NS_TEST_ASSERT_MSG_EQ ((uint32_t) data[0], 0x45u, "Record starts with an IPv4 header");
+      NS_TEST_ASSERT_MSG_EQ ((uint32_t) (data[2] << 8 | data[3]), readLen, "IPv4 total length of the record");
+      NS_TEST_ASSERT_MSG_EQ ((uint32_t) data[9], (uint32_t) UdpL4Protocol::PROT_NUMBER, "UDP packet");
+      records++;
+    }
+  file.Close ();
+  NS_TEST_ASSERT_MSG_EQ (records, 8u, "Every packet of the flush read back");
+
+  Simulator::Destroy ();
+}
+
+// The abstract link channel delivers a frame only in range and not lost, an ARP request only to the owner of the address, charges
+// the sender for every frame and the receivers for the frames delivered, and serializes the frames of a receiver at DataRate
+class IotAbstractLinkChannelTestCase : public TestCase
+{
+public:
+  IotAbstractLinkChannelTestCase ();
+
+private:
+  virtual void DoRun (void);
+  NetDeviceContainer Install (IotAbstractLinkHelper &helper, NodeContainer &nodes);
+  bool Received (Ptr<NetDevice> device, Ptr<const Packet> p, uint16_t protocol, const Address &from);
+  std::map<Ptr<NetDevice>, std::vector<Time> > m_received;
+};
+
+IotAbstractLinkChannelTestCase::IotAbstractLinkChannelTestCase ()
+  : TestCase ("IotAbstractLinkChannel range, loss, ARP, energy and serialization")
+{
+}
+
+bool
+IotAbstractLinkChannelTestCase::Received (Ptr<NetDevice> device, Ptr<const Packet> p, uint16_t protocol, const Address &from)
+{
+  m_received[device].push_back (Simulator::Now ());
+  return true;
+}
+
+/* Three nodes at 0, 10 and 100 meters, with the frames of their devices recorded instead of handed to the node. */
+NetDeviceContainer
+IotAbstractLinkChannelTestCase::Install (IotAbstractLinkHelper &helper, NodeContainer &nodes)
+{
+  nodes.Create (3);
+  Ptr<ListPositionAllocator> positions = CreateObject<ListPositionAllocator> ();
+  positions->Add (Vector (0.0, 0.0, 0.0));
+  positions->Add (Vector (10.0, 0.0, 0.0));
+  positions->Add (Vector (100.0, 0.0, 0.0));
+  MobilityHelper mobility;
+  mobility.SetPositionAllocator (positions);
+  mobility.Install (nodes);
+  helper.SetChannelAttribute ("TxEnergyPerFrame", DoubleValue (1.0));
+  helper.SetChannelAttribute ("TxEnergyPerByte", DoubleValue (0.01));
+  helper.SetChannelAttribute ("RxEnergyPerFrame", DoubleValue (0.5));
+  helper.SetChannelAttribute ("RxEnergyPerByte", DoubleValue (0.001));
+  return helper.Install (nodes);
+}
+
+void
+IotAbstractLinkChannelTestCase::DoRun (void)
+{
+  Ipv4AddressGenerator::Reset ();
+  const uint16_t protocol = 0x88B5;
+
+  // Unit disk of 50 meters: the third node is out of range of the others
+  IotAbstractLinkHelper rangeHelper;
+  rangeHelper.SetUnitDisk (50.0);
+  NodeContainer rangeNodes;
+  NetDeviceContainer range = Install (rangeHelper, rangeNodes);
+  Ptr<IotAbstractLinkChannel> rangeChannel = rangeHelper.GetChannel ();
+
+  // Every frame lost
+  IotAbstractLinkHelper lossHelper;
+  lossHelper.SetFixedLoss (1.0);
+  NodeContainer lossNodes;
+  NetDeviceContainer loss = Install (lossHelper, lossNodes);
+  Ptr<IotAbstractLinkChannel> lossChannel = lossHelper.GetChannel ();
+
+  // Receivers at 80 kbps, 1 ms per frame on top of its bytes: a frame of 100 bytes takes 11 ms
+  IotAbstractLinkHelper rateHelper;
+  rateHelper.SetChannelAttribute ("DataRate", DataRateValue (DataRate ("80kbps")));
+  rateHelper.SetChannelAttribute ("FrameOverhead", TimeValue (MilliSeconds (1)));
+  NodeContainer rateNodes;
+  NetDeviceContainer rate = Install (rateHelper, rateNodes);
+  Ptr<IotAbstractLinkChannel> rateChannel = rateHelper.GetChannel ();
+  InternetStackHelper internet;
+  internet.Install (rateNodes);
+  Ipv4AddressHelper address;
+  address.SetBase ("10.1.5.0", "255.255.255.0");
+  Ipv4InterfaceContainer interfaces = address.Assign (rate);
+
+  NetDeviceContainer all (NetDeviceContainer (range, loss), rate);
+  for (uint32_t i = 0; i < all.GetN (); i++)
+    {
+      all.Get (i)->SetReceiveCallback (MakeCallback (&IotAbstractLinkChannelTestCase::Received, this));
+    }
+
+  range.Get (0)->Send (Create<Packet> (100), range.Get (0)->GetBroadcast (), protocol);
+  range.Get (0)->Send (Create<Packet> (100), range.Get (2)->GetAddress (), protocol);
+  loss.Get (0)->Send (Create<Packet> (100), loss.Get (0)->GetBroadcast (), protocol);
+  loss.Get (0)->Send (Create<Packet> (100), loss.Get (1)->GetAddress (), protocol);
+
+  ArpHeader arp;
+  arp.SetRequest (rate.Get (0)->GetAddress (), interfaces.GetAddress (0), rate.Get (0)->GetBroadcast (), interfaces.GetAddress (2));
+  Ptr<Packet> request = Create<Packet> ();
+  request->AddHeader (arp);
+  uint32_t requestSize = request->GetSize ();
+  rate.Get (0)->Send (request, rate.Get (0)->GetBroadcast (), ArpL3Protocol::PROT_NUMBER);
+  Simulator::Schedule (Seconds (1), &NetDevice::Send, rate.Get (1), Create<Packet> (100), rate.Get (2)->GetAddress (), protocol);
+  Simulator::Schedule (Seconds (1), &NetDevice::Send, rate.Get (1), Create<Packet> (100), rate.Get (2)->GetAddress (), protocol);
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (m_received[range.Get (1)].size (), 1u, "Broadcast delivered in range");
+  NS_TEST_ASSERT_MSG_EQ (m_received[range.Get (2)].size (), 0u, "Broadcast and unicast not delivered out of range");
+  NS_TEST_ASSERT_MSG_EQ (rangeChannel->GetDroppedFrames (), 0u, "Out of range is not a drop");
+  NS_TEST_ASSERT_MSG_EQ_TOL (rangeChannel->GetDeviceEnergyConsumed (range.Get (0)), 2 * (1.0 + 0.01 * 100), 1e-9,
+                             "Sender charged per frame and per byte, in range or not");
+  NS_TEST_ASSERT_MSG_EQ_TOL (rangeChannel->GetDeviceEnergyConsumed (range.Get (1)), 0.5 + 0.001 * 100, 1e-9, "Receiver charged");
+  NS_TEST_ASSERT_MSG_EQ_TOL (rangeChannel->GetDeviceEnergyConsumed (range.Get (2)), 0.0, 1e-9, "Nothing received out of range");
+
+  NS_TEST_ASSERT_MSG_EQ (m_received[loss.Get (1)].size () + m_received[loss.Get (2)].size (), 0u, "Every frame lost");
+  NS_TEST_ASSERT_MSG_EQ (lossChannel->GetDroppedFrames (), 3u, "Broadcast lost for two receivers, unicast for one");
+  NS_TEST_ASSERT_MSG_EQ_TOL (lossChannel->GetDeviceEnergyConsumed (loss.Get (0)), 2 * (1.0 + 0.01 * 100), 1e-9, "Lost frames still sent");
+  NS_TEST_ASSERT_MSG_EQ_TOL (lossChannel->GetTotalEnergyConsumed (), 2 * (1.0 + 0.01 * 100), 1e-9, "No receive energy for lost frames");
+
+  NS_TEST_ASSERT_MSG_EQ (m_received[rate.Get (1)].size (), 0u, "ARP request not given to the other devices");
+  NS_TEST_ASSERT_MSG_EQ (m_received[rate.Get (2)].size (), 3u, "ARP request given to the owner of the address");
+  NS_TEST_ASSERT_MSG_EQ (m_received[rate.Get (2)][2] - m_received[rate.Get (2)][1], MilliSeconds (11),
+                         "Second frame waits for the first at the receiver");
+  NS_TEST_ASSERT_MSG_EQ (m_received[rate.Get (2)][1], Seconds (1) + MicroSeconds (1) + MilliSeconds (11), "First frame after its air time");
+  NS_TEST_ASSERT_MSG_EQ_TOL (rateChannel->GetDeviceEnergyConsumed (rate.Get (0)), 1.0 + 0.01 * requestSize, 1e-9, "ARP request sent once");
+  NS_TEST_ASSERT_MSG_EQ_TOL (rateChannel->GetDeviceEnergyConsumed (rate.Get (1)), 2 * (1.0 + 0.01 * 100), 1e-9, "Only sent");
+  NS_TEST_ASSERT_MSG_EQ_TOL (rateChannel->GetDeviceEnergyConsumed (rate.Get (2)), 0.5 + 0.001 * requestSize + 2 * (0.5 + 0.001 * 100),
+                             1e-9, "Received the request and both frames");
+
+  m_received.clear ();
+  Simulator::Destroy ();
+}
+
+// The relay candidates of a tier follow its ranking, and RelayCandidatesChanged is only fired when they change
+class IotRelayCandidatesTestCase : public TestCase
+{
+public:
+  IotRelayCandidatesTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void Changed (uint16_t tier);
+  uint32_t m_changes;
+};
+
+IotRelayCandidatesTestCase::IotRelayCandidatesTestCase ()
+  : TestCase ("IotEnergyOptimalRouteProcessor relay candidates"),
+    m_changes (0)
+{
+}
+
+void
+IotRelayCandidatesTestCase::Changed (uint16_t tier)
+{
+  m_changes++;
+}
+
+void
+IotRelayCandidatesTestCase::DoRun (void)
+{
+  Ptr<IotEnergyOptimalRouteProcessor> processor = CreateObject<IotEnergyOptimalRouteProcessor> ();
+  processor->SetAttribute ("Verbose", BooleanValue (false));
+  processor->SetAttribute ("RelayCandidates", UintegerValue (2));
+  processor->TraceConnectWithoutContext ("RelayCandidatesChanged", MakeCallback (&IotRelayCandidatesTestCase::Changed, this));
+  Ipv4Address a ("10.1.3.2"), b ("10.1.3.3"), c ("10.1.3.4");
+  processor->AddNodeTierEnergy (1, a, 100);
+  processor->AddNodeTierEnergy (1, b, 95);
+  processor->AddNodeTierEnergy (1, c, 50);
+  NS_TEST_ASSERT_MSG_EQ (m_changes, 2u, "The third node is not a candidate");
+  NS_TEST_ASSERT_MSG_EQ (processor->GetRelayCandidates (1).size (), 2u, "Current and next relay");
+  NS_TEST_ASSERT_MSG_EQ (processor->GetRelayCandidates (1)[0], a, "Highest energy node is the current relay");
+  NS_TEST_ASSERT_MSG_EQ (processor->IsRelayCandidate (c), false, "Low energy node can sleep");
+
+  processor->ReduceNodeEnergyOnTransitHop (a);
+  NS_TEST_ASSERT_MSG_EQ (processor->GetRelayCandidates (1)[0], b, "The next relay takes over");
+  NS_TEST_ASSERT_MSG_EQ (m_changes, 3u, "Role change is published");
+  processor->ReduceNodeEnergyOnTransitHop (c);
+  NS_TEST_ASSERT_MSG_EQ (m_changes, 3u, "No change below the candidates");
+
+  processor->SetNodeAvailable (b, false);
+  NS_TEST_ASSERT_MSG_EQ (processor->IsRelayCandidate (c), true, "A node is woken when a candidate goes away");
+
+  // Every node the selection scores is a candidate, whatever RelayCandidates says
+  Ptr<IotEnergyOptimalRouteProcessor> scoring = CreateObject<IotEnergyOptimalRouteProcessor> ();
+  scoring->SetAttribute ("Verbose", BooleanValue (false));
+  scoring->SetAttribute ("RelayCandidates", UintegerValue (1));
+  scoring->SetAttribute ("SelectionMode", StringValue ("EnergyQueue"));
+  scoring->SetAttribute ("SelectionCandidates", UintegerValue (3));
+  scoring->AddNodeTierEnergy (1, a, 100);
+  scoring->AddNodeTierEnergy (1, b, 95);
+  scoring->AddNodeTierEnergy (1, c, 50);
+  NS_TEST_ASSERT_MSG_EQ (scoring->GetRelayCandidates (1).size (), 3u, "Scored nodes are candidates");
+  scoring->SetNodeQueue (a, 100);
+  scoring->SetNodeQueue (b, 100);
+  NS_TEST_ASSERT_MSG_EQ (scoring->IsRelayCandidate (scoring->SelectNodeInTier (1)), true, "Selected node is awake");
+}
+
+// The duty cycle keeps the relay candidates of the tiers below the highest awake and puts the other radios to sleep;
+// a node entering the candidates is woken at once, a node that sends is woken for SleepDelay
+class IotDutyCycleControllerTestCase : public TestCase
+{
+public:
+  IotDutyCycleControllerTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+IotDutyCycleControllerTestCase::IotDutyCycleControllerTestCase ()
+  : TestCase ("IotDutyCycleController sleeps and wakes the radios")
+{
+}
+
+void
+IotDutyCycleControllerTestCase::DoRun (void)
+{
+  NodeContainer nodes;
+  nodes.Create (4);
+  YansWifiChannelHelper channel = YansWifiChannelHelper::Default ();
+  YansWifiPhyHelper phy = YansWifiPhyHelper::Default ();
+  phy.SetChannel (channel.Create ());
+  WifiHelper wifiHelper;
+  wifiHelper.SetStandard (WIFI_PHY_STANDARD_80211b);
+  WifiMacHelper wifiMacHelper;
+  wifiMacHelper.SetType ("ns3::AdhocWifiMac");
+  NetDeviceContainer devices = wifiHelper.Install (phy, wifiMacHelper, nodes);
+
+  Ptr<IotEnergyOptimalRouteProcessor> processor = CreateObject<IotEnergyOptimalRouteProcessor> ();
+  processor->SetAttribute ("Verbose", BooleanValue (false));
+  processor->SetAttribute ("RelayCandidates", UintegerValue (2));
+  Ipv4Address a ("10.1.3.2"), b ("10.1.3.3"), c ("10.1.3.4"), d ("10.1.3.5");
+  processor->AddNodeTierEnergy (1, a, 100);
+  processor->AddNodeTierEnergy (1, b, 95);
+  processor->AddNodeTierEnergy (1, c, 50);
+  processor->AddNodeTierEnergy (2, d, 100);
+
+  Ptr<IotDutyCycleController> controller = CreateObject<IotDutyCycleController> ();
+  controller->SetAttribute ("RoutingProcessor", PointerValue (processor));
+  controller->SetAttribute ("SleepDelay", TimeValue (MilliSeconds (100)));
+  controller->AddNode (a, devices.Get (0));
+  controller->AddNode (b, devices.Get (1));
+  controller->AddNode (c, devices.Get (2));
+  controller->AddNode (d, devices.Get (3));
+
+  Simulator::Stop (Seconds (1));
+  Simulator::Run ();
+  NS_TEST_ASSERT_MSG_EQ (controller->IsAwake (a), true, "Current relay listens");
+  NS_TEST_ASSERT_MSG_EQ (controller->IsAwake (b), true, "Next relay listens");
+  NS_TEST_ASSERT_MSG_EQ (controller->IsAwake (c), false, "Node outside the candidates sleeps");
+  NS_TEST_ASSERT_MSG_EQ (controller->IsAwake (d), false, "Highest tier has no upstream tier to listen to");
+  NS_TEST_ASSERT_MSG_EQ (controller->GetWakeups (), 0u, "No wakeup yet");
+
+  // RelayCandidatesChanged: the node entering the candidates resumes right away, the one leaving them after SleepDelay
+  processor->SetNodeAvailable (b, false);
+  NS_TEST_ASSERT_MSG_EQ (controller->IsAwake (c), true, "New candidate woken before it becomes the relay");
+  NS_TEST_ASSERT_MSG_EQ (controller->IsAwake (b), true, "Former candidate keeps listening for SleepDelay");
+  NS_TEST_ASSERT_MSG_EQ (controller->GetWakeups (), 1u, "One radio resumed");
+  Simulator::Stop (Seconds (1));
+  Simulator::Run ();
+  NS_TEST_ASSERT_MSG_EQ (controller->IsAwake (b), false, "Former candidate sleeps");
+  NS_TEST_ASSERT_MSG_EQ (controller->IsAwake (c), true, "Candidate stays awake");
+
+  // NotifyTransmit wakes a sleeping sender for SleepDelay only
+  controller->NotifyTransmit (d);
+  NS_TEST_ASSERT_MSG_EQ (controller->IsAwake (d), true, "Sender woken");
+  NS_TEST_ASSERT_MSG_EQ (controller->GetWakeups (), 2u, "Sender counted as a wakeup");
+  Simulator::Stop (MilliSeconds (50));
+  Simulator::Run ();
+  NS_TEST_ASSERT_MSG_EQ (controller->IsAwake (d), true, "Sender still awake within SleepDelay");
+  Simulator::Stop (Seconds (1));
+  Simulator::Run ();
+  NS_TEST_ASSERT_MSG_EQ (controller->IsAwake (d), false, "Sender back to sleep");
+
+  // Downlink receivers are woken like senders
+  controller->NotifyReceive (b);
+  NS_TEST_ASSERT_MSG_EQ (controller->IsAwake (b), true, "Receiver of a unicast packet woken");
+  controller->NotifyTierReceive (2);
+  NS_TEST_ASSERT_MSG_EQ (controller->IsAwake (d), true, "Tier of a multicast packet woken");
+  Simulator::Stop (Seconds (1));
+  Simulator::Run ();
+  NS_TEST_ASSERT_MSG_EQ (controller->IsAwake (b), false, "Receiver back to sleep");
+  NS_TEST_ASSERT_MSG_EQ (controller->IsAwake (d), false, "Tier back to sleep");
+  NS_TEST_ASSERT_MSG_EQ (controller->GetTotalSleepTime () > Seconds (4), true, "Sleep time of c, d and b accumulated");
+
+  controller->Dispose ();
+  Simulator::Destroy ();
+}
+
+// The EnergyQueue mode moves away from a node with a long MAC queue, the Energy mode does not
+class IotQueueAwareSelectionTestCase : public TestCase
+{
+public:
+  IotQueueAwareSelectionTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+IotQueueAwareSelectionTestCase::IotQueueAwareSelectionTestCase ()
+  : TestCase ("IotEnergyOptimalRouteProcessor queue aware selection")
+{
+}
+
+void
+IotQueueAwareSelectionTestCase::DoRun (void)
+{
+  Ptr<IotEnergyOptimalRouteProcessor> processor = CreateObject<IotEnergyOptimalRouteProcessor> ();
+  processor->SetAttribute ("Verbose", BooleanValue (false));
+  Ipv4Address a ("10.1.3.2"), b ("10.1.3.3");
+  processor->AddNodeTierEnergy (1, a, 1000);
+  processor->AddNodeTierEnergy (1, b, 900);
+  processor->SetNodeQueue (a, 5);
+  NS_TEST_ASSERT_MSG_EQ (processor->SelectNodeInTier (1), a, "Energy mode ignores the queue");
+  processor->SetAttribute ("SelectionMode", StringValue ("EnergyQueue"));
+  NS_TEST_ASSERT_MSG_EQ (processor->SelectNodeInTier (1), b, "Idle peer preferred to a loaded node");
+  processor->SetNodeQueue (a, 0);
+  NS_TEST_ASSERT_MSG_EQ (processor->SelectNodeInTier (1), a, "Highest energy node once its queue is empty");
+  NS_TEST_ASSERT_MSG_EQ (processor->SetNodeQueue (Ipv4Address ("10.1.3.9"), 1), false, "No queue for unknown nodes");
+}
+
+// IotLinkMonitor gives the processor the length of the real MAC queue of a node and the delivery probability of its links
+class IotLinkMonitorTestCase : public TestCase
+{
+public:
+  IotLinkMonitorTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+IotLinkMonitorTestCase::IotLinkMonitorTestCase ()
+  : TestCase ("IotLinkMonitor follows the MAC queue and the links")
+{
+}
+
+void
+IotLinkMonitorTestCase::DoRun (void)
+{
+  NodeContainer nodes;
+  nodes.Create (2);
+  YansWifiChannelHelper channel = YansWifiChannelHelper::Default ();
+  YansWifiPhyHelper phy = YansWifiPhyHelper::Default ();
+  phy.SetChannel (channel.Create ());
+  WifiHelper wifiHelper;
+  wifiHelper.SetStandard (WIFI_PHY_STANDARD_80211b);
+  WifiMacHelper wifiMacHelper;
+  wifiMacHelper.SetType ("ns3::AdhocWifiMac");
+  NetDeviceContainer devices = wifiHelper.Install (phy, wifiMacHelper, nodes);
+  // The receiver starts out of range
+  MobilityHelper mobility;
+  Ptr<ListPositionAllocator> positions = CreateObject<ListPositionAllocator> ();
+  positions->Add (Vector (0.0, 0.0, 0.0));
+  positions->Add (Vector (100000.0, 0.0, 0.0));
+  mobility.SetPositionAllocator (positions);
+  mobility.SetMobilityModel ("ns3::ConstantPositionMobilityModel");
+  mobility.Install (nodes);
+
+  Ptr<IotEnergyOptimalRouteProcessor> processor = CreateObject<IotEnergyOptimalRouteProcessor> ();
+  processor->SetAttribute ("Verbose", BooleanValue (false));
+  Ipv4Address a ("10.1.3.2"), b ("10.1.3.3");
+  processor->AddNodeTierEnergy (2, a, 1000);
+  processor->AddNodeTierEnergy (1, b, 1000);
+  Ptr<IotLinkMonitor> monitor = CreateObject<IotLinkMonitor> ();
+  monitor->SetAttribute ("RoutingProcessor", PointerValue (processor));
+  monitor->Install (a, devices.Get (0));
+  monitor->Install (b, devices.Get (1));
+
+  // Broadcast frames are sent once, without acknowledgement: the queue empties on its own
+  for (uint32_t i = 0; i < 5; i++)
+    {
+      devices.Get (0)->Send (Create<Packet> (100), Mac48Address::GetBroadcast (), 0x0800);
+    }
+  NS_TEST_ASSERT_MSG_EQ (monitor->GetQueueLength (a) > 0, true, "Packets wait in the MAC queue");
+  NS_TEST_ASSERT_MSG_EQ (processor->GetNodeQueue (a), monitor->GetQueueLength (a), "Counter follows the MAC queue");
+  Simulator::Stop (Seconds (1));
+  Simulator::Run ();
+  NS_TEST_ASSERT_MSG_EQ (monitor->GetQueueLength (a), 0u, "MAC queue empty");
+  NS_TEST_ASSERT_MSG_EQ (processor->GetNodeQueue (a), 0u, "Counter back to zero");
+
+  // Every retry and the final failure of a unicast frame lower the estimate, delivered frames raise it
+  devices.Get (0)->Send (Create<Packet> (100), devices.Get (1)->GetAddress (), 0x0800);
+  Simulator::Stop (Seconds (1));
+  Simulator::Run ();
+  double lost = processor->GetLinkDelivery (a, b);
+  NS_TEST_ASSERT_MSG_LT (lost, 1.0, "Lost frame lowers the delivery probability");
+  nodes.Get (1)->GetObject<MobilityModel> ()->SetPosition (Vector (5.0, 0.0, 0.0));
+  devices.Get (0)->Send (Create<Packet> (100), devices.Get (1)->GetAddress (), 0x0800);
+  Simulator::Stop (Seconds (1));
+  Simulator::Run ();
+  NS_TEST_ASSERT_MSG_GT (processor->GetLinkDelivery (a, b), lost, "Delivered frame raises it");
+
+  monitor->Dispose ();
+  Simulator::Destroy ();
+}
+
+// SelectGateway follows the link quality measured for a Tier 1 node, the other nodes keep the one of the gateway
+class IotGatewayLinkQualityTestCase : public TestCase
+{
+public:
+  IotGatewayLinkQualityTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+IotGatewayLinkQualityTestCase::IotGatewayLinkQualityTestCase ()
+  : TestCase ("IotEnergyOptimalRouteProcessor gateway link quality")
+{
+}
+
+void
+IotGatewayLinkQualityTestCase::DoRun (void)
+{
+  Ptr<IotEnergyOptimalRouteProcessor> processor = CreateObject<IotEnergyOptimalRouteProcessor> ();
+  processor->SetAttribute ("Verbose", BooleanValue (false));
+  Ipv4Address g1 ("10.1.0.1"), g2 ("10.1.0.2"), a ("10.1.3.2"), b ("10.1.3.3");
+  processor->AddGateway (g1);
+  processor->AddGateway (g2, 0.9);
+  NS_TEST_ASSERT_MSG_EQ_TOL (processor->GetGatewayLinkQuality (a, g2), 0.9, 1e-9, "Quality of the gateway by default");
+  NS_TEST_ASSERT_MSG_EQ_TOL (processor->GetGatewayLinkQuality (a, Ipv4Address ("10.1.0.9")), 0.0, 1e-9, "Unknown gateway");
+
+  processor->SetGatewayLinkQuality (a, g1, 0.2);
+  NS_TEST_ASSERT_MSG_EQ_TOL (processor->GetGatewayLinkQuality (a, g1), 0.2, 1e-9, "Measured quality of the pair");
+  NS_TEST_ASSERT_MSG_EQ (processor->SelectGateway (a), g2, "Lossy link avoided");
+  NS_TEST_ASSERT_MSG_EQ (processor->SelectGateway (b), g1, "Other nodes keep the quality of the gateway");
+}
+
+class IotEtxSelectionTestCase : public TestCase
+{
+public:
+  IotEtxSelectionTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+IotEtxSelectionTestCase::IotEtxSelectionTestCase ()
+  : TestCase ("IotEnergyOptimalRouteProcessor link quality aware selection")
+{
+}
+
+void
+IotEtxSelectionTestCase::DoRun (void)
+{
+  Ptr<IotEnergyOptimalRouteProcessor> processor = CreateObject<IotEnergyOptimalRouteProcessor> ();
+  processor->SetAttribute ("Verbose", BooleanValue (false));
+  processor->SetAttribute ("SelectionMode", StringValue ("EnergyEtx"));
+  Ipv4Address a ("10.1.3.2"), b ("10.1.3.3"), from ("10.1.3.4"), other ("10.1.3.5");
+  processor->AddNodeTierEnergy (1, a, 1000);
+  processor->AddNodeTierEnergy (1, b, 900);
+  processor->AddNodeTierEnergy (2, from, 800);
+  processor->AddNodeTierEnergy (2, other, 800);
+  NS_TEST_ASSERT_MSG_EQ (processor->SelectNodeInTier (1, from), a, "Unknown links count as lossless");
+  processor->SetLinkDelivery (from, a, 0.3);
+  NS_TEST_ASSERT_MSG_EQ_TOL (processor->GetExpectedEnergyPerDeliveredPacket (from, a), 10 / 0.3, 1e-9, "Hop cost over delivery probability");
+  NS_TEST_ASSERT_MSG_EQ (processor->SelectNodeInTier (1, from), b, "Lossy link avoided");
+  NS_TEST_ASSERT_MSG_EQ (processor->SelectNodeInTier (1, other), a, "Links are per sender");
+  processor->SetLinkDelivery (from, a, 0.0);
+  NS_TEST_ASSERT_MSG_EQ_TOL (processor->GetExpectedEnergyPerDeliveredPacket (from, a), 10 / 0.01, 1e-9, "Bounded by MinLinkDelivery");
+}
+
+// Reverse paths are refreshed in place, the oldest one is replaced when the table is full and old ones expire
+class IotReversePathTableTestCase : public TestCase
+{
+public:
+  IotReversePathTableTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+IotReversePathTableTestCase::IotReversePathTableTestCase ()
+  : TestCase ("IotReversePathTable learn, replace and expire")
+{
+}
+
+void
+IotReversePathTableTestCase::DoRun (void)
+{
+  Ptr<IotReversePathTable> table = CreateObject<IotReversePathTable> ();
+  table->SetAttribute ("Capacity", UintegerValue (2));
+  table->SetAttribute ("Lifetime", TimeValue (Seconds (10)));
+  Ipv4Address d1 ("10.1.3.9"), d2 ("10.1.3.3"), d3 ("10.1.3.5"), h1 ("10.1.3.2"), h2 ("10.1.3.4");
+  Simulator::Schedule (Seconds (1), &IotReversePathTable::Learn, table, d1, h1);
+  Simulator::Schedule (Seconds (2), &IotReversePathTable::Learn, table, d2, h1);
+  Simulator::Schedule (Seconds (3), &IotReversePathTable::Learn, table, d1, h2);
+  Simulator::Schedule (Seconds (4), &IotReversePathTable::Learn, table, d3, h1);
+  Simulator::Run ();
+
+  Ipv4Address nextHop;
+  NS_TEST_ASSERT_MSG_EQ (table->GetNEntries (), 2, "Table holds Capacity entries");
+  NS_TEST_ASSERT_MSG_EQ (table->Lookup (d1, nextHop), true, "Refreshed entry kept");
+  NS_TEST_ASSERT_MSG_EQ (nextHop, h2, "Last hop of the latest packet");
+  NS_TEST_ASSERT_MSG_EQ (table->Lookup (d2, nextHop), false, "Oldest entry replaced");
+  NS_TEST_ASSERT_MSG_EQ (table->Lookup (d3, nextHop), true, "New entry inserted");
+  NS_TEST_ASSERT_MSG_EQ (nextHop, h1, "Next hop of the new entry");
+
+  Simulator::Schedule (Seconds (11), &IotReversePathTable::Learn, table, d1, h1);
+  Simulator::Run ();
+  NS_TEST_ASSERT_MSG_EQ (table->Lookup (d3, nextHop), false, "Entry expired after Lifetime");
+  NS_TEST_ASSERT_MSG_EQ (table->Lookup (d1, nextHop), true, "Entry refreshed");
+  Simulator::Destroy ();
+}
+
+// Downlink packets follow the reverse path to their destination until its next hop has no energy left, then go to the node
+// of the next tier chosen by the processor
+class IotDownlinkDepletedRelayTestCase : public TestCase
+{
+public:
+  IotDownlinkDepletedRelayTestCase ();
+
+private:
+  virtual void DoRun (void);
+  Ipv4Address NextHopOf (Ptr<Node> node, Ipv4Address dest);
+};
+
+IotDownlinkDepletedRelayTestCase::IotDownlinkDepletedRelayTestCase ()
+  : TestCase ("IotEnergyOptimalRouting leaves a depleted reverse path")
+{
+}
+
+Ipv4Address
+IotDownlinkDepletedRelayTestCase::NextHopOf (Ptr<Node> node, Ipv4Address dest)
+{
+  Ipv4Header header;
+  header.SetDestination (dest);
+  Socket::SocketErrno err;
+  Ptr<Ipv4Route> route = node->GetObject<Ipv4> ()->GetRoutingProtocol ()->RouteOutput (Create<Packet> (10), header, 0, err);
+  return route ? route->GetGateway () : Ipv4Address ();
+}
+
+void
+IotDownlinkDepletedRelayTestCase::DoRun (void)
+{
+  Config::SetGlobal ("IotRoutingProfileReport", BooleanValue (false));
+  Ipv4AddressGenerator::Reset ();
+
+  // Node 0 is in Tier 1, nodes 1 and 2 in Tier 2; the destination is a Tier 3 node behind them
+  NodeContainer nodes;
+  nodes.Create (3);
+  SimpleNetDeviceHelper simpleNetDeviceHelper;
+  NetDeviceContainer devices = simpleNetDeviceHelper.Install (nodes);
+
+  Ptr<IotEnergyOptimalRouteProcessor> processor = CreateObject<IotEnergyOptimalRouteProcessor> ();
+  processor->SetAttribute ("Verbose", BooleanValue (false));
+  IotEnergyOptimalRoutingHelper routingHelper;
+  routingHelper.Set ("RoutingProcessor", PointerValue (processor));
+  routingHelper.Set ("Verbose", BooleanValue (false));
+  routingHelper.Set ("Downlink", BooleanValue (true));
+  InternetStackHelper internet;
+  internet.SetRoutingHelper (routingHelper);
+  internet.Install (nodes);
+
+  Ipv4AddressHelper address;
+  address.SetBase ("10.1.3.0", "255.255.255.0", "0.0.0.2");
+  Ipv4InterfaceContainer interfaces = address.Assign (devices);
+  Ipv4Address reverse = interfaces.GetAddress (1);
+  Ipv4Address best = interfaces.GetAddress (2);
+  Ipv4Address dest ("10.1.3.50");
+  processor->AddNodeTierEnergy (1, interfaces.GetAddress (0), 100);
+  processor->AddNodeTierEnergy (2, reverse, 2 * IotEnergyOptimalRouteProcessor::HOP_ENERGY_COST);
+  processor->AddNodeTierEnergy (2, best, 100);
+  processor->AddNodeTierEnergy (3, dest, 100);
+
+  Ptr<IotEnergyOptimalRouting> routing = nodes.Get (0)->GetObject<IotEnergyOptimalRouting> ();
+  routing->GetReversePathTable ()->Learn (dest, reverse);
+  NS_TEST_ASSERT_MSG_EQ (NextHopOf (nodes.Get (0), dest), reverse, "Reverse path followed");
+  processor->ReduceNodeEnergyOnTransitHop (reverse);
+  NS_TEST_ASSERT_MSG_EQ (NextHopOf (nodes.Get (0), dest), reverse, "Reverse path kept while its relay has energy");
+  processor->ReduceNodeEnergyOnTransitHop (reverse);
+  NS_TEST_ASSERT_MSG_EQ (processor->GetNodeEnergy (reverse), 0u, "Relay depleted");
+  NS_TEST_ASSERT_MSG_EQ (NextHopOf (nodes.Get (0), dest), best, "Selection of the processor once the relay is depleted");
+  NS_TEST_ASSERT_MSG_EQ (routing->GetCounters ().reversePathMisses, 1u, "Depleted relay counted as a miss");
+
+  Simulator::Destroy ();
+  Config::SetGlobal ("IotRoutingProfileReport", BooleanValue (true));
+}
+
+// The energy pressure of a tier is published at every level crossed, and a path takes the pressure of its most drained tier
+class IotEnergyPressureTestCase : public TestCase
+{
+public:
+  IotEnergyPressureTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void Changed (uint16_t tier, double pressure);
+  uint32_t m_changes;
+  double m_lastPressure;
+};
+
+IotEnergyPressureTestCase::IotEnergyPressureTestCase ()
+  : TestCase ("IotEnergyOptimalRouteProcessor energy pressure"),
+    m_changes (0),
+    m_lastPressure (0.0)
+{
+}
+
+void
+IotEnergyPressureTestCase::Changed (uint16_t tier, double pressure)
+{
+  m_changes++;
+  m_lastPressure = pressure;
+}
+
+void
+IotEnergyPressureTestCase::DoRun (void)
+{
+  Ptr<IotEnergyOptimalRouteProcessor> processor = CreateObject<IotEnergyOptimalRouteProcessor> ();
+  processor->SetAttribute ("Verbose", BooleanValue (false));
+  processor->SetAttribute ("PressureLevels", UintegerValue (4));
+  processor->TraceConnectWithoutContext ("EnergyPressureChanged", MakeCallback (&IotEnergyPressureTestCase::Changed, this));
+  Ipv4Address a ("10.1.3.2"), b ("10.1.3.3"), c ("10.1.3.4"), d ("10.1.3.5");
+  processor->AddNodeTierEnergy (1, a, 20);
+  processor->AddNodeTierEnergy (1, b, 20);
+  processor->AddNodeTierEnergy (2, c, 100);
+  processor->AddNodeTierEnergy (3, d, 100);
+
+  processor->ReduceNodeEnergyOnTransitHop (a);
+  NS_TEST_ASSERT_MSG_EQ (m_changes, 1u, "First level crossed");
+  NS_TEST_ASSERT_MSG_EQ_TOL (m_lastPressure, 0.25, 1e-9, "Spent share of the tier");
+  processor->ReduceNodeEnergyOnTransitHop (c);
+  NS_TEST_ASSERT_MSG_EQ (m_changes, 1u, "No level crossed in tier 2");
+  NS_TEST_ASSERT_MSG_EQ_TOL (processor->GetTierEnergyPressure (2), 0.1, 1e-9, "Pressure between levels");
+  NS_TEST_ASSERT_MSG_EQ_TOL (processor->GetPathEnergyPressure (3), 0.25, 1e-9, "Most drained relay tier");
+  NS_TEST_ASSERT_MSG_EQ_TOL (processor->GetPathEnergyPressure (1), 0.0, 1e-9, "Tier 1 sends to the gateway");
+
+  processor->ReduceNodeEnergyOnTransitHop (a);
+  processor->ReduceNodeEnergyOnTransitHop (b);
+  processor->ReduceNodeEnergyOnTransitHop (b);
+  processor->ReduceNodeEnergyOnTransitHop (b);
+  NS_TEST_ASSERT_MSG_EQ (m_changes, 4u, "Every level crossed once");
+  NS_TEST_ASSERT_MSG_EQ_TOL (m_lastPressure, 1.0, 1e-9, "No energy left in the tier");
+}
+
+// IotAdaptiveSource sends one reading per packet at the rate of Interval without pressure; once the tier relaying its packets
+// has spent half of its energy it takes readings at half the rate and batches them, never beyond one UDP datagram
+class IotAdaptiveSourceTestCase : public TestCase
+{
+public:
+  IotAdaptiveSourceTestCase ();
+
+private:
+  virtual void DoRun (void);
+  static void Sent (IotAdaptiveSourceTestCase *test, uint32_t source, Ptr<const Packet> p);
+  std::vector<std::pair<Time, uint16_t> > m_packets[2];
+  uint32_t m_maxSize;
+};
+
+IotAdaptiveSourceTestCase::IotAdaptiveSourceTestCase ()
+  : TestCase ("IotAdaptiveSource adapts its rate and batches to the energy pressure"),
+    m_maxSize (0)
+{
+}
+
+void
+IotAdaptiveSourceTestCase::Sent (IotAdaptiveSourceTestCase *test, uint32_t source, Ptr<const Packet> p)
+{
+  IotReadingsHeader header;
+  p->PeekHeader (header);
+  test->m_packets[source].push_back (std::make_pair (Simulator::Now (), header.GetReadings ()));
+  test->m_maxSize = std::max (test->m_maxSize, p->GetSize ());
+}
+
+void
+IotAdaptiveSourceTestCase::DoRun (void)
+{
+  Config::SetGlobal ("IotRoutingProfileReport", BooleanValue (false));
+  Ipv4AddressGenerator::Reset ();
+
+  // Both sources are in Tier 2; their packets are relayed by a Tier 1 node that is only known to the processor
+  NodeContainer nodes;
+  nodes.Create (2);
+  SimpleNetDeviceHelper simpleNetDeviceHelper;
+  NetDeviceContainer devices = simpleNetDeviceHelper.Install (nodes);
+
+  Ptr<IotEnergyOptimalRouteProcessor> processor = CreateObject<IotEnergyOptimalRouteProcessor> ();
+  processor->SetAttribute ("Verbose", BooleanValue (false));
+  IotEnergyOptimalRoutingHelper routingHelper;
+  routingHelper.Set ("RoutingProcessor", PointerValue (processor));
+  routingHelper.Set ("Verbose", BooleanValue (false));
+  InternetStackHelper internet;
+  internet.SetRoutingHelper (routingHelper);
+  internet.Install (nodes);
+
+  Ipv4AddressHelper address;
+  address.SetBase ("10.1.3.0", "255.255.255.0", "0.0.0.2");
+  Ipv4InterfaceContainer interfaces = address.Assign (devices);
+  Ipv4Address relay ("10.1.3.50");
+  processor->AddNodeTierEnergy (1, relay, 10 * IotEnergyOptimalRouteProcessor::HOP_ENERGY_COST);
+  processor->AddNodeTierEnergy (2, interfaces.GetAddress (0), 1000000);
+  processor->AddNodeTierEnergy (2, interfaces.GetAddress (1), 1000000);
+
+  // The second source has readings so large that only two fit in a datagram
+  uint32_t readingSizes[2] = { 16, 30000 };
+  for (uint32_t i = 0; i < 2; i++)
+    {
+      Ptr<IotAdaptiveSource> source = CreateObject<IotAdaptiveSource> ();
+      source->SetAttribute ("Remote", AddressValue (InetSocketAddress (Ipv4Address ("10.1.3.1"), 9)));
+      source->SetAttribute ("RoutingProcessor", PointerValue (processor));
+      source->SetAttribute ("ReadingSize", UintegerValue (readingSizes[i]));
+      source->SetAttribute ("HighPriorityEvery", UintegerValue (0));
+      source->SetAttribute ("MinRate", DoubleValue (0.1));
+      source->SetAttribute ("MaxBatch", UintegerValue (5));
+      source->AssignStreams (i);
+      source->TraceConnectWithoutContext ("Tx", MakeBoundCallback (&IotAdaptiveSourceTestCase::Sent, this, i));
+      source->SetStartTime (Seconds (0));
+      source->SetStopTime (Seconds (30));
+      nodes.Get (i)->AddApplication (source);
+    }
+
+  // Half of the energy of the relay tier is spent at 10 s
+  for (uint32_t i = 0; i < 5; i++)
+    {
+      Simulator::Schedule (Seconds (10), &IotEnergyOptimalRouteProcessor::ReduceNodeEnergyOnTransitHop, processor, relay);
+    }
+  Simulator::Stop (Seconds (31));
+  Simulator::Run ();
+
+  Ptr<IotAdaptiveSource> source = DynamicCast<IotAdaptiveSource> (nodes.Get (0)->GetApplication (0));
+  NS_TEST_ASSERT_MSG_EQ_TOL (source->GetPressure (), 0.5, 1e-9, "Path pressure followed");
+  // 10 readings a second apart before the pressure, then 10 two seconds apart, in batches of 3 and the last one sent on stop
+  NS_TEST_ASSERT_MSG_EQ (source->GetReadingsGenerated (), 20u, "Rate halved under pressure");
+  NS_TEST_ASSERT_MSG_EQ (source->GetPacketsSent (), 14u, "10 single readings, 3 batches and the rest");
+  NS_TEST_ASSERT_MSG_EQ (m_packets[0].size (), 14u, "Every packet sent traced");
+  for (uint32_t k = 0; k < m_packets[0].size (); k++)
+    {
+      uint16_t expected = m_packets[0][k].first < Seconds (10) ? 1 : (k + 1 < m_packets[0].size () ? 3 : 1);
+      NS_TEST_ASSERT_MSG_EQ (m_packets[0][k].second, expected, "Readings per packet follow the pressure");
+    }
+  NS_TEST_ASSERT_MSG_EQ (m_packets[1].size (), 15u, "Batches of two large readings");
+  for (uint32_t k = 10; k < m_packets[1].size (); k++)
+    {
+      NS_TEST_ASSERT_MSG_EQ (m_packets[1][k].second, 2, "Batch bounded by the datagram");
+    }
+  NS_TEST_ASSERT_MSG_EQ (m_maxSize <= IotAdaptiveSource::MAX_PAYLOAD, true, "Packets fit in a UDP datagram");
+
+  Simulator::Destroy ();
+  Config::SetGlobal ("IotRoutingProfileReport", BooleanValue (true));
+}
+
+// A snapshot restores the nodes, rankings, aliases, tier energy and link estimates; a file that is not a snapshot changes nothing
+class IotSnapshotTestCase : public TestCase
+{
+public:
+  IotSnapshotTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+IotSnapshotTestCase::IotSnapshotTestCase ()
+  : TestCase ("IotEnergyOptimalRouteProcessor snapshot and restore")
+{
+}
+
+void
+IotSnapshotTestCase::DoRun (void)
+{
+  Ptr<IotEnergyOptimalRouteProcessor> processor = CreateObject<IotEnergyOptimalRouteProcessor> ();
+  processor->SetAttribute ("Verbose", BooleanValue (false));
+  Ipv4Address a ("10.1.3.2"), b ("10.1.3.3"), c ("10.1.3.4"), d ("10.1.3.5"), alias ("10.2.3.4");
+  processor->AddNodeTierEnergy (1, a, 100);
+  processor->AddNodeTierEnergy (1, b, 90);
+  processor->AddNodeTierEnergy (2, c, 80);
+  processor->AddNodeTierEnergy (2, d, 80);
+  processor->AddNodeAddress (c, alias);
+  processor->ReduceNodeEnergyOnTransitHop (a);
+  processor->ReduceNodeEnergyOnTransitHop (a);
+  processor->SetNodeAvailable (d, false);
+  processor->SetLinkDelivery (c, b, 0.5);
+  std::string path = CreateTempDirFilename ("iot-routing.snapshot");
+  NS_TEST_ASSERT_MSG_EQ (processor->SaveSnapshot (path), true, "Snapshot written");
+
+  Ptr<IotEnergyOptimalRouteProcessor> restored = CreateObject<IotEnergyOptimalRouteProcessor> ();
+  restored->SetAttribute ("Verbose", BooleanValue (false));
+  restored->AddNodeTierEnergy (3, Ipv4Address ("10.1.3.9"), 10);
+  NS_TEST_ASSERT_MSG_EQ (restored->LoadSnapshot (path), true, "Snapshot loaded");
+  NS_TEST_ASSERT_MSG_EQ (restored->GetNumberOfNodes (), 4u, "Previous state replaced");
+  NS_TEST_ASSERT_MSG_EQ (restored->GetNodeEnergy (a), 80u, "Energy restored");
+  NS_TEST_ASSERT_MSG_EQ (restored->GetHighestEnergyNodeInTier (1), b, "Ranking restored");
+  NS_TEST_ASSERT_MSG_EQ (restored->IsNodeAvailable (d), false, "Availability restored");
+  NS_TEST_ASSERT_MSG_EQ (restored->GetTierFromIpAddress (alias), 2, "Alias restored");
+  NS_TEST_ASSERT_MSG_EQ (restored->GetTotalEnergyConsumed (), 20u, "Counter restored");
+  NS_TEST_ASSERT_MSG_EQ_TOL (restored->GetTierEnergyPressure (1), 20.0 / 190, 1e-9, "Tier energy restored");
+  NS_TEST_ASSERT_MSG_EQ_TOL (restored->GetExpectedEnergyPerDeliveredPacket (c, b), 20.0, 1e-9, "Link estimate restored");
+  NS_TEST_ASSERT_MSG_EQ (restored->GetRelayCandidates (1).size (), 2u, "Relay candidates derived");
+  // The link monitor writes through the processor, so its updates reach the restored nodes
+  NS_TEST_ASSERT_MSG_EQ (restored->SetNodeQueue (b, 3), true, "Queue of a restored node");
+  NS_TEST_ASSERT_MSG_EQ (restored->GetNodeQueue (b), 3u, "Queue set after the load");
+  restored->SetLinkDelivery (c, b, 0.25);
+  NS_TEST_ASSERT_MSG_EQ_TOL (restored->GetExpectedEnergyPerDeliveredPacket (c, b), 40.0, 1e-9, "Link set after the load");
+
+  std::ofstream garbage (path.c_str (), std::ios::binary | std::ios::trunc);
+  garbage << "not a snapshot of the routing state";
+  garbage.close ();
+  NS_TEST_ASSERT_MSG_EQ (restored->LoadSnapshot (path), false, "Invalid file rejected");
+  NS_TEST_ASSERT_MSG_EQ (restored->GetNodeEnergy (a), 80u, "State unchanged");
+}
+
+// A snapshot loaded later in the run is the state at its own time: harvesting nodes gain what they harvested since. Loading
+// notifies the energy pressure of every tier
+class IotSnapshotTimeTestCase : public TestCase
+{
+public:
+  IotSnapshotTimeTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void Save (void);
+  void Load (void);
+  void Changed (uint16_t tier, double pressure);
+  Ptr<IotEnergyOptimalRouteProcessor> m_processor;
+  std::string m_path;
+  uint32_t m_savedEnergy;
+  std::map<uint16_t, double> m_pressures;
+  Ipv4Address m_a;
+  Ipv4Address m_b;
+};
+
+IotSnapshotTimeTestCase::IotSnapshotTimeTestCase ()
+  : TestCase ("IotEnergyOptimalRouteProcessor snapshot time and pressure"),
+    m_savedEnergy (0),
+    m_a ("10.1.3.2"),
+    m_b ("10.1.3.3")
+{
+}
+
+void
+IotSnapshotTimeTestCase::Changed (uint16_t tier, double pressure)
+{
+  m_pressures[tier] = pressure;
+}
+
+void
+IotSnapshotTimeTestCase::Save (void)
+{
+  m_savedEnergy = m_processor->GetNodeEnergy (m_b);
+  NS_TEST_ASSERT_MSG_EQ (m_processor->SaveSnapshot (m_path), true, "Snapshot written");
+}
+
+void
+IotSnapshotTimeTestCase::Load (void)
+{
+  Ptr<IotEnergyOptimalRouteProcessor> restored = CreateObject<IotEnergyOptimalRouteProcessor> ();
+  restored->SetAttribute ("Verbose", BooleanValue (false));
+  restored->TraceConnectWithoutContext ("EnergyPressureChanged", MakeCallback (&IotSnapshotTimeTestCase::Changed, this));
+  NS_TEST_ASSERT_MSG_EQ (restored->LoadSnapshot (m_path), true, "Snapshot loaded");
+  NS_TEST_ASSERT_MSG_EQ (restored->GetNodeEnergy (m_b) > m_savedEnergy, true, "Harvested since the snapshot");
+  NS_TEST_ASSERT_MSG_EQ (restored->GetNodeEnergy (m_b), m_processor->GetNodeEnergy (m_b), "Same energy as without the snapshot");
+  NS_TEST_ASSERT_MSG_EQ (m_pressures.size (), 2u, "Pressure of every tier notified");
+  NS_TEST_ASSERT_MSG_EQ_TOL (m_pressures[1], 0.0, 1e-9, "Untouched tier");
+  NS_TEST_ASSERT_MSG_EQ_TOL (m_pressures[2], 0.1, 1e-9, "Spent share of the tier");
+}
+
+void
+IotSnapshotTimeTestCase::DoRun (void)
+{
+  m_path = CreateTempDirFilename ("iot-routing-time.snapshot");
+  m_processor = CreateObject<IotEnergyOptimalRouteProcessor> ();
+  m_processor->SetAttribute ("Verbose", BooleanValue (false));
+  m_processor->AddNodeTierEnergy (1, m_a, 500);
+  m_processor->AddNodeTierEnergy (1, m_b, 400);
+  m_processor->AddNodeTierEnergy (2, Ipv4Address ("10.1.3.4"), 100);
+  m_processor->ReduceNodeEnergyOnTransitHop (Ipv4Address ("10.1.3.4"));
+  m_processor->SetNodeHarvestProfile (m_b, m_processor->AddDiurnalHarvestProfile (10.0, Seconds (0), Seconds (100), 1000, Seconds (200)));
+
+  Simulator::Schedule (Seconds (50), &IotSnapshotTimeTestCase::Save, this);
+  Simulator::Schedule (Seconds (60), &IotSnapshotTimeTestCase::Load, this);
+  Simulator::Run ();
+  Simulator::Destroy ();
+  m_processor = 0;
+}
+
+// A Reader of the routing core sees the state published last, and chooses the next hop as the processor does
+class IotRoutingCoreReaderTestCase : public TestCase
+{
+public:
+  IotRoutingCoreReaderTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+IotRoutingCoreReaderTestCase::IotRoutingCoreReaderTestCase ()
+  : TestCase ("IotEnergyOptimalRouteProcessor routing core readers")
+{
+}
+
+void
+IotRoutingCoreReaderTestCase::DoRun (void)
+{
+  Ptr<IotEnergyOptimalRouteProcessor> processor = CreateObject<IotEnergyOptimalRouteProcessor> ();
+  processor->SetAttribute ("Verbose", BooleanValue (false));
+  processor->SetAttribute ("SelectionMode", StringValue ("EnergyEtx"));
+  Ipv4Address a ("10.1.3.2"), b ("10.1.3.3"), from ("10.1.3.4");
+  processor->AddNodeTierEnergy (1, a, 1000);
+  processor->AddNodeTierEnergy (1, b, 900);
+  processor->AddNodeTierEnergy (2, from, 800);
+  iotrouting::RoutingCore &core = processor->GetCore ();
+  iotrouting::RoutingCore::Reader reader (core);
+  NS_TEST_ASSERT_MSG_EQ (reader.SelectNodeInTier (1, from.Get ()), 0u, "Nothing published yet");
+  core.Publish (0);
+  NS_TEST_ASSERT_MSG_EQ (reader.SelectNodeInTier (1, from.Get ()), a.Get (), "Highest energy node");
+  NS_TEST_ASSERT_MSG_EQ (reader.GetTier (from.Get ()), 2, "Tier published");
+
+  std::vector<iotrouting::RoutingCore::Update> updates (1);
+  updates[0].type = iotrouting::RoutingCore::Update::SET_LINK_DELIVERY;
+  updates[0].addr = from.Get ();
+  updates[0].peer = a.Get ();
+  updates[0].estimate = 0.3;
+  processor->ReduceNodeEnergyOnTransitHop (b);
+  NS_TEST_ASSERT_MSG_EQ (reader.GetVersion (), 1u, "Changes are not visible before they are published");
+  core.ApplyUpdates (updates, 0);
+  NS_TEST_ASSERT_MSG_EQ (reader.GetVersion (), 2u, "A batch is published once");
+  NS_TEST_ASSERT_MSG_EQ (reader.SelectNodeInTier (1, from.Get ()), processor->SelectNodeInTier (1, from).Get (), "Same choice as the processor");
+  NS_TEST_ASSERT_MSG_EQ (reader.SelectNodeInTier (1, from.Get ()), b.Get (), "Lossy link avoided");
+}
+
+// A harvesting node gains the energy of its profile as simulation time passes, up to its capacity, without any event
+class IotHarvestingTestCase : public TestCase
+{
+public:
+  IotHarvestingTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void AtNoon (void);
+  void AtNight (void);
+  Ptr<IotEnergyOptimalRouteProcessor> m_processor;
+  Ipv4Address m_a;
+  Ipv4Address m_b;
+};
+
+IotHarvestingTestCase::IotHarvestingTestCase ()
+  : TestCase ("IotEnergyOptimalRouteProcessor energy harvesting"),
+    m_a ("10.1.3.2"),
+    m_b ("10.1.3.3")
+{
+}
+
+void
+IotHarvestingTestCase::AtNoon (void)
+{
+  NS_TEST_ASSERT_MSG_EQ (m_processor->GetNodeEnergy (m_b), 718u, "Half a day of harvest");
+  NS_TEST_ASSERT_MSG_EQ (m_processor->GetNodeEnergy (m_a), 500u, "No harvest without a profile");
+  NS_TEST_ASSERT_MSG_EQ (m_processor->GetRelayCandidates (1)[0], m_a, "No change of the tier yet");
+  NS_TEST_ASSERT_MSG_EQ (m_processor->GetHighestEnergyNodeInTier (1), m_b, "Ranking follows the harvest");
+  NS_TEST_ASSERT_MSG_EQ (m_processor->GetRelayCandidates (1).size (), 1u, "Single relay candidate");
+  NS_TEST_ASSERT_MSG_EQ (m_processor->GetRelayCandidates (1)[0], m_b, "Selected node awake");
+  m_processor->ReduceNodeEnergyOnTransitHop (m_b);
+  NS_TEST_ASSERT_MSG_EQ (m_processor->GetNodeEnergy (m_b), 708u, "Hop taken from the harvested energy");
+  NS_TEST_ASSERT_MSG_EQ (m_processor->GetTotalEnergyHarvested (), 318u, "Harvest counted when the node changes");
+}
+
+void
+IotHarvestingTestCase::AtNight (void)
+{
+  NS_TEST_ASSERT_MSG_EQ (m_processor->GetNodeEnergy (m_b), 1000u, "Capped at the capacity");
+  NS_TEST_ASSERT_MSG_EQ (m_processor->GetHighestEnergyNodeInTier (1), m_b, "Still the highest");
+}
+
+void
+IotHarvestingTestCase::DoRun (void)
+{
+  m_processor = CreateObject<IotEnergyOptimalRouteProcessor> ();
+  m_processor->SetAttribute ("Verbose", BooleanValue (false));
+  m_processor->SetAttribute ("RelayCandidates", UintegerValue (1));
+  m_processor->AddNodeTierEnergy (1, m_a, 500);
+  m_processor->AddNodeTierEnergy (1, m_b, 400);
+  uint32_t profile = m_processor->AddDiurnalHarvestProfile (10.0, Seconds (0), Seconds (100), 1000, Seconds (200));
+  NS_TEST_ASSERT_MSG_EQ (profile, 1u, "Profile added");
+  NS_TEST_ASSERT_MSG_EQ (m_processor->AddDiurnalHarvestProfile (10.0, Seconds (150), Seconds (100), 1000, Seconds (200)), 0u,
+                         "Daylight longer than the period rejected");
+  NS_TEST_ASSERT_MSG_EQ (m_processor->SetNodeHarvestProfile (m_b, profile), true, "Profile set");
+  NS_TEST_ASSERT_MSG_EQ (m_processor->GetHighestEnergyNodeInTier (1), m_a, "Nothing harvested at sunrise");
+
+  Simulator::Schedule (Seconds (50), &IotHarvestingTestCase::AtNoon, this);
+  Simulator::Schedule (Seconds (150), &IotHarvestingTestCase::AtNight, this);
+  Simulator::Run ();
+  Simulator::Destroy ();
+  m_processor = 0;
+}
+
+class IotFastRerouteTestCase : public TestCase
+{
+public:
+  IotFastRerouteTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void AfterHold (void);
+  Ptr<IotEnergyOptimalRouteProcessor> m_processor;
+  Ipv4Address m_from;
+  Ipv4Address m_a;
+  Ipv4Address m_b;
+  Ipv4Address m_c;
+};
+
+IotFastRerouteTestCase::IotFastRerouteTestCase ()
+  : TestCase ("IotEnergyOptimalRouteProcessor backup next hop and failed nodes"),
+    m_from ("10.1.4.1"),
+    m_a ("10.1.3.2"),
+    m_b ("10.1.3.3"),
+    m_c ("10.1.3.4")
+{
+}
+
+void
+IotFastRerouteTestCase::AfterHold (void)
+{
+  NS_TEST_ASSERT_MSG_EQ (m_processor->IsNodeFailed (m_a), false, "Failure cleared after FailureHoldTime");
+  Ipv4Address backup;
+  NS_TEST_ASSERT_MSG_EQ (m_processor->SelectNodeInTier (1, m_from, backup), m_a, "Selected again");
+  NS_TEST_ASSERT_MSG_EQ (backup, m_b, "Backup restored");
+}
+
+void
+IotFastRerouteTestCase::DoRun (void)
+{
+  m_processor = CreateObject<IotEnergyOptimalRouteProcessor> ();
+  m_processor->SetAttribute ("Verbose", BooleanValue (false));
+  m_processor->SetAttribute ("FailureHoldTime", TimeValue (Seconds (10)));
+  m_processor->AddNodeTierEnergy (1, m_a, 500);
+  m_processor->AddNodeTierEnergy (1, m_b, 400);
+  m_processor->AddNodeTierEnergy (1, m_c, 300);
+
+  Ipv4Address backup;
+  NS_TEST_ASSERT_MSG_EQ (m_processor->SelectNodeInTier (1, m_from, backup), m_a, "Highest energy selected");
+  NS_TEST_ASSERT_MSG_EQ (backup, m_b, "Runner-up is the backup");
+
+  m_processor->ReportNodeFailure (m_a);
+  NS_TEST_ASSERT_MSG_EQ (m_processor->IsNodeFailed (m_a), true, "Failure recorded");
+  NS_TEST_ASSERT_MSG_EQ (m_processor->SelectNodeInTier (1, m_from, backup), m_b, "Failed node skipped");
+  NS_TEST_ASSERT_MSG_EQ (backup, m_c, "Backup after the failure");
+  NS_TEST_ASSERT_MSG_EQ (m_processor->GetHighestEnergyNodeInTier (1), m_b, "Failed node out of the ranking");
+  NS_TEST_ASSERT_MSG_EQ (m_processor->GetNodeEnergy (m_a), 500u, "Energy of the failed node kept");
+
+  m_processor->ReportNodeFailure (m_c);
+  NS_TEST_ASSERT_MSG_EQ (m_processor->SelectNodeInTier (1, m_from, backup), m_b, "Last node selected");
+  NS_TEST_ASSERT_MSG_EQ (backup, Ipv4Address (), "No backup left");
+  m_processor->ClearNodeFailure (m_c);
+  NS_TEST_ASSERT_MSG_EQ (m_processor->IsNodeFailed (m_c), false, "Failure cleared");
+
+  Simulator::Schedule (Seconds (11), &IotFastRerouteTestCase::AfterHold, this);
+  Simulator::Run ();
+  Simulator::Destroy ();
+  m_processor = 0;
+}
+
+// A sender whose frame to its next hop is lost switches to its backup at once (FastReroute) and reports the link; once the report
+// is applied the processor skips the node for that sender only, until FailureHoldTime has passed
+class IotFastRerouteRoutingTestCase : public TestCase
+{
+public:
+  IotFastRerouteRoutingTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void AfterReport (void);
+  void AfterHold (void);
+  Ipv4Address NextHopOf (Ptr<Node> node);
+  NodeContainer m_nodes;
+  Ptr<IotEnergyOptimalRouteProcessor> m_processor;
+  Ipv4Address m_sender;
+  Ipv4Address m_other;
+  Ipv4Address m_a;
+  Ipv4Address m_b;
+  Ipv4Address m_c;
+};
+
+IotFastRerouteRoutingTestCase::IotFastRerouteRoutingTestCase ()
+  : TestCase ("IotEnergyOptimalRouting fast reroute on a failed link")
+{
+}
+
+Ipv4Address
+IotFastRerouteRoutingTestCase::NextHopOf (Ptr<Node> node)
+{
+  Ipv4Header header;
+  header.SetDestination (Ipv4Address ("10.1.3.1"));
+  Socket::SocketErrno err;
+  Ptr<Ipv4Route> route = node->GetObject<Ipv4> ()->GetRoutingProtocol ()->RouteOutput (Create<Packet> (10), header, 0, err);
+  return route ? route->GetGateway () : Ipv4Address ();
+}
+
+void
+IotFastRerouteRoutingTestCase::AfterReport (void)
+{
+  NS_TEST_ASSERT_MSG_EQ (m_processor->IsLinkFailed (m_sender, m_a), true, "Link failure reported");
+  NS_TEST_ASSERT_MSG_EQ (m_processor->IsNodeFailed (m_a), false, "Node not failed for the other senders");
+  NS_TEST_ASSERT_MSG_EQ (NextHopOf (m_nodes.Get (0)), m_b, "Processor selection without the failed link");
+  NS_TEST_ASSERT_MSG_EQ (NextHopOf (m_nodes.Get (1)), m_b, "Reported without FastReroute too");
+  NS_TEST_ASSERT_MSG_EQ (NextHopOf (m_nodes.Get (2)), m_a, "Other senders keep the node");
+
+  iotrouting::RoutingCore &core = m_processor->GetCore ();
+  iotrouting::RoutingCore::Reader reader (core);
+  core.Publish (0);
+  uint32_t backup;
+  NS_TEST_ASSERT_MSG_EQ (reader.SelectNodeInTier (1, m_sender.Get (), backup), m_b.Get (), "Failed link skipped by the Readers");
+  NS_TEST_ASSERT_MSG_EQ (backup, m_c.Get (), "Backup past the failed link");
+  NS_TEST_ASSERT_MSG_EQ (reader.SelectNodeInTier (1, m_other.Get (), backup), m_a.Get (), "Readers of other senders keep the node");
+  NS_TEST_ASSERT_MSG_EQ (backup, m_b.Get (), "Backup of the other senders");
+}
+
+void
+IotFastRerouteRoutingTestCase::AfterHold (void)
+{
+  NS_TEST_ASSERT_MSG_EQ (m_processor->IsLinkFailed (m_sender, m_a), false, "Link failure cleared after FailureHoldTime");
+  NS_TEST_ASSERT_MSG_EQ (NextHopOf (m_nodes.Get (0)), m_a, "Node selected again");
+}
+
+void
+IotFastRerouteRoutingTestCase::DoRun (void)
+{
+  Config::SetGlobal ("IotRoutingProfileReport", BooleanValue (false));
+  Ipv4AddressGenerator::Reset ();
+
+  // Nodes 0 to 2 are in Tier 2, nodes 3 to 5 in Tier 1; node 1 runs without FastReroute
+  m_nodes.Create (6);
+  SimpleNetDeviceHelper simpleNetDeviceHelper;
+  NetDeviceContainer devices = simpleNetDeviceHelper.Install (m_nodes);
+
+  m_processor = CreateObject<IotEnergyOptimalRouteProcessor> ();
+  m_processor->SetAttribute ("Verbose", BooleanValue (false));
+  m_processor->SetAttribute ("FailureHoldTime", TimeValue (Seconds (10)));
+  IotEnergyOptimalRoutingHelper routingHelper;
+  routingHelper.Set ("RoutingProcessor", PointerValue (m_processor));
+  routingHelper.Set ("Verbose", BooleanValue (false));
+  routingHelper.Set ("FailureReportDelay", TimeValue (Seconds (1)));
+  InternetStackHelper internet;
+  internet.SetRoutingHelper (routingHelper);
+  internet.Install (m_nodes);
+
+  Ipv4AddressHelper address;
+  address.SetBase ("10.1.3.0", "255.255.255.0", "0.0.0.2");
+  Ipv4InterfaceContainer interfaces = address.Assign (devices);
+  m_sender = interfaces.GetAddress (0);
+  m_other = interfaces.GetAddress (2);
+  m_a = interfaces.GetAddress (3);
+  m_b = interfaces.GetAddress (4);
+  m_c = interfaces.GetAddress (5);
+  for (uint32_t i = 0; i < 3; i++)
+    {
+      m_processor->AddNodeTierEnergy (2, interfaces.GetAddress (i), 100);
+    }
+  m_processor->AddNodeTierEnergy (1, m_a, 500);
+  m_processor->AddNodeTierEnergy (1, m_b, 400);
+  m_processor->AddNodeTierEnergy (1, m_c, 300);
+
+  Ptr<IotEnergyOptimalRouting> routing = m_nodes.Get (0)->GetObject<IotEnergyOptimalRouting> ();
+  Ptr<IotEnergyOptimalRouting> slow = m_nodes.Get (1)->GetObject<IotEnergyOptimalRouting> ();
+  slow->SetAttribute ("FastReroute", BooleanValue (false));
+  NS_TEST_ASSERT_MSG_EQ (NextHopOf (m_nodes.Get (0)), m_a, "Highest energy node selected");
+  NS_TEST_ASSERT_MSG_EQ (NextHopOf (m_nodes.Get (1)), m_a, "Same node without FastReroute");
+
+  routing->NotifyNextHopFailure (m_a);
+  slow->NotifyNextHopFailure (m_a);
+  NS_TEST_ASSERT_MSG_EQ (routing->GetCounters ().fastReroutes, 1u, "One switch to the backup");
+  NS_TEST_ASSERT_MSG_EQ (slow->GetCounters ().fastReroutes, 0u, "No switch without FastReroute");
+  NS_TEST_ASSERT_MSG_EQ (m_processor->IsLinkFailed (m_sender, m_a), false, "Report not applied yet");
+  NS_TEST_ASSERT_MSG_EQ (NextHopOf (m_nodes.Get (0)), m_b, "Backup used from the next packet on");
+  NS_TEST_ASSERT_MSG_EQ (NextHopOf (m_nodes.Get (0)), m_b, "Backup kept while the processor still selects the failed node");
+  NS_TEST_ASSERT_MSG_EQ (NextHopOf (m_nodes.Get (1)), m_a, "Next hop kept until the report without FastReroute");
+
+  Simulator::Schedule (Seconds (2), &IotFastRerouteRoutingTestCase::AfterReport, this);
+  Simulator::Schedule (Seconds (12), &IotFastRerouteRoutingTestCase::AfterHold, this);
+  Simulator::Run ();
+  Simulator::Destroy ();
+  m_processor = 0;
+  m_nodes = NodeContainer ();
+  Config::SetGlobal ("IotRoutingProfileReport", BooleanValue (true));
+}
+
 // The TestSuite class names the TestSuite, identifies what type of TestSuite,
 // and enables the TestCases to be run.  Typically, only the constructor for
 // this class must be defined
@@ -61,6 +1960,32 @@ IotEnergyOptimalRoutingTestSuite::IotEnergyOptimalRoutingTestSuite ()
 {
   // TestDuration for TestCase can be QUICK, EXTENSIVE or TAKES_FOREVER
   AddTestCase (new IotEnergyOptimalRoutingTestCase1, TestCase::QUICK);
+  AddTestCase (new IotLpmForwardingTableTestCase, TestCase::QUICK);
+  AddTestCase (new IotLogHistogramTestCase, TestCase::QUICK);
+  AddTestCase (new IotInterfaceDownRerouteTestCase, TestCase::QUICK);
+  AddTestCase (new IotMultiRadioSelectionTestCase, TestCase::QUICK);
+  AddTestCase (new IotTdmaSchedulerTestCase, TestCase::QUICK);
+  AddTestCase (new IotSchedulerLoopbackTestCase, TestCase::QUICK);
+  AddTestCase (new IotRoutingCountersTestCase, TestCase::QUICK);
+  AddTestCase (new IotPacketAggregatorTestCase, TestCase::QUICK);
+  AddTestCase (new IotPcapRingBufferTestCase, TestCase::QUICK);
+  AddTestCase (new IotAbstractLinkChannelTestCase, TestCase::QUICK);
+  AddTestCase (new IotRelayCandidatesTestCase, TestCase::QUICK);
+  AddTestCase (new IotDutyCycleControllerTestCase, TestCase::QUICK);
+  AddTestCase (new IotQueueAwareSelectionTestCase, TestCase::QUICK);
+  AddTestCase (new IotLinkMonitorTestCase, TestCase::QUICK);
+  AddTestCase (new IotGatewayLinkQualityTestCase, TestCase::QUICK);
+  AddTestCase (new IotEtxSelectionTestCase, TestCase::QUICK);
+  AddTestCase (new IotReversePathTableTestCase, TestCase::QUICK);
+  AddTestCase (new IotDownlinkDepletedRelayTestCase, TestCase::QUICK);
+  AddTestCase (new IotEnergyPressureTestCase, TestCase::QUICK);
+  AddTestCase (new IotAdaptiveSourceTestCase, TestCase::QUICK);
+  AddTestCase (new IotSnapshotTestCase, TestCase::QUICK);
+  AddTestCase (new IotSnapshotTimeTestCase, TestCase::QUICK);
+  AddTestCase (new IotRoutingCoreReaderTestCase, TestCase::QUICK);
+  AddTestCase (new IotHarvestingTestCase, TestCase::QUICK);
+  AddTestCase (new IotFastRerouteTestCase, TestCase::QUICK);
+  AddTestCase (new IotFastRerouteRoutingTestCase, TestCase::QUICK);
 }
 
 // Do not forget to allocate an instance of this TestSuite